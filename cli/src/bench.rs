@@ -0,0 +1,331 @@
+//! bench.rs
+//! `nexus bench`: run every scenario in a benchmark suite at several node
+//! counts and message sizes, and collect what the protocols measured.
+//!
+//! A scenario is an ordinary simulation config. Its `peer` node class is
+//! scaled by copying `peer.0` into `peer.1..N`, and `{size}`/`{duration_ns}`
+//! in runner arguments are replaced with the swept message size and three
+//! quarters of the simulated run time. Protocols report results by printing
+//! `bench,<metric>,<value>` lines, which end up as CSV rows alongside the
+//! host's wall-clock time and each protocol's FUSE operation counters.
+
+use std::borrow::Cow;
+use std::fs::File;
+use std::io::{Write, stdout};
+use std::path::{Path, PathBuf};
+use std::process::Command;
+use std::sync::atomic::Ordering;
+use std::time::Instant;
+
+use anyhow::{Context, Result, bail, ensure};
+use config::ast::{self, TimeUnit};
+use csv::Writer;
+use fuse::stats::Op;
+use runner::ProtocolSummary;
+use runner::cli::{Cli, RunCmd};
+
+use crate::{CONFIG, abort_on_signal, make_sim_dir, run_once, setup_logging};
+
+/// Node class scaled to each requested node count; its first deployment
+/// is the template for the rest.
+const PEER: &str = "peer";
+const FIRST_PEER: &str = "peer.0";
+const SIZE: &str = "{size}";
+const DURATION_NS: &str = "{duration_ns}";
+/// Prefix of the stdout lines protocols report results with.
+const METRIC_PREFIX: &str = "bench,";
+
+#[derive(Debug, serde::Serialize)]
+struct BenchRecord<'a> {
+    scenario: &'a str,
+    nodes: usize,
+    size: Option<usize>,
+    node: &'a str,
+    protocol: &'a str,
+    metric: Cow<'a, str>,
+    value: Cow<'a, str>,
+}
+
+pub fn run(args: Cli) -> Result<()> {
+    let RunCmd::Bench {
+        suite,
+        scenarios,
+        nodes,
+        sizes,
+        output,
+    } = &args.cmd
+    else {
+        unreachable!()
+    };
+    ensure!(
+        !nodes.is_empty() && !nodes.contains(&0),
+        "node counts must be at least 1"
+    );
+    let scenarios = find_scenarios(suite, scenarios.as_deref())?
+        .into_iter()
+        .map(|(name, path)| Ok((name, config::parse(path.clone())?, path)))
+        .collect::<Result<Vec<_>>>()?;
+    let Some((_, first, _)) = scenarios.first() else {
+        bail!("No scenarios found in \"{}\"", suite.display());
+    };
+    build_suite(suite)?;
+
+    let abort = abort_on_signal();
+    let root = make_sim_dir(&first.params.root)?;
+    eprintln!("Benchmark Root: {}", root.to_string_lossy());
+    let _logging = setup_logging(&root, &args, first)?;
+
+    let out: Box<dyn Write> = match output {
+        Some(path) => Box::new(File::create(path)?),
+        None => Box::new(stdout()),
+    };
+    let mut wr = Writer::from_writer(out);
+    'scenarios: for (name, sim, config) in &scenarios {
+        let node_counts: &[usize] = if sim.nodes.contains_key(FIRST_PEER) {
+            nodes
+        } else {
+            &[0]
+        };
+        let sizes: Vec<Option<usize>> = if takes_size(sim) {
+            sizes.iter().copied().map(Some).collect()
+        } else {
+            vec![None]
+        };
+        for &n in node_counts {
+            for &size in &sizes {
+                if abort.load(Ordering::Relaxed) {
+                    break 'scenarios;
+                }
+                let sim = scenario(sim, n, size);
+                let run_root = root.join(run_name(name, n, size));
+                std::fs::create_dir_all(&run_root)?;
+                config::serialize_config(&sim, &run_root.join(CONFIG))?;
+                eprintln!("Running {}", run_name(name, n, size));
+
+                let cmd = RunCmd::Simulate {
+                    config: config.clone(),
+                    checkpoint_at: None,
+                    resume_from: None,
+                    profile: None,
+                    partition: None,
+                    peers: Vec::new(),
+                };
+                let start = Instant::now();
+                let runc = runner::run(&sim)?;
+                let summaries =
+                    run_once(&sim, runc, &run_root, &cmd, args.root.clone(), &abort, None)?;
+                let wall_ns = start.elapsed().as_nanos();
+                let sim_ns = sim
+                    .params
+                    .timestep
+                    .elapsed(sim.params.timestep.count.get(), TimeUnit::Nanoseconds);
+
+                let record = |node, protocol, metric, value| BenchRecord {
+                    scenario: name,
+                    nodes: n,
+                    size,
+                    node,
+                    protocol,
+                    metric,
+                    value,
+                };
+                for (metric, value) in [
+                    ("wall_ns", wall_ns.to_string()),
+                    ("sim_ns", sim_ns.to_string()),
+                ] {
+                    wr.serialize(record("", "", metric.into(), value.into()))?;
+                }
+                for summary in &summaries {
+                    for (metric, value) in metrics(summary) {
+                        wr.serialize(record(&summary.node, &summary.protocol, metric, value))?;
+                    }
+                }
+                wr.flush()?;
+            }
+        }
+    }
+    Ok(())
+}
+
+/// Scenario files to run, as `(name, path)` pairs. With no filter that is
+/// every `.toml` file in `suite`, sorted by name.
+fn find_scenarios(suite: &Path, filter: Option<&[String]>) -> Result<Vec<(String, PathBuf)>> {
+    if let Some(names) = filter {
+        return names
+            .iter()
+            .map(|name| {
+                let path = suite.join(format!("{name}.toml"));
+                ensure!(
+                    path.is_file(),
+                    "No scenario \"{name}\" in \"{}\"",
+                    suite.display()
+                );
+                Ok((name.clone(), path))
+            })
+            .collect();
+    }
+    let mut scenarios = std::fs::read_dir(suite)
+        .with_context(|| format!("Unable to read benchmark suite at \"{}\"", suite.display()))?
+        .filter_map(|e| e.ok())
+        .map(|e| e.path())
+        .filter(|p| p.is_file() && p.extension().is_some_and(|ext| ext == "toml"))
+        .filter_map(|p| Some((p.file_stem()?.to_string_lossy().into_owned(), p)))
+        .collect::<Vec<_>>();
+    scenarios.sort();
+    Ok(scenarios)
+}
+
+/// Build every benchmark protocol with one `make build`, rather than one
+/// build per protocol racing in the same directory.
+fn build_suite(suite: &Path) -> Result<()> {
+    eprintln!("Building benchmarks in {}", suite.display());
+    let status = Command::new("make")
+        .arg("-C")
+        .arg(suite)
+        .arg("build")
+        .stdout(std::io::stderr())
+        .status()
+        .context("Unable to run make")?;
+    ensure!(status.success(), "Building benchmarks failed with {status}");
+    Ok(())
+}
+
+fn run_name(scenario: &str, nodes: usize, size: Option<usize>) -> String {
+    match size {
+        Some(size) => format!("{scenario}-n{nodes}-s{size}"),
+        None => format!("{scenario}-n{nodes}"),
+    }
+}
+
+fn takes_size(sim: &ast::Simulation) -> bool {
+    sim.nodes
+        .values()
+        .flat_map(|node| node.protocols.values())
+        .any(|protocol| protocol.runner.args.iter().any(|arg| arg.contains(SIZE)))
+}
+
+/// `sim` with `nodes` copies of `peer.0` and placeholders substituted. Builds are cleared since `build_suite` already ran.
+fn scenario(sim: &ast::Simulation, nodes: usize, size: Option<usize>) -> ast::Simulation {
+    let mut sim = sim.clone();
+    if let Some(peer) = sim.nodes.get(FIRST_PEER).cloned() {
+        for i in 1..nodes {
+            sim.nodes.insert(format!("{PEER}.{i}"), peer.clone());
+        }
+    }
+    let timestep = &sim.params.timestep;
+    let duration_ns =
+        (timestep.elapsed(timestep.count.get(), TimeUnit::Nanoseconds) / 4 * 3).to_string();
+    let size = size.map(|size| size.to_string());
+    for protocol in sim
+        .nodes
+        .values_mut()
+        .flat_map(|node| node.protocols.values_mut())
+    {
+        protocol.build = ast::Cmd {
+            cmd: String::new(),
+            args: vec![],
+        };
+        for arg in &mut protocol.runner.args {
+            *arg = arg.replace(DURATION_NS, &duration_ns);
+            if let Some(size) = &size {
+                *arg = arg.replace(SIZE, size);
+            }
+        }
+    }
+    sim
+}
+
+/// What `summary`'s protocol reported on stdout, followed by the count,
+/// mean, and p99 latency of every FUSE operation it made.
+fn metrics(summary: &ProtocolSummary) -> Vec<(Cow<'_, str>, Cow<'_, str>)> {
+    let mut metrics = parse_metrics(&summary.output.stdout);
+    for op in Op::ALL {
+        let Some(s) = summary.stats.as_ref().map(|stats| stats.get(op)) else {
+            break;
+        };
+        if s.count == 0 {
+            continue;
+        }
+        for (stat, value) in [
+            ("count", s.count),
+            ("mean_ns", s.mean_ns()),
+            ("p99_ns", s.quantile_ns(0.99)),
+        ] {
+            metrics.push((
+                format!("fuse_{}_{stat}", op.name()).into(),
+                value.to_string().into(),
+            ));
+        }
+    }
+    metrics
+}
+
+fn parse_metrics(stdout: &[u8]) -> Vec<(Cow<'_, str>, Cow<'_, str>)> {
+    stdout
+        .split(|&b| b == b'\n')
+        .filter_map(|line| line.strip_prefix(METRIC_PREFIX.as_bytes()))
+        .filter_map(|line| {
+            let comma = line.iter().position(|&b| b == b',')?;
+            let (metric, value) = (&line[..comma], &line[comma + 1..]);
+            Some((
+                String::from_utf8_lossy(metric),
+                String::from_utf8_lossy(value),
+            ))
+        })
+        .collect()
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn suite() -> PathBuf {
+        Path::new(env!("CARGO_MANIFEST_DIR")).join("../examples/bench")
+    }
+
+    #[test]
+    fn suite_scenarios_scale_and_substitute() {
+        let scenarios = find_scenarios(&suite(), None).unwrap();
+        let names: Vec<_> = scenarios.iter().map(|(name, _)| name.as_str()).collect();
+        assert_eq!(names, ["clock", "fanout", "flood", "pingpong", "sleep"]);
+
+        for (name, path) in scenarios {
+            let sim = config::parse(path).unwrap();
+            assert!(
+                sim.nodes.contains_key(FIRST_PEER),
+                "{name} has no {PEER} node"
+            );
+            let scaled = scenario(&sim, 4, Some(256));
+            assert_eq!(scaled.nodes.len(), sim.nodes.len() + 3);
+            assert!(scaled.nodes.contains_key("peer.3"));
+            for protocol in scaled.nodes.values().flat_map(|n| n.protocols.values()) {
+                assert!(protocol.build.cmd.is_empty());
+                assert!(
+                    protocol.runner.args.iter().all(|arg| !arg.contains('{')),
+                    "{name}: {:?}",
+                    protocol.runner.args
+                );
+            }
+        }
+
+        let sim = config::parse(suite().join("pingpong.toml")).unwrap();
+        assert!(takes_size(&sim));
+        let args = &scenario(&sim, 1, Some(16)).nodes[FIRST_PEER].protocols["ping"]
+            .runner
+            .args;
+        assert_eq!(args, &["ping", "--size=16", "--duration-ns=1500000000"]);
+    }
+
+    #[test]
+    fn metrics_come_from_prefixed_lines() {
+        let stdout = b"hello\nbench,rtt_p50,1200\nbench,rate,3.5\nbench,bad\n";
+        let metrics = parse_metrics(stdout);
+        assert_eq!(
+            metrics,
+            [
+                (Cow::from("rtt_p50"), Cow::from("1200")),
+                (Cow::from("rate"), Cow::from("3.5"))
+            ]
+        );
+    }
+}
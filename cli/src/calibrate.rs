@@ -0,0 +1,311 @@
+//! calibrate.rs
+//! `nexus calibrate`: measure how closely cgroup bandwidth throttling gives
+//! nodes the clock rate they ask for on this host.
+//!
+//! The probe (`examples/count` by default) spins a counter for a second of
+//! wall-clock time and prints it. One unthrottled run gives the count a full
+//! core manages; every throttled run's count, as a fraction of that, times
+//! the frequency of the core it was pinned to is its achieved rate. Runs
+//! cover every combination of requested rate, base `cpu.max` period and
+//! concurrent probe count, and the resulting profile is what
+//! `runner::run` corrects bandwidth with from then on.
+
+use std::collections::HashMap;
+use std::io::{Write, stdout};
+use std::num::NonZeroU64;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+use std::sync::atomic::{AtomicBool, Ordering};
+
+use anyhow::{Context, Result, bail, ensure};
+use config::ast::{self, ClockUnit, Cpu, Mem, Resources, TimeUnit};
+use cpuutils::cpufreq::get_cpu_info;
+use runner::calibration::{Calibration, Point, Sweep, hostname};
+use runner::cli::{Cli, RunCmd};
+use runner::{CPU_PERIOD_MAX, CPU_PERIOD_MIN, RunController};
+
+use crate::{CONFIG, abort_on_signal, make_sim_dir, run_once, setup_logging};
+
+/// Simulated time each probe run lasts. The probe counts for one second of
+/// wall-clock time; the rest covers startup.
+const PROBE_RUN_NS: u64 = 1_500_000_000;
+/// Tells `examples/count` to stay alive once it has printed.
+const HOLD: &str = "--hold";
+const PROBE: &str = "probe";
+
+pub fn run(args: Cli) -> Result<()> {
+    let RunCmd::Calibrate {
+        probe,
+        rates,
+        periods,
+        nodes,
+        tolerance,
+        output,
+    } = &args.cmd
+    else {
+        unreachable!()
+    };
+    ensure!(
+        !rates.is_empty() && !rates.contains(&0),
+        "clock rates must be at least 1 MHz"
+    );
+    ensure!(
+        !nodes.is_empty() && !nodes.contains(&0),
+        "probe counts must be at least 1"
+    );
+    ensure!(
+        !periods.is_empty()
+            && periods
+                .iter()
+                .all(|p| (CPU_PERIOD_MIN..=CPU_PERIOD_MAX).contains(p)),
+        "periods must be between {CPU_PERIOD_MIN} and {CPU_PERIOD_MAX} us"
+    );
+    let path = output
+        .clone()
+        .or_else(Calibration::host_path)
+        .context("Unable to find a home directory to save the calibration profile in")?;
+    let config = probe.join(CONFIG);
+    let template = config::parse(config.clone())?;
+    runner::build(&template)?;
+
+    let abort = abort_on_signal();
+    let root = make_sim_dir(&template.params.root)?;
+    println!("Calibration Root: {}", root.to_string_lossy());
+    let _logging = setup_logging(&root, &args, &template)?;
+    let ctx = Probe {
+        template: &template,
+        root: &root,
+        cmd: RunCmd::Simulate {
+            config,
+            checkpoint_at: None,
+            resume_from: None,
+            profile: None,
+            partition: None,
+            peers: Vec::new(),
+        },
+        fs_root: args.root.clone(),
+        abort: &abort,
+    };
+
+    let baseline = ctx.run("baseline", 1, Resources::default(), CPU_PERIOD_MIN)?;
+    let baseline = baseline
+        .iter()
+        .map(|(_, count, _)| *count)
+        .max()
+        .unwrap_or(0);
+    ensure!(baseline > 0, "Unthrottled probe did not report a count");
+    println!("Unthrottled count: {baseline}");
+
+    let mut sweeps = vec![];
+    for &period_us in periods {
+        let mut points = vec![];
+        for &n in nodes {
+            for &mhz in rates {
+                let resources = Resources {
+                    cpu: Cpu {
+                        cores: None,
+                        hertz: NonZeroU64::new(mhz),
+                        unit: ClockUnit::Megahertz,
+                    },
+                    mem: Mem::default(),
+                };
+                let requested_hz = resources.cpu.requested_cycles().expect("rate is non-zero");
+                let name = format!("p{period_us}-n{n}-r{mhz}");
+                for (_, count, core_hz) in ctx.run(&name, n, resources, period_us)? {
+                    points.push(Point {
+                        nodes: n,
+                        requested_hz,
+                        achieved_hz: count as f64 / baseline as f64 * core_hz as f64,
+                    });
+                }
+            }
+        }
+        sweeps.push(Sweep::new(period_us, points));
+    }
+
+    let calibration = Calibration::from_sweeps(hostname(), sweeps, *tolerance)
+        .context("No throttled probe reported a count")?;
+    report(stdout(), &calibration, nodes)?;
+    calibration.save(&path)?;
+    println!("Saved calibration profile to {}", path.display());
+    Ok(())
+}
+
+struct Probe<'a> {
+    template: &'a ast::Simulation,
+    root: &'a Path,
+    cmd: RunCmd,
+    fs_root: Option<PathBuf>,
+    abort: &'a Arc<AtomicBool>,
+}
+
+impl Probe<'_> {
+    /// Run `nodes` probes at once with `resources` and an uncorrected base
+    /// period of `period_us`. Returns each probe's node, count, and the
+    /// maximum frequency of the core it was pinned to (0 if unpinned).
+    fn run(
+        &self,
+        name: &str,
+        nodes: usize,
+        resources: Resources,
+        period_us: u64,
+    ) -> Result<Vec<(ast::NodeHandle, u64, u64)>> {
+        if self.abort.load(Ordering::Relaxed) {
+            bail!("Calibration interrupted");
+        }
+        println!("Running {name}");
+        let sim = probe_sim(self.template, nodes, resources)?;
+        let root = self.root.join(name);
+        std::fs::create_dir_all(&root)?;
+        let runc = runner::run_calibrated(&sim, Calibration::uncorrected(period_us))?;
+        let core_hz = core_frequencies(&runc);
+        let summaries = run_once(
+            &sim,
+            runc,
+            &root,
+            &self.cmd,
+            self.fs_root.clone(),
+            self.abort,
+            None,
+        )?;
+        Ok(summaries
+            .into_iter()
+            .filter_map(|s| {
+                let count = parse_count(&s.output.stdout)?;
+                let hz = core_hz.get(&s.node).copied().unwrap_or(0);
+                Some((s.node, count, hz))
+            })
+            .collect())
+    }
+}
+
+/// Maximum frequency of the core each throttled node was pinned to, which
+/// is what `Bandwidth` computes its share against.
+fn core_frequencies(runc: &RunController) -> HashMap<ast::NodeHandle, u64> {
+    let cpuinfo = get_cpu_info(&runc.affinity.cpuset);
+    runc.affinity
+        .assignments
+        .iter()
+        .filter_map(|(node, (core, _))| {
+            Some((node.clone(), cpuinfo.cores.get(core)?.max_frequency()))
+        })
+        .collect()
+}
+
+/// `nodes` copies of the template's first node, with `resources`, its
+/// runner told to hold, and the run long enough for the probe to finish.
+fn probe_sim(
+    template: &ast::Simulation,
+    nodes: usize,
+    resources: Resources,
+) -> Result<ast::Simulation> {
+    let mut sim = template.clone();
+    let mut names: Vec<_> = sim.nodes.keys().cloned().collect();
+    names.sort();
+    let Some(mut node) = names.first().and_then(|name| sim.nodes.remove(name)) else {
+        bail!("Probe config has no nodes");
+    };
+    node.resources = resources;
+    for protocol in node.protocols.values_mut() {
+        protocol.build = ast::Cmd {
+            cmd: String::new(),
+            args: vec![],
+        };
+        protocol.runner.args.push(HOLD.to_string());
+    }
+    sim.nodes = (0..nodes)
+        .map(|i| (format!("{PROBE}.{i}"), node.clone()))
+        .collect();
+
+    let timestep = &mut sim.params.timestep;
+    let step_ns = timestep.length.get() * timestep.elapsed(1, TimeUnit::Nanoseconds).max(1);
+    timestep.count = NonZeroU64::new(PROBE_RUN_NS.div_ceil(step_ns)).expect("run is non-zero");
+    Ok(sim)
+}
+
+fn parse_count(stdout: &[u8]) -> Option<u64> {
+    std::str::from_utf8(stdout).ok()?.trim().parse().ok()
+}
+
+/// The per-period fit, the uncorrected error at each probe count, and the
+/// period the profile settled on.
+fn report(mut w: impl Write, calibration: &Calibration, nodes: &[usize]) -> std::io::Result<()> {
+    writeln!(
+        w,
+        "{:>10} {:>10} {:>10} {:>10} {:>10}  {}",
+        "period_us", "scale", "exponent", "residual", "raw_error", "raw_error by nodes"
+    )?;
+    for sweep in &calibration.sweeps {
+        let by_nodes = nodes
+            .iter()
+            .map(|&n| {
+                let errors: Vec<f64> = sweep
+                    .points
+                    .iter()
+                    .filter(|p| p.nodes == n)
+                    .map(|p| p.error().abs())
+                    .collect();
+                let mean = errors.iter().sum::<f64>() / errors.len().max(1) as f64;
+                format!("{n}:{:.1}%", mean * 100.0)
+            })
+            .collect::<Vec<_>>()
+            .join(" ");
+        writeln!(
+            w,
+            "{:>10} {:>10.4} {:>10.4} {:>9.1}% {:>9.1}%  {by_nodes}{}",
+            sweep.period_us,
+            sweep.fit.scale,
+            sweep.fit.exponent,
+            sweep.residual * 100.0,
+            sweep.raw_error * 100.0,
+            if sweep.accurate(calibration.tolerance) {
+                ""
+            } else {
+                "  (inaccurate)"
+            }
+        )?;
+    }
+    let chosen = calibration
+        .sweeps
+        .iter()
+        .find(|s| s.period_us == calibration.period_us);
+    if chosen.is_some_and(|s| s.accurate(calibration.tolerance)) {
+        writeln!(w, "Shortest accurate period: {} us", calibration.period_us)
+    } else {
+        writeln!(
+            w,
+            "No period stayed within {:.1}%; using the most accurate, {} us",
+            calibration.tolerance * 100.0,
+            calibration.period_us
+        )
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn probe_sim_replicates_and_holds() {
+        let config = Path::new(env!("CARGO_MANIFEST_DIR")).join("../examples/count/nexus.toml");
+        let template = config::parse(config).unwrap();
+        let sim = probe_sim(&template, 3, Resources::default()).unwrap();
+        let mut names: Vec<_> = sim.nodes.keys().cloned().collect();
+        names.sort();
+        assert_eq!(names, ["probe.0", "probe.1", "probe.2"]);
+        let node = &sim.nodes["probe.1"];
+        assert!(!node.resources.has_cpu_limit());
+        let protocol = &node.protocols["main"];
+        assert!(protocol.build.cmd.is_empty());
+        assert_eq!(protocol.runner.args.last().map(String::as_str), Some(HOLD));
+        assert_eq!(sim.params.timestep.count.get(), 1500);
+    }
+
+    #[test]
+    fn counts_parse_from_probe_output() {
+        assert_eq!(parse_count(b"123456"), Some(123456));
+        assert_eq!(parse_count(b" 42\n"), Some(42));
+        assert_eq!(parse_count(b""), None);
+        assert_eq!(parse_count(b"oops"), None);
+    }
+}
@@ -1,19 +1,20 @@
 use chrono::{DateTime, Utc};
 use fuse::channel::{ChannelMode, NexusChannel};
 use fuse::ctrl_files::control_files;
-use kernel::{self, KernelBuilder, sources::Source};
+use kernel::{self, Checkpoint, KernelBuilder, Partition, sources::Source};
 use runner::cli::OutputDestination;
-use runner::{ProtocolHandle, ProtocolSummary};
+use runner::{ProtocolHandle, ProtocolSummary, RunController};
 use std::collections::HashSet;
 use std::fs::OpenOptions;
-use std::io::stdout;
+use std::io::{stderr, stdout};
+use std::num::NonZeroU64;
 use std::path::Path;
 use std::sync::Arc;
 use std::sync::atomic::{AtomicBool, Ordering};
 use std::time::SystemTime;
 use tracing_subscriber::{EnvFilter, filter, fmt, prelude::*};
 
-use anyhow::Result;
+use anyhow::{Context, Result, bail, ensure};
 use clap::Parser;
 use config::ast::{self, ChannelType};
 use fuse::{PID, fs::*};
@@ -23,7 +24,10 @@ use std::path::PathBuf;
 
 use crate::output::to_csv;
 
+mod bench;
+mod calibrate;
 mod output;
+mod sweep;
 
 const CONFIG: &str = "nexus.toml";
 
@@ -32,7 +36,12 @@ fn main() -> Result<()> {
     match &args.cmd {
         RunCmd::Simulate { .. } => simulate(args),
         RunCmd::Replay { .. } => replay(args),
+        RunCmd::Fuzz { .. } => fuzz(args),
         RunCmd::Logs { .. } => print_logs(args),
+        RunCmd::Sweep { .. } => sweep::run(args),
+        RunCmd::SweepRun { .. } => sweep::run_point(args),
+        RunCmd::Bench { .. } => bench::run(args),
+        RunCmd::Calibrate { .. } => calibrate::run(args),
         RunCmd::Modules { action } => handle_modules(action),
         RunCmd::Parse {
             trace,
@@ -55,15 +64,29 @@ fn main() -> Result<()> {
             adapter.clone(),
             *header_only,
         ),
-        _ => todo!(),
+        RunCmd::Profile {
+            trace,
+            nodes,
+            protocols,
+            from,
+            to,
+            output,
+        } => trace::profile::run_profile(
+            trace,
+            nodes.clone(),
+            protocols.clone(),
+            *from,
+            *to,
+            output.as_deref(),
+        ),
     }
 }
 
 fn simulate(args: Cli) -> Result<()> {
-    let RunCmd::Simulate { ref config } = args.cmd else {
+    let RunCmd::Simulate { ref config, .. } = args.cmd else {
         unreachable!()
     };
-    let sim = config::parse(config.clone())?;
+    let sim = config::parse_cached(config.clone(), config::cache_dir().as_deref())?;
     let root = make_sim_dir(&sim.params.root)?;
     config::serialize_config(&sim, &root.join(CONFIG))?;
     run(args, sim, root)
@@ -177,64 +200,34 @@ fn list_modules(dir: &Path, category: Option<&str>, prefix: &str) -> Result<()>
 }
 
 fn run(args: Cli, sim: ast::Simulation, root: PathBuf) -> Result<()> {
-    let abort = Arc::new(AtomicBool::new(false));
-    {
-        let abort = abort.clone();
-        ctrlc::set_handler(move || abort.store(true, Ordering::Relaxed))
-            .expect("Error setting signal termination handler");
-    }
-
+    let abort = abort_on_signal();
     println!("Simulation Root: {}", root.to_string_lossy());
     #[allow(unused_variables)]
-    let (trace_path, _trace_handle) = setup_logging(root.as_path(), &args.cmd, &sim)?;
-    runner::build(&sim)?;
+    let (trace_path, _trace_handle) = setup_logging(root.as_path(), &args, &sim)?;
+    let partition = match &args.cmd {
+        RunCmd::Simulate {
+            partition: Some(index),
+            peers,
+            ..
+        } => Some(Partition::new(*index, peers.clone())?),
+        _ => None,
+    };
+    // Only this partition's protocols are built and run here.
+    let local = partition.as_ref().map(|p| p.localize(&sim));
+    let local = local.as_ref().unwrap_or(&sim);
+    runner::build(local)?;
     let mut summaries: Vec<ProtocolSummary> = vec![];
     for _ in 0..args.n.unwrap_or(1) {
-        let mut runc = runner::run(&sim)?;
-        // Spawn reader threads to ensure protocol stdout/stderr gets written
-        // to file
-        let reader_threads =
-            runner::output::spawn_output_readers(&mut runc.handles, &root, |_, _, _, _| {});
-        let protocol_channels = make_fs_channels(&sim, &runc.handles, &args.cmd)?;
-        let (remap_tx, remap_rx) = std::sync::mpsc::channel();
-        let (router_input_tx, router_input_rx) =
-            crossbeam_channel::unbounded::<kernel::RouterInput>();
-        let pids: Vec<u32> = runc.handles.iter().filter_map(|h| h.pid()).collect();
-        let fs = NexusFs::<kernel::RouterInput>::new(
-            args.root.clone(),
-            remap_rx,
-            router_input_tx.clone(),
-        );
-
-        #[allow(unused_variables)]
-        let sess = fs
-            .add_processes(&pids)
-            .add_channels(protocol_channels)?
-            .mount()
-            .expect("unable to mount file system");
-
-        // Need to join fs thread so the other processes don't get stuck
-        // in an uninterruptible sleep state.
-        let file_handles = make_file_handles(&sim, &runc.handles);
-        let protocol_handles = KernelBuilder::new(
-            sim.clone(),
+        let runc = runner::run(local)?;
+        summaries.extend(run_once(
+            &sim,
             runc,
-            file_handles,
-            router_input_tx,
-            router_input_rx,
-            remap_tx,
-        )
-        .abort_flag(abort.clone())
-        .build()?
-        .run(args.cmd.clone())?;
-        // finish() kills the children; once their pipes close the reader
-        // threads see EOF. Join only after kill so we don't deadlock.
-        let mut run_summaries = get_output(protocol_handles);
-        for thread in reader_threads {
-            let _ = thread.join();
-        }
-        runner::output::collect_captured_output(&root, &mut run_summaries);
-        summaries.extend(run_summaries);
+            &root,
+            &args.cmd,
+            args.root.clone(),
+            &abort,
+            partition.as_ref(),
+        )?);
     }
     match args.dest {
         OutputDestination::Stdout => {
@@ -246,12 +239,141 @@ fn run(args: Cli, sim: ast::Simulation, root: PathBuf) -> Result<()> {
             to_csv(f, &summaries);
         }
     }
+    // stderr, so a CSV on stdout stays machine-readable.
+    runner::output::write_stats_summary(stderr(), &summaries)?;
     Ok(())
 }
 
-#[allow(dead_code)]
-fn fuzz(_args: Cli) -> Result<()> {
-    todo!()
+/// Flag set when the process receives SIGINT/SIGTERM, so the kernel can
+/// stop the current simulation cleanly. Can only be installed once.
+fn abort_on_signal() -> Arc<AtomicBool> {
+    let abort = Arc::new(AtomicBool::new(false));
+    {
+        let abort = abort.clone();
+        ctrlc::set_handler(move || abort.store(true, Ordering::Relaxed))
+            .expect("Error setting signal termination handler");
+    }
+    abort
+}
+
+/// Run the protocols `runc` just started for `sim` through one simulation,
+/// with their output captured under `root`, and summarise how each one
+/// ended. With `partition`, `runc` holds only that partition's protocols and
+/// the rest of `sim` runs on other hosts.
+fn run_once(
+    sim: &ast::Simulation,
+    mut runc: RunController,
+    root: &Path,
+    cmd: &RunCmd,
+    fs_root: Option<PathBuf>,
+    abort: &Arc<AtomicBool>,
+    partition: Option<&Partition>,
+) -> Result<Vec<ProtocolSummary>> {
+    // Spawn reader threads to ensure protocol stdout/stderr gets written
+    // to file
+    let reader_threads =
+        runner::output::spawn_output_readers(&mut runc.handles, root, |_, _, _, _| {});
+    let protocol_channels = make_fs_channels(sim, &runc.handles, cmd)?;
+    let (remap_tx, remap_rx) = std::sync::mpsc::channel();
+    let (router_input_tx, router_input_rx) = crossbeam_channel::unbounded::<kernel::RouterInput>();
+    let pids: Vec<u32> = runc.handles.iter().filter_map(|h| h.pid()).collect();
+    let fs = NexusFs::<kernel::RouterInput>::new(fs_root, remap_rx, router_input_tx.clone())
+        .workers(sim.params.fuse_workers);
+    let stats = fs.stats();
+
+    #[allow(unused_variables)]
+    let sess = fs
+        .add_processes(&pids)
+        .add_channels(protocol_channels)?
+        .mount()
+        .expect("unable to mount file system");
+
+    // Need to join fs thread so the other processes don't get stuck
+    // in an uninterruptible sleep state.
+    let file_handles = make_file_handles(sim, &runc.handles);
+    let mut kernel = KernelBuilder::new(
+        sim.clone(),
+        runc,
+        file_handles,
+        router_input_tx,
+        router_input_rx,
+        remap_tx,
+    )
+    .abort_flag(abort.clone())
+    .stats(stats.clone());
+    if let Some(partition) = partition {
+        kernel = kernel.partition(partition.clone());
+    }
+    if let RunCmd::Fuzz { channel, input, .. } = cmd {
+        let input = input
+            .as_ref()
+            .map(|path| {
+                std::fs::read(path)
+                    .with_context(|| format!("Cannot read fuzz input \"{}\"", path.display()))
+            })
+            .transpose()?;
+        kernel = kernel.fuzz(channel.clone(), input);
+    }
+    if let RunCmd::Simulate {
+        checkpoint_at,
+        resume_from,
+        profile,
+        ..
+    } = cmd
+    {
+        if let Some(hz) = *profile {
+            kernel = kernel.profile(hz);
+        }
+        if let Some(timestep) = *checkpoint_at {
+            kernel = kernel.checkpoint_at(timestep, root.join(kernel::checkpoint::CHECKPOINT_FILE));
+        }
+        if let Some(path) = resume_from {
+            kernel = kernel.resume_from(Checkpoint::load(path)?);
+        }
+    }
+    let protocol_handles = kernel.build()?.run(cmd.clone())?;
+    // finish() kills the children; once their pipes close the reader
+    // threads see EOF. Join only after kill so we don't deadlock.
+    let mut summaries = get_output(protocol_handles);
+    for thread in reader_threads {
+        let _ = thread.join();
+    }
+    runner::output::collect_captured_output(root, &mut summaries);
+    runner::output::collect_stats(&stats, &mut summaries);
+    Ok(summaries)
+}
+
+/// Run only the fuzzed node, for as long as the fuzzer linked into it keeps
+/// going, or for the configured timesteps when reproducing a saved input.
+fn fuzz(args: Cli) -> Result<()> {
+    let RunCmd::Fuzz {
+        ref config,
+        ref node,
+        ref channel,
+        ref input,
+    } = args.cmd
+    else {
+        unreachable!()
+    };
+    let mut sim = config::parse_cached(config.clone(), config::cache_dir().as_deref())?;
+    let Some(target) = sim.nodes.get(node) else {
+        bail!("No node \"{node}\" to fuzz; deployments are named like \"{node}.0\"");
+    };
+    ensure!(
+        target
+            .protocols
+            .values()
+            .any(|protocol| protocol.subscribers.contains(channel)),
+        "Node \"{node}\" does not receive on channel \"{channel}\""
+    );
+    // The fuzzed frames stand in for every other node.
+    sim.nodes.retain(|name, _| name == node);
+    if input.is_none() {
+        sim.params.timestep.count = NonZeroU64::MAX;
+    }
+    let root = make_sim_dir(&sim.params.root)?;
+    config::serialize_config(&sim, &root.join(CONFIG))?;
+    run(args, sim, root)
 }
 
 fn get_output(handles: Vec<ProtocolHandle>) -> Vec<ProtocolSummary> {
@@ -273,14 +395,18 @@ fn make_sim_dir(sim_root: &Path) -> Result<PathBuf> {
 
 fn setup_logging(
     root: &Path,
-    cmd: &RunCmd,
+    args: &Cli,
     sim: &ast::Simulation,
 ) -> Result<(PathBuf, Option<trace::layer::TraceHandle>)> {
     let trace_path = root.join("trace.nxs");
 
     // Build TraceLayer for binary logging (both tx and rx go into unified trace)
     let (trace_layer, trace_handle) =
-        if matches!(cmd, RunCmd::Simulate { .. } | RunCmd::Replay { .. }) {
+        // Fuzzing only keeps a trace of the input it reproduces.
+        if matches!(
+            args.cmd,
+            RunCmd::Simulate { .. } | RunCmd::Replay { .. } | RunCmd::Fuzz { input: Some(_), .. }
+        ) {
             let header = trace::format::TraceHeader {
                 node_names: {
                     let mut names: Vec<_> = sim.nodes.keys().cloned().collect();
@@ -308,7 +434,8 @@ fn setup_logging(
                         .collect()
                 },
             };
-            let (layer, handle) = trace::layer::TraceLayer::new(&trace_path, &header)?;
+            let (layer, handle) =
+                trace::layer::TraceLayer::new(&trace_path, &header, args.trace_overflow)?;
             (Some(layer), Some(handle))
         } else {
             (None, None)
@@ -320,7 +447,7 @@ fn setup_logging(
                 .with_filter(filter::filter_fn(|metadata| {
                     !matches!(
                         metadata.target(),
-                        "tx" | "rx" | "drop" | "battery" | "movement" | "motion"
+                        "tx" | "rx" | "drop" | "battery" | "movement" | "motion" | "profile"
                     )
                 }))
                 .with_filter(EnvFilter::from_default_env()),
@@ -329,7 +456,7 @@ fn setup_logging(
             layer.with_filter(filter::filter_fn(|metadata| {
                 matches!(
                     metadata.target(),
-                    "tx" | "rx" | "drop" | "battery" | "movement" | "motion"
+                    "tx" | "rx" | "drop" | "battery" | "movement" | "motion" | "profile"
                 )
             }))
         }))
@@ -393,12 +520,14 @@ fn make_fs_channels(
             .into_iter()
         {
             let mode = match run_cmd {
-                RunCmd::Simulate { .. } => ChannelMode::from_permissions(
+                RunCmd::Fuzz {
+                    channel: fuzzed, ..
+                } if channel == fuzzed => ChannelMode::FuzzWrites,
+                RunCmd::Simulate { .. } | RunCmd::Fuzz { .. } => ChannelMode::from_permissions(
                     protocol.subscribers.contains(channel),
                     protocol.publishers.contains(channel),
                 ),
                 RunCmd::Replay { .. } => ChannelMode::ReplayWrites,
-                RunCmd::Fuzz => ChannelMode::FuzzWrites,
                 _ => unreachable!(),
             };
 
@@ -0,0 +1,481 @@
+//! sweep.rs
+//! `nexus sweep`: run one simulation across a matrix of seeds, timestep
+//! lengths and clock rates, several runs at a time.
+//!
+//! Every run is a child `nexus` process pinned to a CPU set of its own,
+//! carved out of the sweep's affinity so concurrent runs never share a core.
+//! The runner places a run's protocols within the CPUs the run inherits.
+//! Each run gets a directory holding its resolved config, trace, output and
+//! captured logs, and mounts its files under a root of its own there.
+//!
+//! Protocols are built once, before any run starts, so a path compiled into
+//! them names the sweep's `~/nexus`, not a run's. Each run's protocols are
+//! started with that run's root as `$NEXUS_ROOT` and a home in its directory
+//! as `$HOME`, and find their own run's files only if they resolve the root
+//! at runtime: through `nexus::root` in the C++ SDK, or by expanding `~` when
+//! they open a file. One that opens a compiled-in path reaches no run's
+//! mount. Results are aggregated in matrix order once every run has finished,
+//! so the sweep's output does not depend on which run finished first.
+
+use std::fs::File;
+use std::io::{Write, stdout};
+use std::num::NonZeroU64;
+use std::os::unix::process::CommandExt;
+use std::path::{Path, PathBuf};
+use std::process::{Child, Command, ExitStatus, Stdio};
+use std::sync::atomic::Ordering;
+use std::time::Duration;
+
+use anyhow::{Context, Result, bail, ensure};
+use config::ast;
+use cpuutils::cpuset::CpuSet;
+use csv::{Reader, Writer};
+use runner::calibration::Calibration;
+use runner::cli::{Cli, RunCmd};
+
+use crate::{CONFIG, abort_on_signal, make_sim_dir};
+
+/// How often to check on running children.
+const POLL_INTERVAL: Duration = Duration::from_millis(50);
+/// Captured stdout and stderr of a run's `nexus` process.
+const LOG: &str = "nexus.log";
+/// Summary a run writes with `--dest file`.
+const OUTPUT: &str = "output.csv";
+/// Where a run's protocols find its root; read by `nexus::root` in the SDK.
+const ROOT_ENV: &str = "NEXUS_ROOT";
+
+/// One combination of swept parameters.
+#[derive(Debug, Clone, Copy, PartialEq)]
+struct Point {
+    seed: u64,
+    timestep_length: NonZeroU64,
+    clock_scale: f64,
+}
+
+impl Point {
+    fn name(&self) -> String {
+        format!(
+            "seed{}-ts{}-clk{}",
+            self.seed, self.timestep_length, self.clock_scale
+        )
+    }
+}
+
+#[derive(Debug, serde::Deserialize)]
+struct SummaryRow {
+    node: String,
+    protocol: String,
+    stdout: String,
+    stderr: String,
+}
+
+#[derive(Debug, serde::Serialize)]
+struct SweepRecord<'a> {
+    run: &'a str,
+    seed: u64,
+    timestep_length: NonZeroU64,
+    clock_scale: f64,
+    status: String,
+    node: &'a str,
+    protocol: &'a str,
+    stdout: &'a str,
+    stderr: &'a str,
+}
+
+/// Runs in progress: matrix index, child and the CPUs it holds. Dropping it
+/// kills and reaps whatever is still running, so a sweep that fails part
+/// way leaves no run behind.
+struct Running(Vec<(usize, Child, CpuSet)>);
+
+impl Drop for Running {
+    fn drop(&mut self) {
+        for (_, child, _) in &mut self.0 {
+            let _ = child.kill();
+            let _ = child.wait();
+        }
+    }
+}
+
+pub fn run(args: Cli) -> Result<()> {
+    let RunCmd::Sweep {
+        config,
+        seeds,
+        timestep_lengths,
+        clock_scales,
+        cpus_per_run,
+        output,
+    } = &args.cmd
+    else {
+        unreachable!()
+    };
+    ensure!(
+        args.root.is_none(),
+        "Sweeps mount every run under its own directory and do not take --root"
+    );
+    ensure!(
+        clock_scales.iter().flatten().all(|&s| s > 0.0),
+        "Clock scales must be positive"
+    );
+    let sim = config::parse_cached(config.clone(), config::cache_dir().as_deref())?;
+    let points = matrix(
+        &sim,
+        seeds.as_deref(),
+        timestep_lengths.as_deref(),
+        clock_scales.as_deref(),
+    );
+
+    let mut available = CpuSet::default();
+    available.get_current_affinity()?;
+    let cpus = available.enabled_ids();
+    let per_run = cpus_per_run.unwrap_or(sim.nodes.len()).clamp(1, cpus.len());
+    let slots = partition(&cpus, per_run)?;
+
+    runner::build(&sim)?;
+    let abort = abort_on_signal();
+    let root = make_sim_dir(&sim.params.root)?;
+    eprintln!("Sweep Root: {}", root.to_string_lossy());
+    eprintln!(
+        "Running {} simulations, {} at a time on {per_run} CPUs each",
+        points.len(),
+        slots.len()
+    );
+    let run_dirs = points
+        .iter()
+        .map(|point| {
+            let dir = root.join(point.name());
+            std::fs::create_dir_all(dir.join("home"))?;
+            config::serialize_config(&variant(&sim, point, &dir), &dir.join(CONFIG))?;
+            Ok(dir)
+        })
+        .collect::<Result<Vec<_>>>()?;
+
+    let exe = std::env::current_exe().context("Unable to find the nexus executable")?;
+    let calibration = Calibration::host_path().filter(|path| path.exists());
+    let mut statuses: Vec<Option<ExitStatus>> = vec![None; points.len()];
+    let mut free = slots;
+    let mut running = Running(Vec::new());
+    let mut next = 0;
+    loop {
+        while next < points.len() && !abort.load(Ordering::Relaxed) {
+            let Some(cpus) = free.pop() else {
+                break;
+            };
+            eprintln!("Starting {} on CPUs {cpus}", points[next].name());
+            let child = spawn_run(&exe, &args, &run_dirs[next], &cpus, calibration.as_deref())
+                .with_context(|| format!("Unable to start {}", points[next].name()))?;
+            running.0.push((next, child, cpus));
+            next += 1;
+        }
+        if running.0.is_empty() {
+            break;
+        }
+        std::thread::sleep(POLL_INTERVAL);
+        let mut i = 0;
+        while i < running.0.len() {
+            if let Some(status) = running.0[i].1.try_wait()? {
+                let (point, _, cpus) = running.0.swap_remove(i);
+                eprintln!("Finished {} ({status})", points[point].name());
+                statuses[point] = Some(status);
+                free.push(cpus);
+            } else {
+                i += 1;
+            }
+        }
+    }
+
+    let out: Box<dyn Write> = match output {
+        Some(path) => Box::new(File::create(path)?),
+        None => Box::new(stdout()),
+    };
+    let mut wr = Writer::from_writer(out);
+    let mut failed = 0;
+    for ((point, dir), status) in points.iter().zip(&run_dirs).zip(&statuses) {
+        let name = point.name();
+        let status_str = status.map_or_else(|| "not run".to_string(), |s| s.to_string());
+        let record = |status, node, protocol, stdout, stderr| SweepRecord {
+            run: &name,
+            seed: point.seed,
+            timestep_length: point.timestep_length,
+            clock_scale: point.clock_scale,
+            status,
+            node,
+            protocol,
+            stdout,
+            stderr,
+        };
+        let rows = match status {
+            Some(s) if s.success() => read_summaries(&dir.join(OUTPUT)),
+            _ => Ok(Vec::new()),
+        };
+        match rows {
+            Ok(rows) if !rows.is_empty() => {
+                for row in &rows {
+                    wr.serialize(record(
+                        status_str.clone(),
+                        &row.node,
+                        &row.protocol,
+                        &row.stdout,
+                        &row.stderr,
+                    ))?;
+                }
+            }
+            rows => {
+                if let Err(e) = rows {
+                    eprintln!("Unable to read the results of {name}: {e:#}");
+                }
+                if !status.is_some_and(|s| s.success()) {
+                    failed += 1;
+                }
+                wr.serialize(record(status_str, "", "", "", ""))?;
+            }
+        }
+    }
+    wr.flush()?;
+    if failed > 0 {
+        bail!(
+            "{failed} of {} runs did not finish; see {LOG} in their directories under \"{}\"",
+            points.len(),
+            root.display()
+        );
+    }
+    Ok(())
+}
+
+/// Run one point of a sweep in the directory `nexus sweep` prepared for it.
+pub fn run_point(args: Cli) -> Result<()> {
+    let RunCmd::SweepRun { snapshot } = args.cmd.clone() else {
+        unreachable!()
+    };
+    let sim = config::deserialize_config(&snapshot)?;
+    let root = snapshot
+        .parent()
+        .context("Sweep snapshot has no directory")?
+        .to_path_buf();
+    let args = Cli {
+        cmd: RunCmd::Simulate {
+            config: snapshot,
+            checkpoint_at: None,
+            resume_from: None,
+            profile: None,
+            partition: None,
+            peers: Vec::new(),
+        },
+        ..args
+    };
+    crate::run(args, sim, root)
+}
+
+/// Every combination of the swept values, seeds outermost. A parameter
+/// that is not swept keeps the config's value.
+fn matrix(
+    sim: &ast::Simulation,
+    seeds: Option<&[u64]>,
+    timestep_lengths: Option<&[NonZeroU64]>,
+    clock_scales: Option<&[f64]>,
+) -> Vec<Point> {
+    let seeds = seeds.unwrap_or(std::slice::from_ref(&sim.params.seed));
+    let lengths = timestep_lengths.unwrap_or(std::slice::from_ref(&sim.params.timestep.length));
+    let scales = clock_scales.unwrap_or(&[1.0]);
+    let mut points = Vec::with_capacity(seeds.len() * lengths.len() * scales.len());
+    for &seed in seeds {
+        for &timestep_length in lengths {
+            for &clock_scale in scales {
+                points.push(Point {
+                    seed,
+                    timestep_length,
+                    clock_scale,
+                });
+            }
+        }
+    }
+    points
+}
+
+/// `sim` at `point`, writing under `root`. Builds are cleared since the
+/// sweep built every protocol before starting any run.
+fn variant(sim: &ast::Simulation, point: &Point, root: &Path) -> ast::Simulation {
+    let mut sim = sim.clone();
+    sim.params.seed = point.seed;
+    sim.params.timestep.length = point.timestep_length;
+    sim.params.root = root.to_path_buf();
+    for channel in sim.channels.values_mut() {
+        channel.link.delays.ts_config = sim.params.timestep;
+    }
+    for node in sim.nodes.values_mut() {
+        // Scaled in hertz, so fractional scales of coarse units are kept.
+        let cpu = &mut node.resources.cpu;
+        if let Some(hz) = cpu.hertz {
+            let hz = (hz.get() << cpu.unit.lshifts()) as f64 * point.clock_scale;
+            cpu.hertz = Some(NonZeroU64::new(hz.round() as u64).unwrap_or(NonZeroU64::MIN));
+            cpu.unit = ast::ClockUnit::Hertz;
+        }
+        for protocol in node.protocols.values_mut() {
+            protocol.build = ast::Cmd {
+                cmd: String::new(),
+                args: vec![],
+            };
+        }
+    }
+    sim
+}
+
+/// Split `cpus` into as many disjoint sets of `per_run` as fit.
+fn partition(cpus: &[usize], per_run: usize) -> Result<Vec<CpuSet>> {
+    cpus.chunks_exact(per_run)
+        .map(|ids| {
+            let mut set = CpuSet::default();
+            for &id in ids {
+                set.enable_cpu(id)?;
+            }
+            Ok(set)
+        })
+        .collect()
+}
+
+fn spawn_run(
+    exe: &Path,
+    args: &Cli,
+    dir: &Path,
+    cpus: &CpuSet,
+    calibration: Option<&Path>,
+) -> Result<Child> {
+    let log = File::create(dir.join(LOG))?;
+    let home = dir.join("home");
+    let mut cmd = Command::new(exe);
+    cmd.arg("--dest")
+        .arg("file")
+        .arg("--trace-overflow")
+        .arg(args.trace_overflow.to_string())
+        .arg("--root")
+        .arg(home.join("nexus"))
+        .arg("sweep-run")
+        .arg(dir.join(CONFIG))
+        .env("HOME", &home)
+        .env(ROOT_ENV, home.join("nexus"))
+        .stdin(Stdio::null())
+        .stdout(log.try_clone()?)
+        .stderr(log);
+    if let Some(path) = calibration {
+        cmd.env(runner::calibration::CALIBRATION_ENV, path);
+    }
+    let mask = cpus.clone();
+    // SAFETY: only makes the sched_setaffinity syscall, which is safe
+    // between fork and exec; the error path does not allocate.
+    unsafe {
+        cmd.pre_exec(move || {
+            mask.set_affinity(0)
+                .map_err(|_| std::io::Error::last_os_error())
+        });
+    }
+    Ok(cmd.spawn()?)
+}
+
+fn read_summaries(path: &PathBuf) -> Result<Vec<SummaryRow>> {
+    let mut rd = Reader::from_path(path)
+        .with_context(|| format!("Unable to open \"{}\"", path.display()))?;
+    Ok(rd.deserialize().collect::<Result<_, _>>()?)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn arduino() -> ast::Simulation {
+        let path = Path::new(env!("CARGO_MANIFEST_DIR")).join("../examples/arduino/nexus.toml");
+        config::parse(path).unwrap()
+    }
+
+    #[test]
+    fn matrix_crosses_every_swept_value() {
+        let sim = arduino();
+        let ts = |n| NonZeroU64::new(n).unwrap();
+        let points = matrix(&sim, Some(&[1, 2]), Some(&[ts(5), ts(10)]), None);
+        assert_eq!(points.len(), 4);
+        assert_eq!(
+            points.iter().map(Point::name).collect::<Vec<_>>(),
+            [
+                "seed1-ts5-clk1",
+                "seed1-ts10-clk1",
+                "seed2-ts5-clk1",
+                "seed2-ts10-clk1"
+            ]
+        );
+
+        let unswept = matrix(&sim, None, None, None);
+        assert_eq!(
+            unswept,
+            [Point {
+                seed: sim.params.seed,
+                timestep_length: sim.params.timestep.length,
+                clock_scale: 1.0,
+            }]
+        );
+    }
+
+    #[test]
+    fn variant_applies_the_point_everywhere() {
+        let sim = arduino();
+        let point = Point {
+            seed: 9,
+            timestep_length: NonZeroU64::new(7).unwrap(),
+            clock_scale: 0.5,
+        };
+        let root = Path::new("/tmp/sweep/seed9");
+        let v = variant(&sim, &point, root);
+        assert_eq!(v.params.seed, 9);
+        assert_eq!(v.params.timestep.length.get(), 7);
+        assert_eq!(v.params.root, root);
+        for channel in v.channels.values() {
+            assert_eq!(channel.link.delays.ts_config.length.get(), 7);
+        }
+        for (name, node) in &v.nodes {
+            let cpu = &sim.nodes[name].resources.cpu;
+            let half_hz = cpu.hertz.map(|hz| (hz.get() << cpu.unit.lshifts()) / 2);
+            assert_eq!(node.resources.cpu.hertz.map(NonZeroU64::get), half_hz);
+            assert!(half_hz.is_none() || node.resources.cpu.unit == ast::ClockUnit::Hertz);
+            assert!(node.protocols.values().all(|p| p.build.cmd.is_empty()));
+        }
+    }
+
+    #[test]
+    fn snapshots_read_back_ready_to_run() {
+        let sim = arduino();
+        let point = Point {
+            seed: 3,
+            timestep_length: NonZeroU64::new(7).unwrap(),
+            clock_scale: 1.0,
+        };
+        let dir = tempfile::tempdir().unwrap();
+        let snapshot = dir.path().join(CONFIG);
+        let v = variant(&sim, &point, dir.path());
+        config::serialize_config(&v, &snapshot).unwrap();
+
+        // What `run_point` reads before handing the config to the kernel.
+        let read = config::deserialize_config(&snapshot).unwrap();
+        assert_eq!(read.params.seed, 3);
+        assert_eq!(read.params.root, dir.path());
+        for (name, channel) in &read.channels {
+            let link = &channel.link;
+            let original = &v.channels[name].link;
+            for rssi in [-120.0, -80.0, -40.0] {
+                assert_eq!(
+                    link.packet_loss.probability(rssi),
+                    original.packet_loss.probability(rssi)
+                );
+                assert_eq!(
+                    link.bit_error.probability(rssi),
+                    original.bit_error.probability(rssi)
+                );
+            }
+            assert!(link.delays.propagation.parsed_rate.is_some());
+        }
+    }
+
+    #[test]
+    fn partitions_are_disjoint_and_whole() {
+        let cpus: Vec<usize> = (0..10).collect();
+        let slots = partition(&cpus, 3).unwrap();
+        let ids: Vec<_> = slots.iter().map(CpuSet::enabled_ids).collect();
+        assert_eq!(ids, [vec![0, 1, 2], vec![3, 4, 5], vec![6, 7, 8]]);
+    }
+}
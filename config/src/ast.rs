@@ -167,7 +167,16 @@ pub struct ChannelEnergy {
 pub struct NodeProtocol {
     pub root: PathBuf,
     pub build: Cmd,
+    /// Files and directories outside `root` the build reads, which decide
+    /// along with `root` whether a cached build is still up to date.
+    #[serde(default)]
+    pub build_inputs: Vec<PathBuf>,
     pub runner: Cmd,
+    /// Fork every deployment from one initialised process instead of
+    /// starting each with its own `exec`. The program must call the SDK's
+    /// `nexus::zygote` hook.
+    #[serde(default)]
+    pub zygote: bool,
     pub publishers: HashSet<ChannelHandle>,
     pub subscribers: HashSet<ChannelHandle>,
 }
@@ -273,6 +282,17 @@ pub struct Params {
     pub seed: u64,
     pub root: PathBuf,
     pub time_dilation: f64,
+    /// Run steps back to back instead of in real time while every protocol
+    /// is blocked on the router.
+    pub skip_idle: bool,
+    /// Worker threads the router splits link simulation across, each
+    /// owning a share of the channels.
+    pub router_shards: NonZeroUsize,
+    /// Threads FUSE requests are answered on, each serving a share of the
+    /// processes.
+    pub fuse_workers: NonZeroUsize,
+    /// Protocol builds to run at once. `None` runs one per CPU.
+    pub build_jobs: Option<NonZeroUsize>,
 }
 
 #[derive(Serialize, Deserialize, Clone, Debug, Default)]
@@ -0,0 +1,272 @@
+//! Binary cache of validated simulations.
+//!
+//! `parse_cached` stores each simulation it validates under a hash of the
+//! config file's text and location, the crate version and the environment
+//! module resolution reads. With the entry it records every module file
+//! resolution read, by content hash, and every search path candidate it
+//! found missing. While those are unchanged, and the directories and build
+//! inputs the simulation names still exist, the entry is the simulation the
+//! config would validate to and parsing is skipped.
+
+use std::collections::HashSet;
+use std::fs;
+use std::os::unix::ffi::OsStrExt;
+use std::path::{Path, PathBuf};
+use std::time::SystemTime;
+
+use anyhow::{Context, Result};
+use serde::{Deserialize, Serialize};
+use sha2::{Digest, Sha256};
+
+use crate::VERSION;
+use crate::ast::Simulation;
+
+/// Environment variables module and path resolution read.
+const CACHE_ENV: &[&str] = &["NEXUS_MODULE_PATH", "HOME"];
+
+/// A file a validated simulation depends on.
+#[derive(Serialize, Deserialize, Debug, Clone, PartialEq)]
+pub(crate) struct Input {
+    path: PathBuf,
+    /// SHA-256 of its contents, or `None` if it must not exist.
+    hash: Option<[u8; 32]>,
+}
+
+impl Input {
+    pub(crate) fn file(path: PathBuf, contents: &[u8]) -> Self {
+        Self {
+            path,
+            hash: Some(Sha256::digest(contents).into()),
+        }
+    }
+
+    pub(crate) fn absent(path: PathBuf) -> Self {
+        Self { path, hash: None }
+    }
+
+    fn unchanged(&self) -> bool {
+        match self.hash {
+            Some(hash) => fs::read(&self.path)
+                .is_ok_and(|contents| <[u8; 32]>::from(Sha256::digest(contents)) == hash),
+            None => !self.path.exists(),
+        }
+    }
+}
+
+#[derive(Serialize, Deserialize)]
+struct Entry {
+    inputs: Vec<Input>,
+    /// The config left the start time to default to when it was parsed.
+    default_start: bool,
+    sim: Simulation,
+}
+
+/// Where validated simulations are cached: `$XDG_CACHE_HOME/nexus/configs`,
+/// or `~/.cache/nexus/configs`.
+pub fn cache_dir() -> Option<PathBuf> {
+    std::env::var_os("XDG_CACHE_HOME")
+        .map(PathBuf::from)
+        .or_else(|| home::home_dir().map(|home| home.join(".cache")))
+        .map(|cache| cache.join("nexus").join("configs"))
+}
+
+/// Name of the entry for the config at `config` with contents `text`.
+pub(crate) fn key(config: &Path, text: &str) -> Result<String> {
+    let config = std::path::absolute(config)
+        .with_context(|| format!("Cannot resolve path \"{}\"", config.display()))?;
+    let mut hasher = Sha256::new();
+    let mut field = |bytes: &[u8]| {
+        hasher.update((bytes.len() as u64).to_le_bytes());
+        hasher.update(bytes);
+    };
+    field(VERSION.as_bytes());
+    field(config.as_os_str().as_bytes());
+    field(text.as_bytes());
+    for var in CACHE_ENV {
+        field(var.as_bytes());
+        field(std::env::var_os(var).unwrap_or_default().as_bytes());
+    }
+    Ok(format!("{:x}", hasher.finalize()))
+}
+
+/// The simulation cached in `entry`, if it is still what the config
+/// validates to.
+pub(crate) fn load(entry: &Path) -> Option<Simulation> {
+    let bytes = fs::read(entry).ok()?;
+    let (mut entry, _): (Entry, _) =
+        bincode::serde::decode_from_slice(&bytes, bincode::config::standard()).ok()?;
+    if !entry.inputs.iter().all(Input::unchanged) || !paths_exist(&entry.sim) {
+        return None;
+    }
+    entry.sim.parse_expressions().ok()?;
+    if entry.default_start {
+        // Validating now would start the simulation now.
+        let cached = entry.sim.params.timestep.start;
+        let now = SystemTime::now();
+        entry.sim.params.timestep.start = now;
+        for node in entry.sim.nodes.values_mut() {
+            if node.start == cached {
+                node.start = now;
+            }
+        }
+        for channel in entry.sim.channels.values_mut() {
+            let ts_config = &mut channel.link.delays.ts_config;
+            if ts_config.start == cached {
+                ts_config.start = now;
+            }
+        }
+    }
+    Some(entry.sim)
+}
+
+/// Cache `sim` in `entry`. Writes through a temporary file, so concurrent
+/// runs never read half an entry.
+pub(crate) fn save(
+    entry: &Path,
+    inputs: Vec<Input>,
+    default_start: bool,
+    sim: &Simulation,
+) -> Result<()> {
+    let entry_dir = entry.parent().expect("entries live in the cache directory");
+    fs::create_dir_all(entry_dir)?;
+    let bytes = bincode::serde::encode_to_vec(
+        &Entry {
+            inputs,
+            default_start,
+            sim: sim.clone(),
+        },
+        bincode::config::standard(),
+    )?;
+    let tmp = entry.with_extension(format!("{}.tmp", std::process::id()));
+    fs::write(&tmp, bytes)?;
+    fs::rename(&tmp, entry)?;
+    Ok(())
+}
+
+/// Whether the directories and build inputs validation resolved still
+/// exist.
+fn paths_exist(sim: &Simulation) -> bool {
+    let mut checked = HashSet::new();
+    sim.params.root.is_dir()
+        && sim
+            .nodes
+            .values()
+            .flat_map(|node| node.protocols.values())
+            .all(|protocol| {
+                !checked.insert(&protocol.root)
+                    || (protocol.root.is_dir() && protocol.build_inputs.iter().all(|i| i.exists()))
+            })
+}
+
+impl Simulation {
+    /// Parse the link expressions again, which serializing skips.
+    pub(crate) fn parse_expressions(&mut self) -> Result<()> {
+        for channel in self.channels.values_mut() {
+            let link = &mut channel.link;
+            for expr in [&mut link.bit_error, &mut link.packet_loss] {
+                expr.parsed_expr = Some(expr.expr.parse()?);
+            }
+            let propagation = &mut link.delays.propagation;
+            propagation.parsed_rate = Some(propagation.rate.parse()?);
+        }
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const CONFIG: &str = r#"
+use = ["./radio"]
+
+[params]
+root = "."
+timestep.count = 10
+
+[nodes.a]
+deployments = [{}, {}]
+
+[[nodes.a.protocols]]
+name = "p"
+runner = "true"
+publishers = ["air"]
+"#;
+
+    const RADIO: &str = r#"
+[links.lossy]
+packet_loss = "0.25"
+
+[channels.air]
+link = "lossy"
+"#;
+
+    fn setup() -> tempfile::TempDir {
+        let dir = tempfile::tempdir().unwrap();
+        fs::write(dir.path().join("nexus.toml"), CONFIG).unwrap();
+        fs::write(dir.path().join("radio.toml"), RADIO).unwrap();
+        dir
+    }
+
+    fn entry(cache: &Path) -> PathBuf {
+        let entries: Vec<_> = fs::read_dir(cache).unwrap().collect();
+        assert_eq!(entries.len(), 1);
+        entries[0].as_ref().unwrap().path()
+    }
+
+    #[test]
+    fn cached_parse_matches_a_fresh_one() {
+        let dir = setup();
+        let cache = dir.path().join("cache");
+        let config = dir.path().join("nexus.toml");
+        let fresh = crate::parse(config.clone()).unwrap();
+        crate::parse_cached(config.clone(), Some(&cache)).unwrap();
+        let cached = load(&entry(&cache)).unwrap();
+
+        // Start times default to the time of parsing.
+        fn without_starts(value: &mut toml::Value) {
+            if let Some(table) = value.as_table_mut() {
+                table.remove("start");
+                for (_, value) in table.iter_mut() {
+                    without_starts(value);
+                }
+            }
+        }
+        let to_toml = |sim: &Simulation| {
+            let mut value = toml::Value::try_from(sim).unwrap();
+            without_starts(&mut value);
+            value
+        };
+        assert_eq!(to_toml(&cached), to_toml(&fresh));
+        let air = &cached.channels["air"].link;
+        assert_eq!(air.packet_loss.probability(-50.0), 0.25);
+        assert!(air.delays.propagation.parsed_rate.is_some());
+        assert!(
+            cached
+                .nodes
+                .values()
+                .all(|node| node.start == cached.params.timestep.start)
+        );
+    }
+
+    #[test]
+    fn changed_or_shadowing_modules_invalidate_the_entry() {
+        let dir = setup();
+        let cache = dir.path().join("cache");
+        let config = dir.path().join("nexus.toml");
+        crate::parse_cached(config.clone(), Some(&cache)).unwrap();
+        let entry = entry(&cache);
+        assert!(load(&entry).is_some());
+
+        fs::write(dir.path().join("radio.toml"), RADIO.replace("0.25", "0.5")).unwrap();
+        assert!(load(&entry).is_none());
+        let sim = crate::parse_cached(config, Some(&cache)).unwrap();
+        assert_eq!(sim.channels["air"].link.packet_loss.probability(-50.0), 0.5);
+        assert!(load(&entry).is_some());
+
+        let missing = Input::absent(dir.path().join("shadow.toml"));
+        assert!(missing.unchanged());
+        fs::write(dir.path().join("shadow.toml"), "").unwrap();
+        assert!(!missing.unchanged());
+    }
+}
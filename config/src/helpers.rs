@@ -1,7 +1,12 @@
+use std::num::NonZeroUsize;
 use std::path::{Path, PathBuf};
+use std::thread;
 
 use anyhow::{Context, Result, bail};
 
+/// Fewest items worth spreading over threads in `par_map`.
+const PAR_MIN_ITEMS: usize = 64;
+
 pub(crate) fn expand_home(path: &PathBuf) -> PathBuf {
     if let Some(stripped) = path.to_string_lossy().strip_prefix("~/")
         && let Some(home_dir) = home::home_dir()
@@ -40,3 +45,44 @@ pub(crate) fn resolve_directory(config_root: &PathBuf, path: &PathBuf) -> Result
         Ok(root)
     }
 }
+
+/// Map `f` over `items` on every core, keeping their order. Short lists are
+/// mapped on the calling thread.
+pub(crate) fn par_map<T: Send, U: Send>(items: Vec<T>, f: impl Fn(T) -> U + Sync) -> Vec<U> {
+    let threads = thread::available_parallelism().map_or(1, NonZeroUsize::get);
+    if threads == 1 || items.len() < PAR_MIN_ITEMS {
+        return items.into_iter().map(f).collect();
+    }
+    let per_thread = items.len().div_ceil(threads);
+    let mut items = items.into_iter();
+    let chunks: Vec<Vec<T>> = (0..threads)
+        .map(|_| items.by_ref().take(per_thread).collect())
+        .collect();
+    let f = &f;
+    thread::scope(|scope| {
+        let workers: Vec<_> = chunks
+            .into_iter()
+            .map(|chunk| scope.spawn(move || chunk.into_iter().map(f).collect::<Vec<_>>()))
+            .collect();
+        workers
+            .into_iter()
+            .flat_map(|worker| {
+                worker
+                    .join()
+                    .unwrap_or_else(|panic| std::panic::resume_unwind(panic))
+            })
+            .collect()
+    })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn par_map_keeps_order() {
+        let items: Vec<u64> = (0..10 * PAR_MIN_ITEMS as u64).collect();
+        let squares = par_map(items.clone(), |x| x * x);
+        assert_eq!(squares, items.iter().map(|x| x * x).collect::<Vec<_>>());
+    }
+}
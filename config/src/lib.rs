@@ -3,6 +3,7 @@ use crc32fast::Hasher;
 use serde::{Deserialize, Serialize};
 use std::path::{Path, PathBuf};
 
+mod cache;
 mod channel;
 mod helpers;
 mod medium;
@@ -17,26 +18,53 @@ mod validate;
 
 pub mod ast;
 
+pub use cache::cache_dir;
+
 const VERSION: &str = env!("CARGO_PKG_VERSION");
 
 pub const CONTROL_PREFIX: &str = "ctl.";
 const RESERVED_LINKS: [&str; 1] = ["ideal"];
 
-pub fn parse(mut config_root: PathBuf) -> Result<ast::Simulation> {
+pub fn parse(config_root: PathBuf) -> Result<ast::Simulation> {
+    parse_cached(config_root, None)
+}
+
+/// Like `parse`, but reuse the simulation validated from the same inputs
+/// before, if `cache` holds it, and cache the result otherwise. Only
+/// accepted configs are cached; see `cache.rs` for what invalidates them.
+pub fn parse_cached(mut config_root: PathBuf, cache: Option<&Path>) -> Result<ast::Simulation> {
     let config_text = std::fs::read_to_string(&config_root).context(format!(
         "Unable to open file located at {}",
         config_root.to_string_lossy()
     ))?;
+    let entry = cache
+        .map(|dir| cache::key(&config_root, &config_text).map(|key| dir.join(key)))
+        .transpose()?;
+    if let Some(sim) = entry.as_deref().and_then(cache::load) {
+        return Ok(sim);
+    }
+
     let mut parsed: parse::Simulation = toml::from_str(config_text.as_str())
         .context("Failed to parse simulation parameters from config file.")?;
     config_root.pop();
+    let default_start = parsed
+        .params
+        .timestep
+        .as_ref()
+        .is_none_or(|timestep| timestep.start.is_none());
 
     // Resolve module imports and merge into the parsed simulation.
-    module::resolve_and_merge(&config_root, &mut parsed)
+    let inputs = module::resolve_and_merge(&config_root, &mut parsed)
         .context("Failed to resolve module imports.")?;
 
     let validated = ast::Simulation::validate(&config_root, parsed)
         .context("Failed to validate simulation parameters from config file.")?;
+    if let Some(entry) = &entry
+        && let Err(e) = cache::save(entry, inputs, default_start, &validated)
+    {
+        // A cache that cannot be written only costs validating next time.
+        tracing::warn!("Unable to cache validated config: {e:#}");
+    }
     Ok(validated)
 }
 
@@ -137,7 +165,9 @@ pub fn parse_module_file(path: &Path) -> Result<parse::ModuleFile> {
 
 pub fn deserialize_config(src: &Path) -> Result<ast::Simulation> {
     let snapshot = ConfigSnapshot::try_read(src)?;
-    if let Ok(res) = toml::from_str(snapshot.cfg.as_str()) {
+    if let Ok(mut res) = toml::from_str::<ast::Simulation>(snapshot.cfg.as_str()) {
+        res.parse_expressions()
+            .context("Unable to parse link expressions from snapshot.")?;
         Ok(res)
     } else {
         bail!("Unable to deserialize validated configuration from snapshot.");
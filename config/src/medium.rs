@@ -34,6 +34,32 @@ impl Medium {
         }
     }
 
+    /// Farthest distance in meters at which a full-power transmission still
+    /// arrives at or above the noise floor. RSSI only falls with distance, so
+    /// anything farther is always dropped. Infinite when nothing attenuates.
+    pub fn max_range_meters(&self) -> f64 {
+        let margin_db = self.tx_max_dbm() - self.noise_floor_dbm();
+        let range = match self {
+            Medium::Wireless {
+                wavelength_meters,
+                gain_dbi,
+                ..
+            } => wavelength_meters / (4.0 * PI) * 10f64.powf((margin_db + gain_dbi) / 20.0),
+            Medium::Wired { r, l, c, g, f, .. } => {
+                let omega = 2.0 * PI * f;
+                let x = r * g - (omega * omega) * l * c;
+                let y = r * omega * c + g * omega * l;
+                let alpha = (((x * x + y * y).sqrt() + x) / 2.0).sqrt();
+                margin_db / (8.686 * alpha)
+            }
+        };
+        if range.is_nan() {
+            f64::INFINITY
+        } else {
+            range.max(0.0)
+        }
+    }
+
     fn rssi_wireless(&self, tx_power_dbm: f64, distance_meters: f64) -> f64 {
         let Self::Wireless {
             wavelength_meters,
@@ -181,6 +207,37 @@ mod tests {
         }
     }
 
+    #[test]
+    fn max_range_is_where_rssi_meets_noise_floor() {
+        let wireless = Medium::Wireless {
+            shape: SignalShape::Omnidirectional,
+            wavelength_meters: 0.125,
+            gain_dbi: 2.0,
+            rx_min_dbm: -100.0,
+            tx_min_dbm: -10.0,
+            tx_max_dbm: 14.0,
+        };
+        let range = wireless.max_range_meters();
+        assert!((wireless.rssi(14.0, range) - -100.0).abs() < 1e-9);
+        assert!(wireless.rssi(14.0, range * 1.01) < -100.0);
+
+        let wired = Medium::Wired {
+            rx_min_dbm: -60.0,
+            tx_min_dbm: 0.0,
+            tx_max_dbm: 10.0,
+            r: 0.1,
+            l: 2.5e-7,
+            c: 1e-10,
+            g: 1e-6,
+            f: 1e6,
+        };
+        let range = wired.max_range_meters();
+        assert!((wired.rssi(10.0, range) - -60.0).abs() < 1e-9);
+
+        // The ideal link never attenuates
+        assert_eq!(Medium::default().max_range_meters(), f64::INFINITY);
+    }
+
     #[test]
     fn wireless_tx_clamping() {
         let medium = Medium::Wireless {
@@ -412,21 +469,21 @@ impl RssiProbExpr {
         distance: f64,
         unit: DistanceUnit,
         medium: &Medium,
-        rng: &mut rand::rngs::StdRng,
+        rng: &mut impl Rng,
     ) -> bool {
         let rssi = self.rssi(tx_power_dbm, distance, unit, medium);
         self.probability(rssi) > rng.random_range(0.0..=1.0)
     }
 
     /// Returns `true` if the event happens, and `false` otherwise
-    pub fn sample_rssi(&self, rssi: f64, rng: &mut rand::rngs::StdRng) -> bool {
+    pub fn sample_rssi(&self, rssi: f64, rng: &mut impl Rng) -> bool {
         self.probability(rssi) > rng.random_range(0.0..=1.0)
     }
 
     /// Sample using a pre-computed probability value.
     /// If the value for `prob` is not properly constrained from 0.0 - 1.0 this
     /// will give bogus results.
-    pub fn sample_unchecked(&self, prob: f64, rng: &mut rand::rngs::StdRng) -> bool {
+    pub fn sample_unchecked(&self, prob: f64, rng: &mut impl Rng) -> bool {
         prob > rng.random_range(0.0..=1.0)
     }
 
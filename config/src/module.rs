@@ -5,6 +5,7 @@ use std::path::{Path, PathBuf};
 use anyhow::{Context, Result, bail};
 use tracing::warn;
 
+use crate::cache::Input;
 use crate::parse;
 
 const STDLIB_DIR: &str = env!("NEXUS_STDLIB_DIR");
@@ -24,13 +25,19 @@ struct ResolvedModules {
     links: HashMap<String, (parse::Link, Origin, String)>,
     channels: HashMap<String, (parse::Channel, Origin, String)>,
     profiles: HashMap<String, (parse::NodeProfile, Origin, String)>,
+    /// Every file resolution read or looked for, for the config cache.
+    inputs: Vec<Input>,
 }
 
 /// Resolve all modules referenced by `use_list` and merge them into `sim`.
-pub(crate) fn resolve_and_merge(config_dir: &Path, sim: &mut parse::Simulation) -> Result<()> {
+/// Returns the files the result depends on.
+pub(crate) fn resolve_and_merge(
+    config_dir: &Path,
+    sim: &mut parse::Simulation,
+) -> Result<Vec<Input>> {
     let use_list = match sim.r#use.take() {
         Some(list) if !list.is_empty() => list,
-        _ => return Ok(()),
+        _ => return Ok(Vec::new()),
     };
 
     let mut visited = HashSet::new();
@@ -42,7 +49,9 @@ pub(crate) fn resolve_and_merge(config_dir: &Path, sim: &mut parse::Simulation)
             .with_context(|| format!("Failed to resolve module \"{spec}\""))?;
     }
 
-    merge_into_simulation(sim, result)
+    let inputs = std::mem::take(&mut result.inputs);
+    merge_into_simulation(sim, result)?;
+    Ok(inputs)
 }
 
 /// Merge named items into a target map, rejecting duplicates across modules.
@@ -82,8 +91,10 @@ fn resolve_recursive(
         );
     }
 
-    let path = resolve_path(base_dir, spec)
+    let mut missed = Vec::new();
+    let path = find_module(base_dir, spec, &mut missed)
         .with_context(|| format!("Could not resolve module path for \"{spec}\""))?;
+    result.inputs.extend(missed.into_iter().map(Input::absent));
 
     // Already loaded -- skip.
     if visited.contains(&path) {
@@ -98,6 +109,9 @@ fn resolve_recursive(
 
     let text = std::fs::read_to_string(&path)
         .with_context(|| format!("Unable to read module file at \"{}\"", path.display()))?;
+    result
+        .inputs
+        .push(Input::file(path.clone(), text.as_bytes()));
     let module: parse::ModuleFile = toml::from_str(&text)
         .with_context(|| format!("Failed to parse module file at \"{}\"", path.display()))?;
 
@@ -130,6 +144,12 @@ fn resolve_recursive(
 
 /// Resolve a module specifier to a canonical filesystem path.
 fn resolve_path(base_dir: &Path, spec: &str) -> Result<PathBuf> {
+    find_module(base_dir, spec, &mut Vec::new())
+}
+
+/// `resolve_path`, noting in `missed` the search path candidates that did
+/// not exist before the one found: creating one would change the result.
+fn find_module(base_dir: &Path, spec: &str, missed: &mut Vec<PathBuf>) -> Result<PathBuf> {
     let with_ext = |p: PathBuf| -> PathBuf {
         if p.extension().is_some() {
             p
@@ -159,6 +179,7 @@ fn resolve_path(base_dir: &Path, spec: &str) -> Result<PathBuf> {
                     format!("Failed to canonicalize path \"{}\"", candidate.display())
                 });
             }
+            missed.push(candidate);
         }
     }
 
@@ -44,6 +44,10 @@ pub struct Params {
     pub(super) seed: Option<u64>,
     pub(super) root: String,
     pub(super) time_dilation: Option<f64>,
+    pub(super) skip_idle: Option<bool>,
+    pub(super) router_shards: Option<usize>,
+    pub(super) fuse_workers: Option<usize>,
+    pub(super) build_jobs: Option<usize>,
 }
 
 #[derive(Clone, Debug, Default, Deserialize)]
@@ -305,8 +309,10 @@ pub struct NodeProtocol {
     pub(super) root: String,
     pub(super) runner: String,
     pub(super) runner_args: Option<Vec<String>>,
+    pub(super) zygote: Option<bool>,
     pub(super) build: String,
     pub(super) build_args: Option<Vec<String>>,
+    pub(super) build_inputs: Option<Vec<String>>,
     pub(super) publishers: Option<Vec<ChannelName>>,
     pub(super) subscribers: Option<Vec<ChannelName>>,
 }
@@ -17,7 +17,7 @@ use std::path::PathBuf;
 use std::time::SystemTime;
 use std::{
     collections::{HashMap, HashSet},
-    num::NonZeroU64,
+    num::{NonZeroU64, NonZeroUsize},
 };
 
 impl Channel {
@@ -87,8 +87,11 @@ fn channel_namespace(
 ) -> Result<Namespace<Channel>> {
     let mut ns = Namespace::<Channel>::new(String::from("Channel"));
     ns.ban_prefix(CONTROL_PREFIX)?;
-    for (name, channel) in channels {
-        ns.add(name, Channel::validate(channel, processed)?)?;
+    let validated = par_map(channels.into_iter().collect(), |(name, channel)| {
+        (name, Channel::validate(channel, processed))
+    });
+    for (name, channel) in validated {
+        ns.add(name, channel?)?;
     }
     Ok(ns)
 }
@@ -200,25 +203,25 @@ impl Simulation {
 
         let channels: HashMap<_, _> = channel_namespace(val.channels, &processed)?.into();
         let channel_handles = channels.keys().cloned().collect::<HashSet<_>>();
-        let validated_nodes = val
-            .nodes
-            .into_iter()
+        // Nodes validate independently. The first error in map order wins,
+        // as it would validating them one by one.
+        let validated_nodes = par_map(val.nodes.into_iter().collect(), |(key, node)| {
             // Append a unique suffix corresponding to deployment ID to each
             // node's name to deduplicate the handles
-            .map(|(key, node)| {
-                Node::validate(config_root, node, &params.timestep.start, &channel_handles).map(
-                    |nodes| {
-                        nodes
-                            .into_iter()
-                            .enumerate()
-                            .map(|(index, node)| (format!("{key}.{index}"), node))
-                            .collect::<Vec<_>>()
-                    },
-                )
-            })
-            // Collect the intermediary step
-            .collect::<Result<Vec<Vec<(NodeHandle, Node)>>>>()
-            .context("Failed to validate nodes")?;
+            Node::validate(config_root, node, &params.timestep.start, &channel_handles).map(
+                |nodes| {
+                    nodes
+                        .into_iter()
+                        .enumerate()
+                        .map(|(index, node)| (format!("{key}.{index}"), node))
+                        .collect::<Vec<_>>()
+                },
+            )
+        })
+        .into_iter()
+        // Collect the intermediary step
+        .collect::<Result<Vec<Vec<(NodeHandle, Node)>>>>()
+        .context("Failed to validate nodes")?;
         // Flatten 2D array of nodes into unique handles
         let nodes = validated_nodes
             .into_iter()
@@ -312,11 +315,23 @@ impl Params {
         let timestep = validate_optional(val.timestep, TimestepConfig::validate)
             .context("Unable to validate timestep configuration in simulation config.")?;
         let time_dilation = val.time_dilation.unwrap_or(1.0);
+        let router_shards = NonZeroUsize::new(val.router_shards.unwrap_or(1))
+            .context("The router needs at least one shard.")?;
+        let fuse_workers = NonZeroUsize::new(val.fuse_workers.unwrap_or(1))
+            .context("The filesystem needs at least one worker.")?;
+        let build_jobs = val
+            .build_jobs
+            .map(|n| NonZeroUsize::new(n).context("Builds need at least one job."))
+            .transpose()?;
         Ok(Self {
             timestep,
             seed: val.seed.unwrap_or_default(),
             root,
             time_dilation,
+            skip_idle: val.skip_idle.unwrap_or_default(),
+            router_shards,
+            fuse_workers,
+            build_jobs,
         })
     }
 }
@@ -929,6 +944,19 @@ impl NodeProtocol {
             cmd: val.build,
             args: val.build_args.unwrap_or_default(),
         };
+        let build_inputs = val
+            .build_inputs
+            .unwrap_or_default()
+            .into_iter()
+            .map(|input| {
+                std::fs::canonicalize(root.join(&input)).with_context(|| {
+                    format!(
+                        "Cannot resolve build input \"{input}\" of protocol \"{}\"",
+                        val.name
+                    )
+                })
+            })
+            .collect::<Result<_>>()?;
         let publishers = val
             .publishers
             .unwrap_or_default()
@@ -964,8 +992,10 @@ impl NodeProtocol {
 
         Ok(Self {
             root,
-            runner,
             build,
+            build_inputs,
+            runner,
+            zygote: val.zygote.unwrap_or_default(),
             publishers,
             subscribers,
         })
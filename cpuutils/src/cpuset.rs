@@ -6,7 +6,7 @@ use crate::errors::{CpusetError, LibcError};
 
 const BITS_IN_BYTE: usize = 8;
 
-#[derive(Debug)]
+#[derive(Debug, Clone)]
 pub struct CpuSet {
     set: Vec<u8>,
 }
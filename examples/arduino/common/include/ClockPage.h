@@ -0,0 +1,133 @@
+#pragma once
+/**
+ * Memory-mapped simulated clock. Reading `ctl.clock` (e.g.
+ * `$HOME/nexus/ctl.clock`) makes the simulator create a page it republishes
+ * every timestep and returns the path of the file holding it. Once mapped,
+ * reading the clock is a handful of loads with no syscall.
+ *
+ * The layout mirrors `kernel/src/router/clock.rs` and must be kept in sync.
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace nexus {
+
+class ClockPage {
+   public:
+    static constexpr uint32_t MAGIC = 0x4B43584E;  // "NXCK" little-endian
+    static constexpr uint32_t VERSION = 1;
+
+    struct Reading {
+        uint64_t timestep;
+        /** Simulated nanoseconds since the simulation started. */
+        uint64_t elapsed_ns;
+        /** Simulated nanoseconds since the Unix epoch. */
+        uint64_t epoch_ns;
+    };
+
+    /**
+     * Map the page advertised by `clock_file`.
+     *
+     * @param clock_file: Path to the `ctl.clock` control file.
+     */
+    explicit ClockPage(const char* clock_file) {
+        char path[256];
+        int fd = open(clock_file, O_RDONLY);
+        if (fd == -1) {
+            return;
+        }
+        ssize_t n = read(fd, path, sizeof(path) - 1);
+        close(fd);
+        if (n <= 0) {
+            return;
+        }
+        path[n] = '\0';
+
+        fd = open(path, O_RDONLY);
+        if (fd == -1) {
+            return;
+        }
+        void* base = mmap(nullptr, PAGE_BYTES, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            return;
+        }
+        const uint32_t* header = static_cast<const uint32_t*>(base);
+        if (header[0] != MAGIC || header[1] != VERSION) {
+            munmap(base, PAGE_BYTES);
+            return;
+        }
+        base_ = static_cast<const uint8_t*>(base);
+    }
+
+    ~ClockPage() {
+        if (base_ != nullptr) {
+            munmap(const_cast<uint8_t*>(base_), PAGE_BYTES);
+        }
+    }
+
+    ClockPage(const ClockPage&) = delete;
+    ClockPage& operator=(const ClockPage&) = delete;
+
+    /** Whether the page was mapped successfully. */
+    bool ok() const { return base_ != nullptr; }
+
+    /** Length of one simulated timestep in nanoseconds. */
+    uint64_t timestep_ns() const { return ok() ? word(TIMESTEP_NS) : 0; }
+
+    /**
+     * Take a consistent reading of the clock, retrying while the simulator
+     * is midway through publishing a new timestep.
+     *
+     * @returns (Reading): All zeros if the page is not mapped.
+     */
+    Reading now() const {
+        if (!ok()) {
+            return {0, 0, 0};
+        }
+        std::atomic_ref<uint64_t> seq(word(SEQ));
+        for (;;) {
+            uint64_t before = seq.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            Reading r = {
+                std::atomic_ref<uint64_t>(word(TIMESTEP))
+                    .load(std::memory_order_relaxed),
+                std::atomic_ref<uint64_t>(word(ELAPSED_NS))
+                    .load(std::memory_order_relaxed),
+                std::atomic_ref<uint64_t>(word(EPOCH_NS))
+                    .load(std::memory_order_relaxed),
+            };
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq.load(std::memory_order_relaxed) == before) {
+                return r;
+            }
+        }
+    }
+
+   private:
+    static constexpr size_t PAGE_BYTES = 4096;
+    static constexpr size_t TIMESTEP_NS = 8;
+    static constexpr size_t SEQ = 64;
+    static constexpr size_t TIMESTEP = 72;
+    static constexpr size_t ELAPSED_NS = 80;
+    static constexpr size_t EPOCH_NS = 88;
+
+    const uint8_t* base_ = nullptr;
+
+    // atomic_ref needs a non-const referent; the page is still only ever
+    // loaded from.
+    uint64_t& word(size_t offset) const {
+        return *reinterpret_cast<uint64_t*>(const_cast<uint8_t*>(base_) +
+                                            offset);
+    }
+};
+
+}  // namespace nexus
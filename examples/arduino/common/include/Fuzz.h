@@ -0,0 +1,78 @@
+#pragma once
+/**
+ * Persistent-mode fuzzing hook for `nexus fuzz`.
+ *
+ * The fuzzer runs inside the protocol process, so the simulation is set up
+ * once and every input is one iteration of the same process. Hand each input
+ * to `nexus::Fuzz::feed`, which marks the iteration boundary: the simulator
+ * drops whatever the process still has queued and makes the input's frames
+ * the next messages it receives on the fuzzed channel. Then run the protocol
+ * until they have all been read. With libFuzzer (`-fsanitize=fuzzer`):
+ *
+ *     extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+ *         static nexus::Fuzz fuzz(NEXUS_ROOT);
+ *         static bool ready = (setup(), true);
+ *         fuzz.feed(data, size);
+ *         while (fuzz.pending() > 0) {
+ *             loop();
+ *         }
+ *         reset();  // whatever the protocol keeps between packets
+ *         return 0;
+ *     }
+ *
+ * Give the fuzzer's flags as the protocol's run arguments, e.g.
+ * `["-artifact_prefix=crashes/", "-minimize_crash=1"]`. Simulated time keeps
+ * running across iterations; all other state is the protocol's to reset.
+ * Engines that start the target themselves (`afl-fuzz`) cannot reach a
+ * process the simulator runs, but any engine linked in process can drive
+ * the same entry point.
+ *
+ * Every byte string is a valid input, split into frames as
+ * `doc/simulation-files.md` describes. `nexus fuzz --input <crash>` delivers
+ * one to the ordinary build of the protocol and records the run's trace.
+ */
+
+#include <fcntl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "Nexus.h"
+
+namespace nexus {
+
+class Fuzz {
+   public:
+    /** Longest input handed over; one write of a page always arrives whole. */
+    static constexpr size_t MAX_INPUT = 4096;
+
+    explicit Fuzz(std::string_view root)
+        : fuzz_(Path(root, "/ctl.fuzz").c_str(), O_RDWR) {}
+
+    bool ok() const { return fuzz_.ok(); }
+
+    /**
+     * Start an iteration with `len` bytes of input, cut to `MAX_INPUT`.
+     * Outside of `nexus fuzz` the simulator ignores it.
+     */
+    bool feed(const uint8_t* data, size_t len) const {
+        // An empty write never reaches the simulator; a lone byte is too
+        // short to be a frame and starts an iteration without any.
+        static constexpr uint8_t EMPTY = 0;
+        if (len == 0) {
+            return fuzz_.write(&EMPTY, 1) == 1;
+        }
+        len = std::min(len, MAX_INPUT);
+        return fuzz_.write(data, len) == static_cast<ssize_t>(len);
+    }
+
+    /** Frames of the current iteration the protocol has not read yet. */
+    uint64_t pending() const { return fuzz_.read_u64().value_or(0); }
+
+   private:
+    Fd fuzz_;
+};
+
+}  // namespace nexus
@@ -0,0 +1,303 @@
+#pragma once
+/**
+ * A Nexus channel and its link, simulated inside one process.
+ *
+ * For tests that run protocol code millions of packets at a time, without
+ * the simulator, FUSE or cgroups (see `LoraLoopback.h`). Parameters mean what
+ * they do in a simulation config (`doc/config-reference.md`), minus anything
+ * that needs node positions:
+ *
+ * - `packet_loss` and `bit_error` are constant probabilities, as a
+ *   `rate = "0.01"` expression is. Bit errors are drawn as gaps between
+ *   flipped bits, the way the router draws them.
+ * - Transmission, processing and propagation delays are each rounded to
+ *   whole timesteps and summed, as the router does; propagation is over one
+ *   distance shared by every pair of endpoints.
+ * - On an `Exclusive` channel every receiver gets its own FIFO. On a `Shared`
+ *   one, messages waiting for a receiver when it reads collide: the read
+ *   returns their bitwise OR, marked corrupted.
+ * - `ttl`, `read_own_writes` and `max_size` as in `[channels]`.
+ *
+ * Loss and bit errors are drawn per receiver when a message is sent, from a
+ * generator seeded by `seed`, so a seed and a sequence of calls always give
+ * the same run. The draws are not the simulator's.
+ *
+ * Time is the channel's own timestep counter. It only moves when `advance`
+ * is called, or when a receive with a timeout waits on it. Not thread-safe.
+ */
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace nexus::sim {
+
+/** A link's delivery model, as set in `[links.<name>]`. */
+struct Link {
+    /** Probability a message is dropped; `packet_loss.rate`. */
+    double packet_loss = 0;
+    /** Probability each bit is flipped; `bit_error.rate`. */
+    double bit_error = 0;
+    /** `delays.transmission` in bits per second. 0 means no delay. */
+    double transmission_bps = 0;
+    /** `delays.processing` in bits per second. 0 means no delay. */
+    double processing_bps = 0;
+    /** `delays.propagation` in meters per second. 0 means no delay. */
+    double propagation_mps = 0;
+    /** Distance every message travels, in meters. */
+    double distance_m = 0;
+};
+
+enum struct Kind : uint8_t {
+    Exclusive,
+    Shared,
+};
+
+/** A channel, as set in `[channels.<name>]`. */
+struct ChannelConfig {
+    Kind kind = Kind::Exclusive;
+    Link link = {};
+    /** `params.timestep` length. */
+    std::chrono::nanoseconds timestep = std::chrono::milliseconds(1);
+    /** How long a delivered message waits to be read. 0 waits forever. */
+    std::chrono::nanoseconds ttl = std::chrono::nanoseconds(0);
+    bool read_own_writes = false;
+    size_t max_size = 4096;
+    uint64_t seed = 0;
+};
+
+class Channel {
+   public:
+    using Endpoint = uint32_t;
+
+    explicit Channel(const ChannelConfig& config = {}) : config_(config) {
+        rng_ = config.seed;
+        ttl_ = config.ttl.count() > 0 ? timesteps(config.ttl) : NEVER;
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    const ChannelConfig& config() const { return config_; }
+
+    /** Add an endpoint, which both sends and receives. */
+    Endpoint connect() {
+        mailboxes_.emplace_back();
+        return static_cast<Endpoint>(mailboxes_.size() - 1);
+    }
+
+    /** Current timestep. */
+    uint64_t now() const { return now_; }
+
+    std::chrono::nanoseconds elapsed() const {
+        return config_.timestep * static_cast<int64_t>(now_);
+    }
+
+    void advance(uint64_t timesteps = 1) { now_ += timesteps; }
+
+    /** Move time forward to `timestep`, if it is not already past it. */
+    void advance_to(uint64_t timestep) { now_ = std::max(now_, timestep); }
+
+    /** Timesteps `d` takes, rounded up. */
+    uint64_t timesteps(std::chrono::nanoseconds d) const {
+        auto len = config_.timestep.count();
+        return static_cast<uint64_t>((d.count() + len - 1) / len);
+    }
+
+    /** Timesteps a message of `len` bytes takes to arrive. */
+    uint64_t delay(size_t len) const {
+        const Link& link = config_.link;
+        double seconds =
+            std::chrono::duration<double>(config_.timestep).count();
+        double bits = 8.0 * static_cast<double>(len);
+        auto steps = [&](double rate, double amount) -> uint64_t {
+            return rate > 0 ? static_cast<uint64_t>(
+                                  std::llround(amount / rate / seconds))
+                            : 0;
+        };
+        return steps(link.transmission_bps, bits) +
+               steps(link.processing_bps, bits) +
+               steps(link.propagation_mps, link.distance_m);
+    }
+
+    /**
+     * Transmit a message from `src` to every other endpoint, and to `src`
+     * itself with `read_own_writes`.
+     *
+     * @returns (bool): False if the message is longer than `max_size`.
+     */
+    bool send(Endpoint src, const uint8_t buf[], size_t len) {
+        if (len > config_.max_size) {
+            return false;
+        }
+        uint64_t active_at = now_ + delay(len);
+        uint64_t expiration = ttl_ == NEVER ? NEVER : active_at + ttl_;
+        for (Endpoint dst = 0; dst < mailboxes_.size(); ++dst) {
+            if (dst == src && !config_.read_own_writes) {
+                continue;
+            }
+            if (uniform() < config_.link.packet_loss) {
+                continue;
+            }
+            Message msg = {active_at, expiration, false, buffer()};
+            msg.buf.assign(buf, buf + len);
+            msg.bit_errors = flip_bits(msg.buf) > 0;
+            enqueue(mailboxes_[dst], std::move(msg));
+        }
+        return true;
+    }
+
+    /**
+     * Take the next message delivered to `dst` by now, without waiting.
+     *
+     * @param buf: Receive buffer. Longer messages are truncated.
+     * @param bit_errors: Optionally set to whether the message was
+     * corrupted.
+     *
+     * @returns (ssize_t): Length of the message, or -1 if none is waiting.
+     */
+    ssize_t recv(Endpoint dst, uint8_t buf[], size_t len,
+                 bool* bit_errors = nullptr) {
+        std::deque<Message>& mailbox = mailboxes_[dst];
+        while (!mailbox.empty() && mailbox.front().active_at <= now_ &&
+               mailbox.front().expiration < now_) {
+            recycle(mailbox.front());
+            mailbox.pop_front();
+        }
+        if (mailbox.empty() || mailbox.front().active_at > now_) {
+            return -1;
+        }
+        Message& msg = mailbox.front();
+        size_t size = msg.buf.size();
+        bool corrupted = msg.bit_errors;
+        memcpy(buf, msg.buf.data(), std::min(size, len));
+        recycle(msg);
+        mailbox.pop_front();
+        if (config_.kind == Kind::Shared) {
+            // Everything else that has arrived collides with it.
+            while (!mailbox.empty() && mailbox.front().active_at <= now_) {
+                Message& other = mailbox.front();
+                if (other.expiration >= now_) {
+                    size_t n = std::min(other.buf.size(), len);
+                    for (size_t i = 0; i < n; ++i) {
+                        buf[i] = i < size ? static_cast<uint8_t>(
+                                                buf[i] | other.buf[i])
+                                          : other.buf[i];
+                    }
+                    size = std::max(size, other.buf.size());
+                    corrupted = true;
+                }
+                recycle(other);
+                mailbox.pop_front();
+            }
+        }
+        if (bit_errors != nullptr) {
+            *bit_errors = corrupted;
+        }
+        return static_cast<ssize_t>(size);
+    }
+
+    /**
+     * Timestep the next message `recv` would return for `dst` arrives at,
+     * if any; no later than now if one is waiting.
+     */
+    std::optional<uint64_t> next_delivery(Endpoint dst) const {
+        for (const Message& msg : mailboxes_[dst]) {
+            if (msg.active_at > now_ || msg.expiration >= now_) {
+                return msg.active_at;
+            }
+        }
+        return std::nullopt;
+    }
+
+   private:
+    static constexpr uint64_t NEVER = std::numeric_limits<uint64_t>::max();
+
+    struct Message {
+        uint64_t active_at;
+        uint64_t expiration;
+        bool bit_errors;
+        std::vector<uint8_t> buf;
+    };
+
+    ChannelConfig config_;
+    uint64_t ttl_;
+    uint64_t now_ = 0;
+    uint64_t rng_;
+    /** Messages in flight and delivered, per endpoint, by arrival. */
+    std::vector<std::deque<Message>> mailboxes_;
+    /** Payload buffers of read messages, reused so sends do not allocate. */
+    std::vector<std::vector<uint8_t>> spare_;
+
+    std::vector<uint8_t> buffer() {
+        if (spare_.empty()) {
+            return {};
+        }
+        std::vector<uint8_t> buf = std::move(spare_.back());
+        spare_.pop_back();
+        return buf;
+    }
+
+    void recycle(Message& msg) { spare_.push_back(std::move(msg.buf)); }
+
+    /** Messages of one size arrive in order, so this almost always appends. */
+    static void enqueue(std::deque<Message>& mailbox, Message&& msg) {
+        if (mailbox.empty() || mailbox.back().active_at <= msg.active_at) {
+            mailbox.push_back(std::move(msg));
+            return;
+        }
+        auto at = std::upper_bound(
+            mailbox.begin(), mailbox.end(), msg.active_at,
+            [](uint64_t t, const Message& m) { return t < m.active_at; });
+        mailbox.insert(at, std::move(msg));
+    }
+
+    /** splitmix64 */
+    uint64_t next() {
+        uint64_t z = (rng_ += 0x9E3779B97F4A7C15);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+        return z ^ (z >> 31);
+    }
+
+    /** Uniform in [0, 1). */
+    double uniform() { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+
+    /** Flip each bit with probability `bit_error`; returns how many. */
+    size_t flip_bits(std::vector<uint8_t>& buf) {
+        double p = config_.link.bit_error;
+        size_t bits = buf.size() * 8;
+        if (p <= 0 || bits == 0) {
+            return 0;
+        }
+        if (p >= 1) {
+            for (uint8_t& b : buf) {
+                b = static_cast<uint8_t>(~b);
+            }
+            return bits;
+        }
+        double ln_keep = std::log1p(-p);
+        size_t flipped = 0;
+        for (size_t bit = 0;; ++bit) {
+            double gap = std::log(1.0 - uniform()) / ln_keep;
+            if (gap >= static_cast<double>(bits - bit)) {
+                return flipped;
+            }
+            bit += static_cast<size_t>(gap);
+            buf[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+            ++flipped;
+        }
+    }
+};
+
+}  // namespace nexus::sim
@@ -0,0 +1,74 @@
+#pragma once
+/**
+ * `lora::Radio` backend on a channel simulated in process
+ * (`nexus::sim::Channel`), so protocol code can be tested without the
+ * simulator:
+ *
+ *     nexus::sim::Channel air({.kind = nexus::sim::Kind::Shared,
+ *                              .link = {.packet_loss = 0.1}});
+ *     lora::Radio<lora::Loopback> tx(air), rx(air);
+ *     tx.send(msg, len);
+ *     air.advance();
+ *     rx.wait_recv(buf, len, 0);
+ *
+ * Every radio constructed on a channel is one of its endpoints. Receives
+ * follow the simulator's: a timeout is measured in the channel's simulated
+ * time, and 0 polls once. Waiting moves the channel's time forward, to the
+ * next arrival or the end of the timeout, since nothing else can while the
+ * caller is blocked.
+ *
+ * `examples/arduino/loopback` exercises it; run it with `make test`.
+ */
+
+#include <chrono>
+
+#include "LinkModel.h"
+#include "LoraRadio.h"
+
+namespace lora {
+
+class Loopback {
+   public:
+    static constexpr bool HAS_BATCH = false;
+
+    explicit Loopback(nexus::sim::Channel& channel)
+        : channel_(&channel), endpoint_(channel.connect()) {}
+
+    nexus::sim::Channel::Endpoint endpoint() const { return endpoint_; }
+
+    RC init() { return RC::Okay; }
+
+    RC deinit() { return RC::Okay; }
+
+    RC send(const uint8_t buf[], size_t sz) {
+        return channel_->send(endpoint_, buf, sz) ? RC::Okay : RC::SendFailed;
+    }
+
+    RC recv(uint8_t buf[], uint8_t& len, uint32_t timeout_ms, int16_t& rssi) {
+        (void)rssi;
+        ssize_t nread = channel_->recv(endpoint_, buf, len);
+        if (nread < 0 && timeout_ms != 0) {
+            uint64_t deadline =
+                channel_->now() +
+                channel_->timesteps(std::chrono::milliseconds(timeout_ms));
+            auto next = channel_->next_delivery(endpoint_);
+            if (!next || *next > deadline) {
+                channel_->advance_to(deadline);
+                return RC::TimedOut;
+            }
+            channel_->advance_to(*next);
+            nread = channel_->recv(endpoint_, buf, len);
+        }
+        if (nread < 0) {
+            return RC::RecvFailed;
+        }
+        len = nread < len ? (uint8_t)nread : len;
+        return RC::Okay;
+    }
+
+   private:
+    nexus::sim::Channel* channel_;
+    nexus::sim::Channel::Endpoint endpoint_;
+};
+
+}  // namespace lora
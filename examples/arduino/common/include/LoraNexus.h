@@ -0,0 +1,326 @@
+#pragma once
+/**
+ * `lora::Radio` backends for a Nexus simulation, over one channel's files
+ * (`doc/simulation-files.md`).
+ *
+ * Both take the paths as a struct deriving from `lora::NexusPaths`:
+ *
+ *     struct LoraPaths : lora::NexusPaths {
+ *         static constexpr const char* ROOT = NEXUS_ROOT;
+ *         static constexpr const char* CHANNEL = NEXUS_ROOT "/lora/channel";
+ *         static constexpr const char* RECV_TIMEOUT =
+ *             NEXUS_ROOT "/lora/recv_timeout/ms";
+ *         static constexpr const char* PACKET = NEXUS_ROOT "/lora/packet";
+ *     };
+ *     lora::Radio<lora::NexusFile<LoraPaths>> radio;
+ *
+ * Files left null are not used, and the code reading them is compiled out.
+ * With `ROOT` set, paths under it are opened under `nexus::root(ROOT)`
+ * instead (`Nexus.h`).
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <optional>
+
+#include "LoraRadio.h"
+#include "Nexus.h"
+#include "ShmChannel.h"
+
+namespace lora {
+
+struct NexusPaths {
+    /** The Nexus root the paths below were built under, if any. */
+    static constexpr const char* ROOT = nullptr;
+    /** The channel file. Required. */
+    static constexpr const char* CHANNEL = nullptr;
+    /** The channel's `recv_timeout/ms` file. Required. */
+    static constexpr const char* RECV_TIMEOUT = nullptr;
+    /**
+     * Packet file: every read returns the payload behind a fixed header with
+     * the link metadata it was received with, which sets `last_rssi`.
+     */
+    static constexpr const char* PACKET = nullptr;
+    /**
+     * Framed batch file: each packet is a little-endian u32 length followed
+     * by the payload.
+     */
+    static constexpr const char* BATCH = nullptr;
+    /** The channel's `shm` file, for `NexusShm`. */
+    static constexpr const char* SHM = nullptr;
+};
+
+template <class Paths>
+class NexusFile {
+   public:
+    static_assert(Paths::CHANNEL != nullptr && Paths::RECV_TIMEOUT != nullptr,
+                  "Nexus paths need CHANNEL and RECV_TIMEOUT");
+
+    static constexpr bool HAS_BATCH = Paths::BATCH != nullptr;
+
+    RC init() {
+        channel_ = open(path(Paths::CHANNEL).c_str(), O_RDWR);
+        if (channel_ == -1) {
+            return RC::InitFailed;
+        }
+        recv_timeout_ = open(path(Paths::RECV_TIMEOUT).c_str(), O_WRONLY);
+        if (recv_timeout_ == -1) {
+            close(channel_);
+            return RC::InitFailed;
+        }
+        if constexpr (Paths::BATCH != nullptr) {
+            batch_ = open(path(Paths::BATCH).c_str(), O_RDWR);
+            if (batch_ == -1) {
+                close(recv_timeout_);
+                close(channel_);
+                return RC::InitFailed;
+            }
+        }
+        if constexpr (Paths::PACKET != nullptr) {
+            packet_ = open(path(Paths::PACKET).c_str(), O_RDONLY);
+            if (packet_ == -1) {
+                if constexpr (Paths::BATCH != nullptr) {
+                    close(batch_);
+                }
+                close(recv_timeout_);
+                close(channel_);
+                return RC::InitFailed;
+            }
+        }
+        return RC::Okay;
+    }
+
+    RC deinit() {
+        // The simulator keeps the timeout per process, so clear it before
+        // the cached value is lost
+        set_recv_timeout(0);
+        if constexpr (Paths::BATCH != nullptr) {
+            close(batch_);
+            batch_ = -1;
+        }
+        if constexpr (Paths::PACKET != nullptr) {
+            close(packet_);
+            packet_ = -1;
+        }
+        if (close(recv_timeout_) == -1 || close(channel_) == -1) {
+            return RC::DeinitFailed;
+        }
+        recv_timeout_ = -1;
+        channel_ = -1;
+        return RC::Okay;
+    }
+
+    RC send(const uint8_t buf[], size_t sz) {
+        ssize_t nwritten = write(channel_, buf, sz);
+        if (nwritten < 0 || (size_t)nwritten != sz) {
+            return RC::SendFailed;
+        }
+        return RC::Okay;
+    }
+
+    RC recv(uint8_t buf[], uint8_t& len, uint32_t timeout_ms, int16_t& rssi) {
+        // The simulator parks the read until a message arrives or the
+        // timeout elapses in simulated time, so a single read is all that is
+        // needed.
+        RC rc = set_recv_timeout(timeout_ms);
+        if (rc != RC::Okay) {
+            return rc;
+        }
+        if constexpr (Paths::PACKET != nullptr) {
+            // Payload and link metadata arrive together in one read
+            uint8_t packet[PACKET_HEADER + PACKET_MAX_SIZE_BYTES];
+            ssize_t nread = read(packet_, packet, PACKET_HEADER + len);
+            if (nread >= (ssize_t)PACKET_HEADER) {
+                float dbm;
+                memcpy(&dbm, packet + PACKET_RSSI, sizeof(dbm));
+                rssi = (int16_t)std::lround(dbm);
+                size_t copied = (size_t)nread - PACKET_HEADER;
+                memcpy(buf, packet + PACKET_HEADER, copied);
+                len = (uint8_t)copied;
+                return RC::Okay;
+            }
+            return nread == 0 && timeout_ms != 0 ? RC::TimedOut
+                                                 : RC::RecvFailed;
+        } else {
+            (void)rssi;
+            ssize_t nread = read(channel_, buf, len);
+            if (nread > 0) {
+                len = (uint8_t)nread;
+                return RC::Okay;
+            }
+            return nread == 0 && timeout_ms != 0 ? RC::TimedOut
+                                                 : RC::RecvFailed;
+        }
+    }
+
+    /** One `writev` per group of up to `BATCH_MAX_PACKETS` packets. */
+    RC send_batch(const uint8_t* const bufs[], const size_t lens[], size_t n) {
+        // One length prefix and one payload iovec per packet
+        uint32_t prefixes[BATCH_MAX_PACKETS];
+        struct iovec iov[2 * BATCH_MAX_PACKETS];
+        for (size_t start = 0; start < n; start += BATCH_MAX_PACKETS) {
+            size_t count = n - start < BATCH_MAX_PACKETS ? n - start
+                                                         : BATCH_MAX_PACKETS;
+            size_t total = 0;
+            for (size_t i = 0; i < count; ++i) {
+                prefixes[i] = (uint32_t)lens[start + i];
+                iov[2 * i] = {&prefixes[i], FRAME_PREFIX};
+                iov[2 * i + 1] = {const_cast<uint8_t*>(bufs[start + i]),
+                                  lens[start + i]};
+                total += FRAME_PREFIX + lens[start + i];
+            }
+            ssize_t nwritten = writev(batch_, iov, (int)(2 * count));
+            if (nwritten < 0 || (size_t)nwritten != total) {
+                return RC::SendFailed;
+            }
+        }
+        return RC::Okay;
+    }
+
+    /** Up to `BATCH_MAX_PACKETS` packets in one read. */
+    RC recv_batch(uint8_t bufs[][PACKET_MAX_SIZE_BYTES], uint8_t lens[],
+                  size_t& n, uint32_t timeout_ms) {
+        size_t want = n < BATCH_MAX_PACKETS ? n : BATCH_MAX_PACKETS;
+        n = 0;
+        RC rc = set_recv_timeout(timeout_ms);
+        if (rc != RC::Okay) {
+            return rc;
+        }
+        ssize_t nread =
+            read(batch_, frames_, want * (FRAME_PREFIX + PACKET_MAX_SIZE_BYTES));
+        if (nread < 0) {
+            return RC::RecvFailed;
+        }
+        if (nread == 0) {
+            return timeout_ms != 0 ? RC::TimedOut : RC::RecvFailed;
+        }
+        size_t offset = 0;
+        while (n < want && offset + FRAME_PREFIX <= (size_t)nread) {
+            uint32_t sz;
+            memcpy(&sz, frames_ + offset, FRAME_PREFIX);
+            offset += FRAME_PREFIX;
+            if (offset + sz > (size_t)nread) {
+                break;
+            }
+            size_t copied =
+                sz < PACKET_MAX_SIZE_BYTES ? sz : PACKET_MAX_SIZE_BYTES;
+            memcpy(bufs[n], frames_ + offset, copied);
+            lens[n] = (uint8_t)copied;
+            offset += sz;
+            ++n;
+        }
+        return RC::Okay;
+    }
+
+    /** Where `file` is opened, after moving it under the runtime root. */
+    static nexus::Path path(const char* file) {
+        if constexpr (Paths::ROOT != nullptr) {
+            return nexus::rebase(file, Paths::ROOT);
+        } else {
+            return nexus::Path(file, {});
+        }
+    }
+
+   private:
+    static constexpr size_t FRAME_PREFIX = sizeof(uint32_t);
+    static constexpr size_t PACKET_HEADER = 32;
+    static constexpr size_t PACKET_RSSI = 0;
+    static constexpr size_t FRAMES_BYTES =
+        HAS_BATCH ? BATCH_MAX_PACKETS * (FRAME_PREFIX + PACKET_MAX_SIZE_BYTES)
+                  : 1;
+
+    int channel_ = -1;
+    int recv_timeout_ = -1;
+    int packet_ = -1;
+    int batch_ = -1;
+    // Last timeout written to the simulator, so repeated receives with the
+    // same timeout cost a single read syscall.
+    uint32_t recv_timeout_ms_ = 0;
+    uint8_t frames_[FRAMES_BYTES];
+
+    /**
+     * Configure how long (in simulated milliseconds) the simulator holds a
+     * read on the channel file before answering with zero bytes. 0 makes
+     * reads return immediately.
+     */
+    RC set_recv_timeout(uint32_t timeout_ms) {
+        if (timeout_ms == recv_timeout_ms_) {
+            return RC::Okay;
+        }
+        char val[16];
+        int sz = snprintf(val, sizeof(val), "%u", timeout_ms);
+        if (write(recv_timeout_, val, (size_t)sz) != sz) {
+            return RC::RecvFailed;
+        }
+        recv_timeout_ms_ = timeout_ms;
+        return RC::Okay;
+    }
+};
+
+/**
+ * Sends through the channel's shared-memory rings and takes anything already
+ * in them without a syscall. Falls back to `NexusFile` when the rings cannot
+ * be mapped, a send does not fit, or nothing is waiting.
+ */
+template <class Paths>
+class NexusShm {
+   public:
+    static_assert(Paths::SHM != nullptr, "NexusShm needs an SHM path");
+
+    static constexpr bool HAS_BATCH = NexusFile<Paths>::HAS_BATCH;
+
+    RC init() {
+        RC rc = file_.init();
+        if (rc != RC::Okay) {
+            return rc;
+        }
+        shm_.emplace(NexusFile<Paths>::path(Paths::SHM).c_str());
+        if (!shm_->ok()) {
+            shm_.reset();
+        }
+        return RC::Okay;
+    }
+
+    RC deinit() {
+        shm_.reset();
+        return file_.deinit();
+    }
+
+    RC send(const uint8_t buf[], size_t sz) {
+        if (shm_ && shm_->send(buf, sz)) {
+            return RC::Okay;
+        }
+        return file_.send(buf, sz);
+    }
+
+    RC recv(uint8_t buf[], uint8_t& len, uint32_t timeout_ms, int16_t& rssi) {
+        if (shm_) {
+            ssize_t nread = shm_->recv(buf, len);
+            if (nread >= 0) {
+                len = nread < len ? (uint8_t)nread : len;
+                return RC::Okay;
+            }
+        }
+        return file_.recv(buf, len, timeout_ms, rssi);
+    }
+
+    RC send_batch(const uint8_t* const bufs[], const size_t lens[], size_t n) {
+        return file_.send_batch(bufs, lens, n);
+    }
+
+    RC recv_batch(uint8_t bufs[][PACKET_MAX_SIZE_BYTES], uint8_t lens[],
+                  size_t& n, uint32_t timeout_ms) {
+        return file_.recv_batch(bufs, lens, n, timeout_ms);
+    }
+
+   private:
+    NexusFile<Paths> file_;
+    std::optional<nexus::ShmChannel> shm_;
+};
+
+}  // namespace lora
@@ -1,4 +1,29 @@
 #pragma once
+/**
+ * LoRa radio layer shared by the examples.
+ *
+ * `lora::Radio<Backend>` is the radio over one backend, picked at compile
+ * time:
+ *
+ * - `lora::Rf95<Pins>` (`LoraRf95.h`): the RFM95 module through RadioHead.
+ * - `lora::NexusFile<Paths>` (`LoraNexus.h`): a channel's simulation files.
+ * - `lora::NexusShm<Paths>` (`LoraNexus.h`): a channel's shared-memory rings,
+ *   falling back to its files.
+ * - `lora::Loopback` (`LoraLoopback.h`): a channel simulated in process, for
+ *   tests.
+ *
+ * Backends take their configuration as a struct of `static constexpr`
+ * members, so every option is resolved at compile time and the calls inline
+ * into the protocol. The free functions below drive the radio the build
+ * selects: `Rf95` on the board, and under `SIMULATE` the Nexus backend for
+ * the `NEXUS_LORA*` paths the Makefile defines.
+ *
+ * A backend provides `init`, `deinit`, `send` and `recv` (see `Radio` for
+ * the signatures) and `HAS_BATCH`, which says whether it also provides
+ * `send_batch`/`recv_batch` or `Radio` should send and receive one packet at
+ * a time.
+ */
+
 #ifndef SIMULATE
 #include <RH_RF95.h>
 #endif
@@ -11,6 +36,9 @@ namespace lora {
 // This is the maximum size in bytes allowed for the data section of the
 const size_t PACKET_MAX_SIZE_BYTES = 251;
 
+// Most packets moved by a single `send_batch`/`recv_batch` syscall.
+const size_t BATCH_MAX_PACKETS = 32;
+
 enum struct RC : uint8_t {
     Okay,
     AlreadyInit,
@@ -26,11 +54,109 @@ enum struct RC : uint8_t {
     TimedOut,
 };
 
+template <class Backend>
+class Radio {
+   public:
+    /** Arguments are passed on to the backend. */
+    template <class... Args>
+    explicit Radio(Args&&... args) : backend_(static_cast<Args&&>(args)...) {}
+
+    Radio(const Radio&) = delete;
+    Radio& operator=(const Radio&) = delete;
+
+    bool is_active() const { return initialized_; }
+
+    int16_t last_rssi() const { return last_rssi_; }
+
+    Backend& backend() { return backend_; }
+
+    RC init() {
+        RC rc = backend_.init();
+        if (rc == RC::Okay) {
+            initialized_ = true;
+        }
+        return rc;
+    }
+
+    RC deinit() {
+        if (!initialized_) {
+            return RC::NotInit;
+        }
+        RC rc = backend_.deinit();
+        if (rc == RC::Okay) {
+            initialized_ = false;
+        }
+        return rc;
+    }
+
+    /** See `lora::send`. Initializes the radio if needed. */
+    RC send(const uint8_t buf[], size_t sz) {
+        RC rc = ensure_init();
+        return rc == RC::Okay ? backend_.send(buf, sz) : rc;
+    }
+
+    /** See `lora::wait_recv`. Initializes the radio if needed. */
+    RC wait_recv(uint8_t buf[], uint8_t& len, uint32_t timeout_ms) {
+        RC rc = ensure_init();
+        return rc == RC::Okay ? backend_.recv(buf, len, timeout_ms, last_rssi_)
+                              : rc;
+    }
+
+    /** See `lora::send_batch`. */
+    RC send_batch(const uint8_t* const bufs[], const size_t lens[], size_t n) {
+        if constexpr (Backend::HAS_BATCH) {
+            RC rc = ensure_init();
+            return rc == RC::Okay ? backend_.send_batch(bufs, lens, n) : rc;
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                RC rc = send(bufs[i], lens[i]);
+                if (rc != RC::Okay) {
+                    return rc;
+                }
+            }
+            return RC::Okay;
+        }
+    }
+
+    /** See `lora::recv_batch`. */
+    RC recv_batch(uint8_t bufs[][PACKET_MAX_SIZE_BYTES], uint8_t lens[],
+                  size_t& n, uint32_t timeout_ms) {
+        if constexpr (Backend::HAS_BATCH) {
+            RC rc = ensure_init();
+            if (rc != RC::Okay) {
+                n = 0;
+                return rc;
+            }
+            return backend_.recv_batch(bufs, lens, n, timeout_ms);
+        } else {
+            size_t want = n;
+            n = 0;
+            while (n < want) {
+                uint8_t len = PACKET_MAX_SIZE_BYTES;
+                // Only the first receive waits; the rest take what is
+                // already there
+                RC rc = wait_recv(bufs[n], len, n == 0 ? timeout_ms : 0);
+                if (rc != RC::Okay) {
+                    return n == 0 ? rc : RC::Okay;
+                }
+                lens[n++] = len;
+            }
+            return RC::Okay;
+        }
+    }
+
+   private:
+    Backend backend_;
+    bool initialized_ = false;
+    int16_t last_rssi_ = 1;
+
+    RC ensure_init() { return initialized_ ? RC::Okay : init(); }
+};
+
 bool is_active();
 
-#ifdef SIMULATE
-int* get();
-#else
+#ifndef SIMULATE
+/** The RadioHead driver, or null before `init`. */
 RH_RF95* get();
 #endif
 
@@ -56,10 +182,40 @@ RC send(const uint8_t buf[], size_t sz);
  * @param buf: Receive buffer.
  * @param len: Total size of buffer. Gets set to number of bytes copied.
  * @param timeout_ms: Optional timeout in milliseconds to pass to the RF95
- * library. If equal to 0, blocks until message is received.
+ * library. If equal to 0, blocks until message is received. In simulation the
+ * timeout is measured in simulated time, and 0 polls the channel once.
  *
- * @returns (RC): Return code.
+ * @returns (RC): Return code. `TimedOut` if nothing arrived before the
+ * timeout.
  */
 RC wait_recv(uint8_t buf[], uint8_t& len, uint32_t timeout_ms);
 
+/**
+ * Send several packets at once. In simulation (with `NEXUS_LORA_BATCH`) every
+ * group of up to `BATCH_MAX_PACKETS` packets costs one syscall and goes out in
+ * the same timestep; otherwise packets are sent one at a time.
+ *
+ * @param bufs: Send buffers.
+ * @param lens: Size of each send buffer.
+ * @param n: Number of packets.
+ *
+ * @returns (RC): Return code. Stops at the first failure.
+ */
+RC send_batch(const uint8_t* const bufs[], const size_t lens[], size_t n);
+
+/**
+ * Receive every packet waiting, up to `n`. Takes the same timeout as
+ * `wait_recv`, which only applies while nothing at all is waiting.
+ *
+ * @param bufs: Receive buffers of `PACKET_MAX_SIZE_BYTES` each.
+ * @param lens: Set to the number of bytes copied into each buffer.
+ * @param n: Number of buffers. Gets set to number of packets received.
+ * @param timeout_ms: See `wait_recv`.
+ *
+ * @returns (RC): Return code. `TimedOut` if nothing arrived before the
+ * timeout.
+ */
+RC recv_batch(uint8_t bufs[][PACKET_MAX_SIZE_BYTES], uint8_t lens[], size_t& n,
+              uint32_t timeout_ms);
+
 }  // namespace lora
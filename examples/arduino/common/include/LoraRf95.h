@@ -0,0 +1,87 @@
+#pragma once
+/**
+ * `lora::Radio` backend for the RFM95 module on the board, through
+ * RadioHead's RH_RF95 driver.
+ */
+
+#include <Arduino.h>
+#include <RH_RF95.h>
+
+#include "LoraRadio.h"
+
+namespace lora {
+
+/** Wiring of the examples' boards. */
+struct Rf95Pins {
+    static constexpr uint8_t CS = 10;
+    static constexpr uint8_t INT = 2;
+    static constexpr uint8_t RST = 9;
+    static constexpr float FREQUENCY = 915.0;
+};
+
+template <class Pins = Rf95Pins>
+class Rf95 {
+   public:
+    static constexpr bool HAS_BATCH = false;
+
+    Rf95() : driver_(Pins::CS, Pins::INT) {}
+
+    RH_RF95& driver() { return driver_; }
+
+    RC init() {
+        pinMode(3, OUTPUT);
+        pinMode(5, OUTPUT);
+        digitalWrite(3, HIGH);
+        digitalWrite(5, HIGH);
+
+        pinMode(Pins::RST, OUTPUT);
+        digitalWrite(Pins::RST, HIGH);
+
+        digitalWrite(Pins::RST, LOW);
+        delay(10);
+        digitalWrite(Pins::RST, HIGH);
+        delay(10);
+
+        if (!driver_.init()) {
+            return RC::InitFailed;
+        }
+        if (!driver_.setFrequency(Pins::FREQUENCY)) {
+            return RC::SetFrequencyFailed;
+        }
+        return RC::Okay;
+    }
+
+    RC deinit() {
+        // Forfeit SPI line
+        pinMode(Pins::CS, INPUT);
+        return RC::Okay;
+    }
+
+    RC send(const uint8_t buf[], size_t sz) {
+        if (!driver_.send(buf, static_cast<uint8_t>(sz))) {
+            return RC::SendFailed;
+        }
+        if (!driver_.waitPacketSent()) {
+            return RC::TimedOut;
+        }
+        return RC::Okay;
+    }
+
+    RC recv(uint8_t buf[], uint8_t& len, uint32_t timeout_ms, int16_t& rssi) {
+        if (timeout_ms == 0) {
+            driver_.waitAvailable();
+        } else {
+            driver_.waitAvailableTimeout(timeout_ms);
+        }
+        if (!driver_.recv(buf, &len)) {
+            return RC::RecvFailed;
+        }
+        rssi = driver_.lastRssi();
+        return RC::Okay;
+    }
+
+   private:
+    RH_RF95 driver_;
+};
+
+}  // namespace lora
@@ -0,0 +1,589 @@
+#pragma once
+/**
+ * Header-only client SDK for protocols running under Nexus.
+ *
+ * Wraps the simulation files under the Nexus root (e.g. `$HOME/nexus`) so
+ * protocols stop re-implementing them:
+ *
+ * - `nexus::Clock`: simulated time, from the memory-mapped `ctl.clock` page
+ *   when available and the ASCII `ctl.elapsed`/`ctl.time` files otherwise.
+ * - `nexus::Sleep`: relative and absolute simulated sleeps.
+ * - `nexus::Energy`: remaining charge and power state.
+ * - `nexus::Channel`: send and receive on a channel, through its shared-memory
+ *   rings, `batch` file and `packet` file when present and the plain channel
+ *   file otherwise.
+ *
+ * Every class takes the root to open its files under. Pass it through
+ * `nexus::root`, so a run given a root of its own by `$NEXUS_ROOT` finds its
+ * own files instead of the ones the build pointed at.
+ *
+ * Every file is opened once when the object is constructed. Time and values
+ * are formatted into stack buffers, so the hot path never allocates. None of
+ * the classes are thread-safe.
+ *
+ * The file formats are documented in `doc/simulation-files.md`.
+ */
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include "ClockPage.h"
+#include "ShmChannel.h"
+
+namespace nexus {
+
+/**
+ * String literal usable at compile time, so paths built from a
+ * `-D NEXUS_ROOT=...` literal cost nothing at runtime:
+ *
+ *     constexpr auto ELAPSED = nexus::FixedString(NEXUS_ROOT) + "/ctl.elapsed/us";
+ *     int fd = open(ELAPSED.c_str(), O_RDONLY);
+ *
+ * Such paths stay where the build put them whatever `$NEXUS_ROOT` says.
+ */
+template <size_t N>
+struct FixedString {
+    char data[N] = {};
+
+    constexpr FixedString() = default;
+    constexpr FixedString(const char (&s)[N]) {
+        for (size_t i = 0; i < N; ++i) {
+            data[i] = s[i];
+        }
+    }
+
+    constexpr size_t size() const { return N - 1; }
+    constexpr const char* c_str() const { return data; }
+    constexpr operator std::string_view() const { return {data, N - 1}; }
+
+    template <size_t M>
+    constexpr FixedString<N + M - 1> operator+(const char (&rhs)[M]) const {
+        FixedString<N + M - 1> out;
+        for (size_t i = 0; i < N - 1; ++i) {
+            out.data[i] = data[i];
+        }
+        for (size_t i = 0; i < M; ++i) {
+            out.data[N - 1 + i] = rhs[i];
+        }
+        return out;
+    }
+};
+
+/** Path joined at runtime into a fixed buffer. Truncated paths stay empty. */
+class Path {
+   public:
+    static constexpr size_t MAX_LEN = 256;
+
+    Path(std::string_view root, std::string_view a, std::string_view b = {},
+         std::string_view c = {}) {
+        size_t used = 0;
+        for (std::string_view part : {root, a, b, c}) {
+            if (used + part.size() >= MAX_LEN) {
+                buf_[0] = '\0';
+                return;
+            }
+            memcpy(buf_.data() + used, part.data(), part.size());
+            used += part.size();
+        }
+        buf_[used] = '\0';
+    }
+
+    const char* c_str() const { return buf_.data(); }
+
+   private:
+    std::array<char, MAX_LEN> buf_ = {};
+};
+
+/** Environment variable `nexus sweep` sets to each run's root. */
+inline constexpr const char* ROOT_ENV = "NEXUS_ROOT";
+
+/**
+ * The root to open simulation files under: `$NEXUS_ROOT` when set, and
+ * `fallback`, usually the `NEXUS_ROOT` the build defined, otherwise.
+ */
+inline const char* root(const char* fallback) {
+    const char* env = getenv(ROOT_ENV);
+    return env != nullptr && env[0] != '\0' ? env : fallback;
+}
+
+/**
+ * `path`, built under the root `built`, moved under `root(built)`. Paths
+ * outside `built` are kept as they are.
+ */
+inline Path rebase(std::string_view path, const char* built) {
+    std::string_view prefix = built;
+    if (!path.starts_with(prefix)) {
+        return Path(path, {});
+    }
+    return Path(root(built), path.substr(prefix.size()));
+}
+
+/** Owned file descriptor, closed on destruction. */
+class Fd {
+   public:
+    Fd() = default;
+    Fd(const char* path, int flags) : fd_(::open(path, flags | O_CLOEXEC)) {}
+    ~Fd() { reset(); }
+
+    Fd(const Fd&) = delete;
+    Fd& operator=(const Fd&) = delete;
+    Fd(Fd&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+    Fd& operator=(Fd&& other) noexcept {
+        if (this != &other) {
+            reset();
+            fd_ = std::exchange(other.fd_, -1);
+        }
+        return *this;
+    }
+
+    bool ok() const { return fd_ >= 0; }
+    int get() const { return fd_; }
+
+    void reset() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    ssize_t read(void* buf, size_t len) const { return ::read(fd_, buf, len); }
+
+    ssize_t write(const void* buf, size_t len) const {
+        return ::write(fd_, buf, len);
+    }
+
+    /** Read an ASCII decimal value, as served by the control files. */
+    std::optional<uint64_t> read_u64() const {
+        char buf[24];
+        ssize_t n = read(buf, sizeof(buf));
+        if (n <= 0) {
+            return std::nullopt;
+        }
+        uint64_t val = 0;
+        auto [end, ec] = std::from_chars(buf, buf + n, val);
+        (void)end;
+        if (ec != std::errc()) {
+            return std::nullopt;
+        }
+        return val;
+    }
+
+    /** Write `val` as ASCII decimal in a single write. */
+    bool write_u64(uint64_t val) const {
+        char buf[24];
+        auto [end, ec] = std::to_chars(buf, buf + sizeof(buf), val);
+        if (ec != std::errc()) {
+            return false;
+        }
+        size_t len = static_cast<size_t>(end - buf);
+        return write(buf, len) == static_cast<ssize_t>(len);
+    }
+
+   private:
+    int fd_ = -1;
+};
+
+/**
+ * Simulated clock. Reads are plain loads from the `ctl.clock` page when it
+ * can be mapped, and a read of the ASCII nanosecond files otherwise.
+ */
+class Clock {
+   public:
+    explicit Clock(std::string_view root)
+        : page_(Path(root, "/ctl.clock").c_str()),
+          elapsed_(Path(root, "/ctl.elapsed/ns").c_str(), O_RDONLY),
+          time_(Path(root, "/ctl.time/ns").c_str(), O_RDWR) {}
+
+    /** Whether reads come from the memory-mapped page. */
+    bool mapped() const { return page_.ok(); }
+
+    /** Simulated time since the simulation started. */
+    std::chrono::nanoseconds elapsed() const {
+        if (page_.ok()) {
+            return std::chrono::nanoseconds(page_.now().elapsed_ns);
+        }
+        return std::chrono::nanoseconds(elapsed_.read_u64().value_or(0));
+    }
+
+    /**
+     * Simulated wall-clock time. The page always counts from the simulation
+     * start, so once this process sets its own time with `set_now` the value
+     * comes from `ctl.time` instead.
+     */
+    std::chrono::system_clock::time_point now() const {
+        uint64_t ns = page_.ok() && !time_set_
+                          ? page_.now().epoch_ns
+                          : time_.read_u64().value_or(0);
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::nanoseconds(ns)));
+    }
+
+    /** Current timestep, or 0 if the page could not be mapped. */
+    uint64_t timestep() const { return page_.ok() ? page_.now().timestep : 0; }
+
+    /** Set this process's simulated wall-clock time. */
+    bool set_now(std::chrono::system_clock::time_point t) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            t.time_since_epoch());
+        if (ns.count() < 0 ||
+            !time_.write_u64(static_cast<uint64_t>(ns.count()))) {
+            return false;
+        }
+        time_set_ = true;
+        return true;
+    }
+
+   private:
+    ClockPage page_;
+    Fd elapsed_;
+    Fd time_;
+    bool time_set_ = false;
+};
+
+/** Blocking sleeps measured in simulated time. */
+class Sleep {
+   public:
+    explicit Sleep(std::string_view root)
+        : relative_(Path(root, "/ctl.sleep.relative/ns").c_str(), O_WRONLY),
+          absolute_(Path(root, "/ctl.sleep.absolute/ns").c_str(), O_WRONLY) {}
+
+    bool ok() const { return relative_.ok() && absolute_.ok(); }
+
+    /** Block until `d` of simulated time has passed. */
+    template <class Rep, class Period>
+    bool sleep_for(std::chrono::duration<Rep, Period> d) const {
+        return write(relative_, d);
+    }
+
+    /**
+     * Block until `Clock::elapsed()` reaches `t`. Returns straight away if it
+     * already has.
+     */
+    template <class Rep, class Period>
+    bool sleep_until(std::chrono::duration<Rep, Period> t) const {
+        return write(absolute_, t);
+    }
+
+   private:
+    Fd relative_;
+    Fd absolute_;
+
+    template <class Rep, class Period>
+    static bool write(const Fd& fd, std::chrono::duration<Rep, Period> d) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d);
+        return ns.count() >= 0 &&
+               fd.write_u64(static_cast<uint64_t>(ns.count()));
+    }
+};
+
+/** Battery and power state of the node. */
+class Energy {
+   public:
+    explicit Energy(std::string_view root)
+        : left_(Path(root, "/ctl.energy_left").c_str(), O_RDONLY),
+          state_(Path(root, "/ctl.energy_state").c_str(), O_RDWR) {}
+
+    /** Remaining charge in nanojoules. */
+    std::optional<uint64_t> left_nj() const { return left_.read_u64(); }
+
+    /**
+     * Current power state name.
+     *
+     * @param buf: Storage for the name. The view points into it.
+     */
+    std::string_view state(std::span<char> buf) const {
+        ssize_t n = state_.read(buf.data(), buf.size());
+        return n > 0 ? std::string_view(buf.data(), static_cast<size_t>(n))
+                     : std::string_view();
+    }
+
+    /** Switch to the power state named `name`. */
+    bool set_state(std::string_view name) const {
+        return state_.write(name.data(), name.size()) ==
+               static_cast<ssize_t>(name.size());
+    }
+
+   private:
+    Fd left_;
+    Fd state_;
+};
+
+/** Transports `Channel` may use besides the plain channel file. */
+enum Transport : unsigned {
+    TRANSPORT_FILE = 0,
+    /** Shared-memory rings from the channel's `shm` file. */
+    TRANSPORT_SHM = 1 << 0,
+    /** Framed multi-message reads and writes on the `batch` file. */
+    TRANSPORT_BATCH = 1 << 1,
+    /** Link metadata with every read from the `packet` file. */
+    TRANSPORT_PACKET = 1 << 2,
+    TRANSPORT_ALL = TRANSPORT_SHM | TRANSPORT_BATCH | TRANSPORT_PACKET,
+};
+
+/** How a message was received. Only filled in by reads of the `packet` file. */
+struct RxInfo {
+    bool valid = false;
+    float rssi_dbm = 0;
+    float snr_db = 0;
+    uint64_t timestep = 0;
+    uint64_t msg_id = 0;
+    uint32_t src_node = 0;
+};
+
+/**
+ * A channel endpoint. Each requested transport is probed once at
+ * construction, and the fastest one that is available is used per call:
+ * shared-memory rings first, then the `packet`/`batch` files, then the
+ * channel file.
+ *
+ * @tparam MaxMsg: Largest message handled; sizes the receive buffers.
+ * @tparam MaxBatch: Most messages moved by one batch syscall.
+ */
+template <size_t MaxMsg = 256, size_t MaxBatch = 32>
+class BasicChannel {
+   public:
+    static constexpr size_t FRAME_PREFIX = sizeof(uint32_t);
+    static constexpr size_t PACKET_HEADER = 32;
+
+    BasicChannel(std::string_view root, std::string_view name,
+                 unsigned transports = TRANSPORT_ALL)
+        : data_(open_any(Path(root, "/", name, "/channel").c_str())),
+          timeout_(Path(root, "/", name, "/recv_timeout/ns").c_str(),
+                   O_WRONLY) {
+        if (transports & TRANSPORT_PACKET) {
+            packet_ = Fd(Path(root, "/", name, "/packet").c_str(), O_RDONLY);
+        }
+        if (transports & TRANSPORT_BATCH) {
+            batch_ = open_any(Path(root, "/", name, "/batch").c_str());
+        }
+        if (transports & TRANSPORT_SHM) {
+            shm_.emplace(Path(root, "/", name, "/shm").c_str());
+            if (!shm_->ok()) {
+                shm_.reset();
+            }
+        }
+    }
+
+    ~BasicChannel() {
+        // The simulator keeps the timeout per process
+        set_timeout(std::chrono::nanoseconds(0));
+    }
+
+    BasicChannel(const BasicChannel&) = delete;
+    BasicChannel& operator=(const BasicChannel&) = delete;
+
+    bool ok() const { return data_.ok(); }
+    bool has_shm() const { return shm_.has_value(); }
+    bool has_batch() const { return batch_.ok(); }
+    bool has_packet() const { return packet_.ok(); }
+
+    /** Descriptor `recv` reads from, for `poll`/`epoll`. */
+    int fd() const { return packet_.ok() ? packet_.get() : data_.get(); }
+
+    /** Transmit one message. */
+    bool send(std::span<const uint8_t> msg) {
+        if (shm_ && shm_->send(msg.data(), msg.size())) {
+            return true;
+        }
+        return data_.write(msg.data(), msg.size()) ==
+               static_cast<ssize_t>(msg.size());
+    }
+
+    /**
+     * Transmit several messages, all in the same timestep when they go
+     * through the rings or the `batch` file.
+     */
+    bool send_batch(std::span<const std::span<const uint8_t>> msgs) {
+        size_t i = 0;
+        while (shm_ && i < msgs.size() &&
+               shm_->send(msgs[i].data(), msgs[i].size())) {
+            ++i;
+        }
+        if (!batch_.ok()) {
+            for (; i < msgs.size(); ++i) {
+                if (!send(msgs[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        std::array<uint32_t, MaxBatch> prefixes;
+        std::array<struct iovec, 2 * MaxBatch> iov;
+        while (i < msgs.size()) {
+            size_t count = std::min(msgs.size() - i, MaxBatch);
+            size_t total = 0;
+            for (size_t j = 0; j < count; ++j) {
+                const auto& msg = msgs[i + j];
+                prefixes[j] = static_cast<uint32_t>(msg.size());
+                iov[2 * j] = {&prefixes[j], FRAME_PREFIX};
+                iov[2 * j + 1] = {const_cast<uint8_t*>(msg.data()), msg.size()};
+                total += FRAME_PREFIX + msg.size();
+            }
+            ssize_t n = writev(batch_.get(), iov.data(), static_cast<int>(2 * count));
+            if (n != static_cast<ssize_t>(total)) {
+                return false;
+            }
+            i += count;
+        }
+        return true;
+    }
+
+    /**
+     * Receive one message, waiting up to `timeout` of simulated time if none
+     * is queued. A zero timeout polls once.
+     *
+     * @param buf: Receive buffer. Longer messages are truncated.
+     * @param info: Optional link metadata for the message.
+     *
+     * @returns (ssize_t): Bytes received, 0 if nothing arrived, -1 on error.
+     */
+    ssize_t recv(std::span<uint8_t> buf,
+                 std::chrono::nanoseconds timeout = std::chrono::nanoseconds(0),
+                 RxInfo* info = nullptr) {
+        if (info != nullptr) {
+            info->valid = false;
+        }
+        if (shm_) {
+            ssize_t n = shm_->recv(buf.data(), buf.size());
+            if (n >= 0) {
+                return std::min(n, static_cast<ssize_t>(buf.size()));
+            }
+        }
+        if (!set_timeout(timeout)) {
+            return -1;
+        }
+        if (!packet_.ok()) {
+            return data_.read(buf.data(), buf.size());
+        }
+        size_t want = PACKET_HEADER + std::min(buf.size(), MaxMsg);
+        ssize_t n = packet_.read(rx_buf_.data(), want);
+        if (n <= 0) {
+            return n;
+        }
+        if (static_cast<size_t>(n) < PACKET_HEADER) {
+            return -1;
+        }
+        if (info != nullptr) {
+            info->valid = true;
+            memcpy(&info->rssi_dbm, rx_buf_.data() + 0, sizeof(float));
+            memcpy(&info->snr_db, rx_buf_.data() + 4, sizeof(float));
+            memcpy(&info->timestep, rx_buf_.data() + 8, sizeof(uint64_t));
+            memcpy(&info->msg_id, rx_buf_.data() + 16, sizeof(uint64_t));
+            memcpy(&info->src_node, rx_buf_.data() + 24, sizeof(uint32_t));
+        }
+        size_t len = static_cast<size_t>(n) - PACKET_HEADER;
+        memcpy(buf.data(), rx_buf_.data() + PACKET_HEADER, len);
+        return static_cast<ssize_t>(len);
+    }
+
+    /**
+     * Receive every queued message, up to `MaxBatch` when read through the
+     * `batch` file, waiting up to `timeout` only while none is queued.
+     *
+     * @param on_msg: Called with each message. The span is only valid during
+     * the call.
+     *
+     * @returns (ssize_t): Messages received, -1 on error.
+     */
+    template <class F>
+    ssize_t recv_batch(F&& on_msg, std::chrono::nanoseconds timeout =
+                                       std::chrono::nanoseconds(0)) {
+        ssize_t count = 0;
+        if (shm_) {
+            ssize_t n;
+            while ((n = shm_->recv(rx_buf_.data(), MaxMsg)) >= 0) {
+                on_msg(std::span<const uint8_t>(
+                    rx_buf_.data(), std::min(static_cast<size_t>(n), MaxMsg)));
+                ++count;
+            }
+            if (count > 0) {
+                timeout = std::chrono::nanoseconds(0);
+            }
+        }
+        if (!set_timeout(timeout)) {
+            return -1;
+        }
+        if (!batch_.ok()) {
+            std::array<uint8_t, MaxMsg> buf;
+            ssize_t n = recv(buf, timeout);
+            while (n > 0) {
+                on_msg(std::span<const uint8_t>(buf.data(), static_cast<size_t>(n)));
+                ++count;
+                n = recv(buf);
+            }
+            return n < 0 && count == 0 ? -1 : count;
+        }
+        ssize_t n = batch_.read(batch_buf_.data(), batch_buf_.size());
+        if (n < 0) {
+            return count == 0 ? -1 : count;
+        }
+        size_t end = static_cast<size_t>(n);
+        size_t offset = 0;
+        while (offset + FRAME_PREFIX <= end) {
+            uint32_t len;
+            memcpy(&len, batch_buf_.data() + offset, FRAME_PREFIX);
+            offset += FRAME_PREFIX;
+            if (offset + len > end) {
+                break;
+            }
+            on_msg(std::span<const uint8_t>(batch_buf_.data() + offset, len));
+            offset += len;
+            ++count;
+        }
+        return count;
+    }
+
+   private:
+    Fd data_;
+    Fd timeout_;
+    Fd packet_;
+    Fd batch_;
+    std::optional<ShmChannel> shm_;
+    /** Last timeout written, so unchanged timeouts cost no syscall. */
+    uint64_t timeout_ns_ = 0;
+    std::array<uint8_t, PACKET_HEADER + MaxMsg> rx_buf_;
+    std::array<uint8_t, MaxBatch*(FRAME_PREFIX + MaxMsg)> batch_buf_;
+
+    /** A channel file's access follows its publisher/subscriber roles. */
+    static Fd open_any(const char* path) {
+        for (int flags : {O_RDWR, O_RDONLY, O_WRONLY}) {
+            Fd fd(path, flags);
+            if (fd.ok()) {
+                return fd;
+            }
+        }
+        return Fd();
+    }
+
+    bool set_timeout(std::chrono::nanoseconds timeout) {
+        uint64_t ns = timeout.count() > 0 ? static_cast<uint64_t>(timeout.count())
+                                          : 0;
+        if (ns == timeout_ns_) {
+            return true;
+        }
+        if (!timeout_.write_u64(ns)) {
+            return false;
+        }
+        timeout_ns_ = ns;
+        return true;
+    }
+};
+
+using Channel = BasicChannel<>;
+
+}  // namespace nexus
@@ -0,0 +1,213 @@
+#pragma once
+/**
+ * Shared-memory transport for a Nexus channel. Reading a channel's `shm` file
+ * (e.g. `$HOME/nexus/lora/shm`) makes the simulator create a pair of rings and
+ * returns the path of the file holding them. Messages pushed here are
+ * published at the end of the current timestep, and received messages are
+ * pushed by the simulator right after delivery, so neither direction needs a
+ * FUSE request per message.
+ *
+ * The layout mirrors `kernel/src/router/shm.rs` and must be kept in sync.
+ */
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace nexus {
+
+class ShmChannel {
+   public:
+    static constexpr uint32_t MAGIC = 0x4853584E;  // "NXSH" little-endian
+    static constexpr uint32_t VERSION = 1;
+
+    /**
+     * Map the rings advertised by `shm_file`.
+     *
+     * @param shm_file: Path to the channel's `shm` control file.
+     */
+    explicit ShmChannel(const char* shm_file) {
+        char path[256];
+        int fd = open(shm_file, O_RDONLY);
+        if (fd == -1) {
+            return;
+        }
+        ssize_t n = read(fd, path, sizeof(path) - 1);
+        close(fd);
+        if (n <= 0) {
+            return;
+        }
+        path[n] = '\0';
+
+        fd = open(path, O_RDWR);
+        if (fd == -1) {
+            return;
+        }
+        void* base = mmap(nullptr, HEADER_BYTES, PROT_READ, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            close(fd);
+            return;
+        }
+        const uint32_t* header = static_cast<const uint32_t*>(base);
+        bool valid = header[0] == MAGIC && header[1] == VERSION;
+        ring_bytes_ = header[2];
+        max_msg_ = header[3];
+        munmap(base, HEADER_BYTES);
+        if (!valid) {
+            close(fd);
+            return;
+        }
+
+        len_ = HEADER_BYTES + 2 * static_cast<size_t>(ring_bytes_);
+        base = mmap(nullptr, len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            return;
+        }
+        base_ = static_cast<uint8_t*>(base);
+    }
+
+    ~ShmChannel() {
+        if (base_ != nullptr) {
+            munmap(base_, len_);
+        }
+    }
+
+    ShmChannel(const ShmChannel&) = delete;
+    ShmChannel& operator=(const ShmChannel&) = delete;
+
+    /** Whether the rings were mapped successfully. */
+    bool ok() const { return base_ != nullptr; }
+
+    /** Largest payload the channel carries. */
+    uint32_t max_msg() const { return max_msg_; }
+
+    /**
+     * Queue a message for transmission.
+     *
+     * @returns (bool): False if the message is too large or the ring is full.
+     */
+    bool send(const uint8_t buf[], size_t len) {
+        if (!ok() || len > max_msg_) {
+            return false;
+        }
+        std::atomic_ref<uint64_t> head(word(TX_HEAD));
+        std::atomic_ref<uint64_t> tail(word(TX_TAIL));
+        uint64_t h = head.load(std::memory_order_relaxed);
+        uint64_t used = h - tail.load(std::memory_order_acquire);
+        if (ring_bytes_ - used < LEN_PREFIX + len) {
+            return false;
+        }
+        uint32_t sz = static_cast<uint32_t>(len);
+        uint8_t* data = base_ + HEADER_BYTES + ring_bytes_;
+        copy_in(data, h, reinterpret_cast<const uint8_t*>(&sz), LEN_PREFIX);
+        copy_in(data, h + LEN_PREFIX, buf, len);
+        head.store(h + LEN_PREFIX + len, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Take the next received message without blocking.
+     *
+     * @param buf: Receive buffer.
+     * @param len: Size of the buffer. Longer messages are truncated.
+     *
+     * @returns (ssize_t): Length of the message, or -1 if none is waiting.
+     */
+    ssize_t recv(uint8_t buf[], size_t len) {
+        if (!ok()) {
+            return -1;
+        }
+        std::atomic_ref<uint64_t> head(word(RX_HEAD));
+        std::atomic_ref<uint64_t> tail(word(RX_TAIL));
+        uint64_t t = tail.load(std::memory_order_relaxed);
+        uint64_t available = head.load(std::memory_order_acquire) - t;
+        if (available < LEN_PREFIX) {
+            return -1;
+        }
+        const uint8_t* data = base_ + HEADER_BYTES;
+        uint32_t sz;
+        copy_out(data, t, reinterpret_cast<uint8_t*>(&sz), LEN_PREFIX);
+        if (LEN_PREFIX + sz > available) {
+            return -1;
+        }
+        copy_out(data, t + LEN_PREFIX, buf, sz < len ? sz : len);
+        tail.store(t + LEN_PREFIX + sz, std::memory_order_release);
+        return static_cast<ssize_t>(sz);
+    }
+
+    /**
+     * Block until the simulator pushes a message or `timeout_ms` of wall-clock
+     * time passes. Spurious wakeups are possible, so callers should retry
+     * `recv`.
+     *
+     * @param timeout_ms: Wall-clock timeout. 0 waits indefinitely.
+     */
+    void wait(uint32_t timeout_ms) {
+        if (!ok()) {
+            return;
+        }
+        std::atomic_ref<uint32_t> bell(doorbell());
+        uint32_t seen = bell.load(std::memory_order_acquire);
+        if (has_data()) {
+            return;
+        }
+        struct timespec ts = {static_cast<time_t>(timeout_ms / 1000),
+                              static_cast<long>(timeout_ms % 1000) * 1000000L};
+        syscall(SYS_futex, &doorbell(), FUTEX_WAIT, seen,
+                timeout_ms == 0 ? nullptr : &ts, nullptr, 0);
+    }
+
+   private:
+    static constexpr size_t HEADER_BYTES = 4096;
+    static constexpr size_t LEN_PREFIX = sizeof(uint32_t);
+    static constexpr size_t RX_HEAD = 64;
+    static constexpr size_t RX_TAIL = 128;
+    static constexpr size_t TX_HEAD = 192;
+    static constexpr size_t TX_TAIL = 256;
+    static constexpr size_t RX_DOORBELL = 320;
+
+    uint8_t* base_ = nullptr;
+    size_t len_ = 0;
+    uint32_t ring_bytes_ = 0;
+    uint32_t max_msg_ = 0;
+
+    uint64_t& word(size_t offset) {
+        return *reinterpret_cast<uint64_t*>(base_ + offset);
+    }
+
+    uint32_t& doorbell() {
+        return *reinterpret_cast<uint32_t*>(base_ + RX_DOORBELL);
+    }
+
+    bool has_data() {
+        std::atomic_ref<uint64_t> head(word(RX_HEAD));
+        std::atomic_ref<uint64_t> tail(word(RX_TAIL));
+        return head.load(std::memory_order_acquire) !=
+               tail.load(std::memory_order_relaxed);
+    }
+
+    void copy_in(uint8_t* data, uint64_t pos, const uint8_t* src, size_t n) {
+        size_t start = static_cast<size_t>(pos & (ring_bytes_ - 1));
+        size_t first = n < ring_bytes_ - start ? n : ring_bytes_ - start;
+        memcpy(data + start, src, first);
+        memcpy(data, src + first, n - first);
+    }
+
+    void copy_out(const uint8_t* data, uint64_t pos, uint8_t* dst, size_t n) {
+        size_t start = static_cast<size_t>(pos & (ring_bytes_ - 1));
+        size_t first = n < ring_bytes_ - start ? n : ring_bytes_ - start;
+        memcpy(dst, data + start, first);
+        memcpy(dst + first, data, n - first);
+    }
+};
+
+}  // namespace nexus
@@ -0,0 +1,113 @@
+#pragma once
+/**
+ * Checkpoint hooks for `nexus simulate --checkpoint-at` and `--resume-from`.
+ *
+ * Once simulated time reaches the checkpoint timestep the simulator asks
+ * every protocol for its state. Poll `nexus::Snapshot::due` from the main
+ * loop, somewhere the protocol's state is consistent, and hand it over:
+ *
+ *     nexus::Snapshot snapshot(NEXUS_ROOT);
+ *     std::vector<uint8_t> state;
+ *     if (snapshot.restore(state)) {
+ *         load_state(state);  // resumed from a checkpoint
+ *     }
+ *     while (true) {
+ *         if (snapshot.due()) {
+ *             std::vector<uint8_t> out = save_state();
+ *             snapshot.save(out.data(), out.size());
+ *         }
+ *         ...
+ *     }
+ *
+ * `save` does not return once the state is accepted: the simulator holds the
+ * process there until every other protocol has saved too and stops the
+ * simulation after writing the checkpoint. On resume the process starts
+ * from `main` again, so everything outside of the saved state (open channel
+ * files, sleeps, receive timeouts) has to be set up again as usual.
+ *
+ * The file formats are documented in `doc/simulation-files.md`.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "Nexus.h"
+
+namespace nexus {
+
+class Snapshot {
+   public:
+    explicit Snapshot(std::string_view root)
+        : checkpoint_(Path(root, "/ctl.checkpoint").c_str(), O_RDWR),
+          restore_(Path(root, "/ctl.restore").c_str(), O_RDONLY) {}
+
+    /** True when the simulator is waiting for this process's state. */
+    bool due() const {
+        char c = '0';
+        return checkpoint_.ok() && ::pread(checkpoint_.get(), &c, 1, 0) == 1 &&
+               c == '1';
+    }
+
+    /**
+     * Save `len` bytes of state. Does not return on success; returns false
+     * if no checkpoint is being taken or the simulator rejected the state.
+     */
+    bool save(const void* data, size_t len) const {
+        uint8_t header[8];
+        for (size_t i = 0; i < sizeof(header); ++i) {
+            header[i] = static_cast<uint8_t>(static_cast<uint64_t>(len) >> (8 * i));
+        }
+        return write_all(header, sizeof(header)) && write_all(data, len);
+    }
+
+    /**
+     * Read back the state this process saved in the checkpoint the
+     * simulation resumed from. Returns false when there is none.
+     */
+    bool restore(std::vector<uint8_t>& out) const {
+        out.clear();
+        if (!restore_.ok()) {
+            return false;
+        }
+        uint8_t buf[4096];
+        while (true) {
+            ssize_t n = restore_.read(buf, sizeof(buf));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            out.insert(out.end(), buf, buf + n);
+        }
+        return !out.empty();
+    }
+
+   private:
+    bool write_all(const void* data, size_t len) const {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (len > 0) {
+            ssize_t n = checkpoint_.write(p, len);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            len -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    Fd checkpoint_;
+    Fd restore_;
+};
+
+}  // namespace nexus
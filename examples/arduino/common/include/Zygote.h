@@ -0,0 +1,241 @@
+#pragma once
+/**
+ * Fork-server entry hook for protocols with `zygote = true`.
+ *
+ * The runner starts such a protocol once per distinct program and sends it a
+ * request for every deployment. Call `nexus::zygote` at the top of `main`,
+ * after whatever process-wide initialisation all deployments share:
+ *
+ *     int main(int argc, char** argv) {
+ *         load_tables();  // runs once
+ *         nexus::zygote(argc, argv);
+ *         setup();        // runs in every deployment
+ *         ...
+ *     }
+ *
+ * Started normally, `zygote` returns straight away. Started as a zygote it
+ * never returns in the zygote itself: every deployment is forked from it,
+ * and `zygote` returns in the fork with `argc`/`argv` set to that
+ * deployment's arguments and stdin, stdout and stderr replaced.
+ *
+ * The simulator tells processes apart by PID, so nothing before the hook may
+ * open files under the Nexus root. Channels, the clock and `lora::init()`
+ * belong after it.
+ *
+ * The request format is documented in `runner/src/zygote.rs`.
+ */
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace nexus {
+
+/** Environment variable holding the zygote's end of the request socket. */
+inline constexpr const char* ZYGOTE_ENV = "NEXUS_ZYGOTE_FD";
+
+namespace detail {
+
+/** Largest request the runner sends: paths and arguments. */
+inline constexpr size_t ZYGOTE_MAX_REQUEST = 64 * 1024;
+
+inline bool write_all(int fd, const void* buf, size_t len) {
+    const char* p = static_cast<const char*>(buf);
+    while (len > 0) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+inline void reply(int sock, int32_t pid_or_errno) {
+    while (::send(sock, &pid_or_errno, sizeof(pid_or_errno), MSG_NOSIGNAL) < 0 &&
+           errno == EINTR) {
+    }
+}
+
+/**
+ * Runs in the forked deployment: take over its streams, join its cgroup
+ * and wait for the simulation to start, as the runner's shell wrapper does
+ * for protocols it starts itself.
+ */
+inline void become_child(int sock, const int fds[2],
+                         const std::vector<std::string>& fields, int& argc,
+                         char**& argv) {
+    ::close(sock);
+    unsetenv(ZYGOTE_ENV);
+
+    int null = ::open("/dev/null", O_RDONLY);
+    if (null >= 0) {
+        ::dup2(null, STDIN_FILENO);
+        ::close(null);
+    }
+    ::dup2(fds[0], STDOUT_FILENO);
+    ::dup2(fds[1], STDERR_FILENO);
+    ::close(fds[0]);
+    ::close(fds[1]);
+    setvbuf(stdout, nullptr, _IONBF, 0);
+
+    const std::string& lockfile = fields[0];
+    const std::string& procs = fields[1];
+    int cgroup = ::open(procs.c_str(), O_WRONLY | O_CLOEXEC);
+    if (cgroup >= 0) {
+        std::string pid = std::to_string(::getpid());
+        write_all(cgroup, pid.data(), pid.size());
+        ::close(cgroup);
+    }
+    while (::access(lockfile.c_str(), F_OK) == 0) {
+        ::usleep(10'000);
+    }
+
+    // Owned by this process for the rest of its life.
+    static std::vector<std::string> args;
+    static std::vector<char*> ptrs;
+    args.assign(fields.begin() + 2, fields.end());
+    for (std::string& arg : args) {
+        ptrs.push_back(arg.data());
+    }
+    ptrs.push_back(nullptr);
+    argc = static_cast<int>(args.size());
+    argv = ptrs.data();
+}
+
+/**
+ * Fork one deployment. The fork happens twice so the deployment is
+ * re-parented to the runner, which waits on it like any other protocol.
+ * Returns its PID, or a negated errno.
+ */
+inline int32_t spawn(int sock, const int fds[2],
+                     const std::vector<std::string>& fields, int& argc,
+                     char**& argv, bool& in_child) {
+    int pipefd[2];
+    if (::pipe2(pipefd, O_CLOEXEC) != 0) {
+        return -errno;
+    }
+    pid_t middle = ::fork();
+    if (middle < 0) {
+        int err = errno;
+        ::close(pipefd[0]);
+        ::close(pipefd[1]);
+        return -err;
+    }
+    if (middle == 0) {
+        ::close(pipefd[0]);
+        pid_t child = ::fork();
+        if (child == 0) {
+            ::close(pipefd[1]);
+            become_child(sock, fds, fields, argc, argv);
+            in_child = true;
+            return 0;
+        }
+        int32_t result = child < 0 ? -errno : child;
+        write_all(pipefd[1], &result, sizeof(result));
+        ::_exit(0);
+    }
+    ::close(pipefd[1]);
+    int32_t result = -EPROTO;
+    if (::read(pipefd[0], &result, sizeof(result)) != sizeof(result)) {
+        result = -EPROTO;
+    }
+    ::close(pipefd[0]);
+    // Once the middle process is gone the deployment belongs to the runner.
+    while (::waitpid(middle, nullptr, 0) < 0 && errno == EINTR) {
+    }
+    return result;
+}
+
+/** Split a request into its NUL-terminated fields. */
+inline std::vector<std::string> split_fields(const char* buf, size_t len) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (buf[i] == '\0') {
+            fields.emplace_back(buf + start, i - start);
+            start = i + 1;
+        }
+    }
+    return fields;
+}
+
+}  // namespace detail
+
+/**
+ * Serve fork requests when started as a zygote, returning only in the forked
+ * deployments. Returns immediately otherwise.
+ *
+ * @param argc, argv: Replaced with the deployment's arguments in each fork.
+ */
+inline void zygote(int& argc, char**& argv) {
+    const char* env = getenv(ZYGOTE_ENV);
+    if (env == nullptr) {
+        return;
+    }
+    int sock = atoi(env);
+    std::vector<char> buf(detail::ZYGOTE_MAX_REQUEST);
+    while (true) {
+        union {
+            struct cmsghdr align;
+            char data[CMSG_SPACE(2 * sizeof(int))];
+        } control;
+        struct iovec iov = {buf.data(), buf.size()};
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.data;
+        msg.msg_controllen = sizeof(control.data);
+
+        ssize_t n = ::recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // The runner is gone; so is the simulation.
+            ::_exit(0);
+        }
+        int fds[2] = {-1, -1};
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_RIGHTS &&
+            cmsg->cmsg_len == CMSG_LEN(sizeof(fds))) {
+            memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+        }
+        std::vector<std::string> fields =
+            detail::split_fields(buf.data(), static_cast<size_t>(n));
+        if (fds[0] < 0 || fds[1] < 0 || fields.size() < 3 ||
+            (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
+            for (int fd : fds) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+            detail::reply(sock, -EINVAL);
+            continue;
+        }
+        bool in_child = false;
+        int32_t result = detail::spawn(sock, fds, fields, argc, argv, in_child);
+        if (in_child) {
+            return;
+        }
+        ::close(fds[0]);
+        ::close(fds[1]);
+        detail::reply(sock, result);
+    }
+}
+
+}  // namespace nexus
@@ -0,0 +1,115 @@
+/**
+ * loopback/src/main.cpp
+ *
+ * Drives `lora::Radio<lora::Loopback>` through sends, receives and
+ * timeouts on a channel simulated in process. Exits non-zero at the first
+ * check that fails.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "LoraLoopback.h"
+
+#define CHECK(cond)                                                    \
+    do {                                                               \
+        if (!(cond)) {                                                 \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            exit(EXIT_FAILURE);                                        \
+        }                                                              \
+    } while (0)
+
+using lora::RC;
+using Radio = lora::Radio<lora::Loopback>;
+
+namespace {
+
+void send_and_receive() {
+    nexus::sim::Channel air;
+    Radio tx(air), rx(air);
+    const uint8_t msg[] = "ping";
+    CHECK(tx.send(msg, sizeof(msg)) == RC::Okay);
+
+    uint8_t buf[lora::PACKET_MAX_SIZE_BYTES];
+    uint8_t len = sizeof(buf);
+    CHECK(rx.wait_recv(buf, len, 0) == RC::Okay);
+    CHECK(len == sizeof(msg));
+    CHECK(memcmp(buf, msg, sizeof(msg)) == 0);
+    // Without `read_own_writes` the sender hears nothing.
+    len = sizeof(buf);
+    CHECK(tx.wait_recv(buf, len, 0) == RC::RecvFailed);
+    // Each message is read once.
+    len = sizeof(buf);
+    CHECK(rx.wait_recv(buf, len, 0) == RC::RecvFailed);
+}
+
+void receive_waits_in_simulated_time() {
+    // 10 bytes at 8000 bit/s take 10 timesteps of 1 ms.
+    nexus::sim::Channel air({.link = {.transmission_bps = 8000}});
+    Radio tx(air), rx(air);
+    const uint8_t msg[10] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    CHECK(tx.send(msg, sizeof(msg)) == RC::Okay);
+
+    uint8_t buf[lora::PACKET_MAX_SIZE_BYTES];
+    uint8_t len = sizeof(buf);
+    CHECK(rx.wait_recv(buf, len, 0) == RC::RecvFailed);
+    CHECK(air.now() == 0);
+    CHECK(rx.wait_recv(buf, len, 5) == RC::TimedOut);
+    CHECK(air.now() == 5);
+    // Waiting ends at the arrival, not at the end of the timeout.
+    CHECK(rx.wait_recv(buf, len, 100) == RC::Okay);
+    CHECK(air.now() == 10);
+    CHECK(len == sizeof(msg));
+    CHECK(memcmp(buf, msg, sizeof(msg)) == 0);
+}
+
+void timeout_without_traffic() {
+    nexus::sim::Channel air;
+    Radio rx(air);
+    uint8_t buf[lora::PACKET_MAX_SIZE_BYTES];
+    uint8_t len = sizeof(buf);
+    CHECK(rx.wait_recv(buf, len, 50) == RC::TimedOut);
+    CHECK(air.now() == 50);
+}
+
+void lost_and_oversized_packets() {
+    nexus::sim::Channel lossy({.link = {.packet_loss = 1}});
+    Radio tx(lossy), rx(lossy);
+    const uint8_t msg[] = "lost";
+    CHECK(tx.send(msg, sizeof(msg)) == RC::Okay);
+    uint8_t buf[lora::PACKET_MAX_SIZE_BYTES];
+    uint8_t len = sizeof(buf);
+    CHECK(rx.wait_recv(buf, len, 20) == RC::TimedOut);
+
+    nexus::sim::Channel small({.max_size = 4});
+    Radio big(small);
+    CHECK(big.send(msg, sizeof(msg)) == RC::SendFailed);
+}
+
+void shared_senders_collide() {
+    nexus::sim::Channel air({.kind = nexus::sim::Kind::Shared});
+    Radio a(air), b(air), rx(air);
+    const uint8_t one = 0x01;
+    const uint8_t two = 0x02;
+    CHECK(a.send(&one, 1) == RC::Okay);
+    CHECK(b.send(&two, 1) == RC::Okay);
+
+    uint8_t buf[lora::PACKET_MAX_SIZE_BYTES];
+    uint8_t len = sizeof(buf);
+    CHECK(rx.wait_recv(buf, len, 0) == RC::Okay);
+    CHECK(len == 1);
+    CHECK(buf[0] == (one | two));
+    len = sizeof(buf);
+    CHECK(rx.wait_recv(buf, len, 0) == RC::RecvFailed);
+}
+
+}  // namespace
+
+int main() {
+    send_and_receive();
+    receive_waits_in_simulated_time();
+    timeout_without_traffic();
+    lost_and_oversized_packets();
+    shared_senders_collide();
+    printf("loopback: all checks passed\n");
+}
@@ -1,6 +1,11 @@
 #include "LoraRadio.h"
 #ifdef SIMULATE
 #include <iostream>
+
+#include "Zygote.h"
+#ifdef NEXUS_FUZZ
+#include "Fuzz.h"
+#endif
 #else
 #include <Wire.h>
 #include <Arduino.h>
@@ -62,8 +67,23 @@ void loop() {
     }
 }
 
-#ifdef SIMULATE
-int main() {
+#if defined(SIMULATE) && defined(NEXUS_FUZZ)
+// Built with `make build FUZZ=1` for `nexus fuzz`: libFuzzer runs every
+// input through `loop` inside this one process.
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static nexus::Fuzz fuzz(nexus::root(NEXUS_ROOT));
+    static bool ready = (setup(), true);
+    (void)ready;
+    fuzz.feed(data, size);
+    while (fuzz.pending() > 0) {
+        loop();
+    }
+    return 0;
+}
+#elif defined(SIMULATE)
+int main(int argc, char** argv) {
+    // Deployments fork from here under `zygote = true`.
+    nexus::zygote(argc, argv);
     setup();
     while (true) {
         loop();
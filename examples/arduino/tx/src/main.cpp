@@ -1,6 +1,8 @@
 #include "LoraRadio.h"
 #ifdef SIMULATE
 #include <iostream>
+
+#include "Zygote.h"
 #else
 #include <Wire.h>
 #include <Arduino.h>
@@ -65,7 +67,9 @@ void loop() {
 }
 
 #ifdef SIMULATE
-int main() {
+int main(int argc, char** argv) {
+    // Deployments fork from here under `zygote = true`.
+    nexus::zygote(argc, argv);
     setup();
     while (true) {
         loop();
@@ -0,0 +1,155 @@
+#pragma once
+/**
+ * Helpers shared by the benchmark protocols.
+ *
+ * Every benchmark runs its measurement loop for `--duration-ns` of simulated
+ * time, prints one `bench,<metric>,<value>` line per result on stdout, and
+ * then sleeps until the simulation ends. `nexus bench` collects those lines
+ * from the captured output; a protocol that exited instead would end the
+ * simulation for everyone else.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "Nexus.h"
+
+namespace bench {
+
+/** Largest message any benchmark sends, the channel default. */
+inline constexpr size_t MAX_MSG = 4096;
+
+using Channel = nexus::BasicChannel<MAX_MSG>;
+using WallClock = std::chrono::steady_clock;
+
+struct Args {
+    /** Message size in bytes. */
+    size_t size = 32;
+    /** Simulated time to measure for. */
+    std::chrono::nanoseconds duration = std::chrono::seconds(1);
+};
+
+/**
+ * Parse `--size=<bytes>` and `--duration-ns=<ns>` from anywhere in argv.
+ * Values that are not numbers (e.g. an unsubstituted `{size}` placeholder
+ * when a scenario is run with `nexus simulate`) keep the default.
+ */
+inline Args parse_args(int argc, char** argv) {
+    Args args;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg(argv[i]);
+        uint64_t val;
+        auto value = [&](std::string_view flag) {
+            if (!arg.starts_with(flag)) {
+                return false;
+            }
+            std::string_view rest = arg.substr(flag.size());
+            auto [end, ec] =
+                std::from_chars(rest.data(), rest.data() + rest.size(), val);
+            return ec == std::errc() && end == rest.data() + rest.size();
+        };
+        if (value("--size=")) {
+            args.size = std::clamp<size_t>(val, sizeof(uint64_t) * 2, MAX_MSG);
+        } else if (value("--duration-ns=")) {
+            args.duration = std::chrono::nanoseconds(val);
+        }
+    }
+    return args;
+}
+
+/** First positional argument, used to pick a protocol's role. */
+inline std::string_view role(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (!std::string_view(argv[i]).starts_with("--")) {
+            return argv[i];
+        }
+    }
+    return {};
+}
+
+inline void report(const char* metric, uint64_t value) {
+    printf("bench,%s,%" PRIu64 "\n", metric, value);
+}
+
+inline void report(const char* metric, double value) {
+    printf("bench,%s,%.3f\n", metric, value);
+}
+
+/** `count` per second of `elapsed`. */
+inline double rate(uint64_t count, WallClock::duration elapsed) {
+    double s = std::chrono::duration<double>(elapsed).count();
+    return s > 0 ? static_cast<double>(count) / s : 0;
+}
+
+/** Latency samples, reported as count and p50/p99/max. */
+class Samples {
+   public:
+    explicit Samples(size_t reserve = 1 << 16) { values_.reserve(reserve); }
+
+    void add(uint64_t value) { values_.push_back(value); }
+    size_t size() const { return values_.size(); }
+
+    /** Report `<prefix>_count` and, if anything was recorded,
+     * `<prefix>_p50`/`_p99`/`_max`. */
+    void report(const char* prefix) {
+        char metric[64];
+        snprintf(metric, sizeof(metric), "%s_count", prefix);
+        bench::report(metric, static_cast<uint64_t>(values_.size()));
+        if (values_.empty()) {
+            return;
+        }
+        std::sort(values_.begin(), values_.end());
+        snprintf(metric, sizeof(metric), "%s_p50", prefix);
+        bench::report(metric, at(0.50));
+        snprintf(metric, sizeof(metric), "%s_p99", prefix);
+        bench::report(metric, at(0.99));
+        snprintf(metric, sizeof(metric), "%s_max", prefix);
+        bench::report(metric, values_.back());
+    }
+
+   private:
+    std::vector<uint64_t> values_;
+
+    uint64_t at(double q) const {
+        size_t i = static_cast<size_t>(q * static_cast<double>(values_.size() - 1));
+        return values_[i];
+    }
+};
+
+inline uint64_t ns(std::chrono::nanoseconds d) {
+    return d.count() > 0 ? static_cast<uint64_t>(d.count()) : 0;
+}
+
+inline uint64_t wall_ns() {
+    return ns(WallClock::now().time_since_epoch());
+}
+
+/** Sleep in simulated time until the simulation is torn down. */
+[[noreturn]] inline void park(const nexus::Sleep& sleep) {
+    for (;;) {
+        if (!sleep.sleep_for(std::chrono::hours(1))) {
+            pause();
+        }
+    }
+}
+
+/** Exit with a message if `ok` is false; used for setup failures. */
+inline void require(bool ok, const char* what) {
+    if (!ok) {
+        fprintf(stderr, "bench: %s\n", what);
+        exit(EXIT_FAILURE);
+    }
+}
+
+}  // namespace bench
@@ -0,0 +1,64 @@
+/**
+ * bench/src/clock.cpp
+ *
+ * Cost of reading simulated time. For the first half of `--duration-ns`
+ * this reads the memory-mapped `ctl.clock` page in a tight loop, and for
+ * the second half it reads `ctl.elapsed/ns`, which goes through FUSE and
+ * the router on every call. The loop condition still reads the page, which
+ * costs next to nothing in comparison.
+ *
+ * Metrics: page_mapped, page_reads, page_reads_per_wall_s, file_reads,
+ * file_reads_per_wall_s, file_errors.
+ */
+#include <fcntl.h>
+
+#include "Bench.h"
+
+namespace {
+
+void page(const bench::Args& args, const nexus::Clock& clock) {
+    auto until = args.duration / 2;
+    uint64_t reads = 0;
+    auto start = bench::WallClock::now();
+    while (clock.elapsed() < until) {
+        ++reads;
+    }
+    auto elapsed = bench::WallClock::now() - start;
+    bench::report("page_mapped", static_cast<uint64_t>(clock.mapped()));
+    bench::report("page_reads", reads);
+    bench::report("page_reads_per_wall_s", bench::rate(reads, elapsed));
+}
+
+void file(const bench::Args& args, const nexus::Clock& clock) {
+    nexus::Fd elapsed(
+        nexus::Path(nexus::root(NEXUS_ROOT), "/ctl.elapsed/ns").c_str(),
+        O_RDONLY);
+    bench::require(elapsed.ok(), "open ctl.elapsed/ns failed");
+    uint64_t reads = 0;
+    uint64_t errors = 0;
+    auto start = bench::WallClock::now();
+    while (clock.elapsed() < args.duration) {
+        if (elapsed.read_u64()) {
+            ++reads;
+        } else {
+            ++errors;
+        }
+    }
+    auto wall = bench::WallClock::now() - start;
+    bench::report("file_reads", reads);
+    bench::report("file_reads_per_wall_s", bench::rate(reads, wall));
+    bench::report("file_errors", errors);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    setbuf(stdout, NULL);
+    bench::Args args = bench::parse_args(argc, argv);
+    nexus::Clock clock(nexus::root(NEXUS_ROOT));
+    nexus::Sleep sleep(nexus::root(NEXUS_ROOT));
+    bench::require(sleep.ok(), "open sleep control files failed");
+    page(args, clock);
+    file(args, clock);
+    bench::park(sleep);
+}
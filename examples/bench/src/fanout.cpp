@@ -0,0 +1,82 @@
+/**
+ * bench/src/fanout.cpp
+ *
+ * One-to-many delivery on a shared channel. The `source` role broadcasts a
+ * stamped message on `air` once per millisecond of simulated time; every
+ * `rx` role receives it and records how long delivery took. Wall-clock
+ * stamps come from CLOCK_MONOTONIC, which every process on the host shares.
+ *
+ * Metrics (source): sent.
+ * Metrics (rx): delivery_wall_ns_*, delivery_sim_ns_*.
+ */
+#include <array>
+
+#include "Bench.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+struct Header {
+    uint64_t sent_wall_ns;
+    uint64_t sent_sim_ns;
+};
+
+constexpr auto INTERVAL = 1ms;
+
+void source(const bench::Args& args, const nexus::Clock& clock,
+            const nexus::Sleep& sleep) {
+    bench::Channel tx(nexus::root(NEXUS_ROOT), "air");
+    bench::require(tx.ok(), "open air channel failed");
+    std::array<uint8_t, bench::MAX_MSG> msg{};
+    uint64_t sent = 0;
+    while (clock.elapsed() < args.duration) {
+        Header header = {bench::wall_ns(), bench::ns(clock.elapsed())};
+        memcpy(msg.data(), &header, sizeof(header));
+        if (tx.send(std::span<const uint8_t>(msg.data(), args.size))) {
+            ++sent;
+        }
+        sleep.sleep_for(INTERVAL);
+    }
+    bench::report("sent", sent);
+    bench::park(sleep);
+}
+
+void rx(const bench::Args& args, const nexus::Clock& clock,
+        const nexus::Sleep& sleep) {
+    bench::Channel rx(nexus::root(NEXUS_ROOT), "air");
+    bench::require(rx.ok(), "open air channel failed");
+    std::array<uint8_t, bench::MAX_MSG> buf;
+    bench::Samples wall;
+    bench::Samples sim;
+    while (clock.elapsed() < args.duration) {
+        ssize_t n = rx.recv(buf, 10ms);
+        if (n < static_cast<ssize_t>(sizeof(Header))) {
+            continue;
+        }
+        uint64_t now_wall = bench::wall_ns();
+        uint64_t now_sim = bench::ns(clock.elapsed());
+        Header header;
+        memcpy(&header, buf.data(), sizeof(header));
+        wall.add(now_wall - header.sent_wall_ns);
+        sim.add(now_sim - header.sent_sim_ns);
+    }
+    wall.report("delivery_wall_ns");
+    sim.report("delivery_sim_ns");
+    bench::park(sleep);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    setbuf(stdout, NULL);
+    bench::Args args = bench::parse_args(argc, argv);
+    nexus::Clock clock(nexus::root(NEXUS_ROOT));
+    nexus::Sleep sleep(nexus::root(NEXUS_ROOT));
+    bench::require(sleep.ok(), "open sleep control files failed");
+    if (bench::role(argc, argv) == "source") {
+        source(args, clock, sleep);
+    } else {
+        rx(args, clock, sleep);
+    }
+}
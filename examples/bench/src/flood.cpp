@@ -0,0 +1,79 @@
+/**
+ * bench/src/flood.cpp
+ *
+ * Transmit throughput. Each `tx` role writes `--size` byte messages to the
+ * exclusive `flood` channel as fast as it can, like `examples/arduino/tx`
+ * without the pacing. The `sink` role drains the channel in batches and
+ * counts what arrives.
+ *
+ * Metrics (tx): sent, sent_per_wall_s, send_errors.
+ * Metrics (sink): received, received_bytes, received_per_wall_s.
+ */
+#include <array>
+
+#include "Bench.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+void sink(const bench::Args& args, const nexus::Clock& clock,
+          const nexus::Sleep& sleep) {
+    bench::Channel rx(nexus::root(NEXUS_ROOT), "flood");
+    bench::require(rx.ok(), "open flood channel failed");
+    uint64_t received = 0;
+    uint64_t bytes = 0;
+    auto start = bench::WallClock::now();
+    while (clock.elapsed() < args.duration) {
+        rx.recv_batch(
+            [&](std::span<const uint8_t> msg) {
+                ++received;
+                bytes += msg.size();
+            },
+            10ms);
+    }
+    auto elapsed = bench::WallClock::now() - start;
+    bench::report("received", received);
+    bench::report("received_bytes", bytes);
+    bench::report("received_per_wall_s", bench::rate(received, elapsed));
+    bench::park(sleep);
+}
+
+void tx(const bench::Args& args, const nexus::Clock& clock,
+        const nexus::Sleep& sleep) {
+    bench::Channel tx(nexus::root(NEXUS_ROOT), "flood");
+    bench::require(tx.ok(), "open flood channel failed");
+    std::array<uint8_t, bench::MAX_MSG> msg{};
+    std::span<const uint8_t> payload(msg.data(), args.size);
+    uint64_t sent = 0;
+    uint64_t errors = 0;
+    auto start = bench::WallClock::now();
+    while (clock.elapsed() < args.duration) {
+        memcpy(msg.data(), &sent, sizeof(sent));
+        if (tx.send(payload)) {
+            ++sent;
+        } else {
+            ++errors;
+        }
+    }
+    auto elapsed = bench::WallClock::now() - start;
+    bench::report("sent", sent);
+    bench::report("sent_per_wall_s", bench::rate(sent, elapsed));
+    bench::report("send_errors", errors);
+    bench::park(sleep);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    setbuf(stdout, NULL);
+    bench::Args args = bench::parse_args(argc, argv);
+    nexus::Clock clock(nexus::root(NEXUS_ROOT));
+    nexus::Sleep sleep(nexus::root(NEXUS_ROOT));
+    bench::require(sleep.ok(), "open sleep control files failed");
+    if (bench::role(argc, argv) == "sink") {
+        sink(args, clock, sleep);
+    } else {
+        tx(args, clock, sleep);
+    }
+}
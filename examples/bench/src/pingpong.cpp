@@ -0,0 +1,104 @@
+/**
+ * bench/src/pingpong.cpp
+ *
+ * Round-trip latency over exclusive channels. The `pong` role echoes every
+ * message it reads on `ping` back on `pong`. Each `ping` role sends one
+ * message, waits for its own echo (every pinger subscribes to `pong` and
+ * sees everyone's), and records the round trip in wall-clock and simulated
+ * time.
+ *
+ * Metrics (ping): rtt_wall_ns_*, rtt_sim_ns_*, lost.
+ * Metrics (pong): echoed.
+ */
+#include <unistd.h>
+
+#include <array>
+
+#include "Bench.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+struct Header {
+    uint32_t pid;
+    uint32_t seq;
+    uint64_t sent_wall_ns;
+};
+
+/** How long a pinger waits for its echo before counting it lost. */
+constexpr auto ECHO_TIMEOUT = 100ms;
+
+void pong(const bench::Args& args, const nexus::Clock& clock,
+          const nexus::Sleep& sleep) {
+    bench::Channel rx(nexus::root(NEXUS_ROOT), "ping");
+    bench::Channel tx(nexus::root(NEXUS_ROOT), "pong");
+    bench::require(rx.ok() && tx.ok(), "open ping/pong channels failed");
+    std::array<uint8_t, bench::MAX_MSG> buf;
+    uint64_t echoed = 0;
+    while (clock.elapsed() < args.duration) {
+        ssize_t n = rx.recv(buf, 10ms);
+        if (n > 0) {
+            tx.send(std::span<const uint8_t>(buf.data(), static_cast<size_t>(n)));
+            ++echoed;
+        }
+    }
+    bench::report("echoed", echoed);
+    bench::park(sleep);
+}
+
+void ping(const bench::Args& args, const nexus::Clock& clock,
+          const nexus::Sleep& sleep) {
+    bench::Channel tx(nexus::root(NEXUS_ROOT), "ping");
+    bench::Channel rx(nexus::root(NEXUS_ROOT), "pong");
+    bench::require(rx.ok() && tx.ok(), "open ping/pong channels failed");
+    std::array<uint8_t, bench::MAX_MSG> msg{};
+    std::array<uint8_t, bench::MAX_MSG> buf;
+    bench::Samples rtt_wall;
+    bench::Samples rtt_sim;
+    uint64_t lost = 0;
+    Header header = {static_cast<uint32_t>(getpid()), 0, 0};
+    while (clock.elapsed() < args.duration) {
+        ++header.seq;
+        header.sent_wall_ns = bench::wall_ns();
+        auto sent_sim = clock.elapsed();
+        memcpy(msg.data(), &header, sizeof(header));
+        tx.send(std::span<const uint8_t>(msg.data(), args.size));
+
+        bool answered = false;
+        while (!answered && clock.elapsed() - sent_sim < ECHO_TIMEOUT) {
+            ssize_t n = rx.recv(buf, ECHO_TIMEOUT);
+            if (n < static_cast<ssize_t>(sizeof(Header))) {
+                continue;
+            }
+            Header echo;
+            memcpy(&echo, buf.data(), sizeof(echo));
+            answered = echo.pid == header.pid && echo.seq == header.seq;
+        }
+        if (answered) {
+            rtt_wall.add(bench::wall_ns() - header.sent_wall_ns);
+            rtt_sim.add(bench::ns(clock.elapsed() - sent_sim));
+        } else {
+            ++lost;
+        }
+    }
+    rtt_wall.report("rtt_wall_ns");
+    rtt_sim.report("rtt_sim_ns");
+    bench::report("lost", lost);
+    bench::park(sleep);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    setbuf(stdout, NULL);
+    bench::Args args = bench::parse_args(argc, argv);
+    nexus::Clock clock(nexus::root(NEXUS_ROOT));
+    nexus::Sleep sleep(nexus::root(NEXUS_ROOT));
+    bench::require(sleep.ok(), "open sleep control files failed");
+    if (bench::role(argc, argv) == "pong") {
+        pong(args, clock, sleep);
+    } else {
+        ping(args, clock, sleep);
+    }
+}
@@ -0,0 +1,44 @@
+/**
+ * bench/src/sleep.cpp
+ *
+ * Sleep precision. Repeatedly sleeps for one timestep's worth of simulated
+ * time and records how far past the requested wake-up the clock was, along
+ * with how much wall-clock time each sleep took.
+ *
+ * Metrics: overshoot_sim_ns_*, interval_wall_ns_*, sleep_errors.
+ */
+#include "Bench.h"
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr auto INTERVAL = 1ms;
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    setbuf(stdout, NULL);
+    bench::Args args = bench::parse_args(argc, argv);
+    nexus::Clock clock(nexus::root(NEXUS_ROOT));
+    nexus::Sleep sleep(nexus::root(NEXUS_ROOT));
+    bench::require(sleep.ok(), "open sleep control files failed");
+
+    bench::Samples overshoot;
+    bench::Samples wall;
+    uint64_t errors = 0;
+    while (clock.elapsed() < args.duration) {
+        auto target = clock.elapsed() + INTERVAL;
+        auto start = bench::WallClock::now();
+        if (!sleep.sleep_for(INTERVAL)) {
+            ++errors;
+            continue;
+        }
+        wall.add(bench::ns(bench::WallClock::now() - start));
+        overshoot.add(bench::ns(clock.elapsed() - target));
+    }
+    overshoot.report("overshoot_sim_ns");
+    wall.report("interval_wall_ns");
+    bench::report("sleep_errors", errors);
+    bench::park(sleep);
+}
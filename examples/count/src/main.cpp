@@ -4,6 +4,8 @@
 #include <sys/time.h>
 #include <time.h>
 #include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 
 int64_t COUNTER = 0;
 volatile bool CONTINUE = true;
@@ -14,7 +16,7 @@ void alarm_handler(int signum) {
     }
 }
 
-int main() {
+int main(int argc, char** argv) {
     // Nexus tears down protocols with SIGKILL; without this, our final
     // printf can sit in libc's pipe-buffered FILE buffer and be lost.
     setbuf(stdout, NULL);
@@ -29,5 +31,12 @@ int main() {
         COUNTER += 1;
     }
     printf("%ld", COUNTER);
+    // `nexus calibrate` runs several probes at once; exiting would end the
+    // simulation before slower ones have printed, so wait to be torn down.
+    if (argc > 1 && strcmp(argv[1], "--hold") == 0) {
+        for (;;) {
+            pause();
+        }
+    }
     return 0;
 }
@@ -1,7 +1,8 @@
 /**
  * elapsed/src/main.cpp
  *
- * Read from the "elapsed" file.
+ * Read from the "elapsed" files, and compare against the memory-mapped
+ * clock page.
  */
 #include <fcntl.h>
 #include <stddef.h>
@@ -11,31 +12,37 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "Nexus.h"
+
 #define NFILES 3
 
 int FDS[NFILES];
-const char* PATHS[NFILES] = {
-    NEXUS_ROOT "/ctl.elapsed/s",
-    NEXUS_ROOT "/ctl.elapsed/ms",
-    NEXUS_ROOT "/ctl.elapsed/us",
+nexus::Path PATHS[NFILES] = {
+    nexus::Path(nexus::root(NEXUS_ROOT), "/ctl.elapsed/s"),
+    nexus::Path(nexus::root(NEXUS_ROOT), "/ctl.elapsed/ms"),
+    nexus::Path(nexus::root(NEXUS_ROOT), "/ctl.elapsed/us"),
 };
 
 void open_files();
 void read_files();
+void read_clock(const nexus::ClockPage& clock);
 
 int main() {
     setbuf(stdout, NULL);
     open_files();
+    nexus::ClockPage clock(
+        nexus::Path(nexus::root(NEXUS_ROOT), "/ctl.clock").c_str());
     for (size_t i = 0; i < 3; ++i) {
         read_files();
+        read_clock(clock);
         sleep(1);
     }
 }
 
 void open_files() {
     for (size_t i = 0; i < NFILES; ++i) {
-        printf("Opening file at %s\n", PATHS[i]);
-        int fd = open(PATHS[i], O_RDONLY);
+        printf("Opening file at %s\n", PATHS[i].c_str());
+        int fd = open(PATHS[i].c_str(), O_RDONLY);
         if (fd < 0) {
             fprintf(stderr, "Error opening elapsed file.");
             exit(EXIT_FAILURE);
@@ -55,7 +62,19 @@ void read_files() {
         buf[nread] = '\0';
         char* nptr = NULL;
         uint64_t ms_since_epoch = strtoull(buf, &nptr, 10);
-        printf("%s Elapsed: %llu\n", PATHS[i],
+        printf("%s Elapsed: %llu\n", PATHS[i].c_str(),
                (unsigned long long)ms_since_epoch);
     }
 }
+
+void read_clock(const nexus::ClockPage& clock) {
+    if (!clock.ok()) {
+        fprintf(stderr, "Error mapping clock page.");
+        exit(EXIT_FAILURE);
+    }
+    nexus::ClockPage::Reading now = clock.now();
+    printf("Clock page: timestep %llu, elapsed %llu ns, epoch %llu ns\n",
+           (unsigned long long)now.timestep,
+           (unsigned long long)now.elapsed_ns,
+           (unsigned long long)now.epoch_ns);
+}
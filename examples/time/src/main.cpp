@@ -15,6 +15,8 @@
 #include <cassert>
 #include <cstdlib>
 
+#include "Nexus.h"
+
 #define NFILES 3
 #define SECONDS 0
 #define MILLIS 1
@@ -27,10 +29,10 @@
 #define JAN_1_2026_US 1767225600000000
 
 int FDS[NFILES];
-const char* PATHS[NFILES] = {
-    NEXUS_ROOT "/ctl.time/s",
-    NEXUS_ROOT "/ctl.time/ms",
-    NEXUS_ROOT "/ctl.time/us",
+nexus::Path PATHS[NFILES] = {
+    nexus::Path(nexus::root(NEXUS_ROOT), "/ctl.time/s"),
+    nexus::Path(nexus::root(NEXUS_ROOT), "/ctl.time/ms"),
+    nexus::Path(nexus::root(NEXUS_ROOT), "/ctl.time/us"),
 };
 
 void open_files();
@@ -58,8 +60,8 @@ int main() {
 
 void open_files() {
     for (size_t i = 0; i < NFILES; ++i) {
-        printf("Opening file at %s\n", PATHS[i]);
-        int fd = open(PATHS[i], O_RDWR);
+        printf("Opening file at %s\n", PATHS[i].c_str());
+        int fd = open(PATHS[i].c_str(), O_RDWR);
         if (fd < 0) {
             fprintf(stderr, "Error opening time file.");
             exit(EXIT_FAILURE);
@@ -84,7 +86,7 @@ uint64_t read_file(int fd) {
 void read_files() {
     for (size_t i = 0; i < NFILES; ++i) {
         uint64_t val = read_file(FDS[i]);
-        printf("%s Epoch: %llu\n", PATHS[i], (unsigned long long)val);
+        printf("%s Epoch: %llu\n", PATHS[i].c_str(), (unsigned long long)val);
     }
 }
 void write_time(size_t index, uint64_t val) {
@@ -1,8 +1,11 @@
-//! Microbenchmark contrasting linear-scan vs hashmap entry lookup.
+//! Microbenchmarks for the per-syscall lookups in `NexusFs`.
 //!
-//! Models `NexusFs::lookup` which today scans `entries: Vec<FsEntry>` to
-//! find an (parent_inode, name) match. With M total entries (= sum across
-//! all PIDs of control + channel files), each FUSE syscall pays O(M).
+//! 1. Entry lookup: a linear scan of `entries: Vec<FsEntry>` for an
+//!    (parent_inode, name) match, against the hash index `NexusFs::lookup`
+//!    uses. With M total entries (= sum across all PIDs of control + channel
+//!    files), a scan makes each syscall O(M).
+//! 2. Buffer lookup: the `(PID, entry_index)`-keyed map every read and write
+//!    went through, against the per-PID dense tables that replaced it.
 //!
 //! Run with: `cargo run --release -p fuse --bin lookup_bench`
 
@@ -102,6 +105,71 @@ fn bench_hashmap(
     t0.elapsed().as_nanos()
 }
 
+/// Buffers the way `FileTable` holds them: one dense vector per PID.
+fn build_dense(pids: u32, files: usize) -> HashMap<u32, Vec<Option<u64>>> {
+    (0..pids)
+        .map(|pid| (pid, (0..files).map(|i| Some(i as u64)).collect()))
+        .collect()
+}
+
+fn build_keyed(pids: u32, files: usize) -> HashMap<(u32, usize), u64> {
+    (0..pids)
+        .flat_map(|pid| (0..files).map(move |i| ((pid, i), i as u64)))
+        .collect()
+}
+
+fn bench_keyed(map: &HashMap<(u32, usize), u64>, queries: &[(u32, usize)], iters: u32) -> u128 {
+    let t0 = Instant::now();
+    let mut sink: u64 = 0;
+    for _ in 0..iters {
+        for key in queries {
+            if let Some(&v) = map.get(key) {
+                sink ^= v;
+            }
+        }
+    }
+    std::hint::black_box(sink);
+    t0.elapsed().as_nanos()
+}
+
+fn bench_dense(map: &HashMap<u32, Vec<Option<u64>>>, queries: &[(u32, usize)], iters: u32) -> u128 {
+    let t0 = Instant::now();
+    let mut sink: u64 = 0;
+    for _ in 0..iters {
+        for (pid, index) in queries {
+            if let Some(&Some(v)) = map.get(pid).and_then(|files| files.get(*index)) {
+                sink ^= v;
+            }
+        }
+    }
+    std::hint::black_box(sink);
+    t0.elapsed().as_nanos()
+}
+
+fn buffer_bench() {
+    println!("\n# FUSE buffer lookup microbenchmark");
+    println!("# pids  files  keyed_ns/q  dense_ns/q  speedup");
+    for &(pids, chans) in &[(10u32, 2usize), (100, 2), (500, 4), (1000, 4), (2000, 4)] {
+        // ~30 control files plus a directory's worth of files per channel
+        let files = 30 + chans * 12;
+        let keyed = build_keyed(pids, files);
+        let dense = build_dense(pids, files);
+        let queries: Vec<(u32, usize)> = (0..64)
+            .map(|i| ((i * 7919) % pids, (i as usize * 31) % files))
+            .collect();
+        let iters = 20_000;
+        let k = bench_keyed(&keyed, &queries, iters);
+        let d = bench_dense(&dense, &queries, iters);
+        let total_q = (queries.len() as u128) * (iters as u128);
+        let speedup = k as f64 / d.max(1) as f64;
+        println!(
+            "  {pids:>4}  {files:>5}  {:>10}  {:>10}  {speedup:>6.1}x",
+            k / total_q,
+            d.max(1) / total_q
+        );
+    }
+}
+
 fn main() {
     println!("# FUSE entry lookup microbenchmark");
     println!("# nodes  chans  entries  q/iter  linear_ns/q  hashmap_ns/q  speedup");
@@ -130,4 +198,5 @@ fn main() {
             entries.len()
         );
     }
+    buffer_bench();
 }
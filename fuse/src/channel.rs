@@ -39,6 +39,16 @@ impl ChannelMode {
             (false, false) => Self::ReadOnly, // default to read-only
         }
     }
+
+    /// Whether a file opened in this mode can be read from.
+    pub fn can_read(self) -> bool {
+        !matches!(self, Self::WriteOnly)
+    }
+
+    /// Whether a file opened in this mode accepts writes.
+    pub fn can_write(self) -> bool {
+        !matches!(self, Self::ReadOnly)
+    }
 }
 
 impl TryFrom<i32> for ChannelMode {
@@ -10,6 +10,8 @@ pub enum ControlFile {
     SleepRelative(TimeUnit),
     SleepAbsolute(TimeUnit),
     Elapsed(TimeUnit),
+    Clock,
+    Stats,
     EnergyLeft,
     EnergyState,
     PowerFlows,
@@ -23,6 +25,9 @@ pub enum ControlFile {
     PosDy,
     PosDz,
     PosMotion,
+    Checkpoint,
+    Restore,
+    Fuzz,
 }
 
 impl ControlFile {
@@ -47,6 +52,8 @@ impl ControlFile {
             "elapsed/us" => Some(Self::Elapsed(TimeUnit::Microseconds)),
             "elapsed/ms" => Some(Self::Elapsed(TimeUnit::Milliseconds)),
             "elapsed/s" => Some(Self::Elapsed(TimeUnit::Seconds)),
+            "clock" => Some(Self::Clock),
+            "stats" => Some(Self::Stats),
             "energy_left" => Some(Self::EnergyLeft),
             "energy_state" => Some(Self::EnergyState),
             "pos/x" => Some(Self::PosX),
@@ -60,6 +67,9 @@ impl ControlFile {
             "pos/dz" => Some(Self::PosDz),
             "pos/motion" => Some(Self::PosMotion),
             "power_flows" => Some(Self::PowerFlows),
+            "checkpoint" => Some(Self::Checkpoint),
+            "restore" => Some(Self::Restore),
+            "fuzz" => Some(Self::Fuzz),
             _ => None,
         }
     }
@@ -90,7 +100,17 @@ pub fn control_files() -> Vec<String> {
 }
 
 /// Flat control files that remain at the root level (not in subdirectories).
-pub(crate) const CONTROL_FILES: [(&str, ChannelMode, FsEntryKind); 3] = [
+pub(crate) const CONTROL_FILES: [(&str, ChannelMode, FsEntryKind); 8] = [
+    (
+        "ctl.clock",
+        ChannelMode::ReadOnly,
+        FsEntryKind::ControlFile(ControlFile::Clock),
+    ),
+    (
+        "ctl.stats",
+        ChannelMode::ReadOnly,
+        FsEntryKind::ControlFile(ControlFile::Stats),
+    ),
     (
         "ctl.energy_left",
         ChannelMode::ReadOnly,
@@ -106,6 +126,21 @@ pub(crate) const CONTROL_FILES: [(&str, ChannelMode, FsEntryKind); 3] = [
         ChannelMode::ReadWrite,
         FsEntryKind::ControlFile(ControlFile::PowerFlows),
     ),
+    (
+        "ctl.checkpoint",
+        ChannelMode::ReadWrite,
+        FsEntryKind::ControlFile(ControlFile::Checkpoint),
+    ),
+    (
+        "ctl.restore",
+        ChannelMode::ReadOnly,
+        FsEntryKind::ControlFile(ControlFile::Restore),
+    ),
+    (
+        "ctl.fuzz",
+        ChannelMode::ReadWrite,
+        FsEntryKind::ControlFile(ControlFile::Fuzz),
+    ),
 ];
 
 /// Sub-files under the `ctl.time/` directory.
@@ -258,6 +293,15 @@ pub(crate) const POS_SUBFILES: [(&str, ChannelMode, FsEntryKind); 10] = [
     ),
 ];
 
+/// Sub-files under each channel's `recv_timeout/` directory. Unlike the
+/// `ctl.*` files these are created per channel by `NexusFs::add_channels`.
+pub(crate) const RECV_TIMEOUT_SUBFILES: [(&str, ChannelMode, FsEntryKind); 4] = [
+    ("s", ChannelMode::ReadWrite, FsEntryKind::RegularFile),
+    ("ms", ChannelMode::ReadWrite, FsEntryKind::RegularFile),
+    ("us", ChannelMode::ReadWrite, FsEntryKind::RegularFile),
+    ("ns", ChannelMode::ReadWrite, FsEntryKind::RegularFile),
+];
+
 #[cfg(test)]
 mod tests {
     use config::ast::TimeUnit;
@@ -298,6 +342,8 @@ mod tests {
             ControlFile::parse("ctl.elapsed/ns"),
             Some(ControlFile::Elapsed(TimeUnit::Nanoseconds))
         );
+        assert_eq!(ControlFile::parse("ctl.clock"), Some(ControlFile::Clock));
+        assert_eq!(ControlFile::parse("ctl.stats"), Some(ControlFile::Stats));
         assert_eq!(
             ControlFile::parse("ctl.energy_left"),
             Some(ControlFile::EnergyLeft)
@@ -326,6 +372,15 @@ mod tests {
             ControlFile::parse("ctl.power_flows"),
             Some(ControlFile::PowerFlows)
         );
+        assert_eq!(
+            ControlFile::parse("ctl.checkpoint"),
+            Some(ControlFile::Checkpoint)
+        );
+        assert_eq!(
+            ControlFile::parse("ctl.restore"),
+            Some(ControlFile::Restore)
+        );
+        assert_eq!(ControlFile::parse("ctl.fuzz"), Some(ControlFile::Fuzz));
     }
 
     #[test]
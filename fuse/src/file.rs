@@ -1,8 +1,9 @@
 use fuser::FileType;
-use std::{num::NonZeroUsize, time::SystemTime};
+use std::{collections::HashMap, num::NonZeroUsize, time::SystemTime};
 
 use fuser::FileAttr;
 
+use crate::PID;
 use crate::channel::ChannelMode;
 
 /// Return the current user's UID and GID.
@@ -70,3 +71,78 @@ impl NexusFile {
         }
     }
 }
+
+/// Every process's view of the tree: its files, indexed densely by entry
+/// index. Keyed like a `HashMap<(PID, entry_index), NexusFile>`, but a
+/// lookup only hashes the PID, and remapping a PID moves its files at once.
+#[derive(Debug, Default)]
+pub(crate) struct FileTable {
+    by_pid: HashMap<PID, Vec<Option<NexusFile>>>,
+}
+
+impl FileTable {
+    /// Add `file` at `(pid, index)`, returning the one it replaced.
+    pub(crate) fn insert(
+        &mut self,
+        (pid, index): (PID, usize),
+        file: NexusFile,
+    ) -> Option<NexusFile> {
+        let files = self.by_pid.entry(pid).or_default();
+        if files.len() <= index {
+            files.resize_with(index + 1, || None);
+        }
+        files[index].replace(file)
+    }
+
+    pub(crate) fn get(&self, &(pid, index): &(PID, usize)) -> Option<&NexusFile> {
+        self.by_pid.get(&pid)?.get(index)?.as_ref()
+    }
+
+    pub(crate) fn contains_key(&self, key: &(PID, usize)) -> bool {
+        self.get(key).is_some()
+    }
+
+    /// Hand every file of `old_pid` over to `new_pid`.
+    pub(crate) fn remap(&mut self, old_pid: PID, new_pid: PID) {
+        if let Some(files) = self.by_pid.remove(&old_pid) {
+            self.by_pid.insert(new_pid, files);
+        }
+    }
+
+    /// Split into `count` tables, `pid`'s files going to `shard_of(pid)`.
+    pub(crate) fn split(self, count: usize, shard_of: impl Fn(PID) -> usize) -> Vec<Self> {
+        let mut shards: Vec<Self> = (0..count).map(|_| Self::default()).collect();
+        for (pid, files) in self.by_pid {
+            shards[shard_of(pid)].by_pid.insert(pid, files);
+        }
+        shards
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn file(ino: u64) -> NexusFile {
+        NexusFile::new(NonZeroUsize::MIN, ChannelMode::ReadWrite, ino)
+    }
+
+    #[test]
+    fn file_table_is_sparse_per_pid_and_splits_whole_processes() {
+        let mut files = FileTable::default();
+        assert!(files.insert((7, 5), file(1)).is_none());
+        assert!(files.insert((8, 0), file(2)).is_none());
+        // Holes and indices past the end are just missing.
+        assert!(!files.contains_key(&(7, 2)));
+        assert!(!files.contains_key(&(7, 50)));
+        assert!(!files.contains_key(&(9, 0)));
+        let replaced = files.insert((7, 5), file(3)).unwrap();
+        assert_eq!(replaced.attr.ino, 1);
+        assert_eq!(files.get(&(7, 5)).unwrap().attr.ino, 3);
+
+        let shards = files.split(2, |pid| pid as usize % 2);
+        assert!(shards[1].contains_key(&(7, 5)));
+        assert!(shards[0].contains_key(&(8, 0)));
+        assert!(!shards[0].contains_key(&(7, 5)));
+    }
+}
@@ -1,28 +1,39 @@
 use crate::channel::{ChannelMode, NexusChannel};
 use crate::errors::{ChannelError, FsError};
-use crate::file::{NexusFile, default_attr};
-use crate::{ChannelId, FsMessage, ReadRequest, SleepEvent};
+use crate::file::{FileTable, NexusFile, default_attr};
+use crate::stats::{LocalStats, Op, Stats};
+use crate::{
+    ChannelId, CheckpointWrite, FsMessage, POLL_READABLE, POLL_WRITABLE, PollRequest, ReadRequest,
+    SleepEvent,
+};
 use fuser::ReplyWrite;
 use std::num::NonZeroUsize;
-use std::sync::mpsc;
+use std::sync::{Arc, mpsc};
 use tracing::instrument;
 
 use crate::Message;
 use fuser::{
-    BackgroundSession, FUSE_ROOT_ID, FileAttr, FileType, Filesystem, MountOption, ReplyAttr,
-    ReplyData, ReplyDirectory, ReplyEntry, ReplyOpen, Request, consts::FOPEN_DIRECT_IO,
+    BackgroundSession, FUSE_ROOT_ID, FileAttr, FileType, Filesystem, MountOption, PollHandle,
+    ReplyAttr, ReplyData, ReplyDirectory, ReplyEntry, ReplyOpen, ReplyPoll, Request,
+    consts::{FOPEN_DIRECT_IO, FUSE_POLL_SCHEDULE_NOTIFY},
 };
-use libc::{EACCES, EISDIR, EMSGSIZE, ENOENT, O_APPEND};
+use libc::{EACCES, EINVAL, EISDIR, EMSGSIZE, ENOENT, O_APPEND};
 use libc::{O_ACCMODE, O_RDONLY, O_WRONLY};
 use std::ffi::OsStr;
 use std::fs;
 use std::sync::atomic::{AtomicU64, Ordering};
-use std::time::{Duration, SystemTime};
+use std::time::{Duration, Instant, SystemTime};
 use std::{collections::HashMap, path::PathBuf};
 
 use crate::ctrl_files::*;
+use crate::workers::{FsJob, WorkerPool, home_worker};
 
-const TTL: Duration = Duration::from_secs(1);
+/// How long the kernel may cache entries and attributes. Nothing in the tree
+/// changes once mounted, so dentries for the paths protocols open stay cached
+/// for the whole run and repeat `open()`s skip `lookup` altogether. A process
+/// may then see a cached entry for a file it has no buffer for; `open`, `read`
+/// and `write` still check the caller's own buffers and refuse it.
+const TTL: Duration = Duration::from_secs(24 * 60 * 60);
 
 #[derive(Clone, Copy, Debug)]
 pub(crate) enum FsEntryKind {
@@ -44,6 +55,29 @@ struct FsEntry {
     path: String,
 }
 
+/// The virtual filesystem tree. Entries are only added while processes and
+/// channels are registered; at mount the table is frozen behind an `Arc`
+/// and shared by every worker, so resolving an inode never takes a lock.
+#[derive(Debug)]
+pub(crate) struct FsTable {
+    attr: FileAttr,
+    entries: Vec<FsEntry>,
+    /// (parent_inode -> (child_name -> entry_index)) lookup index. Replaces
+    /// the previous O(N) linear scan of `entries`. With thousands of nodes
+    /// and channels, the scan dominated every FUSE syscall.
+    by_parent: HashMap<u64, HashMap<String, usize>>,
+}
+
+impl FsTable {
+    fn new() -> Self {
+        Self {
+            attr: default_attr(FUSE_ROOT_ID, FileType::Directory, 0o755, 0, 0),
+            entries: Vec::default(),
+            by_parent: HashMap::default(),
+        }
+    }
+}
+
 /// FUSE filesystem. Generic over the message type pushed on FUSE events so
 /// the kernel can hand in a `Sender<RouterInput>` (FUSE events arrive at the
 /// router in one mpsc hop, no forwarder thread). Defaults to `FsMessage` so
@@ -54,14 +88,9 @@ where
     T: From<FsMessage> + Send + 'static,
 {
     root: PathBuf,
-    attr: FileAttr,
-    entries: Vec<FsEntry>,
-    /// (parent_inode -> (child_name -> entry_index)) lookup index. Replaces
-    /// the previous O(N) linear scan of `entries`. With thousands of nodes
-    /// and channels, the scan dominated every FUSE syscall.
-    by_parent: HashMap<u64, HashMap<String, usize>>,
+    table: FsTable,
     /// Per-process file buffers keyed by `(PID, entry_index)`.
-    buffers: HashMap<(u32, usize), NexusFile>,
+    buffers: FileTable,
     /// Sender into the kernel/router. The send side is crossbeam-backed
     /// because every FUSE syscall in the hot path drives one send.
     /// There is no reply channel: the router invokes the per-request
@@ -73,9 +102,11 @@ where
     /// Per-instance inode counter (must not be static; the GUI reuses
     /// the process across simulation runs).
     inode_gen: AtomicU64,
-    /// Cache mapping thread IDs to their thread group ID (process ID).
-    /// Allows pthreads to access the same FUSE files as the main thread.
-    tgid_cache: HashMap<u32, u32>,
+    /// Per-process operation counters, shared with the router for
+    /// `ctl.stats` and the run summary.
+    stats: LocalStats,
+    /// Threads requests are answered on once mounted.
+    workers: NonZeroUsize,
 }
 
 impl<T> NexusFs<T>
@@ -94,54 +125,31 @@ where
         let root = root.unwrap_or_else(|| expand_home(&PathBuf::from("~/nexus")));
         Self {
             root,
-            attr: Self::root_attr(),
-            entries: Vec::default(),
-            by_parent: HashMap::default(),
-            buffers: HashMap::default(),
+            table: FsTable::new(),
+            buffers: FileTable::default(),
             fs_to_kernel_tx,
             remap_rx,
             inode_gen: AtomicU64::new(FUSE_ROOT_ID + 1),
-            tgid_cache: HashMap::new(),
-        }
-    }
-
-    /// Drain the remap channel and migrate FUSE buffer entries from
-    /// old PIDs to new PIDs.
-    fn apply_pending_remaps(&mut self) {
-        while let Ok((old_pid, new_pid)) = self.remap_rx.try_recv() {
-            let keys_to_migrate: Vec<usize> = self
-                .buffers
-                .keys()
-                .filter(|(pid, _)| *pid == old_pid)
-                .map(|(_, idx)| *idx)
-                .collect();
-            for idx in keys_to_migrate {
-                if let Some(file) = self.buffers.remove(&(old_pid, idx)) {
-                    self.buffers.insert((new_pid, idx), file);
-                }
-            }
+            stats: LocalStats::new(Arc::default()),
+            workers: NonZeroUsize::MIN,
         }
     }
 
-    fn root_attr() -> FileAttr {
-        default_attr(FUSE_ROOT_ID, FileType::Directory, 0o755, 0, 0)
+    /// Answer requests on `workers` threads, each serving its own share of
+    /// the processes. One worker answers them on the session thread itself.
+    pub fn workers(mut self, workers: NonZeroUsize) -> Self {
+        self.workers = workers;
+        self
     }
 
     pub fn root(&self) -> &PathBuf {
         &self.root
     }
 
-    /// Resolve a thread ID to its thread group ID (TGID / process ID).
-    /// The TGID is what `Child::id()` returns for the main thread and is
-    /// the key used in `self.buffers`. Pthreads have distinct TIDs but
-    /// share their parent's TGID, so this lets them access the same files.
-    fn resolve_tgid(&mut self, tid: u32) -> u32 {
-        if let Some(&tgid) = self.tgid_cache.get(&tid) {
-            return tgid;
-        }
-        let tgid = read_tgid(tid).unwrap_or(tid);
-        self.tgid_cache.insert(tid, tgid);
-        tgid
+    /// Registry the filesystem records per-process operation counters into.
+    /// Hand it to the kernel so router-side latencies land next to them.
+    pub fn stats(&self) -> Arc<Stats> {
+        self.stats.shared().clone()
     }
 
     /// Find or create an entry in the tree. Returns `(inode, entry_index)`.
@@ -154,15 +162,21 @@ where
         kind: FsEntryKind,
         path: String,
     ) -> (u64, usize) {
-        if let Some(&index) = self.by_parent.get(&parent_inode).and_then(|m| m.get(&name)) {
+        let table = &mut self.table;
+        if let Some(&index) = table
+            .by_parent
+            .get(&parent_inode)
+            .and_then(|m| m.get(&name))
+        {
             (index_to_inode(index), index)
         } else {
-            let index = self.entries.len();
-            self.by_parent
+            let index = table.entries.len();
+            table
+                .by_parent
                 .entry(parent_inode)
                 .or_default()
                 .insert(name.clone(), index);
-            self.entries.push(FsEntry {
+            table.entries.push(FsEntry {
                 name,
                 parent_inode,
                 kind,
@@ -202,6 +216,9 @@ where
     }
 
     pub fn add_processes(mut self, pids: &[u32]) -> Self {
+        for &pid in pids {
+            self.stats.shared().register(pid);
+        }
         // Flat control files (energy, position, power)
         for (file, mode, kind) in CONTROL_FILES.iter() {
             let (inode, idx) =
@@ -278,8 +295,34 @@ where
                 return Err(ChannelError::DuplicateChannel);
             }
 
-            // Both these files are read-only
-            for name in ["rssi", "snr"] {
+            // Framed batch file, same access as the channel file itself
+            let batch_path = format!("{channel}/batch");
+            let (batch_inode, batch_idx) = self.get_or_make_entry(
+                "batch".to_string(),
+                dir_inode,
+                FsEntryKind::RegularFile,
+                batch_path,
+            );
+            self.buffers.insert(
+                (pid, batch_idx),
+                NexusFile::new(max_msg_size, mode, batch_inode),
+            );
+
+            // Received messages behind a link metadata header
+            let packet_path = format!("{channel}/packet");
+            let (packet_inode, packet_idx) = self.get_or_make_entry(
+                "packet".to_string(),
+                dir_inode,
+                FsEntryKind::RegularFile,
+                packet_path,
+            );
+            self.buffers.insert(
+                (pid, packet_idx),
+                NexusFile::new(max_msg_size, ChannelMode::ReadOnly, packet_inode),
+            );
+
+            // Signal quality and the shared-memory ring path are read-only
+            for name in ["rssi", "snr", "shm"] {
                 let subfile_path = format!("{channel}/{name}");
                 let (subfile_inode, subfile_idx) = self.get_or_make_entry(
                     name.to_string(),
@@ -296,6 +339,24 @@ where
                     ),
                 );
             }
+
+            // Receive timeout directory, one writable file per time unit
+            let timeout_dir = format!("{channel}/recv_timeout");
+            let (timeout_inode, _) = self.get_or_make_entry(
+                "recv_timeout".to_string(),
+                dir_inode,
+                FsEntryKind::Directory,
+                timeout_dir.clone(),
+            );
+            for &(name, mode, kind) in RECV_TIMEOUT_SUBFILES.iter() {
+                let subfile_path = format!("{timeout_dir}/{name}");
+                let (subfile_inode, subfile_idx) =
+                    self.get_or_make_entry(name.to_string(), timeout_inode, kind, subfile_path);
+                self.buffers.insert(
+                    (pid, subfile_idx),
+                    NexusFile::new(NonZeroUsize::new(64).unwrap(), mode, subfile_inode),
+                );
+            }
         }
         Ok(self)
     }
@@ -303,7 +364,9 @@ where
     /// Mount the filesystem without blocking and yield the background session.
     /// Replies flow directly from the router back to the kernel via the
     /// per-request `ReplyData` token (carried in `FsMessage::Read`), so there
-    /// is no longer a separate reply channel to hand back.
+    /// is no longer a separate reply channel to hand back. With more than one
+    /// worker, their threads are started here and stopped when the session
+    /// is unmounted.
     pub fn mount(self) -> Result<BackgroundSession, FsError> {
         let mut options = vec![MountOption::FSName("nexus".to_string())];
         if std::env::var_os("NEXUS_FUSE_ALLOW_OTHER").is_some() {
@@ -316,11 +379,12 @@ where
                 err,
             })?;
         }
-        let sess =
-            fuser::spawn_mount2(self, &root, &options).map_err(|err| FsError::MountError {
+        let sess = fuser::spawn_mount2(self.into_session(), &root, &options).map_err(|err| {
+            FsError::MountError {
                 root: root.clone(),
                 err,
-            })?;
+            }
+        })?;
         let deadline = std::time::Instant::now() + std::time::Duration::from_secs(5);
         while !root.exists() {
             if std::time::Instant::now() > deadline {
@@ -332,84 +396,155 @@ where
         Ok(sess)
     }
 
-    /// Forward a read request to the router. Returns immediately; the router
-    /// invokes `reply.data(...)` on the carried `ReplyData` once a message
-    /// is available (or `reply.data(&[])` if the channel is empty). On
-    /// channel send failure (kernel shutting down) the `ReplyData` stored
-    /// inside the dropped `FsMessage` will trigger `Drop`'s EIO fallback,
-    /// so the syscall never hangs.
-    fn read_message(
-        &mut self,
-        reply: ReplyData,
-        size: u32,
-        buf_key: (u32, usize),
-        msg_id: ChannelId,
-    ) {
-        if !self.buffers.contains_key(&buf_key) {
-            reply.error(EACCES);
-            return;
+    /// Freeze the tree and split the buffers between the workers.
+    fn into_session(self) -> FsSession<T> {
+        let table = Arc::new(self.table);
+        let workers = self.workers.get();
+        let mut shards: Vec<FsShard<T>> = self
+            .buffers
+            .split(workers, |pid| home_worker(pid, workers))
+            .into_iter()
+            .map(|buffers| FsShard {
+                table: table.clone(),
+                buffers,
+                fs_to_kernel_tx: self.fs_to_kernel_tx.clone(),
+                stats: LocalStats::new(self.stats.shared().clone()),
+            })
+            .collect();
+        let dispatch = if workers == 1 {
+            Dispatch::Inline(shards.pop().expect("one shard per worker"))
+        } else {
+            Dispatch::Workers(WorkerPool::spawn(shards))
+        };
+        FsSession {
+            table,
+            remap_rx: self.remap_rx,
+            tgid_cache: HashMap::new(),
+            dispatch,
         }
-        let req = FsMessage::Read(ReadRequest {
-            id: msg_id,
-            size,
-            reply,
-        });
-        let _ = self.fs_to_kernel_tx.send(req.into());
     }
 }
 
 impl Default for NexusFs<FsMessage> {
     fn default() -> Self {
-        let root = expand_home(&PathBuf::from("~/nexus"));
         let (fs_tx, _kernel_rx) = crossbeam_channel::unbounded::<FsMessage>();
-        Self {
-            root,
-            attr: Self::root_attr(),
-            entries: Vec::default(),
-            by_parent: HashMap::default(),
-            buffers: HashMap::default(),
-            fs_to_kernel_tx: fs_tx,
-            remap_rx: mpsc::channel().1,
-            inode_gen: AtomicU64::new(FUSE_ROOT_ID + 1),
-            tgid_cache: HashMap::new(),
-        }
+        Self::new(None, mpsc::channel().1, fs_tx)
     }
 }
 
-impl<T> Filesystem for NexusFs<T>
+/// The buffers of the processes one worker serves, and what it needs to
+/// answer their requests on its own.
+#[derive(Debug)]
+pub(crate) struct FsShard<T> {
+    table: Arc<FsTable>,
+    /// File buffers keyed by `(PID, entry_index)`, for this worker's
+    /// processes only.
+    buffers: FileTable,
+    fs_to_kernel_tx: crossbeam_channel::Sender<T>,
+    stats: LocalStats,
+}
+
+/// How a mounted filesystem answers the requests fuser reads for it.
+#[derive(Debug)]
+enum Dispatch<T> {
+    /// On the session thread, as they are read.
+    Inline(FsShard<T>),
+    /// On worker threads, by the worker owning the calling process.
+    Workers(WorkerPool),
+}
+
+/// The filesystem fuser drives once mounted. It resolves who is calling and
+/// hands each request to the shard holding that process's buffers.
+#[derive(Debug)]
+pub(crate) struct FsSession<T> {
+    table: Arc<FsTable>,
+    /// Receiver for (old_pid, new_pid) pairs sent by the router.
+    remap_rx: mpsc::Receiver<(u32, u32)>,
+    /// Cache mapping thread IDs to their thread group ID (process ID).
+    /// Allows pthreads to access the same FUSE files as the main thread.
+    /// Only the session thread resolves callers, so even with workers the
+    /// cache needs no lock.
+    tgid_cache: HashMap<u32, u32>,
+    dispatch: Dispatch<T>,
+}
+
+impl<T> FsSession<T>
 where
     T: From<FsMessage> + Send + 'static,
 {
-    fn setattr(
-        &mut self,
-        req: &Request<'_>,
-        ino: u64,
-        _mode: Option<u32>,
-        _uid: Option<u32>,
-        _gid: Option<u32>,
-        _size: Option<u64>,
-        _atime: Option<fuser::TimeOrNow>,
-        _mtime: Option<fuser::TimeOrNow>,
-        _ctime: Option<SystemTime>,
-        _fh: Option<u64>,
-        _crtime: Option<SystemTime>,
-        _chgtime: Option<SystemTime>,
-        _bkuptime: Option<SystemTime>,
-        _flags: Option<u32>,
-        reply: ReplyAttr,
-    ) {
-        // Just return current attrs -- we ignore truncate/chmod/etc.
-        self.getattr(req, ino, _fh, reply);
+    /// Drain the remap channel and migrate FUSE buffer entries from
+    /// old PIDs to new PIDs.
+    fn apply_pending_remaps(&mut self) {
+        while let Ok((old_pid, new_pid)) = self.remap_rx.try_recv() {
+            match &mut self.dispatch {
+                Dispatch::Inline(shard) => shard.remap(old_pid, new_pid),
+                Dispatch::Workers(pool) => pool.remap(old_pid, new_pid),
+            }
+        }
     }
 
-    #[instrument(skip_all)]
-    fn lookup(&mut self, req: &Request, parent: u64, name: &OsStr, reply: ReplyEntry) {
+    /// Resolve a thread ID to its thread group ID (TGID / process ID).
+    /// The TGID is what `Child::id()` returns for the main thread and is
+    /// the key used in the buffers. Pthreads have distinct TIDs but
+    /// share their parent's TGID, so this lets them access the same files.
+    fn resolve_tgid(&mut self, tid: u32) -> u32 {
+        if let Some(&tgid) = self.tgid_cache.get(&tid) {
+            return tgid;
+        }
+        let tgid = read_tgid(tid).unwrap_or(tid);
+        self.tgid_cache.insert(tid, tgid);
+        tgid
+    }
+
+    /// Resolve the process behind `req` and answer `job` for it.
+    fn dispatch(&mut self, req: &Request<'_>, job: FsJob) {
         self.apply_pending_remaps();
         let pid = self.resolve_tgid(req.pid());
+        match &mut self.dispatch {
+            Dispatch::Inline(shard) => shard.serve(pid, job),
+            Dispatch::Workers(pool) => pool.send(pid, job),
+        }
+    }
+}
+
+impl<T> FsShard<T>
+where
+    T: From<FsMessage> + Send + 'static,
+{
+    pub(crate) fn serve(&mut self, pid: u32, job: FsJob) {
+        match job {
+            FsJob::Lookup {
+                parent,
+                name,
+                reply,
+            } => self.lookup(pid, parent, &name, reply),
+            FsJob::Getattr { ino, reply } => self.getattr(pid, ino, reply),
+            FsJob::Open { ino, flags, reply } => self.open(pid, ino, flags, reply),
+            FsJob::Read { ino, size, reply } => self.read(pid, ino, size, reply),
+            FsJob::Write { ino, data, reply } => self.write(pid, ino, data, reply),
+            FsJob::Poll {
+                ino,
+                handle,
+                events,
+                flags,
+                reply,
+            } => self.poll(pid, ino, handle, events, flags, reply),
+            FsJob::Remap(new_pid) => self.remap(pid, new_pid),
+        }
+    }
+
+    /// Move every buffer of `old_pid` over to `new_pid`.
+    fn remap(&mut self, old_pid: u32, new_pid: u32) {
+        self.buffers.remap(old_pid, new_pid);
+    }
+
+    fn lookup(&mut self, pid: u32, parent: u64, name: &OsStr, reply: ReplyEntry) {
+        let _timer = self.stats.timer(pid, Op::Lookup);
         let name_str = name.to_string_lossy();
 
         // O(1) index lookup keyed by (parent_inode, name).
         let index_opt = self
+            .table
             .by_parent
             .get(&parent)
             .and_then(|m| m.get(name_str.as_ref()))
@@ -418,7 +553,7 @@ where
             reply.error(ENOENT);
             return;
         };
-        let entry = &self.entries[index];
+        let entry = &self.table.entries[index];
 
         let inode = index_to_inode(index);
         match entry.kind {
@@ -439,15 +574,12 @@ where
         }
     }
 
-    #[instrument(skip_all)]
-    fn getattr(&mut self, req: &Request, ino: u64, _fh: Option<u64>, reply: ReplyAttr) {
-        self.apply_pending_remaps();
-        let pid = self.resolve_tgid(req.pid());
+    fn getattr(&mut self, pid: u32, ino: u64, reply: ReplyAttr) {
         match ino {
-            FUSE_ROOT_ID => reply.attr(&TTL, &self.attr),
+            FUSE_ROOT_ID => reply.attr(&TTL, &self.table.attr),
             _ => {
                 let index = inode_to_index(ino);
-                let Some(entry) = self.entries.get(index) else {
+                let Some(entry) = self.table.entries.get(index) else {
                     reply.error(ENOENT);
                     return;
                 };
@@ -467,12 +599,10 @@ where
         }
     }
 
-    #[instrument(skip_all)]
-    fn open(&mut self, req: &Request<'_>, ino: u64, flags: i32, reply: ReplyOpen) {
-        self.apply_pending_remaps();
-        let pid = self.resolve_tgid(req.pid());
+    fn open(&mut self, pid: u32, ino: u64, flags: i32, reply: ReplyOpen) {
+        let _timer = self.stats.timer(pid, Op::Open);
         let index = inode_to_index(ino);
-        let Some(entry) = self.entries.get(index) else {
+        let Some(entry) = self.table.entries.get(index) else {
             reply.error(ENOENT);
             return;
         };
@@ -509,26 +639,14 @@ where
         reply.opened(index as u64, FOPEN_DIRECT_IO);
     }
 
-    #[instrument(skip_all)]
-    fn read(
-        &mut self,
-        req: &Request,
-        ino: u64,
-        _fh: u64,
-        _offset: i64,
-        size: u32,
-        _flags: i32,
-        _lock: Option<u64>,
-        reply: ReplyData,
-    ) {
-        self.apply_pending_remaps();
-        let pid = self.resolve_tgid(req.pid());
+    fn read(&mut self, pid: u32, ino: u64, size: u32, reply: ReplyData) {
+        let _timer = self.stats.timer(pid, Op::Read);
         if ino == FUSE_ROOT_ID {
             reply.error(EISDIR);
             return;
         }
         let index = inode_to_index(ino);
-        let Some(entry) = self.entries.get(index) else {
+        let Some(entry) = self.table.entries.get(index) else {
             reply.error(ENOENT);
             return;
         };
@@ -544,27 +662,40 @@ where
         self.read_message(reply, size, (pid, index), msg_id);
     }
 
-    #[instrument(skip_all)]
-    fn write(
+    /// Forward a read request to the router. Returns immediately; the router
+    /// invokes `reply.data(...)` on the carried `ReplyData` once a message
+    /// is available (or `reply.data(&[])` if the channel is empty). On
+    /// channel send failure (kernel shutting down) the `ReplyData` stored
+    /// inside the dropped `FsMessage` will trigger `Drop`'s EIO fallback,
+    /// so the syscall never hangs.
+    fn read_message(
         &mut self,
-        req: &Request<'_>,
-        ino: u64,
-        _fh: u64,
-        _offset: i64,
-        data: &[u8],
-        _write_flags: u32,
-        _flags: i32,
-        _lock_owner: Option<u64>,
-        reply: ReplyWrite,
+        reply: ReplyData,
+        size: u32,
+        buf_key: (u32, usize),
+        msg_id: ChannelId,
     ) {
-        self.apply_pending_remaps();
-        let pid = self.resolve_tgid(req.pid());
+        if !self.buffers.contains_key(&buf_key) {
+            reply.error(EACCES);
+            return;
+        }
+        let req = FsMessage::Read(ReadRequest {
+            id: msg_id,
+            size,
+            issued: Instant::now(),
+            reply,
+        });
+        let _ = self.fs_to_kernel_tx.send(req.into());
+    }
+
+    fn write(&mut self, pid: u32, ino: u64, data: Vec<u8>, reply: ReplyWrite) {
+        let mut timer = self.stats.timer(pid, Op::Write);
         if ino == FUSE_ROOT_ID {
             reply.error(EISDIR);
             return;
         }
         let index = inode_to_index(ino);
-        let Some(entry) = self.entries.get(index) else {
+        let Some(entry) = self.table.entries.get(index) else {
             reply.error(ENOENT);
             return;
         };
@@ -580,6 +711,7 @@ where
             }
             FsEntryKind::ControlFile(ControlFile::SleepRelative(unit))
             | FsEntryKind::ControlFile(ControlFile::SleepAbsolute(unit)) => {
+                timer.set_op(Op::Sleep);
                 let is_relative = matches!(
                     entry.kind,
                     FsEntryKind::ControlFile(ControlFile::SleepRelative(_))
@@ -588,7 +720,7 @@ where
                     reply.error(EMSGSIZE);
                     return;
                 };
-                let parsed = String::from_utf8_lossy(data).trim().parse::<u64>();
+                let parsed = String::from_utf8_lossy(&data).trim().parse::<u64>();
                 match parsed {
                     Ok(val) => {
                         let msg = FsMessage::Sleep(SleepEvent {
@@ -597,6 +729,7 @@ where
                             unit,
                             is_relative,
                             bytes_consumed,
+                            issued: Instant::now(),
                             reply,
                         });
                         // Ignore SendError: it only fires once the kernel
@@ -614,32 +747,202 @@ where
                     }
                 }
             }
+            FsEntryKind::ControlFile(ControlFile::Checkpoint) => {
+                if u32::try_from(data.len()).is_err() {
+                    reply.error(EMSGSIZE);
+                    return;
+                }
+                // The router decides when to answer: the write that
+                // completes a protocol's state is held until the simulation
+                // stops.
+                let msg = FsMessage::Checkpoint(CheckpointWrite { pid, data, reply });
+                let _ = self.fs_to_kernel_tx.send(msg.into());
+            }
             _ => {
-                // Drop writes from file, only source of writes will be from the kernel
-                if file.mode == ChannelMode::ReplayWrites {
+                // Drop writes from file, only source of writes will be from
+                // the kernel (a replay log, or the fuzzer's frames)
+                if matches!(
+                    file.mode,
+                    ChannelMode::ReplayWrites | ChannelMode::FuzzWrites
+                ) {
                     reply.written(data.len() as u32);
                     return;
                 }
 
+                let Ok(bytes_written) = data.len().try_into() else {
+                    reply.error(EMSGSIZE);
+                    return;
+                };
+                if let Err(errno) = check_write(&entry.path, &data, file.max_msg_size.get()) {
+                    reply.error(errno);
+                    return;
+                }
                 let msg = FsMessage::Write(Message {
                     id: (pid, entry.path.clone()),
-                    data: data.to_vec(),
+                    data,
                 });
                 // See the matching note in the Sleep arm above: shutdown
                 // races drop the kernel receiver before this thread
                 // drains, so a SendError here is informational, not
                 // fatal.
                 let _ = self.fs_to_kernel_tx.send(msg.into());
-                let Ok(bytes_written) = data.len().try_into() else {
-                    reply.error(EMSGSIZE);
-                    return;
-                };
 
                 reply.written(bytes_written);
             }
         }
     }
 
+    fn poll(
+        &mut self,
+        pid: u32,
+        ino: u64,
+        ph: PollHandle,
+        events: u32,
+        flags: u32,
+        reply: ReplyPoll,
+    ) {
+        let index = inode_to_index(ino);
+        let Some(entry) = self.table.entries.get(index) else {
+            reply.error(ENOENT);
+            return;
+        };
+        if matches!(entry.kind, FsEntryKind::Directory) {
+            reply.error(EISDIR);
+            return;
+        }
+        let Some(file) = self.buffers.get(&(pid, index)) else {
+            reply.error(EACCES);
+            return;
+        };
+
+        match poll_answer(entry, file.mode, events) {
+            PollAnswer::Ready(ready) => reply.poll(ready),
+            PollAnswer::Router { ready } => {
+                let msg = FsMessage::Poll(PollRequest {
+                    id: (pid, entry.path.clone()),
+                    ready,
+                    notify: flags & FUSE_POLL_SCHEDULE_NOTIFY != 0,
+                    handle: ph,
+                    reply,
+                });
+                // See the Sleep arm in `write`: a SendError only happens
+                // during shutdown and dropping the reply there is harmless.
+                let _ = self.fs_to_kernel_tx.send(msg.into());
+            }
+        }
+    }
+}
+
+impl<T> Filesystem for FsSession<T>
+where
+    T: From<FsMessage> + Send + 'static,
+{
+    fn setattr(
+        &mut self,
+        req: &Request<'_>,
+        ino: u64,
+        _mode: Option<u32>,
+        _uid: Option<u32>,
+        _gid: Option<u32>,
+        _size: Option<u64>,
+        _atime: Option<fuser::TimeOrNow>,
+        _mtime: Option<fuser::TimeOrNow>,
+        _ctime: Option<SystemTime>,
+        _fh: Option<u64>,
+        _crtime: Option<SystemTime>,
+        _chgtime: Option<SystemTime>,
+        _bkuptime: Option<SystemTime>,
+        _flags: Option<u32>,
+        reply: ReplyAttr,
+    ) {
+        // Just return current attrs -- we ignore truncate/chmod/etc.
+        self.getattr(req, ino, _fh, reply);
+    }
+
+    #[instrument(skip_all)]
+    fn lookup(&mut self, req: &Request, parent: u64, name: &OsStr, reply: ReplyEntry) {
+        let name = name.to_owned();
+        self.dispatch(
+            req,
+            FsJob::Lookup {
+                parent,
+                name,
+                reply,
+            },
+        );
+    }
+
+    #[instrument(skip_all)]
+    fn getattr(&mut self, req: &Request, ino: u64, _fh: Option<u64>, reply: ReplyAttr) {
+        self.dispatch(req, FsJob::Getattr { ino, reply });
+    }
+
+    #[instrument(skip_all)]
+    fn open(&mut self, req: &Request<'_>, ino: u64, flags: i32, reply: ReplyOpen) {
+        self.dispatch(req, FsJob::Open { ino, flags, reply });
+    }
+
+    #[instrument(skip_all)]
+    fn read(
+        &mut self,
+        req: &Request,
+        ino: u64,
+        _fh: u64,
+        _offset: i64,
+        size: u32,
+        _flags: i32,
+        _lock: Option<u64>,
+        reply: ReplyData,
+    ) {
+        self.dispatch(req, FsJob::Read { ino, size, reply });
+    }
+
+    #[instrument(skip_all)]
+    fn write(
+        &mut self,
+        req: &Request<'_>,
+        ino: u64,
+        _fh: u64,
+        _offset: i64,
+        data: &[u8],
+        _write_flags: u32,
+        _flags: i32,
+        _lock_owner: Option<u64>,
+        reply: ReplyWrite,
+    ) {
+        let data = data.to_vec();
+        self.dispatch(req, FsJob::Write { ino, data, reply });
+    }
+
+    /// Report readiness for `poll`/`epoll`. Writes never block on the FUSE
+    /// side and control-file reads are answered straight away, so only reads
+    /// on data channel files need the router, which parks `ph` and notifies it
+    /// once a message is delivered to the caller's mailbox.
+    #[instrument(skip_all)]
+    fn poll(
+        &mut self,
+        req: &Request<'_>,
+        ino: u64,
+        _fh: u64,
+        ph: PollHandle,
+        events: u32,
+        flags: u32,
+        reply: ReplyPoll,
+    ) {
+        self.dispatch(
+            req,
+            FsJob::Poll {
+                ino,
+                handle: ph,
+                events,
+                flags,
+                reply,
+            },
+        );
+    }
+
+    /// Listings only depend on the tree, so they are answered on the
+    /// session thread whatever the worker count.
     #[instrument(skip_all)]
     fn readdir(
         &mut self,
@@ -649,10 +952,11 @@ where
         offset: i64,
         mut reply: ReplyDirectory,
     ) {
+        let table = &self.table;
         // Check that the inode is either ROOT or a known directory
         if ino != FUSE_ROOT_ID {
             let index = inode_to_index(ino);
-            match self.entries.get(index) {
+            match table.entries.get(index) {
                 Some(entry) if matches!(entry.kind, FsEntryKind::Directory) => {}
                 _ => {
                     reply.error(ENOENT);
@@ -670,7 +974,7 @@ where
                 } else {
                     // Find parent inode for ".."
                     let index = inode_to_index(ino);
-                    self.entries[index].parent_inode
+                    table.entries[index].parent_inode
                 },
                 FileType::Directory,
                 "..".to_string(),
@@ -679,9 +983,9 @@ where
 
         // Add children of this directory using the (parent -> name -> index)
         // index, avoiding a full scan over every entry in the simulation.
-        if let Some(children) = self.by_parent.get(&ino) {
+        if let Some(children) = table.by_parent.get(&ino) {
             for (_, &i) in children.iter() {
-                let entry = &self.entries[i];
+                let entry = &table.entries[i];
                 let file_type = match entry.kind {
                     FsEntryKind::Directory => FileType::Directory,
                     FsEntryKind::RegularFile | FsEntryKind::ControlFile(_) => FileType::RegularFile,
@@ -704,6 +1008,64 @@ where
     }
 }
 
+/// Refuse a write to a data channel the router could not publish: EMSGSIZE
+/// for a message longer than the channel's `max_size`, and for a `batch`
+/// write, EINVAL if a frame runs past the end of the write.
+fn check_write(path: &str, data: &[u8], max_msg: usize) -> Result<(), i32> {
+    const FRAME_PREFIX: usize = size_of::<u32>();
+    if !path.ends_with("/batch") {
+        return if path.ends_with("/channel") && data.len() > max_msg {
+            Err(EMSGSIZE)
+        } else {
+            Ok(())
+        };
+    }
+    let mut rest = data;
+    while !rest.is_empty() {
+        let Some((prefix, tail)) = rest.split_first_chunk::<FRAME_PREFIX>() else {
+            return Err(EINVAL);
+        };
+        let len = u32::from_le_bytes(*prefix) as usize;
+        if len > tail.len() {
+            return Err(EINVAL);
+        }
+        if len > max_msg {
+            return Err(EMSGSIZE);
+        }
+        rest = &tail[len..];
+    }
+    Ok(())
+}
+
+/// How a `poll` on an open file is answered.
+#[derive(Debug, PartialEq, Eq)]
+enum PollAnswer {
+    /// Straight away, with these events.
+    Ready(u32),
+    /// By the router, which adds `POLLIN` if a read would return data now.
+    Router { ready: u32 },
+}
+
+/// Decide how to answer a `poll` for `events` on `entry`, opened in `mode`.
+/// Only the readability of data channels depends on the router.
+fn poll_answer(entry: &FsEntry, mode: ChannelMode, events: u32) -> PollAnswer {
+    let mut ready = 0;
+    if mode.can_write() {
+        ready |= POLL_WRITABLE;
+    }
+    let is_data_channel = matches!(entry.kind, FsEntryKind::RegularFile)
+        && ["/channel", "/batch", "/packet"]
+            .iter()
+            .any(|suffix| entry.path.ends_with(suffix));
+    if !mode.can_read() || events & POLL_READABLE == 0 {
+        PollAnswer::Ready(ready)
+    } else if !is_data_channel {
+        PollAnswer::Ready(ready | POLL_READABLE)
+    } else {
+        PollAnswer::Router { ready }
+    }
+}
+
 fn expand_home(path: &PathBuf) -> PathBuf {
     if let Some(stripped) = path.to_string_lossy().strip_prefix("~/")
         && let Some(home_dir) = home::home_dir()
@@ -751,6 +1113,15 @@ mod tests {
     const ENT_A: usize = 1;
     const ENT_B: usize = 2;
 
+    impl FsSession<FsMessage> {
+        fn inline(&self) -> &FsShard<FsMessage> {
+            match &self.dispatch {
+                Dispatch::Inline(shard) => shard,
+                Dispatch::Workers(_) => panic!("session answers on workers"),
+            }
+        }
+    }
+
     #[test]
     fn test_apply_pending_remaps_migrates_buffers() {
         let (tx, rx) = mpsc::channel();
@@ -768,16 +1139,17 @@ mod tests {
         // Send a remap: 100 -> 300
         tx.send((100, 300)).unwrap();
 
+        let mut fs = fs.into_session();
         fs.apply_pending_remaps();
 
         // Old keys gone
-        assert!(!fs.buffers.contains_key(&(100, ENT_A)));
-        assert!(!fs.buffers.contains_key(&(100, ENT_B)));
+        assert!(!fs.inline().buffers.contains_key(&(100, ENT_A)));
+        assert!(!fs.inline().buffers.contains_key(&(100, ENT_B)));
         // New keys present
-        assert!(fs.buffers.contains_key(&(300, ENT_A)));
-        assert!(fs.buffers.contains_key(&(300, ENT_B)));
+        assert!(fs.inline().buffers.contains_key(&(300, ENT_A)));
+        assert!(fs.inline().buffers.contains_key(&(300, ENT_B)));
         // Unrelated PID untouched
-        assert!(fs.buffers.contains_key(&(200, ENT_A)));
+        assert!(fs.inline().buffers.contains_key(&(200, ENT_A)));
         // Channel should be drained
         assert!(rx_is_empty(&fs.remap_rx));
     }
@@ -791,10 +1163,11 @@ mod tests {
         };
 
         fs.buffers.insert((100, ENT_A), test_file(1));
+        let mut fs = fs.into_session();
         fs.apply_pending_remaps();
 
         // Nothing should change
-        assert!(fs.buffers.contains_key(&(100, ENT_A)));
+        assert!(fs.inline().buffers.contains_key(&(100, ENT_A)));
     }
 
     #[test]
@@ -810,12 +1183,13 @@ mod tests {
 
         tx.send((10, 11)).unwrap();
         tx.send((20, 21)).unwrap();
+        let mut fs = fs.into_session();
         fs.apply_pending_remaps();
 
-        assert!(fs.buffers.contains_key(&(11, ENT_A)));
-        assert!(fs.buffers.contains_key(&(21, ENT_A)));
-        assert!(!fs.buffers.contains_key(&(10, ENT_A)));
-        assert!(!fs.buffers.contains_key(&(20, ENT_A)));
+        assert!(fs.inline().buffers.contains_key(&(11, ENT_A)));
+        assert!(fs.inline().buffers.contains_key(&(21, ENT_A)));
+        assert!(!fs.inline().buffers.contains_key(&(10, ENT_A)));
+        assert!(!fs.inline().buffers.contains_key(&(20, ENT_A)));
     }
 
     #[test]
@@ -828,34 +1202,136 @@ mod tests {
         };
 
         fs.buffers.insert((50, ENT_A), test_file(1));
+        let mut fs = fs.into_session();
         fs.apply_pending_remaps();
 
         // Original buffer still there, no panic
-        assert!(fs.buffers.contains_key(&(50, ENT_A)));
-        assert!(!fs.buffers.contains_key(&(1000, ENT_A)));
+        assert!(fs.inline().buffers.contains_key(&(50, ENT_A)));
+        assert!(!fs.inline().buffers.contains_key(&(1000, ENT_A)));
+    }
+
+    #[test]
+    fn test_remapped_pid_stays_on_its_worker() {
+        let (tx, rx) = mpsc::channel();
+        let mut fs = NexusFs {
+            remap_rx: rx,
+            ..Default::default()
+        }
+        .workers(NonZeroUsize::new(2).unwrap());
+        fs.buffers.insert((100, ENT_A), test_file(1));
+        fs.buffers.insert((101, ENT_A), test_file(1));
+        let mut fs = fs.into_session();
+
+        // 301 would be worker 1's, but its buffers are still on worker 0.
+        tx.send((100, 301)).unwrap();
+        fs.apply_pending_remaps();
+        let Dispatch::Workers(pool) = &fs.dispatch else {
+            panic!("session answers inline");
+        };
+        assert_eq!(pool.worker_of(301), 0);
+        assert_eq!(pool.worker_of(101), 1);
+
+        // Chained remaps follow the buffers too.
+        tx.send((301, 503)).unwrap();
+        fs.apply_pending_remaps();
+        let Dispatch::Workers(pool) = &fs.dispatch else {
+            panic!("session answers inline");
+        };
+        assert_eq!(pool.worker_of(503), 0);
+        assert_eq!(pool.worker_of(301), 1);
     }
 
     /// Helper for tests: locate an entry's index by full path (slow scan,
     /// only used in #[cfg(test)] code).
     fn buffer_for(fs: &NexusFs, pid: u32, path: &str) -> bool {
-        let Some(idx) = fs.entries.iter().position(|e| e.path == path) else {
+        let Some(idx) = fs.table.entries.iter().position(|e| e.path == path) else {
             return false;
         };
         fs.buffers.contains_key(&(pid, idx))
     }
 
+    #[test]
+    fn test_check_write() {
+        let frame = |len: u32, payload: &[u8]| {
+            let mut out = len.to_le_bytes().to_vec();
+            out.extend_from_slice(payload);
+            out
+        };
+        assert_eq!(check_write("lora/channel", &[0; 8], 8), Ok(()));
+        assert_eq!(check_write("lora/channel", &[0; 9], 8), Err(EMSGSIZE));
+        // Control files are not messages.
+        assert_eq!(check_write("ctl.energy_state", &[0; 9], 8), Ok(()));
+
+        let mut batch = frame(3, b"abc");
+        batch.extend(frame(0, b""));
+        assert_eq!(check_write("lora/batch", &batch, 8), Ok(()));
+        assert_eq!(check_write("lora/batch", &[], 8), Ok(()));
+        // Each frame gets the limit a single write does.
+        assert_eq!(
+            check_write("lora/batch", &frame(9, &[0; 9]), 8),
+            Err(EMSGSIZE)
+        );
+        // Truncated prefix, and a frame running past the end.
+        assert_eq!(check_write("lora/batch", &[1, 0], 8), Err(EINVAL));
+        assert_eq!(check_write("lora/batch", &frame(4, b"abc"), 8), Err(EINVAL));
+    }
+
+    #[test]
+    fn test_poll_answer() {
+        let entry = |kind, path: &str| FsEntry {
+            name: String::new(),
+            parent_inode: FUSE_ROOT_ID,
+            kind,
+            path: path.to_string(),
+        };
+        let channel = entry(FsEntryKind::RegularFile, "lora/channel");
+        let both = POLL_READABLE | POLL_WRITABLE;
+
+        // Readability of a data channel is the router's call.
+        assert_eq!(
+            poll_answer(&channel, ChannelMode::ReadWrite, both),
+            PollAnswer::Router {
+                ready: POLL_WRITABLE
+            }
+        );
+        for path in ["lora/batch", "lora/packet"] {
+            let file = entry(FsEntryKind::RegularFile, path);
+            assert_eq!(
+                poll_answer(&file, ChannelMode::ReadOnly, POLL_READABLE),
+                PollAnswer::Router { ready: 0 }
+            );
+        }
+        // Not asking for POLLIN, or unable to read: nothing to wait for.
+        assert_eq!(
+            poll_answer(&channel, ChannelMode::ReadWrite, POLL_WRITABLE),
+            PollAnswer::Ready(POLL_WRITABLE)
+        );
+        assert_eq!(
+            poll_answer(&channel, ChannelMode::WriteOnly, both),
+            PollAnswer::Ready(POLL_WRITABLE)
+        );
+        // Control files always have something to read.
+        let ctl = entry(FsEntryKind::ControlFile(ControlFile::Clock), "ctl.clock");
+        assert_eq!(
+            poll_answer(&ctl, ChannelMode::ReadOnly, both),
+            PollAnswer::Ready(POLL_READABLE)
+        );
+    }
+
     #[test]
     fn test_add_processes_creates_directories_and_files() {
         let fs = NexusFs::default().add_processes(&[100]);
 
         // Should have directory entries for ctl.time and ctl.elapsed
         assert!(
-            fs.entries
+            fs.table
+                .entries
                 .iter()
                 .any(|e| e.name == "ctl.time" && matches!(e.kind, FsEntryKind::Directory))
         );
         assert!(
-            fs.entries
+            fs.table
+                .entries
                 .iter()
                 .any(|e| e.name == "ctl.elapsed" && matches!(e.kind, FsEntryKind::Directory))
         );
@@ -870,7 +1346,8 @@ mod tests {
 
         // Should have ctl.pos directory
         assert!(
-            fs.entries
+            fs.table
+                .entries
                 .iter()
                 .any(|e| e.name == "ctl.pos" && matches!(e.kind, FsEntryKind::Directory))
         );
@@ -893,15 +1370,32 @@ mod tests {
 
         // Should have a "lora" directory
         assert!(
-            fs.entries
+            fs.table
+                .entries
                 .iter()
                 .any(|e| e.name == "lora" && matches!(e.kind, FsEntryKind::Directory))
         );
 
-        // Should have lora/channel, lora/rssi, lora/snr buffer entries
+        // Should have lora/channel, lora/batch, lora/packet, lora/rssi,
+        // lora/snr buffer entries
         assert!(buffer_for(&fs, 100, "lora/channel"));
+        assert!(buffer_for(&fs, 100, "lora/batch"));
+        assert!(buffer_for(&fs, 100, "lora/packet"));
         assert!(buffer_for(&fs, 100, "lora/rssi"));
         assert!(buffer_for(&fs, 100, "lora/snr"));
+        assert!(buffer_for(&fs, 100, "lora/shm"));
+
+        // Should have a lora/recv_timeout directory with one file per unit
+        assert!(
+            fs.table
+                .entries
+                .iter()
+                .any(|e| e.path == "lora/recv_timeout" && matches!(e.kind, FsEntryKind::Directory))
+        );
+        assert!(buffer_for(&fs, 100, "lora/recv_timeout/s"));
+        assert!(buffer_for(&fs, 100, "lora/recv_timeout/ms"));
+        assert!(buffer_for(&fs, 100, "lora/recv_timeout/us"));
+        assert!(buffer_for(&fs, 100, "lora/recv_timeout/ns"));
     }
 
     fn rx_is_empty(rx: &mpsc::Receiver<(u32, u32)>) -> bool {
@@ -2,9 +2,12 @@ pub mod channel;
 pub mod errors;
 pub mod file;
 pub mod fs;
+pub mod stats;
+mod workers;
 
 use config::ast::{self, TimeUnit};
-use fuser::{ReplyData, ReplyWrite};
+use fuser::{PollHandle, ReplyData, ReplyPoll, ReplyWrite};
+use std::time::Instant;
 
 pub type Mode = i32;
 pub type PID = u32;
@@ -26,14 +29,40 @@ pub struct ReadRequest {
     /// size and stashes any remainder in per-handle `unread_msg` state for
     /// the next read.
     pub size: u32,
+    /// When the FUSE worker forwarded the request, for the router's
+    /// request-to-reply latency.
+    pub issued: Instant,
     pub reply: ReplyData,
 }
 
+/// `poll(2)` events reported for a file that can be read without blocking.
+pub const POLL_READABLE: u32 = (libc::POLLIN | libc::POLLRDNORM) as u32;
+/// `poll(2)` events reported for a file that accepts writes.
+pub const POLL_WRITABLE: u32 = (libc::POLLOUT | libc::POLLWRNORM) as u32;
+
+/// Readiness query for a channel file. The FUSE worker fills in the events it
+/// can answer on its own (`ready`, e.g. `POLLOUT` for writable files) and the
+/// router adds `POLLIN` when the handle has a message waiting. If nothing is
+/// readable yet and the kernel asked to be notified, the router keeps `handle`
+/// and calls `notify()` once a message lands in the mailbox.
+#[derive(Debug)]
+pub struct PollRequest {
+    pub id: ChannelId,
+    /// Events already known to be ready, as a `poll(2)` bitmask.
+    pub ready: u32,
+    /// Whether the kernel wants a wakeup (`FUSE_POLL_SCHEDULE_NOTIFY`).
+    pub notify: bool,
+    pub handle: PollHandle,
+    pub reply: ReplyPoll,
+}
+
 #[derive(Debug)]
 pub enum FsMessage {
     Write(Message),
     Read(ReadRequest),
     Sleep(SleepEvent),
+    Poll(PollRequest),
+    Checkpoint(CheckpointWrite),
 }
 
 // `KernelMessage` (Exclusive/Shared/Empty) used to carry replies back from
@@ -61,6 +90,22 @@ pub struct SleepEvent {
     /// `reply.written()` so glibc's write loop sees the full request as
     /// consumed and doesn't reissue the syscall.
     pub bytes_consumed: u32,
+    /// When the FUSE worker forwarded the request, for the router's
+    /// request-to-reply latency.
+    pub issued: Instant,
+    /// FUSE object for marking write as concluded
+    pub reply: ReplyWrite,
+}
+
+/// Part of a protocol's saved state, written to `ctl.checkpoint`. The router
+/// answers the write that completes the state only once the simulation has
+/// stopped, so the process can make no further progress in between.
+#[derive(Debug)]
+pub struct CheckpointWrite {
+    /// PID of the process saving its state
+    pub pid: PID,
+    /// Bytes written
+    pub data: Vec<u8>,
     /// FUSE object for marking write as concluded
     pub reply: ReplyWrite,
 }
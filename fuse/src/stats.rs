@@ -0,0 +1,364 @@
+//! stats.rs
+//! Per-process operation counters and latency histograms. The FUSE worker
+//! times each lookup/open/read/write/sleep handler, and the router times
+//! reads and sleeps from the moment FUSE forwarded them to the moment it
+//! replied. Both sides record into one `Stats` registry keyed by PID, which
+//! backs `ctl.stats` and the per-protocol summary printed after a run.
+//!
+//! Collection never takes a lock: each thread keeps its own `LocalStats`
+//! cache of the per-process entries, and an entry is a block of relaxed
+//! atomics. The registry's mutex is only touched when a PID is registered,
+//! remapped, or first seen by a thread.
+
+use std::collections::HashMap;
+use std::fmt;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex};
+use std::time::Instant;
+
+use crate::PID;
+
+/// Number of latency buckets. Bucket 0 holds zero-length operations and
+/// bucket `i` holds those taking `[2^(i-1), 2^i)` ns, so the last one starts
+/// at roughly 275 s and absorbs anything longer.
+pub const BUCKETS: usize = 40;
+
+/// Operation being timed.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum Op {
+    Lookup,
+    Open,
+    Read,
+    Write,
+    /// Write to a `ctl.sleep.*` file.
+    Sleep,
+    /// Read request, from FUSE forwarding it to the router replying.
+    RouterRead,
+    /// Sleep request, from FUSE forwarding it to the router waking it.
+    RouterSleep,
+}
+
+impl Op {
+    pub const COUNT: usize = 7;
+    pub const ALL: [Op; Op::COUNT] = [
+        Op::Lookup,
+        Op::Open,
+        Op::Read,
+        Op::Write,
+        Op::Sleep,
+        Op::RouterRead,
+        Op::RouterSleep,
+    ];
+
+    pub const fn name(self) -> &'static str {
+        match self {
+            Op::Lookup => "lookup",
+            Op::Open => "open",
+            Op::Read => "read",
+            Op::Write => "write",
+            Op::Sleep => "sleep",
+            Op::RouterRead => "router_read",
+            Op::RouterSleep => "router_sleep",
+        }
+    }
+}
+
+/// Bucket an operation of `ns` nanoseconds falls in.
+fn bucket(ns: u64) -> usize {
+    ((u64::BITS - ns.leading_zeros()) as usize).min(BUCKETS - 1)
+}
+
+#[derive(Debug)]
+struct Histogram {
+    count: AtomicU64,
+    total_ns: AtomicU64,
+    buckets: [AtomicU64; BUCKETS],
+}
+
+impl Default for Histogram {
+    fn default() -> Self {
+        Self {
+            count: AtomicU64::new(0),
+            total_ns: AtomicU64::new(0),
+            buckets: std::array::from_fn(|_| AtomicU64::new(0)),
+        }
+    }
+}
+
+impl Histogram {
+    fn record(&self, ns: u64) {
+        self.count.fetch_add(1, Ordering::Relaxed);
+        self.total_ns.fetch_add(ns, Ordering::Relaxed);
+        self.buckets[bucket(ns)].fetch_add(1, Ordering::Relaxed);
+    }
+
+    fn snapshot(&self) -> OpSnapshot {
+        OpSnapshot {
+            count: self.count.load(Ordering::Relaxed),
+            total_ns: self.total_ns.load(Ordering::Relaxed),
+            buckets: std::array::from_fn(|i| self.buckets[i].load(Ordering::Relaxed)),
+        }
+    }
+}
+
+/// Live counters for one process.
+#[derive(Debug, Default)]
+pub struct ProcessStats {
+    ops: [Histogram; Op::COUNT],
+}
+
+impl ProcessStats {
+    /// Count one `op` that started at `start` and has just finished.
+    pub fn record(&self, op: Op, start: Instant) {
+        let ns = u64::try_from(start.elapsed().as_nanos()).unwrap_or(u64::MAX);
+        self.ops[op as usize].record(ns);
+    }
+
+    pub fn snapshot(&self) -> StatsSnapshot {
+        StatsSnapshot {
+            ops: std::array::from_fn(|i| self.ops[i].snapshot()),
+        }
+    }
+}
+
+/// Point-in-time copy of one operation's counters. Individual fields are
+/// read independently, so a snapshot taken mid-operation may be off by one.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct OpSnapshot {
+    pub count: u64,
+    pub total_ns: u64,
+    pub buckets: [u64; BUCKETS],
+}
+
+impl OpSnapshot {
+    pub fn mean_ns(&self) -> u64 {
+        self.total_ns.checked_div(self.count).unwrap_or(0)
+    }
+
+    /// Upper bound of the bucket holding the `q` quantile (0.0..=1.0), so
+    /// the true value is at most this and more than half of it.
+    pub fn quantile_ns(&self, q: f64) -> u64 {
+        let total: u64 = self.buckets.iter().sum();
+        if total == 0 {
+            return 0;
+        }
+        let rank = ((q.clamp(0.0, 1.0) * total as f64).ceil() as u64).max(1);
+        let mut seen = 0;
+        for (i, &n) in self.buckets.iter().enumerate() {
+            seen += n;
+            if seen >= rank {
+                return if i == 0 { 0 } else { 1 << i };
+            }
+        }
+        1 << (BUCKETS - 1)
+    }
+}
+
+/// Point-in-time copy of one process' counters.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub struct StatsSnapshot {
+    pub ops: [OpSnapshot; Op::COUNT],
+}
+
+impl StatsSnapshot {
+    pub fn get(&self, op: Op) -> &OpSnapshot {
+        &self.ops[op as usize]
+    }
+}
+
+/// The `ctl.stats` format: a header, then one whitespace-separated line per
+/// operation with latencies in nanoseconds.
+impl fmt::Display for StatsSnapshot {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        writeln!(f, "op count total_ns mean_ns p50_ns p99_ns")?;
+        for op in Op::ALL {
+            let s = self.get(op);
+            writeln!(
+                f,
+                "{} {} {} {} {} {}",
+                op.name(),
+                s.count,
+                s.total_ns,
+                s.mean_ns(),
+                s.quantile_ns(0.5),
+                s.quantile_ns(0.99)
+            )?;
+        }
+        Ok(())
+    }
+}
+
+/// Registry of per-process counters shared by the FUSE filesystem and the
+/// router. Only registered PIDs are counted, so stray processes poking at
+/// the mount do not grow it.
+#[derive(Debug, Default)]
+pub struct Stats {
+    processes: Mutex<HashMap<PID, Arc<ProcessStats>>>,
+}
+
+impl Stats {
+    pub fn register(&self, pid: PID) {
+        self.processes
+            .lock()
+            .expect("stats registry poisoned")
+            .entry(pid)
+            .or_default();
+    }
+
+    /// Count `new_pid` against the same entry as `old_pid`, so a protocol
+    /// restarted under a new PID keeps accumulating into one set of
+    /// counters.
+    pub fn remap(&self, old_pid: PID, new_pid: PID) {
+        let mut processes = self.processes.lock().expect("stats registry poisoned");
+        if let Some(entry) = processes.get(&old_pid).cloned() {
+            processes.insert(new_pid, entry);
+        }
+    }
+
+    pub fn get(&self, pid: PID) -> Option<Arc<ProcessStats>> {
+        self.processes
+            .lock()
+            .expect("stats registry poisoned")
+            .get(&pid)
+            .cloned()
+    }
+
+    pub fn snapshot(&self, pid: PID) -> Option<StatsSnapshot> {
+        self.get(pid).map(|stats| stats.snapshot())
+    }
+}
+
+/// One thread's handle on a `Stats` registry. Caches the entries it has
+/// already looked up, so recording is a map probe plus three relaxed atomic
+/// adds.
+#[derive(Debug)]
+pub struct LocalStats {
+    shared: Arc<Stats>,
+    cache: HashMap<PID, Arc<ProcessStats>>,
+}
+
+impl LocalStats {
+    pub fn new(shared: Arc<Stats>) -> Self {
+        Self {
+            shared,
+            cache: HashMap::new(),
+        }
+    }
+
+    pub fn shared(&self) -> &Arc<Stats> {
+        &self.shared
+    }
+
+    /// Counters for `pid`, or `None` if it was never registered. Misses are
+    /// not cached so a PID registered later is still picked up.
+    pub fn get(&mut self, pid: PID) -> Option<&Arc<ProcessStats>> {
+        if !self.cache.contains_key(&pid) {
+            let stats = self.shared.get(pid)?;
+            self.cache.insert(pid, stats);
+        }
+        self.cache.get(&pid)
+    }
+
+    /// Count one `op` by `pid` that started at `start`.
+    pub fn record(&mut self, pid: PID, op: Op, start: Instant) {
+        if let Some(stats) = self.get(pid) {
+            stats.record(op, start);
+        }
+    }
+
+    /// Start timing `op` by `pid`; it is recorded when the timer drops.
+    pub fn timer(&mut self, pid: PID, op: Op) -> OpTimer {
+        OpTimer {
+            stats: self.get(pid).cloned(),
+            op,
+            start: Instant::now(),
+        }
+    }
+}
+
+/// Records its operation when dropped, so every return path of a handler
+/// is counted.
+#[derive(Debug)]
+pub struct OpTimer {
+    stats: Option<Arc<ProcessStats>>,
+    op: Op,
+    start: Instant,
+}
+
+impl OpTimer {
+    /// Count the operation as `op` instead, for handlers whose kind is only
+    /// known once the target file has been resolved.
+    pub fn set_op(&mut self, op: Op) {
+        self.op = op;
+    }
+}
+
+impl Drop for OpTimer {
+    fn drop(&mut self) {
+        if let Some(stats) = &self.stats {
+            stats.record(self.op, self.start);
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn buckets_are_powers_of_two() {
+        assert_eq!(bucket(0), 0);
+        assert_eq!(bucket(1), 1);
+        assert_eq!(bucket(2), 2);
+        assert_eq!(bucket(3), 2);
+        assert_eq!(bucket(1024), 11);
+        assert_eq!(bucket(u64::MAX), BUCKETS - 1);
+    }
+
+    #[test]
+    fn quantiles_come_from_bucket_bounds() {
+        let h = Histogram::default();
+        for ns in [100, 100, 100, 100, 100, 100, 100, 100, 100, 5000] {
+            h.record(ns);
+        }
+        let s = h.snapshot();
+        assert_eq!(s.count, 10);
+        assert_eq!(s.mean_ns(), 590);
+        assert_eq!(s.quantile_ns(0.5), 128);
+        assert_eq!(s.quantile_ns(0.99), 8192);
+        assert_eq!(
+            OpSnapshot {
+                count: 0,
+                total_ns: 0,
+                buckets: [0; BUCKETS]
+            }
+            .quantile_ns(0.5),
+            0
+        );
+    }
+
+    #[test]
+    fn only_registered_pids_are_counted_and_remaps_share_counters() {
+        let shared = Arc::new(Stats::default());
+        shared.register(10);
+        let mut local = LocalStats::new(shared.clone());
+        local.record(10, Op::Read, Instant::now());
+        local.record(99, Op::Read, Instant::now());
+        assert!(shared.snapshot(99).is_none());
+
+        shared.remap(10, 11);
+        {
+            let mut timer = local.timer(11, Op::Write);
+            timer.set_op(Op::Sleep);
+        }
+        let snapshot = shared.snapshot(10).unwrap();
+        assert_eq!(snapshot.get(Op::Read).count, 1);
+        assert_eq!(snapshot.get(Op::Sleep).count, 1);
+        assert_eq!(snapshot.get(Op::Write).count, 0);
+        assert_eq!(shared.snapshot(11), Some(snapshot.clone()));
+
+        let text = snapshot.to_string();
+        assert_eq!(text.lines().count(), 1 + Op::COUNT);
+        assert!(text.starts_with("op count total_ns mean_ns p50_ns p99_ns\nlookup 0 0 0 0 0\n"));
+    }
+}
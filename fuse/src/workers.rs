@@ -0,0 +1,142 @@
+//! workers.rs
+//! Worker threads answering FUSE requests in parallel.
+//!
+//! fuser reads `/dev/fuse` on a single session thread. With more than one
+//! worker, that thread only resolves the calling process and hands the
+//! request, reply token included, to the worker owning the process. Process
+//! `p` starts out on worker `p % workers` along with all of its buffers, and
+//! every request it makes goes to that worker, so a process's requests are
+//! answered (and its writes reach the router) in the order it made them.
+//!
+//! When the router remaps a PID, the buffers are migrated by the worker that
+//! already holds them, and the new PID is pinned to that worker. Buffers
+//! never move between workers.
+
+use std::collections::HashMap;
+use std::ffi::OsString;
+use std::thread::{self, JoinHandle};
+
+use crossbeam_channel::Sender;
+use fuser::{PollHandle, ReplyAttr, ReplyData, ReplyEntry, ReplyOpen, ReplyPoll, ReplyWrite};
+
+use crate::fs::FsShard;
+use crate::{FsMessage, PID};
+
+/// A FUSE request for a worker to answer on behalf of a process.
+#[derive(Debug)]
+pub(crate) enum FsJob {
+    Lookup {
+        parent: u64,
+        name: OsString,
+        reply: ReplyEntry,
+    },
+    Getattr {
+        ino: u64,
+        reply: ReplyAttr,
+    },
+    Open {
+        ino: u64,
+        flags: i32,
+        reply: ReplyOpen,
+    },
+    Read {
+        ino: u64,
+        size: u32,
+        reply: ReplyData,
+    },
+    Write {
+        ino: u64,
+        data: Vec<u8>,
+        reply: ReplyWrite,
+    },
+    Poll {
+        ino: u64,
+        handle: PollHandle,
+        events: u32,
+        flags: u32,
+        reply: ReplyPoll,
+    },
+    /// Hand the process's buffers over to this PID.
+    Remap(PID),
+}
+
+/// Worker a process's buffers are placed on at mount.
+pub(crate) fn home_worker(pid: PID, workers: usize) -> usize {
+    pid as usize % workers
+}
+
+#[derive(Debug)]
+pub(crate) struct WorkerPool {
+    senders: Vec<Sender<(PID, FsJob)>>,
+    /// Remapped PIDs, and the worker their buffers are on.
+    pinned: HashMap<PID, usize>,
+    threads: Vec<JoinHandle<()>>,
+}
+
+impl WorkerPool {
+    /// Start one worker per shard. Shard `i` must hold the buffers of the
+    /// processes whose `home_worker` is `i`.
+    pub(crate) fn spawn<T>(shards: Vec<FsShard<T>>) -> Self
+    where
+        T: From<FsMessage> + Send + 'static,
+    {
+        let mut senders = Vec::with_capacity(shards.len());
+        let mut threads = Vec::with_capacity(shards.len());
+        for (i, mut shard) in shards.into_iter().enumerate() {
+            let (tx, rx) = crossbeam_channel::unbounded::<(PID, FsJob)>();
+            let thread = thread::Builder::new()
+                .name(format!("nexus-fuse-{i}"))
+                .spawn(move || {
+                    for (pid, job) in rx.iter() {
+                        shard.serve(pid, job);
+                    }
+                })
+                .expect("failed to spawn FUSE worker thread");
+            senders.push(tx);
+            threads.push(thread);
+        }
+        Self {
+            senders,
+            pinned: HashMap::new(),
+            threads,
+        }
+    }
+
+    pub(crate) fn worker_of(&self, pid: PID) -> usize {
+        self.pinned
+            .get(&pid)
+            .copied()
+            .unwrap_or_else(|| home_worker(pid, self.senders.len()))
+    }
+
+    /// Queue `job` on `pid`'s worker. If the worker is gone the job is
+    /// dropped, and with it the reply token, which fails the syscall with
+    /// EIO instead of leaving it hanging.
+    pub(crate) fn send(&self, pid: PID, job: FsJob) {
+        let _ = self.senders[self.worker_of(pid)].send((pid, job));
+    }
+
+    /// Migrate `old_pid`'s buffers to `new_pid` on the worker holding them.
+    /// Queued behind everything `old_pid` already sent, and ahead of
+    /// anything `new_pid` will.
+    pub(crate) fn remap(&mut self, old_pid: PID, new_pid: PID) {
+        let worker = self.worker_of(old_pid);
+        self.send(old_pid, FsJob::Remap(new_pid));
+        self.pinned.remove(&old_pid);
+        if worker == home_worker(new_pid, self.senders.len()) {
+            self.pinned.remove(&new_pid);
+        } else {
+            self.pinned.insert(new_pid, worker);
+        }
+    }
+}
+
+impl Drop for WorkerPool {
+    /// Let the workers finish what is queued, then wait for them.
+    fn drop(&mut self) {
+        self.senders.clear();
+        for thread in self.threads.drain(..) {
+            let _ = thread.join();
+        }
+    }
+}
@@ -9,7 +9,7 @@ use config::ast::DistanceUnit;
 
 use crate::config_editor;
 use crate::constants::*;
-use crate::panels::{breakpoints, grid, inspector, messages, sequence, timeline, toolbar};
+use crate::panels::{breakpoints, grid, inspector, messages, profile, sequence, timeline, toolbar};
 use crate::render::grid::GridView;
 use crate::sim::bridge::GuiEvent;
 use crate::state::*;
@@ -593,6 +593,7 @@ impl NexusApp {
                 state.event_cursor,
                 total_records,
                 &state.breakpoints,
+                None,
             );
             // Push speed changes back to the kernel's time_dilation atomic.
             state.time_dilation.store(
@@ -699,6 +700,7 @@ impl NexusApp {
                     state.current_timestep,
                     state.event_cursor,
                     &mut state.seq_zoom,
+                    None,
                 );
                 if let sequence::SequenceAction::JumpToEvent { record_index, node } = seq_action {
                     let already_selected = state.selected_node.as_ref() == Some(&node)
@@ -878,6 +880,7 @@ impl NexusApp {
                 view_mode: ViewMode::default(),
                 bp_input: BreakpointInput::default(),
                 seq_zoom: SEQ_ZOOM_DEFAULT,
+                profile_window: PROFILE_WINDOW_DEFAULT,
             }));
         }
     }
@@ -995,6 +998,7 @@ impl NexusApp {
                     &state.sim,
                     &mut state.messages[msg_start..],
                 );
+                trim_message_history(&mut state.messages, &mut state.expanded_messages);
                 state.current_timestep = actual_target;
                 state.node_states = state
                     .controller
@@ -1054,6 +1058,29 @@ impl NexusApp {
                                     }
                                 });
                         }
+
+                        if state.controller.has_cpu_samples() {
+                            ui.separator();
+
+                            egui::CollapsingHeader::new("CPU profile")
+                                .default_open(true)
+                                .show(ui, |ui| {
+                                    let node = state.selected_node.as_ref().and_then(|name| {
+                                        state.controller.node_names().iter().position(|n| n == name)
+                                    });
+                                    let from =
+                                        state.current_timestep.saturating_sub(state.profile_window);
+                                    profile::show_profile(
+                                        ui,
+                                        &state
+                                            .controller
+                                            .records_between(from, state.current_timestep),
+                                        node,
+                                        state.current_timestep,
+                                        &mut state.profile_window,
+                                    );
+                                });
+                        }
                     });
                 });
         }
@@ -1125,36 +1152,15 @@ impl NexusApp {
                 state.event_cursor,
                 total_records,
                 &state.breakpoints,
+                Some(state.controller.summary()),
             );
 
             if action.toggle_play {
                 state.playing = !state.playing;
             }
 
-            // Helper: seek to a timestep (shared by seek_to and event stepping)
-            let seek_to_ts = |state: &mut ReplayState, ts: u64, egui_time: f64| {
-                state.current_timestep = ts;
-                state.playing = false;
-                state.node_states = state
-                    .controller
-                    .reconstruct_states(ts, &state.initial_states);
-                state.messages.clear();
-                gather_messages_through(&state.controller, ts, &state.sim, &mut state.messages);
-                correlate_all_tx_receivers(&state.controller, &state.sim, &mut state.messages);
-                state.active_arrows.clear();
-                state.last_sender.fill(None);
-                gather_arrows_at(
-                    &state.controller,
-                    ts,
-                    &mut state.active_arrows,
-                    &state.channel_subscribers,
-                    &mut state.last_sender,
-                    egui_time,
-                );
-            };
-
             if let Some(ts) = action.seek_to {
-                seek_to_ts(state, ts, egui_time);
+                seek_replay_to(state, ts, egui_time);
                 // Snap event cursor to first record at this timestep
                 if state.event_stepping {
                     state.event_cursor = state.controller.first_record_index_at(ts);
@@ -1169,7 +1175,7 @@ impl NexusApp {
                         state.event_cursor = Some(next);
                         if let Some(ts) = state.controller.timestep_for_record(next) {
                             if ts != state.current_timestep {
-                                seek_to_ts(state, ts, egui_time);
+                                seek_replay_to(state, ts, egui_time);
                             }
                             state.current_timestep = ts;
                         }
@@ -1191,6 +1197,7 @@ impl NexusApp {
                         &state.sim,
                         &mut state.messages[msg_start..],
                     );
+                    trim_message_history(&mut state.messages, &mut state.expanded_messages);
                     gather_arrows_at(
                         &state.controller,
                         state.current_timestep,
@@ -1208,28 +1215,15 @@ impl NexusApp {
                     let start = state
                         .event_cursor
                         .unwrap_or(state.controller.total_records());
-                    let prev = state.controller.all_records()[..start]
-                        .iter()
-                        .enumerate()
-                        .rev()
-                        .find(|(_, r)| {
-                            matches!(
-                                r.event,
-                                TraceEvent::MessageSent { .. }
-                                    | TraceEvent::MessageRecv { .. }
-                                    | TraceEvent::MessageDropped { .. }
-                            )
-                        })
-                        .map(|(i, _)| i);
-                    if let Some(idx) = prev {
+                    if let Some(idx) = state.controller.previous_message_index(start) {
                         state.event_cursor = Some(idx);
                         if let Some(ts) = state.controller.timestep_for_record(idx) {
-                            seek_to_ts(state, ts, egui_time);
+                            seek_replay_to(state, ts, egui_time);
                         }
                     }
                 } else {
                     state.current_timestep = state.current_timestep.saturating_sub(1);
-                    seek_to_ts(state, state.current_timestep, egui_time);
+                    seek_replay_to(state, state.current_timestep, egui_time);
                 }
             }
         });
@@ -1246,23 +1240,33 @@ impl NexusApp {
                     state.current_timestep,
                     state.event_cursor,
                     &mut state.seq_zoom,
+                    Some((state.controller.summary(), state.controller.node_names())),
                 );
-                if let sequence::SequenceAction::JumpToEvent { record_index, node } = seq_action {
-                    let already_selected = state.selected_node.as_ref() == Some(&node)
-                        && state.event_cursor == Some(record_index);
-                    if already_selected {
-                        state.event_cursor = None;
-                        state.event_stepping = false;
-                        state.expanded_nodes.remove(&node);
-                        state.selected_node = None;
-                    } else {
-                        state.event_cursor = Some(record_index);
-                        state.event_stepping = true;
-                        state.expanded_nodes.clear();
-                        state.expanded_nodes.insert(node.clone());
-                        state.selected_node = Some(node);
-                        state.panels.inspector = true;
+                match seq_action {
+                    sequence::SequenceAction::JumpToEvent { record_index, node } => {
+                        let already_selected = state.selected_node.as_ref() == Some(&node)
+                            && state.event_cursor == Some(record_index);
+                        if already_selected {
+                            state.event_cursor = None;
+                            state.event_stepping = false;
+                            state.expanded_nodes.remove(&node);
+                            state.selected_node = None;
+                        } else {
+                            state.event_cursor = Some(record_index);
+                            state.event_stepping = true;
+                            state.expanded_nodes.clear();
+                            state.expanded_nodes.insert(node.clone());
+                            state.selected_node = Some(node);
+                            state.panels.inspector = true;
+                        }
                     }
+                    sequence::SequenceAction::Seek(ts) => {
+                        seek_replay_to(state, ts, egui_time);
+                        if state.event_stepping {
+                            state.event_cursor = state.controller.first_record_index_at(ts);
+                        }
+                    }
+                    sequence::SequenceAction::None => {}
                 }
             }
             ViewMode::Grid => {
@@ -1455,7 +1459,7 @@ impl NexusApp {
     fn new_config(&mut self) {
         use config::ast::*;
         use std::collections::HashMap;
-        use std::num::NonZeroU64;
+        use std::num::{NonZeroU64, NonZeroUsize};
         use std::time::SystemTime;
 
         let sim = Simulation {
@@ -1469,6 +1473,10 @@ impl NexusApp {
                 seed: 42,
                 root: std::env::temp_dir().join("nexus"),
                 time_dilation: 1.0,
+                skip_idle: false,
+                router_shards: NonZeroUsize::MIN,
+                fuse_workers: NonZeroUsize::MIN,
+                build_jobs: None,
             },
             channels: HashMap::new(),
             nodes: HashMap::new(),
@@ -1544,6 +1552,7 @@ impl NexusApp {
                         view_mode: ViewMode::default(),
                         bp_input: BreakpointInput::default(),
                         seq_zoom: SEQ_ZOOM_DEFAULT,
+                        profile_window: PROFILE_WINDOW_DEFAULT,
                     }));
                 }
                 Err(e) => {
@@ -1837,6 +1846,8 @@ fn process_gui_event(
                         state.motion_spec = spec.clone();
                     }
                 }
+                // Profiles are read from replays, not the live view.
+                TraceEvent::CpuSample { .. } => {}
             }
         }
         GuiEvent::TimestepAdvanced(ts) => {
@@ -1892,7 +1903,7 @@ fn create_sim_from_trace_header(
 ) -> config::ast::Simulation {
     use config::ast::*;
     use std::collections::HashMap;
-    use std::num::NonZeroU64;
+    use std::num::{NonZeroU64, NonZeroUsize};
     use std::time::SystemTime;
 
     let mut nodes = HashMap::new();
@@ -1937,40 +1948,84 @@ fn create_sim_from_trace_header(
             seed: 0,
             root: std::env::temp_dir(),
             time_dilation: 1.0,
+            skip_idle: false,
+            router_shards: NonZeroUsize::MIN,
+            fuse_workers: NonZeroUsize::MIN,
+            build_jobs: None,
         },
         channels: HashMap::new(),
         nodes,
     }
 }
 
+/// Seek replay to a timestep (shared by the timeline, event stepping and the
+/// sequence overview).
+fn seek_replay_to(state: &mut ReplayState, ts: u64, egui_time: f64) {
+    state.current_timestep = ts;
+    state.playing = false;
+    state.node_states = state
+        .controller
+        .reconstruct_states(ts, &state.initial_states);
+    state.messages.clear();
+    gather_messages_through(&state.controller, ts, &state.sim, &mut state.messages);
+    correlate_all_tx_receivers(&state.controller, &state.sim, &mut state.messages);
+    trim_message_history(&mut state.messages, &mut state.expanded_messages);
+    state.active_arrows.clear();
+    state.last_sender.fill(None);
+    gather_arrows_at(
+        &state.controller,
+        ts,
+        &mut state.active_arrows,
+        &state.channel_subscribers,
+        &mut state.last_sender,
+        egui_time,
+    );
+}
+
 fn gather_messages_at(
     controller: &crate::sim::replay::ReplayController,
     ts: u64,
     sim: &config::ast::Simulation,
     messages: &mut Vec<MessageEntry>,
 ) {
-    // Find the starting flat index for this timestep
-    let base_idx = controller.first_record_index_at(ts);
-    let records = controller.records_at(ts);
-    for (i, record) in records.iter().enumerate() {
-        let flat_idx = base_idx.map(|b| b + i);
-        if let Some(entry) = trace_record_to_message(record, sim, flat_idx) {
+    controller.for_each_record(ts, ts, |i, record| {
+        if let Some(entry) = trace_record_to_message(record, sim, Some(i)) {
             messages.push(entry);
         }
-    }
+    });
 }
 
+/// Gather the messages of the latest timesteps through `ts`, starting at
+/// the summary bucket that brings them to `MAX_MESSAGE_HISTORY`. Older ones
+/// are only shown in aggregate.
 fn gather_messages_through(
     controller: &crate::sim::replay::ReplayController,
     ts: u64,
     sim: &config::ast::Simulation,
     messages: &mut Vec<MessageEntry>,
 ) {
-    for (i, record) in controller.records_through(ts).iter().enumerate() {
+    let from = controller
+        .summary()
+        .window_start(ts, MAX_MESSAGE_HISTORY as u64);
+    controller.for_each_record(from, ts, |i, record| {
         if let Some(entry) = trace_record_to_message(record, sim, Some(i)) {
             messages.push(entry);
         }
+    });
+}
+
+/// Drop the oldest messages beyond `MAX_MESSAGE_HISTORY`, keeping expanded
+/// rows on the same messages.
+fn trim_message_history(messages: &mut Vec<MessageEntry>, expanded: &mut HashSet<usize>) {
+    let excess = messages.len().saturating_sub(MAX_MESSAGE_HISTORY);
+    if excess == 0 {
+        return;
     }
+    messages.drain(..excess);
+    *expanded = expanded
+        .iter()
+        .filter_map(|i| i.checked_sub(excess))
+        .collect();
 }
 
 /// Correlate TX messages with their corresponding RX/Drop events in replay mode.
@@ -2053,25 +2108,28 @@ fn correlate_all_tx_receivers(
         }
     }
 
-    // Check bit_errors from trace records for received messages
-    for record in controller.all_records() {
-        if let TraceEvent::MessageRecv {
-            dst_node,
-            bit_errors,
-            msg_id,
-            ..
-        } = &record.event
-            && *bit_errors
-            && let Some(&tx_idx) = tx_by_id.get(msg_id)
-        {
-            let node_name = node_name_by_index(sim, *dst_node as usize);
-            // Update matching rx_info
-            for info in &mut rx_infos {
-                if info.tx_idx == tx_idx && info.receiver.node == node_name {
-                    info.receiver.has_bit_errors = true;
+    // Check bit_errors from trace records for received messages, over the
+    // timesteps the messages span
+    if let (Some(first), Some(last)) = (messages.first(), messages.last()) {
+        controller.for_each_record(first.timestep, last.timestep, |_, record| {
+            if let TraceEvent::MessageRecv {
+                dst_node,
+                bit_errors,
+                msg_id,
+                ..
+            } = &record.event
+                && *bit_errors
+                && let Some(&tx_idx) = tx_by_id.get(msg_id)
+            {
+                let node_name = node_name_by_index(sim, *dst_node as usize);
+                // Update matching rx_info
+                for info in &mut rx_infos {
+                    if info.tx_idx == tx_idx && info.receiver.node == node_name {
+                        info.receiver.has_bit_errors = true;
+                    }
                 }
             }
-        }
+        });
     }
 
     // Apply receiver info to TX entries
@@ -387,10 +387,12 @@ fn show_protocols(
                             cmd: String::new(),
                             args: Vec::new(),
                         },
+                        build_inputs: Vec::new(),
                         runner: Cmd {
                             cmd: String::new(),
                             args: Vec::new(),
                         },
+                        zygote: false,
                         publishers: HashSet::new(),
                         subscribers: HashSet::new(),
                     },
@@ -47,6 +47,9 @@ pub const COLOR_REMOVE_BUTTON: Color32 = Color32::from_rgb(200, 60, 60);
 pub const COLOR_MODULE_REMOVE: Color32 = Color32::from_rgb(220, 60, 60);
 pub const COLOR_IMPORTED_GREEN: Color32 = Color32::from_rgb(60, 160, 60);
 
+// Flame graph
+pub const COLOR_FLAME_TEXT: Color32 = Color32::from_gray(20);
+
 // -- Node rendering -----------------------------------------------------------
 pub const NODE_RADIUS: f32 = 4.0;
 pub const NODE_ZOOM_CLAMP_MIN: f32 = 0.3;
@@ -93,6 +96,20 @@ pub const SEQ_DOT_RADIUS_CURRENT: f32 = 7.0;
 pub const SEQ_SELECTION_RING_RADIUS: f32 = 10.0;
 pub const SEQ_SELECTION_RING_STROKE: f32 = 2.0;
 
+// -- Sequence overview --------------------------------------------------------
+/// Zoom below which a replay's sequence diagram shows the trace summary.
+pub const SEQ_LOD_ZOOM: f32 = 0.5;
+pub const SEQ_LOD_MAX_ROWS: usize = 512;
+pub const SEQ_LOD_ROW_HEIGHT: f32 = 6.0;
+pub const SEQ_LOD_ROW_GAP: f32 = 1.0;
+pub const SEQ_LOD_LABEL_EVERY: usize = 8;
+/// Share of the lifeline spacing the busiest cell's bar fills.
+pub const SEQ_LOD_BAR_FILL: f32 = 0.8;
+pub const SEQ_LOD_BAR_MIN_WIDTH: f32 = 2.0;
+
+// -- Timeline activity strip --------------------------------------------------
+pub const TIMELINE_ACTIVITY_HEIGHT: f32 = 14.0;
+
 // -- Grid view ----------------------------------------------------------------
 pub const GRID_ZOOM_MIN: f32 = 0.01;
 pub const GRID_ZOOM_MAX: f32 = 1000.0;
@@ -112,11 +129,28 @@ pub const CONFIG_PANEL_WIDTH: f32 = 300.0;
 pub const INSPECTOR_PANEL_WIDTH: f32 = 180.0;
 pub const BREAKPOINTS_PANEL_WIDTH: f32 = 220.0;
 pub const MAX_MESSAGES_DISPLAY: usize = 200;
+/// Messages kept for the messages panel and sequence diagram in replay;
+/// older ones are shown in aggregate.
+pub const MAX_MESSAGE_HISTORY: usize = 2_000;
 pub const INSPECTOR_EVENTS_SCROLL_HEIGHT: f32 = 200.0;
 pub const BREAKPOINTS_SCROLL_HEIGHT: f32 = 120.0;
 
+// -- Flame graph --------------------------------------------------------------
+pub const FLAME_ROW_HEIGHT: f32 = 16.0;
+pub const FLAME_FONT_SIZE: f32 = 10.0;
+pub const FLAME_MIN_WIDTH: f32 = 1.0;
+pub const FLAME_GAP: f32 = 1.0;
+pub const FLAME_LABEL_PADDING: f32 = 2.0;
+pub const PROFILE_WINDOW_DEFAULT: u64 = 100;
+
 // -- Playback -----------------------------------------------------------------
 pub const PLAYBACK_SPEED_MIN: f32 = 0.1;
 pub const PLAYBACK_SPEED_MAX: f32 = 10.0;
 pub const PLAYBACK_SPEED_DEFAULT: f32 = 1.0;
 pub const SEQ_ZOOM_DEFAULT: f32 = 1.0;
+
+// -- Replay -------------------------------------------------------------------
+/// Decoded trace blocks kept in memory (64 KiB of records each, encoded).
+pub const REPLAY_BLOCK_CACHE: usize = 16;
+/// Node state snapshots kept for seeking back.
+pub const REPLAY_STATE_CHECKPOINTS: u64 = 256;
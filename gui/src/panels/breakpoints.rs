@@ -303,6 +303,8 @@ pub fn check_breakpoints(
                     TraceEvent::PositionUpdate { node, .. } => Some(*node),
                     TraceEvent::EnergyUpdate { node, .. } => Some(*node),
                     TraceEvent::MotionUpdate { node, .. } => Some(*node),
+                    // Profiler samples are not something the node did.
+                    TraceEvent::CpuSample { .. } => None,
                 };
                 if let Some(idx) = node_idx {
                     let node_name = node_name_by_index(sim, idx as usize);
@@ -2,6 +2,7 @@ pub mod breakpoints;
 pub mod grid;
 pub mod inspector;
 pub mod messages;
+pub mod profile;
 pub mod sequence;
 pub mod timeline;
 pub mod toolbar;
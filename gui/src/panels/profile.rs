@@ -0,0 +1,200 @@
+use std::collections::BTreeMap;
+
+use egui::{Color32, FontId, Pos2, Rect, Sense, Ui, Vec2};
+use trace::format::{TraceEvent, TraceRecord};
+
+use crate::constants::*;
+
+/// Samples of one frame and the frames it called, by name.
+#[derive(Default)]
+struct Frame {
+    count: u64,
+    children: BTreeMap<String, Frame>,
+}
+
+impl Frame {
+    /// Rows the frame and its callees take up.
+    fn depth(&self) -> usize {
+        1 + self.children.values().map(Frame::depth).max().unwrap_or(0)
+    }
+}
+
+/// Fold the CPU samples of `node` into a call tree rooted at its protocols.
+fn build_tree(records: &[TraceRecord], node: u32) -> Frame {
+    let mut root = Frame::default();
+    for record in records {
+        let TraceEvent::CpuSample {
+            node: n,
+            protocol,
+            stack,
+            count,
+        } = &record.event
+        else {
+            continue;
+        };
+        if *n != node {
+            continue;
+        }
+        let count = u64::from(*count);
+        root.count += count;
+        let mut frame = root.children.entry(protocol.clone()).or_default();
+        frame.count += count;
+        for name in stack.split(';').filter(|name| !name.is_empty()) {
+            frame = frame.children.entry(name.to_string()).or_default();
+            frame.count += count;
+        }
+    }
+    root
+}
+
+/// Stable warm colour per function name, as flame graphs use.
+fn frame_color(name: &str) -> Color32 {
+    let hash = name.bytes().fold(0xcbf2_9ce4_8422_2325u64, |h, b| {
+        (h ^ u64::from(b)).wrapping_mul(0x100_0000_01b3)
+    });
+    Color32::from_rgb(
+        205 + (hash % 50) as u8,
+        80 + ((hash >> 8) % 120) as u8,
+        40 + ((hash >> 16) % 50) as u8,
+    )
+}
+
+/// Draw the callees of `frame`, spread over `width` pixels from `x`, one row
+/// below `y`. Sets `hovered` to the tooltip of the frame under `pointer`.
+#[allow(clippy::too_many_arguments)]
+fn draw_children(
+    ui: &Ui,
+    frame: &Frame,
+    x: f32,
+    y: f32,
+    width: f32,
+    total: u64,
+    pointer: Option<Pos2>,
+    hovered: &mut Option<String>,
+) {
+    let mut left = x;
+    for (name, child) in &frame.children {
+        let w = width * child.count as f32 / frame.count as f32;
+        if w >= FLAME_MIN_WIDTH {
+            let rect = Rect::from_min_size(
+                Pos2::new(left, y),
+                Vec2::new(w - FLAME_GAP, FLAME_ROW_HEIGHT - FLAME_GAP),
+            );
+            let painter = ui.painter().with_clip_rect(rect.intersect(ui.clip_rect()));
+            painter.rect_filled(rect, 0.0, frame_color(name));
+            painter.text(
+                rect.left_center() + Vec2::new(FLAME_LABEL_PADDING, 0.0),
+                egui::Align2::LEFT_CENTER,
+                name,
+                FontId::monospace(FLAME_FONT_SIZE),
+                COLOR_FLAME_TEXT,
+            );
+            if pointer.is_some_and(|p| rect.contains(p)) {
+                let share = 100.0 * child.count as f64 / total as f64;
+                *hovered = Some(format!("{name}\n{} samples ({share:.1}%)", child.count));
+            }
+            draw_children(
+                ui,
+                child,
+                left,
+                y + FLAME_ROW_HEIGHT,
+                w,
+                total,
+                pointer,
+                hovered,
+            );
+        }
+        left += w;
+    }
+}
+
+/// Show a flame graph of where `node` spent its CPU time in the `window`
+/// timesteps up to `current_timestep`, from the trace's CPU samples.
+/// `records` must be in timestep order.
+pub fn show_profile(
+    ui: &mut Ui,
+    records: &[TraceRecord],
+    node: Option<usize>,
+    current_timestep: u64,
+    window: &mut u64,
+) {
+    let from = current_timestep.saturating_sub(*window);
+    ui.horizontal(|ui| {
+        ui.label("Window");
+        ui.add(
+            egui::DragValue::new(window)
+                .range(1..=u64::MAX)
+                .suffix(" ts"),
+        );
+        ui.label(
+            egui::RichText::new(format!("t={from}..={current_timestep}")).color(COLOR_LABEL_DIM),
+        );
+    });
+
+    let Some(node) = node else {
+        ui.label(egui::RichText::new("Select a node").color(COLOR_LABEL_DIM));
+        return;
+    };
+    let start = records.partition_point(|r| r.timestep < from);
+    let end = records.partition_point(|r| r.timestep <= current_timestep);
+    let root = build_tree(&records[start..end.max(start)], node as u32);
+    if root.count == 0 {
+        ui.label(
+            egui::RichText::new("No CPU samples (simulate with --profile)").color(COLOR_LABEL_DIM),
+        );
+        return;
+    }
+    ui.label(egui::RichText::new(format!("{} samples", root.count)).color(COLOR_LABEL_DIM));
+
+    let size = Vec2::new(
+        ui.available_width(),
+        (root.depth() - 1) as f32 * FLAME_ROW_HEIGHT,
+    );
+    let (rect, response) = ui.allocate_exact_size(size, Sense::hover());
+    let mut hovered = None;
+    draw_children(
+        ui,
+        &root,
+        rect.left(),
+        rect.top(),
+        rect.width(),
+        root.count,
+        response.hover_pos(),
+        &mut hovered,
+    );
+    if let Some(text) = hovered {
+        response.on_hover_text_at_pointer(text);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn sample(timestep: u64, node: u32, stack: &str, count: u32) -> TraceRecord {
+        TraceRecord {
+            timestep,
+            event: TraceEvent::CpuSample {
+                node,
+                protocol: "p".into(),
+                stack: stack.into(),
+                count,
+            },
+        }
+    }
+
+    #[test]
+    fn tree_counts_every_frame_on_the_stack() {
+        let records = [
+            sample(1, 0, "main;loop;send", 2),
+            sample(2, 0, "main;loop", 1),
+            sample(2, 1, "main", 5),
+        ];
+        let root = build_tree(&records, 0);
+        assert_eq!(root.count, 3);
+        assert_eq!(root.depth(), 5);
+        let main = &root.children["p"].children["main"];
+        assert_eq!(main.count, 3);
+        assert_eq!(main.children["loop"].children["send"].count, 2);
+    }
+}
@@ -1,4 +1,5 @@
-use egui::{Pos2, Rect, Stroke, Ui, Vec2};
+use egui::{Color32, Pos2, Rect, Stroke, Ui, Vec2};
+use trace::summary::{Counts, TraceSummary};
 
 use crate::constants::*;
 use crate::state::{MessageEntry, MessageKind, ReceiverOutcome};
@@ -12,6 +13,8 @@ pub enum SequenceAction {
         record_index: usize,
         node: String,
     },
+    /// User clicked a row of the overview; seek to this timestep.
+    Seek(u64),
 }
 
 /// Show the message sequence diagram.
@@ -28,6 +31,11 @@ pub enum SequenceAction {
 ///
 /// `zoom` scales both the lifeline spacing and row height. Ctrl+scroll
 /// adjusts it in-place.
+///
+/// Given an `overview` (the trace summary, and the trace's node names in
+/// summary order), zooming out below `SEQ_LOD_ZOOM` switches to drawing the
+/// whole trace in aggregate; see `show_overview`.
+#[allow(clippy::too_many_arguments)]
 pub fn show_sequence_diagram(
     ui: &mut Ui,
     messages: &[MessageEntry],
@@ -35,6 +43,7 @@ pub fn show_sequence_diagram(
     current_timestep: u64,
     current_event: Option<usize>,
     zoom: &mut f32,
+    overview: Option<(&TraceSummary, &[String])>,
 ) -> SequenceAction {
     let mut action = SequenceAction::None;
 
@@ -65,6 +74,19 @@ pub fn show_sequence_diagram(
     let mut sorted_names: Vec<String> = node_names.to_vec();
     sorted_names.sort();
 
+    if let Some((summary, trace_nodes)) = overview
+        && *zoom < SEQ_LOD_ZOOM
+    {
+        return show_overview(
+            ui,
+            summary,
+            trace_nodes,
+            &sorted_names,
+            lifeline_spacing,
+            current_timestep,
+        );
+    }
+
     let margin = lifeline_spacing / 2.0;
     let total_width = (sorted_names.len() as f32) * lifeline_spacing;
 
@@ -425,3 +447,171 @@ pub fn show_sequence_diagram(
 
     action
 }
+
+/// Draw the whole trace from its summary, one row per bucket of the finest
+/// level that fits in `SEQ_LOD_MAX_ROWS` rows. Each lifeline gets a bar per
+/// row as wide as the node's message count relative to the busiest cell,
+/// shading from green to red with its drop rate. Only the rows in view are
+/// drawn, and clicking one seeks to its first timestep.
+fn show_overview(
+    ui: &mut Ui,
+    summary: &TraceSummary,
+    trace_nodes: &[String],
+    sorted_names: &[String],
+    lifeline_spacing: f32,
+    current_timestep: u64,
+) -> SequenceAction {
+    let mut action = SequenceAction::None;
+    let finest = &summary.levels()[0];
+    let level = summary.level_for(finest.len() as u64 * finest.width, SEQ_LOD_MAX_ROWS);
+    // Summary series behind each lifeline.
+    let series: Vec<Option<&[Counts]>> = sorted_names
+        .iter()
+        .map(|name| {
+            trace_nodes
+                .iter()
+                .position(|n| n == name)
+                .and_then(|i| level.nodes.get(i))
+                .map(Vec::as_slice)
+        })
+        .collect();
+    let busiest = series
+        .iter()
+        .flatten()
+        .flat_map(|s| s.iter())
+        .map(Counts::total)
+        .max()
+        .unwrap_or(0)
+        .max(1);
+
+    ui.label(
+        egui::RichText::new(format!(
+            "Overview, {} timesteps per row. Zoom in for messages.",
+            level.width
+        ))
+        .color(COLOR_LABEL_DIM),
+    );
+
+    let row_height = SEQ_LOD_ROW_HEIGHT;
+    let margin = lifeline_spacing / 2.0;
+    let total_width = (sorted_names.len() as f32) * lifeline_spacing;
+    egui::ScrollArea::both()
+        .id_salt("sequence_overview_scroll")
+        .scroll_bar_visibility(egui::scroll_area::ScrollBarVisibility::AlwaysVisible)
+        .show(ui, |ui| {
+            let total_height =
+                SEQ_HEADER_HEIGHT + (level.len() as f32) * row_height + SEQ_BOTTOM_PADDING;
+            let (rect, response) = ui.allocate_exact_size(
+                Vec2::new(
+                    (total_width + SEQ_TS_LABEL_MARGIN).max(ui.available_width()),
+                    total_height,
+                ),
+                egui::Sense::click(),
+            );
+            let painter = ui.painter_at(rect);
+            let lifeline_x = |i: usize| {
+                rect.left() + SEQ_TS_LABEL_MARGIN + margin + (i as f32) * lifeline_spacing
+            };
+            let body_top = rect.top() + SEQ_HEADER_HEIGHT;
+
+            for (i, name) in sorted_names.iter().enumerate() {
+                painter.text(
+                    Pos2::new(lifeline_x(i), rect.top() + SEQ_HEADER_HEIGHT / 2.0),
+                    egui::Align2::CENTER_CENTER,
+                    name,
+                    egui::FontId::proportional(SEQ_FONT_SIZE_MIN),
+                    COLOR_HEADER,
+                );
+                painter.line_segment(
+                    [
+                        Pos2::new(lifeline_x(i), body_top),
+                        Pos2::new(lifeline_x(i), rect.bottom()),
+                    ],
+                    Stroke::new(SEQ_LIFELINE_STROKE, COLOR_LIFELINE),
+                );
+            }
+
+            let current = level.bucket_of(current_timestep);
+            painter.rect_filled(
+                Rect::from_min_size(
+                    Pos2::new(rect.left(), body_top + (current as f32) * row_height),
+                    Vec2::new(rect.width(), row_height),
+                ),
+                0.0,
+                COLOR_HIGHLIGHT,
+            );
+
+            let row_at = |y: f32| ((y - body_top) / row_height).floor().max(0.0) as usize;
+            let clip = ui.clip_rect();
+            let visible = row_at(clip.top())..(row_at(clip.bottom()) + 1).min(level.len());
+            let pointer = response.hover_pos();
+            let mut hovered = None;
+            for bucket in visible {
+                let y = body_top + (bucket as f32) * row_height;
+                if bucket % SEQ_LOD_LABEL_EVERY == 0 {
+                    painter.text(
+                        Pos2::new(rect.left() + GRID_LABEL_OFFSET, y + row_height / 2.0),
+                        egui::Align2::LEFT_CENTER,
+                        format!("t={}", level.start_of(bucket)),
+                        egui::FontId::proportional(SEQ_TS_FONT_MIN),
+                        COLOR_TS_LABEL,
+                    );
+                }
+                for (i, counts) in series.iter().enumerate() {
+                    let Some(counts) = counts.map(|s| s[bucket]) else {
+                        continue;
+                    };
+                    if counts.total() == 0 {
+                        continue;
+                    }
+                    let share = counts.total() as f32 / busiest as f32;
+                    let bar = Rect::from_center_size(
+                        Pos2::new(lifeline_x(i), y + row_height / 2.0),
+                        Vec2::new(
+                            (lifeline_spacing * SEQ_LOD_BAR_FILL * share)
+                                .max(SEQ_LOD_BAR_MIN_WIDTH),
+                            row_height - SEQ_LOD_ROW_GAP,
+                        ),
+                    );
+                    let color = mix(COLOR_TX_OK, COLOR_DROP, counts.drop_rate().unwrap_or(0.0));
+                    painter.rect_filled(bar, 0.0, color);
+                    if pointer.is_some_and(|p| {
+                        row_at(p.y) == bucket && (p.x - lifeline_x(i)).abs() <= margin
+                    }) {
+                        hovered = Some((i, bucket, counts));
+                    }
+                }
+            }
+
+            if response.clicked()
+                && let Some(p) = response.interact_pointer_pos()
+                && !level.is_empty()
+            {
+                action = SequenceAction::Seek(level.start_of(row_at(p.y).min(level.len() - 1)));
+            }
+            if let Some((i, bucket, counts)) = hovered {
+                let start = level.start_of(bucket);
+                let dropped = counts
+                    .drop_rate()
+                    .map(|rate| format!(" ({:.0}% of deliveries)", rate * 100.0))
+                    .unwrap_or_default();
+                response.on_hover_text_at_pointer(format!(
+                    "{}  t={}..{}\n{} sent, {} received, {} dropped{dropped}",
+                    sorted_names[i],
+                    start,
+                    start + level.width - 1,
+                    counts.sent,
+                    counts.received,
+                    counts.dropped,
+                ));
+            }
+        });
+
+    action
+}
+
+/// Blend from `a` to `b` by `t` in 0..=1.
+fn mix(a: Color32, b: Color32, t: f32) -> Color32 {
+    let lerp = |x: u8, y: u8| (f32::from(x) + (f32::from(y) - f32::from(x)) * t).round() as u8;
+    Color32::from_rgb(lerp(a.r(), b.r()), lerp(a.g(), b.g()), lerp(a.b(), b.b()))
+}
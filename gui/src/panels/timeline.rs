@@ -1,4 +1,5 @@
-use egui::Ui;
+use egui::{Pos2, Rect, Ui, Vec2};
+use trace::summary::TraceSummary;
 
 use crate::constants::*;
 use crate::state::Breakpoint;
@@ -14,6 +15,7 @@ pub struct TimelineAction {
 ///
 /// `event_stepping` / `event_cursor` / `total_records` enable event-level controls.
 /// `breakpoints` renders timestep breakpoint markers on the scrubber.
+/// `overview`, in replay, draws the trace's message activity under it.
 #[allow(clippy::too_many_arguments)]
 pub fn show_timeline(
     ui: &mut Ui,
@@ -25,6 +27,7 @@ pub fn show_timeline(
     event_cursor: Option<usize>,
     total_records: usize,
     breakpoints: &[Breakpoint],
+    overview: Option<&TraceSummary>,
 ) -> TimelineAction {
     let mut action = TimelineAction {
         seek_to: None,
@@ -33,6 +36,7 @@ pub fn show_timeline(
         step_backward: false,
     };
 
+    let mut scrubber = Rect::NOTHING;
     egui::Frame::NONE
         .inner_margin(PANEL_FRAME_MARGIN)
         .show(ui, |ui| {
@@ -90,6 +94,7 @@ pub fn show_timeline(
                     .text("timestep")
                     .integer();
                 let slider_resp = ui.add(slider);
+                scrubber = slider_resp.rect;
                 if slider_resp.changed() {
                     action.seek_to = Some(ts_f32 as u64);
                 }
@@ -141,7 +146,88 @@ pub fn show_timeline(
                     }
                 });
             });
+
+            if let Some(summary) = overview {
+                show_activity(ui, summary, scrubber, total_timesteps, &mut action);
+            }
         }); // Frame
 
     action
 }
+
+/// Draw a strip under the scrubber's span with a bar per summary bucket, as
+/// tall as its message count relative to the busiest bucket and red for the
+/// share dropped. Clicking the strip seeks there.
+fn show_activity(
+    ui: &mut Ui,
+    summary: &TraceSummary,
+    scrubber: Rect,
+    total_timesteps: u64,
+    action: &mut TimelineAction,
+) {
+    let (row, response) = ui.allocate_exact_size(
+        Vec2::new(ui.available_width(), TIMELINE_ACTIVITY_HEIGHT),
+        egui::Sense::click(),
+    );
+    let strip = Rect::from_x_y_ranges(scrubber.x_range(), row.y_range());
+    if strip.width() <= 0.0 {
+        return;
+    }
+    let span = total_timesteps + 1;
+    let level = summary.level_for(span, strip.width() as usize);
+    let busiest = level
+        .total
+        .iter()
+        .map(|c| c.total())
+        .max()
+        .unwrap_or(0)
+        .max(1);
+    let x_of = |ts: u64| strip.left() + strip.width() * (ts as f32 / span as f32);
+    let painter = ui.painter_at(strip);
+    for (bucket, counts) in level.total.iter().enumerate() {
+        if counts.total() == 0 {
+            continue;
+        }
+        let start = level.start_of(bucket);
+        let left = x_of(start);
+        let right = x_of(start + level.width).max(left + 1.0);
+        let height = strip.height() * counts.total() as f32 / busiest as f32;
+        let dropped = height * counts.dropped as f32 / counts.total() as f32;
+        let bottom = strip.bottom();
+        painter.rect_filled(
+            Rect::from_min_max(Pos2::new(left, bottom - height), Pos2::new(right, bottom)),
+            0.0,
+            COLOR_TX_OK,
+        );
+        painter.rect_filled(
+            Rect::from_min_max(Pos2::new(left, bottom - dropped), Pos2::new(right, bottom)),
+            0.0,
+            COLOR_DROP,
+        );
+    }
+
+    let ts_at = |x: f32| {
+        let frac = ((x - strip.left()) / strip.width()).clamp(0.0, 1.0);
+        ((frac * span as f32) as u64).min(total_timesteps)
+    };
+    if response.clicked()
+        && let Some(p) = response.interact_pointer_pos()
+    {
+        action.seek_to = Some(ts_at(p.x));
+    }
+    if let Some(p) = response.hover_pos()
+        && strip.x_range().contains(p.x)
+    {
+        let bucket = level.bucket_of(ts_at(p.x));
+        let counts = level.total[bucket];
+        let start = level.start_of(bucket);
+        response.on_hover_text_at_pointer(format!(
+            "t={}..{}\n{} sent, {} received, {} dropped",
+            start,
+            start + level.width - 1,
+            counts.sent,
+            counts.received,
+            counts.dropped,
+        ));
+    }
+}
@@ -211,10 +211,12 @@ fn run_inner(
     let protocol_channels = make_fs_channels(&sim, &runc.handles)?;
     let (remap_tx, remap_rx) = std::sync::mpsc::channel();
     let (router_input_tx, router_input_rx) = crossbeam_channel::unbounded::<kernel::RouterInput>();
-    let fs = NexusFs::<kernel::RouterInput>::new(fs_root, remap_rx, router_input_tx.clone());
+    let fs = NexusFs::<kernel::RouterInput>::new(fs_root, remap_rx, router_input_tx.clone())
+        .workers(sim.params.fuse_workers);
 
     let file_handles = make_file_handles(&sim, &runc.handles);
     let pids: Vec<u32> = runc.handles.iter().filter_map(|h| h.pid()).collect();
+    let stats = fs.stats();
 
     let sess = fs
         .add_processes(&pids)
@@ -236,9 +238,15 @@ fn run_inner(
     .abort_flag(abort)
     .pause_flag(pause)
     .time_dilation(time_dilation)
+    .stats(stats)
     .build()?;
     let protocol_handles = kernel.run(RunCmd::Simulate {
         config: PathBuf::new(),
+        checkpoint_at: None,
+        resume_from: None,
+        profile: None,
+        partition: None,
+        peers: Vec::new(),
     })?;
 
     // Kill processes first so their pipes close, unblocking reader threads.
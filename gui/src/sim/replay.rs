@@ -1,44 +1,65 @@
-use std::ops::Range;
+use std::cell::RefCell;
+use std::collections::VecDeque;
 use std::path::Path;
+use std::rc::Rc;
 
 use trace::format::{TraceEvent, TraceRecord};
 use trace::reader::{TraceReadError, TraceReader};
+use trace::summary::TraceSummary;
 
+use crate::constants::*;
 use crate::state::NodeState;
 
 /// Controls replay of a trace file with seeking and state reconstruction.
+///
+/// Records stay in the trace file: blocks are decoded when a query reaches
+/// them and a few recent ones are cached, so memory does not grow with the
+/// length of the trace. Views of the whole trace are drawn from its
+/// `TraceSummary` instead.
 pub struct ReplayController {
     reader: TraceReader,
-    /// All records, loaded into memory for fast seeking.
-    all_records: Vec<TraceRecord>,
-    /// Sorted index: (timestep, range into all_records).
-    ts_ranges: Vec<(u64, Range<usize>)>,
+    summary: TraceSummary,
+    /// Flat index of each block's first record, then the total.
+    block_starts: Vec<usize>,
+    /// Recently decoded blocks, most recently used last.
+    cache: RefCell<VecDeque<(usize, Rc<[TraceRecord]>)>>,
     pub total_timesteps: u64,
     /// Cached state from last reconstruction to allow incremental replay.
     last_reconstructed: Option<(u64, Vec<NodeState>)>,
+    /// Node states after every `checkpoint_interval`th timestep reached so
+    /// far, in order, so seeking back replays from the nearest one.
+    checkpoints: Vec<(u64, Vec<NodeState>)>,
+    checkpoint_interval: u64,
 }
 
 impl ReplayController {
     pub fn open(path: impl AsRef<Path>) -> Result<Self, TraceReadError> {
+        let path = path.as_ref();
         let mut reader = TraceReader::open(path)?;
         let total_timesteps = reader.header.timestep_count;
+        let summary = TraceSummary::open(path, &mut reader)?;
 
-        // Load all records into memory for fast seeking
-        let mut all_records = Vec::new();
-        reader.rewind()?;
-        while let Some(record) = reader.next_record()? {
-            all_records.push(record);
+        let mut block_starts = Vec::with_capacity(reader.block_count() + 1);
+        let mut start = 0;
+        for i in 0..reader.block_count() {
+            block_starts.push(start);
+            start += match reader.block_info(i).map_or(0, |info| info.records) {
+                // Unblocked traces do not say how many records they hold.
+                0 => reader.read_block(i)?.len(),
+                records => records as usize,
+            };
         }
-
-        // Build timestep index
-        let ts_ranges = build_ts_index(&all_records);
+        block_starts.push(start);
 
         Ok(Self {
             reader,
-            all_records,
-            ts_ranges,
+            summary,
+            block_starts,
+            cache: RefCell::new(VecDeque::new()),
             total_timesteps,
             last_reconstructed: None,
+            checkpoints: Vec::new(),
+            checkpoint_interval: total_timesteps.div_ceil(REPLAY_STATE_CHECKPOINTS).max(1),
         })
     }
 
@@ -55,134 +76,196 @@ impl ReplayController {
         &self.reader.header.node_max_nj
     }
 
+    pub fn summary(&self) -> &TraceSummary {
+        &self.summary
+    }
+
+    pub fn has_cpu_samples(&self) -> bool {
+        self.summary.cpu_samples() > 0
+    }
+
     pub fn num_channels(&self) -> usize {
         self.reader.header.channel_names.len()
     }
 
-    /// Build channel_index -> Vec<subscriber node_index> by scanning all RX events.
-    /// This is more reliable than using the config's protocol subscriber lists,
-    /// which may not be available when opening a trace file directly.
+    /// Build channel_index -> Vec<subscriber node_index> from the nodes the
+    /// summary saw receive on each channel. This is more reliable than
+    /// using the config's protocol subscriber lists, which may not be
+    /// available when opening a trace file directly.
     pub fn build_channel_subscribers(&self) -> Vec<Vec<usize>> {
-        let num_channels = self.reader.header.channel_names.len();
-        let mut subs = vec![Vec::new(); num_channels];
-        for record in &self.all_records {
-            if let TraceEvent::MessageRecv {
-                dst_node, channel, ..
-            } = &record.event
-            {
-                let ch_idx = *channel as usize;
-                let node_idx = *dst_node as usize;
-                if ch_idx < num_channels && !subs[ch_idx].contains(&node_idx) {
-                    subs[ch_idx].push(node_idx);
-                }
-            }
+        let mut subs = vec![Vec::new(); self.num_channels()];
+        for (sub, receivers) in subs.iter_mut().zip(self.summary.receivers()) {
+            sub.extend(receivers.iter().map(|&node| node as usize));
         }
         subs
     }
 
-    /// Get all records for a specific timestep (binary search).
-    pub fn records_at(&self, ts: u64) -> &[TraceRecord] {
-        match self.ts_ranges.binary_search_by_key(&ts, |(t, _)| *t) {
-            Ok(idx) => &self.all_records[self.ts_ranges[idx].1.clone()],
-            Err(_) => &[],
+    /// Records of block `i`, decoded on first use.
+    fn block(&self, i: usize) -> Rc<[TraceRecord]> {
+        let mut cache = self.cache.borrow_mut();
+        if let Some(at) = cache.iter().position(|(block, _)| *block == i) {
+            let entry = cache.remove(at).unwrap();
+            let records = entry.1.clone();
+            cache.push_back(entry);
+            return records;
+        }
+        let records: Rc<[TraceRecord]> = match self.reader.read_block(i) {
+            Ok(records) => records.into(),
+            Err(e) => {
+                eprintln!("Failed to read trace block {i}: {e}");
+                Rc::from([])
+            }
+        };
+        if cache.len() >= REPLAY_BLOCK_CACHE {
+            cache.pop_front();
         }
+        cache.push_back((i, records.clone()));
+        records
     }
 
-    /// Get all records from timestep 0 through ts (inclusive).
-    pub fn records_through(&self, ts: u64) -> &[TraceRecord] {
-        // Find the upper bound in ts_ranges
-        let end_idx = match self.ts_ranges.binary_search_by_key(&ts, |(t, _)| *t) {
-            Ok(idx) => self.ts_ranges[idx].1.end,
-            Err(idx) => {
-                if idx == 0 {
-                    return &[];
+    /// Block holding the record at flat index `idx`.
+    fn block_of_record(&self, idx: usize) -> Option<usize> {
+        (idx < self.total_records()).then(|| self.block_starts.partition_point(|&s| s <= idx) - 1)
+    }
+
+    /// Call `f` with the flat index of every record from timestep `from`
+    /// through `to` (inclusive), in order. Only the blocks spanning that
+    /// range are decoded.
+    pub fn for_each_record(&self, from: u64, to: u64, mut f: impl FnMut(usize, &TraceRecord)) {
+        for b in self.reader.block_at_timestep(from)..self.reader.block_count() {
+            if self
+                .reader
+                .block_info(b)
+                .is_some_and(|info| info.first_ts > to)
+            {
+                break;
+            }
+            let records = self.block(b);
+            let start = records.partition_point(|r| r.timestep < from);
+            for (i, record) in records.iter().enumerate().skip(start) {
+                if record.timestep > to {
+                    return;
                 }
-                self.ts_ranges[idx - 1].1.end
+                f(self.block_starts[b] + i, record);
             }
-        };
-        &self.all_records[..end_idx]
+        }
     }
 
-    /// Get a record by flat index into all_records.
+    /// Records from timestep `from` through `to` (inclusive).
+    pub fn records_between(&self, from: u64, to: u64) -> Vec<TraceRecord> {
+        let mut records = Vec::new();
+        self.for_each_record(from, to, |_, record| records.push(record.clone()));
+        records
+    }
+
+    /// Get all records for a specific timestep.
+    pub fn records_at(&self, ts: u64) -> Vec<TraceRecord> {
+        self.records_between(ts, ts)
+    }
+
+    /// Get a record by flat index.
     #[allow(dead_code)]
-    pub fn record_at_index(&self, idx: usize) -> Option<&TraceRecord> {
-        self.all_records.get(idx)
+    pub fn record_at_index(&self, idx: usize) -> Option<TraceRecord> {
+        let b = self.block_of_record(idx)?;
+        self.block(b).get(idx - self.block_starts[b]).cloned()
     }
 
     /// Total number of records in the trace.
     pub fn total_records(&self) -> usize {
-        self.all_records.len()
+        *self.block_starts.last().unwrap()
     }
 
     /// Return the timestep of the record at a given index.
     pub fn timestep_for_record(&self, idx: usize) -> Option<u64> {
-        self.all_records.get(idx).map(|r| r.timestep)
+        let b = self.block_of_record(idx)?;
+        self.block(b)
+            .get(idx - self.block_starts[b])
+            .map(|r| r.timestep)
     }
 
-    /// Binary search for the first record index at or after a given timestep.
+    /// Flat index of the first record at or after a given timestep.
     pub fn first_record_index_at(&self, ts: u64) -> Option<usize> {
-        match self.ts_ranges.binary_search_by_key(&ts, |(t, _)| *t) {
-            Ok(idx) => Some(self.ts_ranges[idx].1.start),
-            Err(idx) => {
-                // ts not found exactly; return start of next timestep if available
-                if idx < self.ts_ranges.len() {
-                    Some(self.ts_ranges[idx].1.start)
-                } else {
-                    None
-                }
-            }
+        let b = self.reader.block_at_timestep(ts);
+        if b >= self.reader.block_count() {
+            return None;
         }
+        let records = self.block(b);
+        Some(self.block_starts[b] + records.partition_point(|r| r.timestep < ts))
     }
 
-    /// Get all records as a slice.
-    pub fn all_records(&self) -> &[TraceRecord] {
-        &self.all_records
+    /// Flat index of the last message event before flat index `before`.
+    pub fn previous_message_index(&self, before: usize) -> Option<usize> {
+        let before = before.min(self.total_records());
+        let last_block = self.block_of_record(before.checked_sub(1)?)?;
+        for b in (0..=last_block).rev() {
+            let records = self.block(b);
+            let end = (before - self.block_starts[b]).min(records.len());
+            if let Some(i) = records[..end].iter().rposition(|r| {
+                matches!(
+                    r.event,
+                    TraceEvent::MessageSent { .. }
+                        | TraceEvent::MessageRecv { .. }
+                        | TraceEvent::MessageDropped { .. }
+                )
+            }) {
+                return Some(self.block_starts[b] + i);
+            }
+        }
+        None
     }
 
     /// Reconstruct node states at a given timestep by replaying
-    /// PositionUpdate and EnergyUpdate events. Uses incremental caching.
+    /// PositionUpdate and EnergyUpdate events. Starts from the last
+    /// reconstruction or the nearest checkpoint before `ts`, whichever is
+    /// later.
     pub fn reconstruct_states(&mut self, ts: u64, initial_states: &[NodeState]) -> Vec<NodeState> {
-        // Check if we can build incrementally from cached state
-        if let Some((cached_ts, ref cached_states)) = self.last_reconstructed {
-            if cached_ts == ts {
-                return cached_states.clone();
+        let cached = self
+            .last_reconstructed
+            .as_ref()
+            .filter(|(cached_ts, _)| *cached_ts <= ts);
+        let checkpoint = self
+            .checkpoints
+            .iter()
+            .rev()
+            .find(|(cp_ts, _)| *cp_ts <= ts);
+        // Records after `from` (all of them if None) are still to apply.
+        let (from, mut states) = match (cached, checkpoint) {
+            (Some((cached_ts, cached)), _) if *cached_ts == ts => return cached.clone(),
+            (Some((cached_ts, cached)), Some((cp_ts, _))) if cached_ts >= cp_ts => {
+                (Some(*cached_ts), cached.clone())
             }
-            if cached_ts < ts {
-                // Apply only records in (cached_ts, ts]
-                let mut states = cached_states.clone();
-                let start_idx = match self.ts_ranges.binary_search_by_key(&cached_ts, |(t, _)| *t) {
-                    Ok(idx) => self.ts_ranges[idx].1.end,
-                    Err(idx) => {
-                        if idx == 0 {
-                            0
-                        } else {
-                            self.ts_ranges[idx - 1].1.end
-                        }
-                    }
-                };
-                let end_idx = match self.ts_ranges.binary_search_by_key(&ts, |(t, _)| *t) {
-                    Ok(idx) => self.ts_ranges[idx].1.end,
-                    Err(idx) => {
-                        if idx == 0 {
-                            0
-                        } else {
-                            self.ts_ranges[idx - 1].1.end
-                        }
-                    }
-                };
-                if start_idx < end_idx {
-                    apply_state_updates(&mut states, &self.all_records[start_idx..end_idx]);
+            (_, Some((cp_ts, cp))) => (Some(*cp_ts), cp.clone()),
+            (Some((cached_ts, cached)), None) => (Some(*cached_ts), cached.clone()),
+            (None, None) => (None, initial_states.to_vec()),
+        };
+
+        let interval = self.checkpoint_interval;
+        let last_checkpoint = self.checkpoints.last().map(|(cp_ts, _)| *cp_ts);
+        let mut next_checkpoint = match from {
+            Some(from) => (from / interval + 1) * interval,
+            None => 0,
+        };
+        let mut new_checkpoints = Vec::new();
+        let mut checkpoint_through = |states: &[NodeState], through: u64| {
+            while next_checkpoint <= through {
+                if last_checkpoint.is_none_or(|last| next_checkpoint > last) {
+                    new_checkpoints.push((next_checkpoint, states.to_vec()));
                 }
-                self.last_reconstructed = Some((ts, states.clone()));
-                return states;
+                next_checkpoint += interval;
             }
-            // cached_ts > ts: seeking backward, rebuild from scratch
+        };
+        let start = from.map_or(0, |from| from + 1);
+        if start <= ts {
+            self.for_each_record(start, ts, |_, record| {
+                // The state so far is the state after every earlier timestep.
+                if let Some(before) = record.timestep.checked_sub(1) {
+                    checkpoint_through(&states, before);
+                }
+                apply_state_updates(&mut states, std::slice::from_ref(record));
+            });
         }
-
-        // Full rebuild from initial
-        let mut states = initial_states.to_vec();
-        let records = self.records_through(ts);
-        apply_state_updates(&mut states, records);
+        checkpoint_through(&states, ts);
+        self.checkpoints.extend(new_checkpoints);
         self.last_reconstructed = Some((ts, states.clone()));
         states
     }
@@ -224,22 +307,3 @@ fn apply_state_updates(states: &mut [NodeState], records: &[TraceRecord]) {
         }
     }
 }
-
-/// Build an index mapping each timestep to its range in the records vec.
-fn build_ts_index(records: &[TraceRecord]) -> Vec<(u64, Range<usize>)> {
-    let mut ranges = Vec::new();
-    if records.is_empty() {
-        return ranges;
-    }
-    let mut start = 0;
-    let mut current_ts = records[0].timestep;
-    for (i, record) in records.iter().enumerate() {
-        if record.timestep != current_ts {
-            ranges.push((current_ts, start..i));
-            current_ts = record.timestep;
-            start = i;
-        }
-    }
-    ranges.push((current_ts, start..records.len()));
-    ranges
-}
@@ -355,6 +355,8 @@ pub struct ReplayState {
     pub bp_input: BreakpointInput,
     /// Zoom level for the sequence diagram (1.0 = default).
     pub seq_zoom: f32,
+    /// Timesteps up to the current one covered by the CPU profile.
+    pub profile_window: u64,
 }
 
 /// Per-node runtime state for visualization.
@@ -6,14 +6,28 @@
 //! 2. mpsc round-trip: kernel and router exchange ~2 messages per kernel
 //!    inner-loop iteration, the kernel spins for `delta` real-time per
 //!    timestep, so this is one of the highest-frequency operations.
+//! 3. Deadlines: `examples/sleep` scaled to thousands of nodes. Every node
+//!    alternates 50- and 25-step sleeps and broadcasts a TTL'd message to a
+//!    neighbour each time it wakes. Compares the router's timing wheel
+//!    against the binary heaps plus dirty-mailbox sweep it replaced.
+//! 4. Bit errors: a 251-byte LoRa frame broadcast to hundreds of receivers
+//!    on an exclusive channel is corrupted once per receiver. Compares the
+//!    gap sampling in `kernel::corrupt` against one draw per bit.
 //!
 //! Run: `cargo run --release -p kernel --bin router_bench`
 
-use std::collections::VecDeque;
+use std::borrow::Cow;
+use std::cmp::Reverse;
+use std::collections::{BinaryHeap, VecDeque};
 use std::num::NonZeroU64;
 use std::sync::mpsc;
 use std::time::{Duration, Instant};
 
+use kernel::corrupt::flip_random_bits;
+use kernel::wheel::TimingWheel;
+use rand::rngs::StdRng;
+use rand::{Rng, SeedableRng};
+
 #[derive(Clone)]
 struct QueuedMsg {
     expiration: Option<NonZeroU64>,
@@ -71,6 +85,222 @@ fn mailbox_sweep_bench() {
     }
 }
 
+/// Steps a sleeper spends parked, alternating like `examples/sleep`.
+const SLEEPS: [u64; 2] = [50, 25];
+const DELIVERY_DELAY: u64 = 3;
+const TTL: u64 = 10;
+
+/// One run of the sleep scenario. `arm` parks a sleeper, `send` queues a
+/// delivery to a handle, and `step` advances one timestep, pushing every
+/// sleeper it woke onto `woken`.
+trait Deadlines {
+    fn new(sleepers: usize) -> Self;
+    fn arm(&mut self, due: u64, pid: usize);
+    fn send(&mut self, due: u64, handle: usize);
+    fn step(&mut self, ts: u64, woken: &mut Vec<usize>);
+}
+
+/// The structures the router used before the wheel: a min-heap of sleep
+/// alarms, a `(timestep, sequence)` heap of deliveries, and a TTL sweep over
+/// the mailboxes known to be non-empty.
+struct Heaps {
+    alarms: BinaryHeap<Reverse<(u64, usize)>>,
+    queued: BinaryHeap<(Reverse<u64>, Reverse<usize>, usize)>,
+    sequence: usize,
+    mailboxes: Vec<VecDeque<u64>>,
+    nonempty: Vec<usize>,
+    active: Vec<bool>,
+}
+
+impl Deadlines for Heaps {
+    fn new(sleepers: usize) -> Self {
+        Self {
+            alarms: BinaryHeap::new(),
+            queued: BinaryHeap::new(),
+            sequence: 0,
+            mailboxes: vec![VecDeque::new(); sleepers],
+            nonempty: Vec::new(),
+            active: vec![false; sleepers],
+        }
+    }
+
+    fn arm(&mut self, due: u64, pid: usize) {
+        self.alarms.push(Reverse((due, pid)));
+    }
+
+    fn send(&mut self, due: u64, handle: usize) {
+        self.queued
+            .push((Reverse(due), Reverse(self.sequence), handle));
+        self.sequence += 1;
+    }
+
+    fn step(&mut self, ts: u64, woken: &mut Vec<usize>) {
+        let mailboxes = &mut self.mailboxes;
+        let active = &mut self.active;
+        self.nonempty.retain(|&i| {
+            while mailboxes[i].front().is_some_and(|&exp| exp < ts) {
+                mailboxes[i].pop_front();
+            }
+            active[i] = !mailboxes[i].is_empty();
+            active[i]
+        });
+        while let Some(&Reverse((due, pid))) = self.alarms.peek()
+            && due <= ts
+        {
+            self.alarms.pop();
+            woken.push(pid);
+        }
+        while self.queued.peek().is_some_and(|(due, _, _)| due.0 <= ts) {
+            let (_, _, handle) = self.queued.pop().unwrap();
+            self.mailboxes[handle].push_back(ts + TTL);
+            if !self.active[handle] {
+                self.active[handle] = true;
+                self.nonempty.push(handle);
+            }
+        }
+    }
+}
+
+enum Deadline {
+    Wake(usize),
+    Deliver(usize),
+    Expire(usize),
+}
+
+/// The router's layout: one wheel holding all three kinds of deadline.
+struct Wheel {
+    wheel: TimingWheel<Deadline>,
+    mailboxes: Vec<VecDeque<u64>>,
+}
+
+impl Deadlines for Wheel {
+    fn new(sleepers: usize) -> Self {
+        Self {
+            wheel: TimingWheel::new(0),
+            mailboxes: vec![VecDeque::new(); sleepers],
+        }
+    }
+
+    fn arm(&mut self, due: u64, pid: usize) {
+        self.wheel.insert(due, Deadline::Wake(pid));
+    }
+
+    fn send(&mut self, due: u64, handle: usize) {
+        self.wheel.insert(due, Deadline::Deliver(handle));
+    }
+
+    fn step(&mut self, ts: u64, woken: &mut Vec<usize>) {
+        let mut deliveries = Vec::new();
+        for (_, deadline) in self.wheel.advance() {
+            match deadline {
+                Deadline::Expire(i) => {
+                    while self.mailboxes[i].front().is_some_and(|&exp| exp < ts) {
+                        self.mailboxes[i].pop_front();
+                    }
+                }
+                Deadline::Wake(pid) => woken.push(pid),
+                Deadline::Deliver(handle) => deliveries.push(handle),
+            }
+        }
+        for handle in deliveries {
+            self.mailboxes[handle].push_back(ts + TTL);
+            self.wheel.insert(ts + TTL + 1, Deadline::Expire(handle));
+        }
+    }
+}
+
+/// Run the scenario for `steps` timesteps and return ns per step. Sleepers
+/// start staggered so wakeups spread over every timestep.
+fn run_sleepers<D: Deadlines>(sleepers: usize, steps: u64) -> u128 {
+    let mut d = D::new(sleepers);
+    let mut phase = vec![0usize; sleepers];
+    for pid in 0..sleepers {
+        d.arm(1 + (pid as u64 % SLEEPS[0]), pid);
+    }
+    let mut woken = Vec::new();
+    let t0 = Instant::now();
+    for ts in 1..=steps {
+        d.step(ts, &mut woken);
+        for pid in woken.drain(..) {
+            d.send(ts + DELIVERY_DELAY, (pid + 1) % sleepers);
+            phase[pid] ^= 1;
+            d.arm(ts + SLEEPS[phase[pid]], pid);
+        }
+    }
+    t0.elapsed().as_nanos() / steps as u128
+}
+
+fn sleeper_bench() {
+    println!("\n# Router deadlines (sleep scenario)");
+    println!("# sleepers  heaps_ns/step  wheel_ns/step  speedup");
+    for &sleepers in &[1_000usize, 10_000, 50_000, 200_000] {
+        let steps = 5_000;
+        let heaps_ns = run_sleepers::<Heaps>(sleepers, steps);
+        let wheel_ns = run_sleepers::<Wheel>(sleepers, steps);
+        let speedup = heaps_ns as f64 / wheel_ns.max(1) as f64;
+        println!("  {sleepers:>8}  {heaps_ns:>13}  {wheel_ns:>13}  {speedup:>6.1}x");
+    }
+}
+
+/// Largest LoRa frame, as in the examples' `lora::PACKET_MAX_SIZE_BYTES`.
+const LORA_FRAME: usize = 251;
+
+/// Corrupt one frame per receiver with a draw per bit, as link simulation
+/// did before gap sampling. Returns ns per receiver and the flips made.
+fn corrupt_per_bit(frame: &[u8], receivers: usize, prob: f64, rng: &mut StdRng) -> (u128, usize) {
+    let mut flipped = 0;
+    let t0 = Instant::now();
+    for _ in 0..receivers {
+        let mut buf = Cow::from(frame);
+        for bit in 0..frame.len() * 8 {
+            if prob > rng.random_range(0.0..=1.0) {
+                buf.to_mut()[bit / 8] ^= 1 << (bit % 8);
+                flipped += 1;
+            }
+        }
+        std::hint::black_box(&buf);
+    }
+    (t0.elapsed().as_nanos() / receivers as u128, flipped)
+}
+
+fn corrupt_gaps(frame: &[u8], receivers: usize, prob: f64, rng: &mut StdRng) -> (u128, usize) {
+    let mut flipped = 0;
+    let t0 = Instant::now();
+    for _ in 0..receivers {
+        let mut buf = Cow::from(frame);
+        flipped += flip_random_bits(&mut buf, prob, rng);
+        std::hint::black_box(&buf);
+    }
+    (t0.elapsed().as_nanos() / receivers as u128, flipped)
+}
+
+fn corruption_bench() {
+    println!("\n# Bit errors ({LORA_FRAME}-byte frame, per receiver)");
+    println!("# receivers  bit_error_p  per_bit_ns  gaps_ns  speedup  flips(per_bit/gaps)");
+    let frame = [0xa5u8; LORA_FRAME];
+    let mut rng = StdRng::seed_from_u64(1);
+    for &receivers in &[100usize, 500] {
+        for &prob in &[1e-5, 1e-4, 1e-3, 1e-2] {
+            let rounds = 20;
+            let (mut per_bit_ns, mut gaps_ns) = (0, 0);
+            let (mut per_bit_flips, mut gap_flips) = (0, 0);
+            for _ in 0..rounds {
+                let (ns, flips) = corrupt_per_bit(&frame, receivers, prob, &mut rng);
+                per_bit_ns += ns;
+                per_bit_flips += flips;
+                let (ns, flips) = corrupt_gaps(&frame, receivers, prob, &mut rng);
+                gaps_ns += ns;
+                gap_flips += flips;
+            }
+            let (per_bit_ns, gaps_ns) = (per_bit_ns / rounds, gaps_ns / rounds);
+            let speedup = per_bit_ns as f64 / gaps_ns.max(1) as f64;
+            println!(
+                "  {receivers:>9}  {prob:>11.0e}  {per_bit_ns:>10}  {gaps_ns:>7}  {speedup:>6.1}x  {per_bit_flips}/{gap_flips}"
+            );
+        }
+    }
+}
+
 fn mpsc_roundtrip_bench() {
     use std::thread;
     println!("\n# IPC round-trip latency (kernel <-> router)");
@@ -130,5 +360,7 @@ fn mpsc_roundtrip_bench() {
 
 fn main() {
     mailbox_sweep_bench();
+    sleeper_bench();
+    corruption_bench();
     mpsc_roundtrip_bench();
 }
@@ -0,0 +1,302 @@
+//! checkpoint.rs
+//! On-disk format of a simulation checkpoint.
+//!
+//! `nexus simulate --checkpoint-at <timestep>` asks every protocol to save its
+//! state through `ctl.checkpoint` once simulated time reaches the timestep.
+//! A process that has saved is held in its write, so once all of them have
+//! the simulation can be captured whole: the router's mailboxes, the messages
+//! still in flight, the random streams, and every node's clock, position and
+//! battery, alongside the protocol states. `--resume-from` starts a fresh set
+//! of processes, hands each one its state through `ctl.restore` and carries
+//! on from the captured timestep.
+//!
+//! Handles, nodes and processes are recorded by name rather than by index,
+//! since process start order and so handle order change from run to run.
+//! What a process was doing outside of its saved state is not captured: sleeps
+//! and receive timeouts, poll registrations and shared-memory rings all start
+//! over with the new process.
+
+use std::io;
+use std::path::{Path, PathBuf};
+
+use bincode::{Decode, Encode, config};
+
+use crate::errors::CheckpointError;
+
+/// Name of the checkpoint file in the simulation directory.
+pub const CHECKPOINT_FILE: &str = "checkpoint";
+
+/// Bumped whenever the layout below changes.
+const VERSION: u32 = 1;
+
+/// Everything needed to continue a simulation from where it was captured.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub struct Checkpoint {
+    pub(crate) version: u32,
+    /// Kernel timestep the resumed run starts from.
+    pub(crate) next_timestep: u64,
+    /// Router timestep at the time of capture.
+    pub(crate) timestep: u64,
+    /// Length of one timestep, which must match the resumed configuration.
+    pub(crate) timestep_ns: u64,
+    pub(crate) next_msg_id: u64,
+    pub(crate) node_names: Vec<String>,
+    /// Per-node state, in `node_names` order.
+    pub(crate) nodes: Vec<NodeSnapshot>,
+    pub(crate) handles: Vec<HandleSnapshot>,
+    /// Messages routed but not yet delivered, as `(due timestep, index into
+    /// handles, message)`, in delivery order.
+    pub(crate) deliveries: Vec<(u64, usize, MessageSnapshot)>,
+    /// Pending mailbox expiries as `(due timestep, index into handles)`.
+    pub(crate) expiries: Vec<(u64, usize)>,
+    /// One random stream per router shard.
+    pub(crate) rngs: Vec<RngSnapshot>,
+    pub(crate) processes: Vec<ProcessSnapshot>,
+}
+
+/// Node state protocols and the energy model can change at runtime.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct NodeSnapshot {
+    /// Node clock origin (`ctl.time`), as seconds and nanoseconds since the
+    /// Unix epoch.
+    pub(crate) start: (u64, u32),
+    pub(crate) point: [f64; 3],
+    /// Azimuth, elevation and roll.
+    pub(crate) orientation: [f64; 3],
+    pub(crate) motion: MotionSnapshot,
+    pub(crate) is_dynamic: bool,
+    pub(crate) energy: Option<EnergySnapshot>,
+}
+
+/// Mirror of `types::MotionPattern`.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) enum MotionSnapshot {
+    Static,
+    Velocity {
+        initial: [f64; 3],
+        velocity: [f64; 3],
+        start_ts: u64,
+    },
+    Linear {
+        start: [f64; 3],
+        end: [f64; 3],
+        start_ts: u64,
+        duration_us: u64,
+    },
+    Circle {
+        center: [f64; 3],
+        radius: f64,
+        start_angle_deg: f64,
+        angular_vel_deg_per_us: f64,
+        start_ts: u64,
+    },
+}
+
+/// The mutable part of a node's `EnergyState`.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct EnergySnapshot {
+    pub(crate) charge_nj: u64,
+    pub(crate) current_state: Option<String>,
+    pub(crate) is_dead: bool,
+    pub(crate) power_sources: Vec<(String, FlowSnapshot)>,
+    pub(crate) power_sinks: Vec<(String, FlowSnapshot)>,
+}
+
+/// Mirror of `types::PowerFlowState`.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) enum FlowSnapshot {
+    Constant {
+        nj_per_ts: u64,
+    },
+    PiecewiseLinear {
+        breakpoints: Vec<(u64, u64)>,
+        repeat_us: Option<u64>,
+    },
+}
+
+/// One channel endpoint of one protocol.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct HandleSnapshot {
+    pub(crate) node: String,
+    pub(crate) protocol: String,
+    pub(crate) channel: String,
+    pub(crate) mailbox: Vec<MessageSnapshot>,
+    /// Read offset and message of a partially read exclusive message.
+    pub(crate) unread: Option<(usize, Vec<u8>)>,
+    pub(crate) signal: SignalSnapshot,
+}
+
+/// Mirror of `router::SignalInfo`.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct SignalSnapshot {
+    pub(crate) rssi_dbm: f64,
+    pub(crate) snr_db: f64,
+    pub(crate) src_node: usize,
+    pub(crate) msg_id: u64,
+    pub(crate) timestep: u64,
+}
+
+/// Mirror of `router::QueuedMessage`.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct MessageSnapshot {
+    pub(crate) src: usize,
+    pub(crate) buf: Vec<u8>,
+    pub(crate) expiration: Option<u64>,
+    pub(crate) bit_errors: bool,
+    pub(crate) msg_id: u64,
+    pub(crate) rssi_dbm: f64,
+    pub(crate) snr_db: f64,
+}
+
+/// Position of a ChaCha stream.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct RngSnapshot {
+    pub(crate) seed: [u8; 32],
+    pub(crate) stream: u64,
+    pub(crate) word_pos: u128,
+}
+
+/// The state a protocol saved through `ctl.checkpoint`.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct ProcessSnapshot {
+    pub(crate) node: String,
+    pub(crate) protocol: String,
+    pub(crate) state: Vec<u8>,
+}
+
+impl Checkpoint {
+    pub(crate) fn new(next_timestep: u64, timestep: u64, timestep_ns: u64) -> Self {
+        Self {
+            version: VERSION,
+            next_timestep,
+            timestep,
+            timestep_ns,
+            next_msg_id: 0,
+            node_names: Vec::new(),
+            nodes: Vec::new(),
+            handles: Vec::new(),
+            deliveries: Vec::new(),
+            expiries: Vec::new(),
+            rngs: Vec::new(),
+            processes: Vec::new(),
+        }
+    }
+
+    /// Read a checkpoint written by an earlier run.
+    pub fn load(path: &Path) -> Result<Self, CheckpointError> {
+        let io_err = |e: io::Error| CheckpointError::Io(path.to_path_buf(), e);
+        let bytes = std::fs::read(path).map_err(io_err)?;
+        let (checkpoint, _): (Self, _) = bincode::decode_from_slice(&bytes, config::standard())
+            .map_err(CheckpointError::Decode)?;
+        if checkpoint.version != VERSION {
+            return Err(CheckpointError::Version(checkpoint.version));
+        }
+        Ok(checkpoint)
+    }
+
+    /// Write the checkpoint to `path`, replacing it only once it is complete.
+    pub fn write(&self, path: &Path) -> Result<(), CheckpointError> {
+        let bytes =
+            bincode::encode_to_vec(self, config::standard()).map_err(CheckpointError::Encode)?;
+        let tmp = PathBuf::from(format!("{}.tmp", path.display()));
+        std::fs::write(&tmp, bytes).map_err(|e| CheckpointError::Io(tmp.clone(), e))?;
+        std::fs::rename(&tmp, path).map_err(|e| CheckpointError::Io(path.to_path_buf(), e))
+    }
+
+    /// Simulated timestep the checkpoint was taken at, as protocols saw it.
+    pub fn timestep(&self) -> u64 {
+        self.timestep
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn write_then_load() {
+        let mut checkpoint = Checkpoint::new(41, 42, 1_000);
+        checkpoint.node_names = vec!["a".to_string()];
+        checkpoint.nodes.push(NodeSnapshot {
+            start: (1_700_000_000, 5),
+            point: [1.0, 2.0, 3.0],
+            orientation: [0.0; 3],
+            motion: MotionSnapshot::Linear {
+                start: [0.0; 3],
+                end: [1.0; 3],
+                start_ts: 3,
+                duration_us: 10,
+            },
+            is_dynamic: true,
+            energy: Some(EnergySnapshot {
+                charge_nj: 9,
+                current_state: Some("rx".to_string()),
+                is_dead: false,
+                power_sources: vec![(
+                    "solar".to_string(),
+                    FlowSnapshot::PiecewiseLinear {
+                        breakpoints: vec![(0, 1), (10, 2)],
+                        repeat_us: Some(20),
+                    },
+                )],
+                power_sinks: vec![],
+            }),
+        });
+        let msg = MessageSnapshot {
+            src: 0,
+            buf: b"hello".to_vec(),
+            expiration: Some(50),
+            bit_errors: false,
+            msg_id: 7,
+            rssi_dbm: -80.0,
+            snr_db: 3.5,
+        };
+        checkpoint.handles.push(HandleSnapshot {
+            node: "a".to_string(),
+            protocol: "p".to_string(),
+            channel: "lora".to_string(),
+            mailbox: vec![msg.clone()],
+            unread: Some((2, b"abc".to_vec())),
+            signal: SignalSnapshot {
+                rssi_dbm: -1.0,
+                snr_db: 2.0,
+                src_node: 0,
+                msg_id: 3,
+                timestep: 40,
+            },
+        });
+        checkpoint.deliveries.push((44, 0, msg));
+        checkpoint.expiries.push((51, 0));
+        checkpoint.rngs.push(RngSnapshot {
+            seed: [9; 32],
+            stream: 0,
+            word_pos: 1 << 70,
+        });
+        checkpoint.processes.push(ProcessSnapshot {
+            node: "a".to_string(),
+            protocol: "p".to_string(),
+            state: vec![0, 1, 2],
+        });
+
+        let dir = std::env::temp_dir().join(format!("nexus-checkpoint-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let path = dir.join(CHECKPOINT_FILE);
+        checkpoint.write(&path).unwrap();
+        let loaded = Checkpoint::load(&path).unwrap();
+        std::fs::remove_dir_all(&dir).unwrap();
+        assert_eq!(loaded, checkpoint);
+    }
+
+    #[test]
+    fn rejects_other_versions() {
+        let mut checkpoint = Checkpoint::new(0, 1, 1);
+        checkpoint.version = VERSION + 1;
+        let dir = std::env::temp_dir().join(format!("nexus-checkpoint-v-{}", std::process::id()));
+        std::fs::create_dir_all(&dir).unwrap();
+        let path = dir.join(CHECKPOINT_FILE);
+        checkpoint.write(&path).unwrap();
+        let loaded = Checkpoint::load(&path);
+        std::fs::remove_dir_all(&dir).unwrap();
+        assert!(matches!(loaded, Err(CheckpointError::Version(v)) if v == VERSION + 1));
+    }
+}
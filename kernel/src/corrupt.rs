@@ -0,0 +1,166 @@
+//! corrupt.rs
+//! Bit error sampling for link simulation.
+//!
+//! Every bit of a message is flipped independently with the link's bit
+//! error probability `p`. Rather than drawing once per bit, the gaps between
+//! flipped bits are drawn directly: the number of intact bits before the
+//! next flip is geometric, `floor(ln(u) / ln(1 - p))` for a uniform `u` in
+//! `(0, 1]`. A message with `k` bit errors costs `k + 1` draws instead of
+//! one per bit, which for a 251-byte LoRa frame at realistic error rates is
+//! one or two draws instead of 2008.
+//!
+//! RNG stream: one `f64` per gap, in bit order (bit `i` of byte `b` is bit
+//! `8 * b + i`), ending with the draw whose gap runs past the last bit. No
+//! draws are made when `p` is 0 or at least 1. Runs with a given seed are
+//! therefore reproducible, though they differ from runs before gap sampling.
+
+use std::borrow::Cow;
+
+use rand::Rng;
+
+/// Flip each bit of `buf` with probability `prob`, returning how many were
+/// flipped. A borrowed buffer is only copied once a bit actually flips.
+pub fn flip_random_bits(buf: &mut Cow<'_, [u8]>, prob: f64, rng: &mut impl Rng) -> usize {
+    let bits = buf.len() * u8::BITS as usize;
+    if prob <= 0.0 || bits == 0 {
+        return 0;
+    }
+    if prob >= 1.0 {
+        buf.to_mut().iter_mut().for_each(|b| *b = !*b);
+        return bits;
+    }
+    // ln(1 - p), accurate for the tiny `p` bit error models tend to produce.
+    let ln_keep = (-prob).ln_1p();
+    let mut flipped = 0;
+    let mut bit = 0usize;
+    loop {
+        let u = 1.0 - rng.random::<f64>();
+        // Saturates for gaps too long to matter.
+        let gap = (u.ln() / ln_keep) as usize;
+        bit = match bit.checked_add(gap) {
+            Some(bit) if bit < bits => bit,
+            _ => return flipped,
+        };
+        buf.to_mut()[bit / 8] ^= 1 << (bit % 8);
+        flipped += 1;
+        bit += 1;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use rand::SeedableRng;
+    use rand::rngs::StdRng;
+
+    /// The per-bit sampling gap sampling replaced: flip bit `i` where the
+    /// `i`th item of `flips` is true. Returns the bits visited and flipped.
+    fn flip_bits(buf: &mut Cow<'_, [u8]>, flips: impl IntoIterator<Item = bool>) -> (usize, usize) {
+        let mut flips = flips.into_iter();
+        let mut count = 0;
+        let mut flipped = 0;
+        for i in 0..buf.len() {
+            for index in 0..u8::BITS {
+                match flips.next() {
+                    Some(true) => {
+                        count += 1;
+                        flipped += 1;
+                        buf.to_mut()[i] ^= 1 << index;
+                    }
+                    Some(false) => {
+                        count += 1;
+                    }
+                    None => return (count, flipped),
+                }
+            }
+        }
+        (count, flipped)
+    }
+
+    #[test]
+    fn flip_bits_copies_only_on_flip() {
+        let data = [0u8, 0xff];
+        let mut buf = Cow::from(&data[..]);
+        assert_eq!(flip_bits(&mut buf, [false; 16]), (16, 0));
+        assert!(matches!(buf, Cow::Borrowed(_)));
+        let flips = (0..16).map(|i| i == 1 || i == 15);
+        assert_eq!(flip_bits(&mut buf, flips), (16, 2));
+        assert_eq!(&buf[..], [0b10, 0x7f]);
+    }
+
+    #[test]
+    fn copies_only_on_flip() {
+        let mut rng = StdRng::seed_from_u64(0);
+        let data = [0u8, 0xff];
+        let mut buf = Cow::from(&data[..]);
+        assert_eq!(flip_random_bits(&mut buf, 0.0, &mut rng), 0);
+        assert!(matches!(buf, Cow::Borrowed(_)));
+        assert_eq!(flip_random_bits(&mut buf, 1.0, &mut rng), 16);
+        assert_eq!(&buf[..], [0xff, 0]);
+    }
+
+    #[test]
+    fn flips_at_the_requested_rate() {
+        let mut rng = StdRng::seed_from_u64(7);
+        let data = [0u8; 251];
+        for prob in [0.001, 0.01, 0.3] {
+            let mut flipped = 0;
+            let mut set = 0;
+            for _ in 0..1_000 {
+                let mut buf = Cow::from(&data[..]);
+                flipped += flip_random_bits(&mut buf, prob, &mut rng);
+                set += buf.iter().map(|b| b.count_ones() as usize).sum::<usize>();
+            }
+            assert_eq!(flipped, set);
+            let expected = prob * (data.len() * 8 * 1_000) as f64;
+            let error = (flipped as f64 - expected).abs() / expected;
+            assert!(
+                error < 0.05,
+                "p = {prob}: {flipped} flips, expected {expected}"
+            );
+        }
+    }
+
+    #[test]
+    fn agrees_with_per_bit_sampling() {
+        let mut rng = StdRng::seed_from_u64(11);
+        let data = [0u8; 251];
+        let prob = 0.02;
+        let (mut per_bit, mut gaps) = (0, 0);
+        // Flips per bit position, which gap sampling must keep uniform.
+        let mut by_bit = vec![0usize; data.len() * 8];
+        for _ in 0..1_000 {
+            let mut buf = Cow::from(&data[..]);
+            let draws = std::iter::repeat_with(|| rng.random_bool(prob));
+            per_bit += flip_bits(&mut buf, draws).1;
+            let mut buf = Cow::from(&data[..]);
+            gaps += flip_random_bits(&mut buf, prob, &mut rng);
+            for (bit, count) in by_bit.iter_mut().enumerate() {
+                *count += usize::from(buf[bit / 8] >> (bit % 8) & 1 == 1);
+            }
+        }
+        let error = (gaps as f64 - per_bit as f64).abs() / per_bit as f64;
+        assert!(error < 0.05, "{gaps} gap flips vs {per_bit} per-bit flips");
+        // The first and last halves of the frame see the same error rate.
+        let (head, tail) = by_bit.split_at(by_bit.len() / 2);
+        let (head, tail) = (head.iter().sum::<usize>(), tail.iter().sum::<usize>());
+        let skew = (head as f64 - tail as f64).abs() / (head + tail) as f64;
+        assert!(
+            skew < 0.05,
+            "{head} flips in the first half, {tail} in the second"
+        );
+    }
+
+    #[test]
+    fn same_seed_same_errors() {
+        let data = [0u8; 64];
+        let run = |seed| {
+            let mut rng = StdRng::seed_from_u64(seed);
+            let mut buf = Cow::from(&data[..]);
+            flip_random_bits(&mut buf, 0.05, &mut rng);
+            buf.into_owned()
+        };
+        assert_eq!(run(3), run(3));
+        assert_ne!(run(3), run(4));
+    }
+}
@@ -1,4 +1,5 @@
-use bincode::error::DecodeError;
+use bincode::error::{DecodeError, EncodeError};
+use std::net::SocketAddr;
 use std::path::PathBuf;
 use std::{io, process::Output};
 
@@ -35,6 +36,12 @@ pub enum KernelError {
     PollRegistration,
     #[error("Error encountered when polling file.")]
     PollError,
+    #[error("Checkpoint error: {0}")]
+    Checkpoint(CheckpointError),
+    #[error("Failed to start the profiler: {0}")]
+    Profiler(io::Error),
+    #[error("Partition error: {0}")]
+    Partition(PartitionError),
 }
 
 #[derive(Error, Debug)]
@@ -61,6 +68,50 @@ pub enum SourceError {
     NoReplayLog,
 }
 
+#[derive(Error, Debug)]
+pub enum CheckpointError {
+    #[error("Failed to access checkpoint `{0:?}`: {1}")]
+    Io(PathBuf, io::Error),
+    #[error("Failed to decode checkpoint: {0}")]
+    Decode(DecodeError),
+    #[error("Failed to encode checkpoint: {0}")]
+    Encode(EncodeError),
+    #[error("Checkpoint has format version {0}, which this build cannot read")]
+    Version(u32),
+    #[error("Checkpoint does not match this simulation: {0}")]
+    Mismatch(String),
+}
+
+#[derive(Error, Debug)]
+pub enum PartitionError {
+    #[error("Partition {0} is out of range for {1} peers")]
+    Index(usize, usize),
+    #[error(
+        "Channel `{0}` crosses partitions with no delay; every such channel needs at least one timestep of latency"
+    )]
+    NoLookahead(String),
+    #[error("{0} are not supported across partitions")]
+    Unsupported(&'static str),
+    #[error("Failed to reach partition at {0}: {1}")]
+    Io(SocketAddr, io::Error),
+    #[error("Timed out waiting for the partition at {0}")]
+    Timeout(SocketAddr),
+    #[error("Partition {0} does not run the same simulation")]
+    Mismatch(usize),
+    #[error("Failed to encode a window: {0}")]
+    Encode(EncodeError),
+    #[error("Failed to decode a window from {0}: {1}")]
+    Decode(SocketAddr, DecodeError),
+    #[error("Lost the connection to partition {0}")]
+    Disconnected(usize),
+    #[error("Partition {peer} sent the window through timestep {found}, expected {expected}")]
+    Desync {
+        peer: usize,
+        expected: u64,
+        found: u64,
+    },
+}
+
 #[derive(Error, Debug)]
 pub enum ConversionError {
     #[error("Failed to convert channel `{0}` to handle")]
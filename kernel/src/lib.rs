@@ -1,22 +1,32 @@
+pub mod checkpoint;
+pub mod corrupt;
 pub mod errors;
 mod events;
 mod helpers;
 pub mod log;
+pub mod partition;
+mod profiler;
 mod resolver;
 pub(crate) mod router;
 pub mod sources;
 mod status;
 mod test_utils;
 pub mod types;
+pub mod wheel;
 
+pub use checkpoint::Checkpoint;
+pub use partition::Partition;
 pub use router::RouterInput;
 
 use fuse::PID;
+use fuse::stats::Stats;
 use helpers::{make_handles, unzip};
 
-use rand::{SeedableRng, rngs::StdRng};
+use rand::SeedableRng;
+use rand_chacha::ChaCha12Rng;
 use std::{
     collections::{BTreeMap, HashMap},
+    num::{NonZeroU32, NonZeroUsize},
     path::PathBuf,
     sync::{
         Arc,
@@ -31,9 +41,10 @@ use runner::{ProtocolHandle, RunController, cli::RunCmd};
 use tracing::{instrument, warn};
 use types::*;
 
+use crate::profiler::{ProfileTarget, Profiler};
 use crate::sources::Source;
 use crate::{
-    errors::{KernelError, SourceError},
+    errors::{ConversionError, KernelError, PartitionError, SourceError},
     events::Event,
     resolver::ResolvedChannels,
 };
@@ -70,7 +81,7 @@ impl<H, Tx, Rx> KernelServer<H, Tx, Rx> {
 
 pub struct Kernel {
     root: PathBuf,
-    rng: StdRng,
+    rng: ChaCha12Rng,
     timestep: TimestepConfig,
     time_dilation: Arc<AtomicU64>,
     channels: ResolvedChannels,
@@ -85,6 +96,20 @@ pub struct Kernel {
     remap_tx: mpsc::Sender<(u32, u32)>,
     abort: Option<Arc<AtomicBool>>,
     pause: Option<Arc<AtomicBool>>,
+    stats: Arc<Stats>,
+    skip_idle: bool,
+    router_shards: NonZeroUsize,
+    /// What to checkpoint and what to resume from.
+    checkpointing: router::Checkpointing,
+    /// Nodes that were depleted when the checkpoint being resumed was taken.
+    /// Their fresh processes are frozen before the first step.
+    depleted: Vec<String>,
+    /// Sampling rate and the protocols to sample, when profiling.
+    profile: Option<(NonZeroU32, Vec<ProfileTarget>)>,
+    /// Connections to the other partitions, when this is one of several.
+    exchange: Option<router::Exchange>,
+    /// The channel `nexus fuzz` feeds.
+    fuzz: Option<router::Fuzzing>,
 }
 
 /// Builder for constructing a `Kernel` with optional flags.
@@ -98,6 +123,12 @@ pub struct KernelBuilder {
     abort: Option<Arc<AtomicBool>>,
     pause: Option<Arc<AtomicBool>>,
     time_dilation: Option<Arc<AtomicU64>>,
+    stats: Option<Arc<Stats>>,
+    checkpoint_at: Option<(u64, PathBuf)>,
+    resume: Option<Checkpoint>,
+    profile: Option<NonZeroU32>,
+    partition: Option<Partition>,
+    fuzz: Option<(ast::ChannelHandle, Option<Vec<u8>>)>,
 }
 
 impl KernelBuilder {
@@ -119,6 +150,12 @@ impl KernelBuilder {
             abort: None,
             pause: None,
             time_dilation: None,
+            stats: None,
+            checkpoint_at: None,
+            resume: None,
+            profile: None,
+            partition: None,
+            fuzz: None,
         }
     }
 
@@ -137,6 +174,49 @@ impl KernelBuilder {
         self
     }
 
+    /// Record router latencies into the registry the FUSE filesystem uses
+    /// (`NexusFs::stats`), so `ctl.stats` shows both sides.
+    pub fn stats(mut self, stats: Arc<Stats>) -> Self {
+        self.stats = Some(stats);
+        self
+    }
+
+    /// Ask protocols to save their state once simulated time reaches
+    /// `timestep`, then write a checkpoint to `path` and stop.
+    pub fn checkpoint_at(mut self, timestep: u64, path: PathBuf) -> Self {
+        self.checkpoint_at = Some((timestep, path));
+        self
+    }
+
+    /// Continue from a checkpoint an earlier run of the same simulation
+    /// wrote.
+    pub fn resume_from(mut self, checkpoint: Checkpoint) -> Self {
+        self.resume = Some(checkpoint);
+        self
+    }
+
+    /// Sample every protocol's call stack `hz` times per second of CPU time
+    /// it uses and record the samples in the trace.
+    pub fn profile(mut self, hz: NonZeroU32) -> Self {
+        self.profile = Some(hz);
+        self
+    }
+
+    /// Run only `partition`'s nodes, exchanging writes with the hosts
+    /// running the others. `build` connects to them.
+    pub fn partition(mut self, partition: Partition) -> Self {
+        self.partition = Some(partition);
+        self
+    }
+
+    /// Feed the frames protocols write to `ctl.fuzz` into `channel` in place
+    /// of what they would receive on it. With `input`, deliver its frames
+    /// once before the first step.
+    pub fn fuzz(mut self, channel: ast::ChannelHandle, input: Option<Vec<u8>>) -> Self {
+        self.fuzz = Some((channel, input));
+        self
+    }
+
     pub fn build(self) -> Result<Kernel, KernelError> {
         let sim = self.sim;
         // Sort nodes lexicographically for deterministic ordering
@@ -147,7 +227,7 @@ impl KernelBuilder {
             .into_iter()
             .map(|(name, idx)| (name, NodeIdx(idx)))
             .collect();
-        let channels = ResolvedChannels::try_resolve(
+        let mut channels = ResolvedChannels::try_resolve(
             sim.channels,
             node_names,
             nodes,
@@ -155,9 +235,93 @@ impl KernelBuilder {
             self.file_handles,
             &sim.params.timestep,
         )?;
+        let profile = self.profile.map(|hz| {
+            let targets = self
+                .runc
+                .handles
+                .iter()
+                .filter_map(|h| {
+                    Some(ProfileTarget {
+                        node: node_handles.get(&h.node)?.0,
+                        protocol: Arc::from(h.protocol.as_str()),
+                        cgroup: h.cgroup_path.clone()?,
+                        cpus: self.runc.affinity.cpus(&h.node),
+                    })
+                })
+                .collect();
+            (hz, targets)
+        });
+        let exchange = self
+            .partition
+            .map(|partition| {
+                if self.checkpoint_at.is_some() || self.resume.is_some() {
+                    return Err(PartitionError::Unsupported("Checkpoints"));
+                }
+                router::Exchange::connect(
+                    &partition,
+                    &mut channels,
+                    sim.params.timestep,
+                    sim.params.seed,
+                )
+            })
+            .transpose()
+            .map_err(KernelError::Partition)?;
+        let fuzz = self
+            .fuzz
+            .map(|(channel, input)| {
+                let index = channels
+                    .channel_names
+                    .iter()
+                    .position(|name| **name == *channel)
+                    .ok_or(ConversionError::ChannelHandleConversion(channel))?;
+                Ok(router::Fuzzing::new(ChannelIdx(index), input))
+            })
+            .transpose()
+            .map_err(KernelError::KernelInit)?;
+        let protocols = self
+            .runc
+            .handles
+            .iter()
+            .filter_map(|h| {
+                let node = *node_handles.get(&h.node)?;
+                Some((h.pid()?, (node, Arc::from(h.protocol.as_str()))))
+            })
+            .collect();
+        let ts = &sim.params.timestep;
+        let resume = self
+            .resume
+            .map(|checkpoint| {
+                router::Restore::resolve(
+                    checkpoint,
+                    &mut channels,
+                    &protocols,
+                    sim.params.router_shards,
+                    ts.length.get() * ts.unit.to_ns_factor(),
+                )
+            })
+            .transpose()
+            .map_err(KernelError::Checkpoint)?;
+        let depleted = match resume {
+            Some(_) => channels
+                .nodes
+                .iter()
+                .zip(&channels.node_names)
+                .filter(|(node, _)| node.energy.as_ref().is_some_and(|e| e.is_dead))
+                .map(|(_, name)| name.to_string())
+                .collect(),
+            None => Vec::new(),
+        };
+        let (at, path) = self.checkpoint_at.unzip();
+        let checkpointing = router::Checkpointing {
+            at,
+            path: path.unwrap_or_default(),
+            protocols,
+            done: Arc::default(),
+            resume,
+        };
         Ok(Kernel {
             root: sim.params.root,
-            rng: StdRng::seed_from_u64(sim.params.seed),
+            rng: ChaCha12Rng::seed_from_u64(sim.params.seed),
             timestep: sim.params.timestep,
             time_dilation: self
                 .time_dilation
@@ -169,6 +333,14 @@ impl KernelBuilder {
             remap_tx: self.remap_tx,
             abort: self.abort,
             pause: self.pause,
+            stats: self.stats.unwrap_or_default(),
+            skip_idle: sim.params.skip_idle,
+            router_shards: sim.params.router_shards,
+            checkpointing,
+            depleted,
+            profile,
+            exchange,
+            fuzz,
         })
     }
 }
@@ -211,14 +383,38 @@ impl Kernel {
             remap_tx,
             abort,
             pause,
+            stats,
+            skip_idle,
+            router_shards,
+            checkpointing,
+            depleted,
+            profile,
+            exchange,
+            fuzz,
         } = self;
+        let first_timestep = checkpointing
+            .resume
+            .as_ref()
+            .map_or(0, |resume| resume.next_timestep);
+        let checkpointed = checkpointing.done.clone();
         let mut event_queue = BTreeMap::new();
         // Shared simulated-timestep counter. The kernel main thread writes,
         // the router reads on Tick. Replaces the embedded timestep that used
         // to flow in `Poll(u64)`, eliminating the synchronous reply that
         // made every spin-loop iteration a blocking IPC round-trip.
         let current_ts = Arc::new(AtomicU64::new(0));
+        let profiler = profile
+            .map(|(hz, targets)| Profiler::start(targets, hz, current_ts.clone()))
+            .transpose()
+            .map_err(KernelError::Profiler)?;
         let (energy_tx, energy_rx) = mpsc::channel::<router::EnergyEvents>();
+        // Kernel timestep of the next step with work for a protocol, while
+        // the router reports every protocol blocked on it; see `skip_idle`.
+        // Replays inject writes the router can't see coming, so they always
+        // run paced.
+        let idle_until = (skip_idle
+            && matches!(cmd, RunCmd::Simulate { .. } | RunCmd::Fuzz { .. }))
+        .then(|| Arc::new(AtomicU64::new(0)));
         let mut routing_server = {
             let source = Self::get_write_source(cmd).map_err(KernelError::SourceError)?;
             RoutingServer::serve(
@@ -231,9 +427,18 @@ impl Kernel {
                 energy_tx,
                 router_input_tx,
                 router_input_rx,
+                stats,
+                idle_until.clone(),
+                router_shards,
+                checkpointing,
+                exchange,
+                fuzz,
             )
         }?;
         let mut status_server = StatusServer::serve(time_dilation.clone(), runc)?;
+        for name in depleted {
+            status_server.freeze_node(name)?;
+        }
         queue_event(
             &mut event_queue,
             RESOURCE_UPDATE_INTERVAL,
@@ -247,10 +452,16 @@ impl Kernel {
             .unwrap_or_else(std::time::Instant::now);
         let mut next_tick_at = std::time::Instant::now();
         let loop_start = next_tick_at;
-        'outer: for timestep in 0..self.timestep.count.into() {
+        // `idle_until` value whose idle stretch the CPU check confirmed.
+        let mut idle_window = 0;
+        'outer: for timestep in first_timestep..self.timestep.count.into() {
             if abort.as_ref().is_some_and(|a| a.load(Ordering::Relaxed)) {
                 break;
             }
+            // Every protocol is held in its save; nothing left to simulate.
+            if checkpointed.load(Ordering::Acquire) {
+                break;
+            }
             if timestep % ts_update_interval == 0 {
                 tracing::event!(target: "timestep", tracing::Level::TRACE, timestep = timestep);
             }
@@ -293,7 +504,8 @@ impl Kernel {
                     status::messages::StatusMessage::PrematureExit => {
                         break 'outer;
                     }
-                    status::messages::StatusMessage::Respawned { .. } => {}
+                    status::messages::StatusMessage::Respawned { .. }
+                    | status::messages::StatusMessage::CpuIdle(_) => {}
                 }
             }
 
@@ -314,6 +526,28 @@ impl Kernel {
                         && !pid_changes.is_empty()
                     {
                         routing_server.remap_pids(pid_changes)?;
+                        // A fresh process is runnable.
+                        idle_window = 0;
+                    }
+                }
+            }
+
+            // Every protocol is blocked on a reply the router will not send
+            // before `until`, so the steps in between only advance simulated
+            // time and can run back to back. They still run one at a time,
+            // with the usual per-step bookkeeping, so the result is the same
+            // as a paced run. Before trusting a new stretch, check that no
+            // protocol used any CPU time outside of nexus since the last
+            // look (e.g. a second thread still working).
+            if let Some(idle) = &idle_until {
+                let until = idle.load(Ordering::Acquire);
+                if timestep + 1 < until {
+                    if until != idle_window && status_server.cpu_idle()? {
+                        idle_window = until;
+                    }
+                    if until == idle_window {
+                        next_tick_at = std::time::Instant::now();
+                        continue;
                     }
                 }
             }
@@ -348,6 +582,9 @@ impl Kernel {
             "RTF_FINAL ticks={final_ticks} elapsed_ns={elapsed_ns} loop_wall_ns={loop_wall_ns}"
         );
 
+        // Record the last samples before the protocols are killed.
+        drop(profiler);
+
         // Handle any outstanding FS requests so it can be cleanly unmounted
         let run_handles = status_server.shutdown()?;
         routing_server.shutdown()?;
@@ -358,7 +595,7 @@ impl Kernel {
     #[instrument(skip_all)]
     fn get_write_source(cmd: RunCmd) -> Result<Source, SourceError> {
         match cmd {
-            RunCmd::Simulate { .. } => Source::simulated(),
+            RunCmd::Simulate { .. } | RunCmd::Fuzz { .. } => Source::simulated(),
             RunCmd::Replay { logs } => {
                 // Prefer unified trace format if available, fall back to legacy
                 let trace_file = logs.join("trace.nxs");
@@ -0,0 +1,454 @@
+//! partition.rs
+//! Running one simulation across several hosts.
+//!
+//! `nexus simulate --partition <i> --peers <addr>,...` runs partition `i` of
+//! the nodes on this host: its own kernel, FUSE mount and protocols, with the
+//! full configuration so every node's position and channels are known. Nodes
+//! are split by name, in contiguous runs of the sorted node list, so nodes
+//! named after the area they are in mostly share a host with their
+//! neighbours.
+//!
+//! A write whose channel has subscribers on another partition is routed
+//! locally as usual and also forwarded to every partition it can reach,
+//! which runs link simulation for its own receivers. Forwarded writes are
+//! exchanged in windows as long as the smallest delay of any channel that
+//! crosses partitions (the lookahead): a write made during a window cannot be
+//! delivered before the next one starts, so once every peer's batch for a
+//! window is in, the partition can run the whole next window on its own. A
+//! peer with nothing to forward still sends its (empty) batch, which is all
+//! the synchronization there is. See `router/exchange.rs`.
+//!
+//! Hosts connect in a full mesh: each partition listens on its own address,
+//! connects to every partition before it and accepts every partition after
+//! it, then checks with a handshake that they all run the same simulation.
+
+use std::collections::HashSet;
+use std::io::{BufReader, BufWriter, ErrorKind, Write};
+use std::net::{Shutdown, SocketAddr, TcpListener, TcpStream};
+use std::thread::{self, JoinHandle};
+use std::time::{Duration, Instant};
+
+use bincode::{Decode, Encode};
+use config::ast;
+use tracing::{info, warn};
+
+use crate::errors::PartitionError;
+
+/// How long to wait for every peer to come up.
+const CONNECT_TIMEOUT: Duration = Duration::from_secs(120);
+/// Pause between attempts to reach a peer that is not listening yet.
+const CONNECT_RETRY: Duration = Duration::from_millis(100);
+
+/// This host's share of a simulation split across several hosts.
+#[derive(Debug, Clone, PartialEq)]
+pub struct Partition {
+    index: usize,
+    /// Address of every partition's host, in partition order.
+    peers: Vec<SocketAddr>,
+}
+
+impl Partition {
+    pub fn new(index: usize, peers: Vec<SocketAddr>) -> Result<Self, PartitionError> {
+        if index >= peers.len() {
+            return Err(PartitionError::Index(index, peers.len()));
+        }
+        Ok(Self { index, peers })
+    }
+
+    pub fn index(&self) -> usize {
+        self.index
+    }
+
+    pub fn count(&self) -> usize {
+        self.peers.len()
+    }
+
+    /// Partition running node `node` of `nodes`, counted in name order.
+    pub(crate) fn owner(&self, node: usize, nodes: usize) -> usize {
+        node * self.count() / nodes.max(1)
+    }
+
+    /// Names of the nodes this partition runs.
+    pub fn local_nodes(&self, sim: &ast::Simulation) -> HashSet<String> {
+        let mut names: Vec<&String> = sim.nodes.keys().collect();
+        names.sort();
+        let count = names.len();
+        names
+            .into_iter()
+            .enumerate()
+            .filter(|&(node, _)| self.owner(node, count) == self.index)
+            .map(|(_, name)| name.clone())
+            .collect()
+    }
+
+    /// `sim` with only this partition's nodes, for building and launching
+    /// the protocols this host runs. The kernel still takes all of `sim`.
+    pub fn localize(&self, sim: &ast::Simulation) -> ast::Simulation {
+        let local = self.local_nodes(sim);
+        let mut sim = sim.clone();
+        sim.nodes.retain(|name, _| local.contains(name));
+        sim
+    }
+}
+
+/// What every partition must agree on before exchanging anything.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct Hello {
+    pub(crate) partition: usize,
+    pub(crate) partitions: usize,
+    pub(crate) seed: u64,
+    pub(crate) node_names: Vec<String>,
+    pub(crate) channel_names: Vec<String>,
+    pub(crate) timestep_ns: u64,
+    pub(crate) lookahead: u64,
+}
+
+/// A write forwarded to the partitions running its receivers.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub(crate) struct RemoteWrite {
+    /// Router timestep the write was made in.
+    pub(crate) timestep: u64,
+    pub(crate) src: usize,
+    pub(crate) channel: usize,
+    pub(crate) msg_id: u64,
+    /// Where the sender was when it transmitted, which only its own host
+    /// keeps track of.
+    pub(crate) point: [f64; 3],
+    /// Azimuth, elevation and roll.
+    pub(crate) orientation: [f64; 3],
+    pub(crate) data: Vec<u8>,
+}
+
+#[derive(Encode, Decode, Debug)]
+enum Frame {
+    Hello(Hello),
+    /// Every write a peer made for this partition before router timestep
+    /// `through`.
+    Window {
+        through: u64,
+        writes: Vec<RemoteWrite>,
+    },
+}
+
+/// Connection to one other partition.
+#[derive(Debug)]
+struct Link {
+    tx: BufWriter<TcpStream>,
+    /// Windows as the reader thread decoded them. Reading on a thread of its
+    /// own means a peer blocked writing its batch to us always gets drained,
+    /// whatever this partition is doing.
+    rx: crossbeam_channel::Receiver<Result<Frame, PartitionError>>,
+    reader: Option<JoinHandle<()>>,
+}
+
+/// Connections to every other partition.
+#[derive(Debug)]
+pub(crate) struct Peers {
+    index: usize,
+    /// One per partition, `None` for this one.
+    links: Vec<Option<Link>>,
+}
+
+impl Peers {
+    /// Connect to every other partition of `partition` and check that they
+    /// run the same simulation as `hello` describes.
+    pub(crate) fn connect(partition: &Partition, hello: Hello) -> Result<Self, PartitionError> {
+        let own = partition.peers[partition.index];
+        let listener = TcpListener::bind(own).map_err(|e| PartitionError::Io(own, e))?;
+        let deadline = Instant::now() + CONNECT_TIMEOUT;
+        let mut links: Vec<Option<Link>> = (0..partition.count()).map(|_| None).collect();
+        for (peer, &addr) in partition.peers.iter().enumerate().take(partition.index) {
+            let stream = connect_by(addr, deadline)?;
+            links[peer] = Some(Link::handshake(stream, addr, peer, &hello)?);
+        }
+        listener
+            .set_nonblocking(true)
+            .map_err(|e| PartitionError::Io(own, e))?;
+        while links.iter().skip(partition.index + 1).any(Option::is_none) {
+            let (stream, addr) = match listener.accept() {
+                Ok(accepted) => accepted,
+                Err(e) if e.kind() == ErrorKind::WouldBlock => {
+                    if Instant::now() >= deadline {
+                        let missing = (partition.index + 1..partition.count())
+                            .find(|&peer| links[peer].is_none())
+                            .expect("a partition is still missing");
+                        return Err(PartitionError::Timeout(partition.peers[missing]));
+                    }
+                    thread::sleep(CONNECT_RETRY);
+                    continue;
+                }
+                Err(e) => return Err(PartitionError::Io(own, e)),
+            };
+            stream
+                .set_nonblocking(false)
+                .map_err(|e| PartitionError::Io(addr, e))?;
+            let (peer, link) = Link::accept(stream, addr, &hello)?;
+            if peer <= partition.index || links.get(peer).is_none_or(Option::is_some) {
+                warn!("Ignoring unexpected connection from partition {peer} at {addr}");
+                continue;
+            }
+            links[peer] = Some(link);
+        }
+        info!(
+            "Partition {} of {} connected to its peers",
+            partition.index,
+            partition.count()
+        );
+        Ok(Self {
+            index: partition.index,
+            links,
+        })
+    }
+
+    /// Send every peer its writes from the window ending before `through`,
+    /// then wait for each peer's writes for this partition from the same
+    /// window. They come back in partition order, each peer's in the order
+    /// it made them.
+    pub(crate) fn swap(
+        &mut self,
+        through: u64,
+        outboxes: &mut [Vec<RemoteWrite>],
+    ) -> Result<Vec<RemoteWrite>, PartitionError> {
+        for (peer, link) in self.links.iter_mut().enumerate() {
+            let Some(link) = link else { continue };
+            let frame = Frame::Window {
+                through,
+                writes: std::mem::take(&mut outboxes[peer]),
+            };
+            link.send(peer, &frame)?;
+        }
+        let mut writes = Vec::new();
+        for (peer, link) in self.links.iter().enumerate() {
+            let Some(link) = link else { continue };
+            match link.rx.recv() {
+                Ok(Ok(Frame::Window {
+                    through: found,
+                    writes: batch,
+                })) if found == through => writes.extend(batch),
+                Ok(Ok(Frame::Window { through: found, .. })) => {
+                    return Err(PartitionError::Desync {
+                        peer,
+                        expected: through,
+                        found,
+                    });
+                }
+                Ok(Ok(Frame::Hello(_))) => return Err(PartitionError::Mismatch(peer)),
+                Ok(Err(e)) => return Err(e),
+                Err(_) => return Err(PartitionError::Disconnected(peer)),
+            }
+        }
+        Ok(writes)
+    }
+
+    pub(crate) fn index(&self) -> usize {
+        self.index
+    }
+
+    pub(crate) fn count(&self) -> usize {
+        self.links.len()
+    }
+}
+
+impl Link {
+    /// Introduce ourselves to partition `peer`, which we connected to.
+    fn handshake(
+        stream: TcpStream,
+        addr: SocketAddr,
+        peer: usize,
+        hello: &Hello,
+    ) -> Result<Self, PartitionError> {
+        let mut link = Self::new(stream, addr)?;
+        link.send(peer, &Frame::Hello(hello.clone()))?;
+        match link.rx.recv_timeout(CONNECT_TIMEOUT) {
+            Ok(Ok(Frame::Hello(theirs))) if theirs.partition == peer && agree(hello, &theirs) => {
+                Ok(link)
+            }
+            Ok(Err(e)) => Err(e),
+            _ => Err(PartitionError::Mismatch(peer)),
+        }
+    }
+
+    /// Learn who connected to us, then introduce ourselves.
+    fn accept(
+        stream: TcpStream,
+        addr: SocketAddr,
+        hello: &Hello,
+    ) -> Result<(usize, Self), PartitionError> {
+        let mut link = Self::new(stream, addr)?;
+        let theirs = match link.rx.recv_timeout(CONNECT_TIMEOUT) {
+            Ok(Ok(Frame::Hello(theirs))) => theirs,
+            Ok(Err(e)) => return Err(e),
+            _ => return Err(PartitionError::Timeout(addr)),
+        };
+        if !agree(hello, &theirs) {
+            return Err(PartitionError::Mismatch(theirs.partition));
+        }
+        link.send(theirs.partition, &Frame::Hello(hello.clone()))?;
+        Ok((theirs.partition, link))
+    }
+
+    fn new(stream: TcpStream, addr: SocketAddr) -> Result<Self, PartitionError> {
+        let io_err = |e| PartitionError::Io(addr, e);
+        // Windows are small and latency bound.
+        stream.set_nodelay(true).map_err(io_err)?;
+        let mut reader = BufReader::new(stream.try_clone().map_err(io_err)?);
+        let (frames_tx, rx) = crossbeam_channel::unbounded();
+        let reader = thread::Builder::new()
+            .name(format!("nexus_peer_{addr}"))
+            .spawn(move || {
+                loop {
+                    let frame =
+                        bincode::decode_from_std_read(&mut reader, bincode::config::standard())
+                            .map_err(|e| PartitionError::Decode(addr, e));
+                    let failed = frame.is_err();
+                    if frames_tx.send(frame).is_err() || failed {
+                        return;
+                    }
+                }
+            })
+            .map_err(io_err)?;
+        Ok(Self {
+            tx: BufWriter::new(stream),
+            rx,
+            reader: Some(reader),
+        })
+    }
+
+    fn send(&mut self, peer: usize, frame: &Frame) -> Result<(), PartitionError> {
+        bincode::encode_into_std_write(frame, &mut self.tx, bincode::config::standard())
+            .map_err(PartitionError::Encode)?;
+        self.tx
+            .flush()
+            .map_err(|_| PartitionError::Disconnected(peer))
+    }
+}
+
+impl Drop for Link {
+    fn drop(&mut self) {
+        // Ends the reader thread, which holds the other half of the socket.
+        let _ = self.tx.flush();
+        let _ = self.tx.get_ref().shutdown(Shutdown::Both);
+        if let Some(reader) = self.reader.take() {
+            let _ = reader.join();
+        }
+    }
+}
+
+/// Whether two partitions' handshakes describe the same simulation.
+fn agree(ours: &Hello, theirs: &Hello) -> bool {
+    ours.partitions == theirs.partitions
+        && ours.seed == theirs.seed
+        && ours.node_names == theirs.node_names
+        && ours.channel_names == theirs.channel_names
+        && ours.timestep_ns == theirs.timestep_ns
+        && ours.lookahead == theirs.lookahead
+}
+
+/// Connect to `addr`, retrying until it listens or `deadline` passes.
+fn connect_by(addr: SocketAddr, deadline: Instant) -> Result<TcpStream, PartitionError> {
+    loop {
+        match TcpStream::connect(addr) {
+            Ok(stream) => return Ok(stream),
+            Err(e)
+                if matches!(
+                    e.kind(),
+                    ErrorKind::ConnectionRefused | ErrorKind::ConnectionReset
+                ) =>
+            {
+                if Instant::now() >= deadline {
+                    return Err(PartitionError::Timeout(addr));
+                }
+                thread::sleep(CONNECT_RETRY);
+            }
+            Err(e) => return Err(PartitionError::Io(addr, e)),
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::test_utils::helpers::free_addrs;
+
+    fn hello(partition: usize) -> Hello {
+        Hello {
+            partition,
+            partitions: 3,
+            seed: 7,
+            node_names: vec!["a".into(), "b".into(), "c".into()],
+            channel_names: vec!["air".into()],
+            timestep_ns: 1_000,
+            lookahead: 5,
+        }
+    }
+
+    fn write(src: usize, msg_id: u64) -> RemoteWrite {
+        RemoteWrite {
+            timestep: 3,
+            src,
+            channel: 0,
+            msg_id,
+            point: [1.0, 2.0, 3.0],
+            orientation: [0.0; 3],
+            data: vec![src as u8],
+        }
+    }
+
+    #[test]
+    fn nodes_split_into_contiguous_runs() {
+        let peers = free_addrs(3);
+        let owners: Vec<_> = (0..7)
+            .map(|node| Partition::new(0, peers.clone()).unwrap().owner(node, 7))
+            .collect();
+        assert_eq!(owners, [0, 0, 0, 1, 1, 2, 2]);
+        assert!(Partition::new(3, peers).is_err());
+    }
+
+    #[test]
+    fn mesh_swaps_windows_in_partition_order() {
+        let peers = free_addrs(3);
+        let hosts: Vec<_> = (0..3)
+            .map(|index| {
+                let partition = Partition::new(index, peers.clone()).unwrap();
+                thread::spawn(move || {
+                    let mut mesh = Peers::connect(&partition, hello(index)).unwrap();
+                    // Partition `i` sends one write to each peer, tagged
+                    // with the peer's index, then an empty window.
+                    let mut outboxes: Vec<_> =
+                        (0..3).map(|peer| vec![write(index, peer as u64)]).collect();
+                    outboxes[index].clear();
+                    let first = mesh.swap(10, &mut outboxes).unwrap();
+                    assert!(outboxes.iter().all(Vec::is_empty));
+                    let second = mesh.swap(15, &mut outboxes).unwrap();
+                    (first, second)
+                })
+            })
+            .collect();
+        for (index, host) in hosts.into_iter().enumerate() {
+            let (first, second) = host.join().unwrap();
+            let expected: Vec<_> = (0..3)
+                .filter(|&peer| peer != index)
+                .map(|peer| write(peer, index as u64))
+                .collect();
+            assert_eq!(first, expected);
+            assert!(second.is_empty());
+        }
+    }
+
+    #[test]
+    fn handshake_rejects_a_different_simulation() {
+        let peers = free_addrs(2);
+        let first = Partition::new(0, peers.clone()).unwrap();
+        let host = thread::spawn(move || {
+            let mut other = hello(0);
+            other.partitions = 2;
+            Peers::connect(&first, other).map(|_| ())
+        });
+        let mut ours = hello(1);
+        ours.partitions = 2;
+        ours.seed = 8;
+        let second = Partition::new(1, peers).unwrap();
+        assert!(Peers::connect(&second, ours).is_err());
+        assert!(host.join().unwrap().is_err());
+    }
+}
@@ -0,0 +1,188 @@
+//! profiler/mod.rs
+//! Sampling profiler for protocol processes, keyed to simulated time.
+//!
+//! `nexus simulate --profile <hz>` opens a sampling counter on every
+//! protocol's cgroup (see `perf.rs`), on each CPU the protocol may run on:
+//! the one its node is pinned to, or all of the runner's for a node without
+//! a CPU limit. Each sample wakes the profiler thread,
+//! which tags it with the timestep the kernel last published in
+//! `current_ts`, symbolizes its callchain and counts it. Samples with the
+//! same protocol and stack in the same timestep become one `profile` event,
+//! which the trace layer records as a `CpuSample` alongside the message
+//! records.
+
+mod perf;
+mod symbols;
+
+use std::collections::HashMap;
+use std::io;
+use std::num::NonZeroU32;
+use std::path::PathBuf;
+use std::sync::Arc;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::thread::{self, JoinHandle};
+
+use tracing::{Level, event, warn};
+
+use perf::CgroupSampler;
+use symbols::Symbolizer;
+
+/// Longest the profiler thread waits for a sample before checking whether
+/// it should stop.
+const POLL_TIMEOUT_MS: libc::c_int = 50;
+
+/// A protocol to sample.
+#[derive(Debug, Clone)]
+pub struct ProfileTarget {
+    /// Index of the node, as in the trace header.
+    pub node: usize,
+    pub protocol: Arc<str>,
+    /// The protocol's own cgroup; respawns land in the same one.
+    pub cgroup: PathBuf,
+    /// CPUs the protocol runs on, from its node's assignment.
+    pub cpus: Vec<usize>,
+}
+
+/// Running profiler. Dropping it stops sampling and records what is left.
+pub struct Profiler {
+    stop: Arc<AtomicBool>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl Profiler {
+    /// Sample every target `hz` times per second of CPU time it uses.
+    pub fn start(
+        targets: Vec<ProfileTarget>,
+        hz: NonZeroU32,
+        current_ts: Arc<AtomicU64>,
+    ) -> io::Result<Self> {
+        let online = perf::online_cpus()?;
+        let period_ns = 1_000_000_000 / u64::from(hz.get());
+        let samplers = targets
+            .iter()
+            .map(|target| {
+                let cpus: Vec<usize> = target
+                    .cpus
+                    .iter()
+                    .copied()
+                    .filter(|cpu| online.contains(cpu))
+                    .collect();
+                CgroupSampler::open(&target.cgroup, &cpus, period_ns).map_err(|e| {
+                    io::Error::new(
+                        e.kind(),
+                        format!("cannot sample cgroup {}: {e}", target.cgroup.display()),
+                    )
+                })
+            })
+            .collect::<io::Result<Vec<_>>>()?;
+        let stop = Arc::new(AtomicBool::new(false));
+        let thread = {
+            let stop = stop.clone();
+            thread::Builder::new()
+                .name("nexus-profiler".to_string())
+                .spawn(move || sample(targets, samplers, current_ts, &stop))?
+        };
+        Ok(Self {
+            stop,
+            thread: Some(thread),
+        })
+    }
+}
+
+impl Drop for Profiler {
+    fn drop(&mut self) {
+        self.stop.store(true, Ordering::Relaxed);
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+    }
+}
+
+/// Per-timestep sample counts, keyed by target and folded stack.
+#[derive(Default)]
+struct Pending {
+    timestep: u64,
+    counts: HashMap<(usize, String), u32>,
+}
+
+impl Pending {
+    fn flush(&mut self, targets: &[ProfileTarget]) {
+        let timestep = self.timestep;
+        for ((target, stack), count) in self.counts.drain() {
+            let ProfileTarget { node, protocol, .. } = &targets[target];
+            event!(target: "profile", Level::INFO, timestep, node, protocol = &**protocol, stack = stack.as_str(), count);
+        }
+    }
+}
+
+/// Profiler thread body.
+fn sample(
+    targets: Vec<ProfileTarget>,
+    mut samplers: Vec<CgroupSampler>,
+    current_ts: Arc<AtomicU64>,
+    stop: &AtomicBool,
+) {
+    // (sampler, ring) behind each polled fd.
+    let owners: Vec<(usize, usize)> = samplers
+        .iter()
+        .enumerate()
+        .flat_map(|(s, sampler)| (0..sampler.len()).map(move |r| (s, r)))
+        .collect();
+    let mut fds: Vec<libc::pollfd> = samplers
+        .iter()
+        .flat_map(CgroupSampler::fds)
+        .map(|fd| libc::pollfd {
+            fd,
+            events: libc::POLLIN,
+            revents: 0,
+        })
+        .collect();
+    let mut symbolizer = Symbolizer::default();
+    let mut pending = Pending::default();
+    let mut lost = 0;
+    loop {
+        let stopping = stop.load(Ordering::Relaxed);
+        // SAFETY: `fds` is a live array of `fds.len()` pollfds.
+        let ready = unsafe {
+            libc::poll(
+                fds.as_mut_ptr(),
+                fds.len() as libc::nfds_t,
+                if stopping { 0 } else { POLL_TIMEOUT_MS },
+            )
+        };
+        if ready < 0 {
+            let err = io::Error::last_os_error();
+            if err.kind() != io::ErrorKind::Interrupted {
+                warn!("Profiler stopped: {err}");
+                pending.flush(&targets);
+                break;
+            }
+            continue;
+        }
+        let timestep = current_ts.load(Ordering::Acquire);
+        if timestep != pending.timestep || ready == 0 {
+            pending.flush(&targets);
+            pending.timestep = timestep;
+        }
+        if ready > 0 {
+            for (pollfd, &(s, r)) in fds.iter_mut().zip(&owners) {
+                if pollfd.revents == 0 {
+                    continue;
+                }
+                pollfd.revents = 0;
+                lost += samplers[s].drain(r, |pid, ips| {
+                    let stack = symbolizer.fold(pid, ips);
+                    *pending.counts.entry((s, stack)).or_default() += 1;
+                });
+            }
+        }
+        if stopping {
+            // This pass drained what was left.
+            pending.flush(&targets);
+            break;
+        }
+    }
+    if lost > 0 {
+        warn!("{lost} CPU samples were lost; try a lower --profile rate");
+    }
+}
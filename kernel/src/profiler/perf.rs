@@ -0,0 +1,317 @@
+//! perf.rs
+//! `perf_event_open` sampling counters bound to a cgroup, one per CPU, and
+//! the ring buffers the kernel writes their samples into.
+//!
+//! Each counter is a `cpu-clock` software event, so it works without a PMU
+//! (in VMs and containers) and a sample is taken after every `period_ns` of
+//! CPU time the cgroup's tasks run, however the CPU is throttled. Only user
+//! space is sampled, which keeps the counters usable at
+//! `kernel.perf_event_paranoid` 1 and is where protocol code runs anyway.
+
+use std::ffi::CString;
+use std::io;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd};
+use std::os::unix::ffi::OsStrExt;
+use std::path::Path;
+use std::ptr;
+use std::sync::atomic::{AtomicU64, Ordering};
+
+const PERF_TYPE_SOFTWARE: u32 = 1;
+const PERF_COUNT_SW_CPU_CLOCK: u64 = 0;
+const PERF_SAMPLE_TID: u64 = 1 << 1;
+const PERF_SAMPLE_CALLCHAIN: u64 = 1 << 5;
+const PERF_FLAG_PID_CGROUP: libc::c_ulong = 1 << 2;
+const PERF_FLAG_FD_CLOEXEC: libc::c_ulong = 1 << 3;
+const PERF_EVENT_IOC_ENABLE: libc::c_ulong = 0x2400;
+
+// `perf_event_attr` flag bits.
+const ATTR_DISABLED: u64 = 1 << 0;
+const ATTR_EXCLUDE_KERNEL: u64 = 1 << 5;
+const ATTR_EXCLUDE_HV: u64 = 1 << 6;
+const ATTR_EXCLUDE_CALLCHAIN_KERNEL: u64 = 1 << 21;
+
+const PERF_RECORD_LOST: u32 = 2;
+const PERF_RECORD_SAMPLE: u32 = 9;
+/// Callchain entries at or above this mark a context switch (user, kernel,
+/// ...) rather than a frame.
+const PERF_CONTEXT_MAX: u64 = -4095i64 as u64;
+
+/// Deepest callchain the kernel is asked for.
+const MAX_STACK: u16 = 127;
+/// Data pages per ring. A power of two, as the kernel requires.
+const RING_PAGES: usize = 16;
+/// Offsets of `data_head` and `data_tail` in `perf_event_mmap_page`.
+const OFF_DATA_HEAD: usize = 1024;
+const OFF_DATA_TAIL: usize = 1032;
+const RECORD_HEADER: usize = 8;
+
+/// `struct perf_event_attr` up to `PERF_ATTR_SIZE_VER5`.
+#[repr(C)]
+#[derive(Default)]
+struct PerfEventAttr {
+    kind: u32,
+    size: u32,
+    config: u64,
+    sample_period: u64,
+    sample_type: u64,
+    read_format: u64,
+    flags: u64,
+    wakeup_events: u32,
+    bp_type: u32,
+    config1: u64,
+    config2: u64,
+    branch_sample_type: u64,
+    sample_regs_user: u64,
+    sample_stack_user: u32,
+    clockid: i32,
+    sample_regs_intr: u64,
+    aux_watermark: u32,
+    sample_max_stack: u16,
+    reserved: u16,
+}
+
+/// One mapped counter.
+#[derive(Debug)]
+struct Ring {
+    fd: OwnedFd,
+    base: *mut u8,
+    page: usize,
+    data_len: usize,
+}
+
+// SAFETY: the mapping is owned by the ring and only touched through
+// `&mut self`, so it can move to the profiler thread with it.
+unsafe impl Send for Ring {}
+
+impl Ring {
+    fn open(attr: &PerfEventAttr, cgroup: &OwnedFd, cpu: usize) -> io::Result<Self> {
+        // SAFETY: `attr` outlives the call and its `size` says how much of it
+        // the kernel may read. The cgroup fd is open for the whole call.
+        let fd = unsafe {
+            libc::syscall(
+                libc::SYS_perf_event_open,
+                ptr::from_ref(attr),
+                cgroup.as_raw_fd(),
+                cpu as libc::c_int,
+                -1 as libc::c_int,
+                PERF_FLAG_PID_CGROUP | PERF_FLAG_FD_CLOEXEC,
+            )
+        };
+        if fd < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        // SAFETY: perf_event_open returned a fresh fd that nothing else owns.
+        let fd = unsafe { OwnedFd::from_raw_fd(fd as libc::c_int) };
+        // SAFETY: sysconf has no preconditions.
+        let page = unsafe { libc::sysconf(libc::_SC_PAGESIZE) } as usize;
+        let len = page * (RING_PAGES + 1);
+        // SAFETY: a new shared mapping of the counter's fd, which the kernel
+        // checks is a metadata page plus a power-of-two number of pages.
+        let base = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED,
+                fd.as_raw_fd(),
+                0,
+            )
+        };
+        if base == libc::MAP_FAILED {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(Self {
+            fd,
+            base: base.cast(),
+            page,
+            data_len: page * RING_PAGES,
+        })
+    }
+
+    fn enable(&self) -> io::Result<()> {
+        // SAFETY: PERF_EVENT_IOC_ENABLE takes no argument and `self.fd` is a
+        // perf event fd.
+        if unsafe { libc::ioctl(self.fd.as_raw_fd(), PERF_EVENT_IOC_ENABLE, 0) } < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        Ok(())
+    }
+
+    fn control(&self, offset: usize) -> &AtomicU64 {
+        // SAFETY: `offset` is one of the 8-byte aligned `data_head` and
+        // `data_tail` fields of the metadata page, which stays mapped for as
+        // long as `self`. The kernel only accesses them atomically too.
+        unsafe { &*self.base.add(offset).cast::<AtomicU64>() }
+    }
+
+    /// Copy `out.len()` bytes starting at free-running position `pos`.
+    fn copy_out(&self, pos: u64, out: &mut [u8]) {
+        // SAFETY: the data pages start one page into the mapping.
+        let data = unsafe { self.base.add(self.page) };
+        let at = pos as usize & (self.data_len - 1);
+        let first = out.len().min(self.data_len - at);
+        // SAFETY: `at + first` and `out.len() - first` are both within the
+        // `data_len` bytes of data pages, and `out` is not part of the
+        // mapping. The caller only copies what `data_head` says is written.
+        unsafe {
+            ptr::copy_nonoverlapping(data.add(at), out.as_mut_ptr(), first);
+            ptr::copy_nonoverlapping(data, out.as_mut_ptr().add(first), out.len() - first);
+        }
+    }
+
+    /// Hand every sample written since the last call to `sample` as the
+    /// sampled PID and its callchain, innermost frame first. Returns how
+    /// many samples the kernel had to drop because the ring was full.
+    fn drain(&mut self, buf: &mut Vec<u8>, mut sample: impl FnMut(u32, &[u64])) -> u64 {
+        let head = self.control(OFF_DATA_HEAD).load(Ordering::Acquire);
+        let mut tail = self.control(OFF_DATA_TAIL).load(Ordering::Relaxed);
+        let mut lost = 0;
+        let mut ips = Vec::new();
+        while head.wrapping_sub(tail) >= RECORD_HEADER as u64 {
+            let mut header = [0; RECORD_HEADER];
+            self.copy_out(tail, &mut header);
+            let kind = u32::from_le_bytes(header[..4].try_into().unwrap());
+            let size = u16::from_le_bytes(header[6..8].try_into().unwrap()) as usize;
+            if size < RECORD_HEADER || head.wrapping_sub(tail) < size as u64 {
+                break;
+            }
+            buf.resize(size, 0);
+            self.copy_out(tail, buf);
+            let word = |at: usize| {
+                buf.get(at..at + 8)
+                    .map(|b| u64::from_le_bytes(b.try_into().unwrap()))
+            };
+            match kind {
+                PERF_RECORD_SAMPLE => {
+                    // { u32 pid, tid; u64 nr; u64 ips[nr]; }
+                    let pid = u32::from_le_bytes(buf[8..12].try_into().unwrap());
+                    let nr = word(16).unwrap_or(0) as usize;
+                    ips.clear();
+                    ips.extend(
+                        (0..nr)
+                            .filter_map(|i| word(24 + i * 8))
+                            .filter(|&ip| ip < PERF_CONTEXT_MAX),
+                    );
+                    sample(pid, &ips);
+                }
+                // { u64 id; u64 lost; }
+                PERF_RECORD_LOST => lost += word(16).unwrap_or(0),
+                _ => {}
+            }
+            tail = tail.wrapping_add(size as u64);
+        }
+        self.control(OFF_DATA_TAIL).store(tail, Ordering::Release);
+        lost
+    }
+}
+
+impl Drop for Ring {
+    fn drop(&mut self) {
+        // SAFETY: unmaps exactly the mapping made in `open`, which nothing
+        // borrows past `self`.
+        unsafe {
+            libc::munmap(self.base.cast(), self.page * (RING_PAGES + 1));
+        }
+    }
+}
+
+/// Sampling counters for every task in one cgroup.
+#[derive(Debug)]
+pub(crate) struct CgroupSampler {
+    rings: Vec<Ring>,
+    buf: Vec<u8>,
+}
+
+impl CgroupSampler {
+    /// Sample the tasks in `cgroup` once every `period_ns` of their CPU time,
+    /// on each of `cpus`. Every sample wakes a `poll` on the sampler's fds.
+    pub(crate) fn open(cgroup: &Path, cpus: &[usize], period_ns: u64) -> io::Result<Self> {
+        let path = CString::new(cgroup.as_os_str().as_bytes())?;
+        // SAFETY: `path` is a NUL-terminated string that outlives the call.
+        let dir = unsafe { libc::open(path.as_ptr(), libc::O_RDONLY | libc::O_CLOEXEC) };
+        if dir < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        // SAFETY: open returned a fresh fd that nothing else owns.
+        let dir = unsafe { OwnedFd::from_raw_fd(dir) };
+        let attr = PerfEventAttr {
+            kind: PERF_TYPE_SOFTWARE,
+            size: size_of::<PerfEventAttr>() as u32,
+            config: PERF_COUNT_SW_CPU_CLOCK,
+            sample_period: period_ns,
+            sample_type: PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN,
+            flags: ATTR_DISABLED
+                | ATTR_EXCLUDE_KERNEL
+                | ATTR_EXCLUDE_HV
+                | ATTR_EXCLUDE_CALLCHAIN_KERNEL,
+            wakeup_events: 1,
+            sample_max_stack: MAX_STACK,
+            ..Default::default()
+        };
+        let rings = cpus
+            .iter()
+            .map(|&cpu| Ring::open(&attr, &dir, cpu))
+            .collect::<io::Result<Vec<_>>>()?;
+        for ring in &rings {
+            ring.enable()?;
+        }
+        Ok(Self {
+            rings,
+            buf: Vec::new(),
+        })
+    }
+
+    /// The fds to poll for new samples, one per CPU.
+    pub(crate) fn fds(&self) -> impl Iterator<Item = libc::c_int> + '_ {
+        self.rings.iter().map(|ring| ring.fd.as_raw_fd())
+    }
+
+    /// Drain the ring of the `i`th fd. See `Ring::drain`.
+    pub(crate) fn drain(&mut self, i: usize, sample: impl FnMut(u32, &[u64])) -> u64 {
+        self.rings[i].drain(&mut self.buf, sample)
+    }
+
+    pub(crate) fn len(&self) -> usize {
+        self.rings.len()
+    }
+}
+
+/// CPUs that are online, from `/sys/devices/system/cpu/online` (e.g.
+/// `0-3,8-11`).
+pub(crate) fn online_cpus() -> io::Result<Vec<usize>> {
+    let online = std::fs::read_to_string("/sys/devices/system/cpu/online")?;
+    parse_cpu_list(online.trim())
+        .ok_or_else(|| io::Error::new(io::ErrorKind::InvalidData, "unreadable CPU list"))
+}
+
+fn parse_cpu_list(list: &str) -> Option<Vec<usize>> {
+    let mut cpus = Vec::new();
+    for range in list.split(',').filter(|r| !r.is_empty()) {
+        match range.split_once('-') {
+            Some((lo, hi)) => cpus.extend(lo.parse::<usize>().ok()?..=hi.parse().ok()?),
+            None => cpus.push(range.parse().ok()?),
+        }
+    }
+    Some(cpus)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn attr_matches_the_kernel_layout() {
+        // PERF_ATTR_SIZE_VER5
+        assert_eq!(size_of::<PerfEventAttr>(), 112);
+    }
+
+    #[test]
+    fn parses_cpu_lists() {
+        assert_eq!(parse_cpu_list("0"), Some(vec![0]));
+        assert_eq!(
+            parse_cpu_list("0-3,8,10-11"),
+            Some(vec![0, 1, 2, 3, 8, 10, 11])
+        );
+        assert_eq!(parse_cpu_list("0-x"), None);
+    }
+}
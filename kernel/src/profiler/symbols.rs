@@ -0,0 +1,280 @@
+//! symbols.rs
+//! Turn sampled instruction pointers into function names, from the process's
+//! `/proc/<pid>/maps` and the symbol tables of the files mapped there.
+//!
+//! Only the ELF symbol tables are read, not DWARF, so inlined functions are
+//! attributed to their caller and stripped libraries show up as the
+//! library's name. Names are left mangled; `c++filt` demangles the folded
+//! output.
+
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
+use std::sync::Arc;
+
+/// Frame name for an address in no known mapping.
+const UNKNOWN: &str = "[unknown]";
+
+const ELF_MAGIC: [u8; 4] = *b"\x7fELF";
+const ELFCLASS64: u8 = 2;
+const ELFDATA2LSB: u8 = 1;
+const PT_LOAD: u32 = 1;
+const SHT_SYMTAB: u32 = 2;
+const SHT_DYNSYM: u32 = 11;
+const STT_FUNC: u8 = 2;
+const SYM_SIZE: usize = 24;
+
+/// Function symbols of one ELF file.
+#[derive(Debug, Default)]
+pub(crate) struct ElfSymbols {
+    /// `(file offset, virtual address, size)` of each loaded segment.
+    segments: Vec<(u64, u64, u64)>,
+    /// `(address, size, name)`, sorted by address.
+    functions: Vec<(u64, u64, Arc<str>)>,
+}
+
+fn u16_at(b: &[u8], at: usize) -> Option<u16> {
+    Some(u16::from_le_bytes(b.get(at..at + 2)?.try_into().ok()?))
+}
+
+fn u32_at(b: &[u8], at: usize) -> Option<u32> {
+    Some(u32::from_le_bytes(b.get(at..at + 4)?.try_into().ok()?))
+}
+
+fn u64_at(b: &[u8], at: usize) -> Option<u64> {
+    Some(u64::from_le_bytes(b.get(at..at + 8)?.try_into().ok()?))
+}
+
+impl ElfSymbols {
+    /// Parse a 64-bit little-endian ELF file. Returns `None` for anything
+    /// else.
+    pub(crate) fn parse(elf: &[u8]) -> Option<Self> {
+        if elf.get(..4)? != ELF_MAGIC || elf[4] != ELFCLASS64 || elf[5] != ELFDATA2LSB {
+            return None;
+        }
+        let phoff = u64_at(elf, 0x20)? as usize;
+        let shoff = u64_at(elf, 0x28)? as usize;
+        let phentsize = u16_at(elf, 0x36)? as usize;
+        let phnum = u16_at(elf, 0x38)? as usize;
+        let shentsize = u16_at(elf, 0x3a)? as usize;
+        let shnum = u16_at(elf, 0x3c)? as usize;
+
+        let mut symbols = Self::default();
+        for i in 0..phnum {
+            let ph = phoff + i * phentsize;
+            if u32_at(elf, ph)? == PT_LOAD {
+                symbols.segments.push((
+                    u64_at(elf, ph + 8)?,
+                    u64_at(elf, ph + 16)?,
+                    u64_at(elf, ph + 32)?,
+                ));
+            }
+        }
+
+        let section = |i: usize| {
+            let sh = shoff + i * shentsize;
+            Some((
+                u32_at(elf, sh + 4)?,
+                u64_at(elf, sh + 0x18)? as usize,
+                u64_at(elf, sh + 0x20)? as usize,
+                u32_at(elf, sh + 0x28)? as usize,
+            ))
+        };
+        for i in 0..shnum {
+            let Some((kind, offset, size, link)) = section(i) else {
+                continue;
+            };
+            if kind != SHT_SYMTAB && kind != SHT_DYNSYM {
+                continue;
+            }
+            let Some((_, str_offset, str_size, _)) = section(link) else {
+                continue;
+            };
+            let (Some(table), Some(strings)) = (
+                elf.get(offset..offset.saturating_add(size)),
+                elf.get(str_offset..str_offset.saturating_add(str_size)),
+            ) else {
+                continue;
+            };
+            for sym in table.chunks_exact(SYM_SIZE) {
+                let (Some(name), Some(value), Some(len)) =
+                    (u32_at(sym, 0), u64_at(sym, 8), u64_at(sym, 16))
+                else {
+                    continue;
+                };
+                if sym[4] & 0xf != STT_FUNC || value == 0 {
+                    continue;
+                }
+                let Some(name) = strings.get(name as usize..).and_then(|s| {
+                    let end = s.iter().position(|&c| c == 0)?;
+                    std::str::from_utf8(&s[..end]).ok()
+                }) else {
+                    continue;
+                };
+                if !name.is_empty() {
+                    symbols.functions.push((value, len, Arc::from(name)));
+                }
+            }
+        }
+        symbols.functions.sort_by_key(|(addr, _, _)| *addr);
+        // `.symtab` repeats what `.dynsym` has.
+        symbols.functions.dedup_by_key(|(addr, _, _)| *addr);
+        Some(symbols)
+    }
+
+    /// Name of the function holding the code at `offset` into the file.
+    pub(crate) fn lookup(&self, offset: u64) -> Option<&Arc<str>> {
+        let &(file_off, vaddr, _) = self
+            .segments
+            .iter()
+            .find(|(file_off, _, size)| (*file_off..file_off + size).contains(&offset))?;
+        let addr = offset - file_off + vaddr;
+        let i = self
+            .functions
+            .partition_point(|(start, _, _)| *start <= addr);
+        let (start, size, name) = self.functions.get(i.checked_sub(1)?)?;
+        // Symbols without a size run up to the next one.
+        (*size == 0 || addr < start + size).then_some(name)
+    }
+}
+
+/// One executable line of `/proc/<pid>/maps`.
+#[derive(Debug)]
+struct Mapping {
+    start: u64,
+    end: u64,
+    offset: u64,
+    /// File backing the mapping, or a pseudo-name such as `[vdso]`.
+    path: Arc<str>,
+}
+
+fn parse_maps(maps: &str) -> Vec<Mapping> {
+    maps.lines()
+        .filter_map(|line| {
+            let mut fields = line.split_ascii_whitespace();
+            let (start, end) = fields.next()?.split_once('-')?;
+            let perms = fields.next()?;
+            let offset = fields.next()?;
+            let path = fields.nth(2).unwrap_or("");
+            if perms.as_bytes().get(2) != Some(&b'x') {
+                return None;
+            }
+            Some(Mapping {
+                start: u64::from_str_radix(start, 16).ok()?,
+                end: u64::from_str_radix(end, 16).ok()?,
+                offset: u64::from_str_radix(offset, 16).ok()?,
+                path: Arc::from(path),
+            })
+        })
+        .collect()
+}
+
+/// Caches symbol tables per file and resolved frames per process.
+#[derive(Debug, Default)]
+pub(crate) struct Symbolizer {
+    maps: HashMap<u32, Vec<Mapping>>,
+    files: HashMap<Arc<str>, Option<ElfSymbols>>,
+    frames: HashMap<(u32, u64), Arc<str>>,
+}
+
+impl Symbolizer {
+    /// Fold a callchain, innermost frame first as perf reports it, into a
+    /// `;`-separated stack with the outermost frame first.
+    pub(crate) fn fold(&mut self, pid: u32, ips: &[u64]) -> String {
+        let mut stack = String::new();
+        for (depth, &ip) in ips.iter().enumerate().rev() {
+            // Every frame but the innermost is a return address, which can
+            // already belong to the next function after a call that does not
+            // return.
+            let ip = if depth == 0 { ip } else { ip.saturating_sub(1) };
+            let frame = self.frame(pid, ip);
+            if !stack.is_empty() {
+                stack.push(';');
+            }
+            stack.push_str(&frame);
+        }
+        stack
+    }
+
+    fn frame(&mut self, pid: u32, ip: u64) -> Arc<str> {
+        if let Some(frame) = self.frames.get(&(pid, ip)) {
+            return frame.clone();
+        }
+        let mut frame = self.resolve(pid, ip);
+        if frame.is_none() {
+            // Mapped since the maps were read, e.g. by `dlopen`.
+            self.maps.remove(&pid);
+            frame = self.resolve(pid, ip);
+        }
+        let frame = frame.unwrap_or_else(|| Arc::from(UNKNOWN));
+        self.frames.insert((pid, ip), frame.clone());
+        frame
+    }
+
+    fn resolve(&mut self, pid: u32, ip: u64) -> Option<Arc<str>> {
+        let maps = self.maps.entry(pid).or_insert_with(|| {
+            std::fs::read_to_string(format!("/proc/{pid}/maps"))
+                .map(|maps| parse_maps(&maps))
+                .unwrap_or_default()
+        });
+        let mapping = maps.iter().find(|m| (m.start..m.end).contains(&ip))?;
+        let symbols = self
+            .files
+            .entry(mapping.path.clone())
+            .or_insert_with(|| load(Path::new(&*mapping.path), pid));
+        let offset = ip - mapping.start + mapping.offset;
+        let named = symbols.as_ref().and_then(|s| s.lookup(offset)).cloned();
+        Some(named.unwrap_or_else(|| {
+            let file = mapping.path.rsplit('/').next().unwrap_or(&mapping.path);
+            Arc::from(format!("[{file}]"))
+        }))
+    }
+}
+
+/// Symbols of a mapped file. Read through the process's root so files in
+/// another mount namespace still resolve.
+fn load(path: &Path, pid: u32) -> Option<ElfSymbols> {
+    if !path.is_absolute() {
+        return None;
+    }
+    let rooted = PathBuf::from(format!("/proc/{pid}/root{}", path.display()));
+    let elf = std::fs::read(&rooted)
+        .or_else(|_| std::fs::read(path))
+        .ok()?;
+    ElfSymbols::parse(&elf)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn parses_executable_mappings() {
+        let maps = "\
+55d0c0a00000-55d0c0a01000 r--p 00000000 08:01 1234 /usr/bin/proto
+55d0c0a01000-55d0c0a05000 r-xp 00001000 08:01 1234 /usr/bin/proto
+7ffd1a3e0000-7ffd1a3e2000 r-xp 00000000 00:00 0    [vdso]
+7ffd1a400000-7ffd1a421000 rw-p 00000000 00:00 0
+";
+        let maps = parse_maps(maps);
+        assert_eq!(maps.len(), 2);
+        assert_eq!(maps[0].start, 0x55d0c0a01000);
+        assert_eq!(maps[0].offset, 0x1000);
+        assert_eq!(&*maps[0].path, "/usr/bin/proto");
+        assert_eq!(&*maps[1].path, "[vdso]");
+    }
+
+    #[test]
+    fn resolves_this_test_binary() {
+        #[inline(never)]
+        fn marker() -> u64 {
+            std::hint::black_box(7)
+        }
+        let ip = marker as usize as u64;
+        let mut symbolizer = Symbolizer::default();
+        let frame = symbolizer.frame(std::process::id(), ip);
+        assert!(frame.contains("marker"), "resolved to {frame}");
+        // Outermost first, and cached.
+        let stack = symbolizer.fold(std::process::id(), &[ip, 0]);
+        assert_eq!(stack, format!("{UNKNOWN};{frame}"));
+    }
+}
@@ -0,0 +1,195 @@
+//! batch.rs
+//! Framed batch mode for channel files. A write to a channel's `batch` file
+//! carries any number of messages, each a little-endian u32 length followed
+//! by the payload, and a read drains as many queued messages as fit in the
+//! caller's buffer in the same framing. A batch is routed as a whole in the
+//! timestep it is written, exactly as if each message had been written to the
+//! channel file back to back.
+
+use config::ast::ChannelKind;
+use tracing::warn;
+
+use crate::router::{ReadKind, RouterError, RoutingServer};
+
+/// Bytes in each frame's length prefix.
+pub(crate) const FRAME_PREFIX: usize = size_of::<u32>();
+
+/// Split a batch into its payloads. The whole batch is rejected if any frame
+/// runs past the end of `data`, so a malformed write never half-sends.
+pub(crate) fn split_frames(data: &[u8]) -> Result<Vec<&[u8]>, RouterError> {
+    let mut frames = Vec::new();
+    let mut offset = 0;
+    while offset < data.len() {
+        let Some(prefix) = data.get(offset..offset + FRAME_PREFIX) else {
+            return Err(RouterError::InvalidBatch(offset));
+        };
+        let len = u32::from_le_bytes(prefix.try_into().expect("prefix length")) as usize;
+        let start = offset + FRAME_PREFIX;
+        let Some(frame) = data.get(start..start.saturating_add(len)) else {
+            return Err(RouterError::InvalidBatch(offset));
+        };
+        frames.push(frame);
+        offset = start + len;
+    }
+    Ok(frames)
+}
+
+/// Append one framed payload to `out`.
+pub(crate) fn push_frame(out: &mut Vec<u8>, payload: &[u8]) {
+    let len = u32::try_from(payload.len()).expect("frames fit u32");
+    out.extend_from_slice(&len.to_le_bytes());
+    out.extend_from_slice(payload);
+}
+
+/// Cut `out` down to `cap` bytes. Only ever needed when the first frame alone
+/// is larger than the read; its prefix is rewritten to the length kept.
+/// Returns how many of its payload bytes were kept when it was cut.
+fn truncate_batch(out: &mut Vec<u8>, cap: usize) -> Option<usize> {
+    if out.len() <= cap {
+        return None;
+    }
+    if cap < FRAME_PREFIX {
+        out.clear();
+        return Some(0);
+    }
+    out.truncate(cap);
+    let kept = cap - FRAME_PREFIX;
+    let prefix = u32::try_from(kept).expect("frames fit u32");
+    out[..FRAME_PREFIX].copy_from_slice(&prefix.to_le_bytes());
+    Some(kept)
+}
+
+impl RoutingServer {
+    /// Publish every message in a write to handle `index`'s `batch` file.
+    /// The FUSE side answers malformed batches and oversized frames with an
+    /// error before they get here; should one slip through anyway it is
+    /// dropped whole rather than stopping the router.
+    pub fn write_batch(&mut self, index: usize, msg: fuse::Message) -> Result<(), RouterError> {
+        let (_, _, channel_handle) = self.channels.handles[index];
+        let max_size = self.channels.channels[channel_handle.0]
+            .r#type
+            .max_size
+            .get();
+        let frames = match split_frames(&msg.data) {
+            Ok(frames) if frames.iter().all(|frame| frame.len() <= max_size) => frames,
+            Ok(_) => {
+                warn!("Dropping batch with a frame longer than {max_size} bytes");
+                return Ok(());
+            }
+            Err(e) => {
+                warn!("Dropping batch: {e}");
+                return Ok(());
+            }
+        };
+        for frame in frames {
+            let frame_msg = fuse::Message {
+                id: (msg.id.0, String::new()),
+                data: frame.to_vec(),
+            };
+            self.write_channel_file(index, frame_msg)?;
+        }
+        Ok(())
+    }
+
+    /// Read from handle `index`'s `batch` file. Blocks under a receive
+    /// timeout exactly like a read of the channel file.
+    pub fn read_batch(&mut self, index: usize, req: fuse::ReadRequest) -> Result<(), RouterError> {
+        self.read_or_park(index, ReadKind::Batch, req)
+    }
+
+    /// Reply to `req` with as many framed messages as fit in it. An empty
+    /// reply means nothing was waiting. A first message too large for the
+    /// read is cut; on exclusive channels the rest of it is kept for the next
+    /// read, as a plain channel read would, while shared channels drop it.
+    pub(super) fn deliver_batch(&mut self, index: usize, req: fuse::ReadRequest) {
+        let cap = req.size as usize;
+        let mut out = Vec::new();
+        // A message partially read through the channel file goes first.
+        let mut first = self.unread_msg[index].take();
+        if let Some((offset, buf)) = &first {
+            push_frame(&mut out, &buf[*offset..]);
+        }
+        // Peek at the next message's size so one that would overflow the
+        // buffer stays queued for the next read. Stop when a take leaves the
+        // mailbox unchanged (collisions on a shared medium are re-read until
+        // they expire).
+        while let Some(next) = self.mailboxes[index].front() {
+            if !out.is_empty() && out.len() + FRAME_PREFIX + next.buf.len() > cap {
+                break;
+            }
+            let before = self.mailboxes[index].len();
+            if let Some(buf) = self.take_msg(index) {
+                push_frame(&mut out, &buf);
+                first.get_or_insert((0, buf));
+            }
+            if self.mailboxes[index].len() >= before {
+                break;
+            }
+        }
+        let (_, _, channel_handle) = self.channels.handles[index];
+        let incremental = matches!(
+            self.channels.channels[channel_handle.0].r#type.kind,
+            ChannelKind::Exclusive { .. }
+        );
+        if let Some(kept) = truncate_batch(&mut out, cap) {
+            if let Some((offset, buf)) = first.filter(|_| incremental) {
+                self.unread_msg[index] = Some((offset + kept, buf));
+            }
+        }
+        req.reply.data(&out);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn frames_roundtrip() {
+        let mut batch = Vec::new();
+        push_frame(&mut batch, b"one");
+        push_frame(&mut batch, b"");
+        push_frame(&mut batch, b"three");
+        assert_eq!(batch.len(), 3 * FRAME_PREFIX + 8);
+        let frames = split_frames(&batch).unwrap();
+        assert_eq!(frames, vec![&b"one"[..], &b""[..], &b"three"[..]]);
+        assert!(split_frames(&[]).unwrap().is_empty());
+    }
+
+    #[test]
+    fn malformed_batch_is_rejected_whole() {
+        let mut batch = Vec::new();
+        push_frame(&mut batch, b"ok");
+        // Length runs past the end of the write.
+        batch.extend_from_slice(&10u32.to_le_bytes());
+        batch.extend_from_slice(b"short");
+        assert!(matches!(
+            split_frames(&batch),
+            Err(RouterError::InvalidBatch(6))
+        ));
+        // Trailing bytes too short to hold a prefix.
+        assert!(matches!(
+            split_frames(&[1, 0]),
+            Err(RouterError::InvalidBatch(0))
+        ));
+    }
+
+    #[test]
+    fn oversized_first_frame_is_truncated() {
+        let mut out = Vec::new();
+        push_frame(&mut out, &[7; 10]);
+        assert_eq!(truncate_batch(&mut out, 8), Some(4));
+        assert_eq!(out.len(), 8);
+        assert_eq!(split_frames(&out).unwrap(), vec![&[7; 4][..]]);
+
+        let mut out = Vec::new();
+        push_frame(&mut out, b"x");
+        assert_eq!(truncate_batch(&mut out, 2), Some(0));
+        assert!(out.is_empty());
+
+        let mut out = Vec::new();
+        push_frame(&mut out, b"fits");
+        assert_eq!(truncate_batch(&mut out, 64), None);
+        assert_eq!(split_frames(&out).unwrap(), vec![&b"fits"[..]]);
+    }
+}
@@ -0,0 +1,715 @@
+//! checkpoint.rs
+//! Taking a checkpoint of the router and starting from one. The file format
+//! is in `crate::checkpoint`.
+//!
+//! A protocol saves its state by writing it to `ctl.checkpoint`, prefixed
+//! with its length as a little-endian `u64`, in as many writes as it likes.
+//! The write that completes the state is not answered, which holds the
+//! process where it is while the rest of the simulation carries on. Once
+//! every process on a live node is held, the router is captured at the end of
+//! the timestep and the kernel stops the run. Depleted nodes are frozen and
+//! restart from scratch when they recover anyway, so they are not waited for.
+
+use std::cmp::Ordering as CmpOrdering;
+use std::path::PathBuf;
+use std::sync::atomic::AtomicBool;
+use std::time::{Duration, SystemTime};
+
+use config::ast::{Orientation, Point};
+use fuse::PID;
+use fuser::ReplyWrite;
+use rand::SeedableRng;
+
+use super::*;
+use crate::checkpoint::*;
+use crate::errors::CheckpointError;
+use crate::types::{EnergyState, MotionPattern, Node, NodeIdx, PowerFlowState};
+
+/// Length prefix of a state written to `ctl.checkpoint`.
+const STATE_HEADER: usize = size_of::<u64>();
+
+/// What a run checkpoints and what it resumes from.
+#[derive(Debug, Default)]
+pub(crate) struct Checkpointing {
+    /// Router timestep from which protocols are asked to save their state.
+    pub(crate) at: Option<Timestep>,
+    /// Where the checkpoint is written.
+    pub(crate) path: PathBuf,
+    /// Node and protocol of every process the runner started, whether or
+    /// not it has channel files. Together they name the process across runs.
+    pub(crate) protocols: HashMap<PID, (NodeHandle, Arc<str>)>,
+    /// Set once the checkpoint is on disk.
+    pub(crate) done: Arc<AtomicBool>,
+    /// Checkpoint this run starts from.
+    pub(crate) resume: Option<Restore>,
+}
+
+/// A checkpoint matched up with the handles and processes of this run.
+/// Node state has already been applied by `Restore::resolve`.
+#[derive(Debug)]
+pub(crate) struct Restore {
+    /// Kernel timestep to start from.
+    pub(crate) next_timestep: u64,
+    timestep: Timestep,
+    next_msg_id: u64,
+    handles: Vec<(usize, HandleSnapshot)>,
+    deliveries: Vec<(Timestep, usize, MessageSnapshot)>,
+    expiries: Vec<(Timestep, usize)>,
+    rngs: Vec<RngSnapshot>,
+    states: HashMap<PID, Vec<u8>>,
+}
+
+/// Router-side checkpoint bookkeeping.
+#[derive(Debug, Default)]
+pub(crate) struct CheckpointState {
+    at: Option<Timestep>,
+    path: PathBuf,
+    protocols: HashMap<PID, (NodeHandle, Arc<str>)>,
+    done: Arc<AtomicBool>,
+    /// Whether the checkpoint has been written.
+    written: bool,
+    /// States still being written.
+    partial: HashMap<PID, Vec<u8>>,
+    /// Complete states, with the write that completed them.
+    saved: HashMap<PID, (Vec<u8>, ReplyWrite)>,
+    /// States handed back through `ctl.restore`, with how much of each has
+    /// been read.
+    restores: HashMap<PID, (usize, Vec<u8>)>,
+}
+
+impl CheckpointState {
+    /// Split `plan` into the router's bookkeeping and the state to resume.
+    pub(crate) fn new(plan: Checkpointing) -> (Self, Option<Restore>) {
+        let state = Self {
+            at: plan.at,
+            path: plan.path,
+            protocols: plan.protocols,
+            done: plan.done,
+            ..Self::default()
+        };
+        (state, plan.resume)
+    }
+
+    /// Processes on a live node that have not saved their state yet.
+    pub(super) fn waiting_on<'a>(
+        &'a self,
+        channels: &'a ResolvedChannels,
+    ) -> impl Iterator<Item = PID> + 'a {
+        self.protocols
+            .iter()
+            .filter(|(pid, (node, _))| {
+                !self.saved.contains_key(pid)
+                    && !channels.nodes[node.0]
+                        .energy
+                        .as_ref()
+                        .is_some_and(|e| e.is_dead)
+            })
+            .map(|(&pid, _)| pid)
+    }
+}
+
+impl RoutingServer {
+    /// Whether the checkpoint has been requested and not yet taken.
+    fn checkpoint_due(&self) -> bool {
+        let cp = &self.checkpoint;
+        !cp.written && cp.at.is_some_and(|at| self.timestep >= at)
+    }
+
+    /// `ctl.checkpoint` read: `1` once the calling process should save its
+    /// state, `0` otherwise.
+    pub(super) fn read_checkpoint(&mut self, req: fuse::ReadRequest) {
+        let due = self.checkpoint_due() && !self.checkpoint.saved.contains_key(&req.id.0);
+        Self::reply_capped(req.reply, req.size, if due { b"1" } else { b"0" });
+    }
+
+    /// `ctl.restore` read: the next part of the state the calling process
+    /// saved in the checkpoint this run resumed from. Empty once all of it
+    /// has been read, or when there is none.
+    pub(super) fn read_restore(&mut self, req: fuse::ReadRequest) {
+        let Some((read, state)) = self.checkpoint.restores.get_mut(&req.id.0) else {
+            req.reply.data(&[]);
+            return;
+        };
+        let n = (state.len() - *read).min(req.size as usize);
+        req.reply.data(&state[*read..*read + n]);
+        *read += n;
+    }
+
+    /// `ctl.checkpoint` write: part of the calling process's state. The
+    /// write that completes it is held until the simulation stops. Fails
+    /// with `EINVAL` when no checkpoint is being taken, the process was not
+    /// started by the runner, it has saved already, or it wrote more than
+    /// its length prefix announced.
+    pub fn save_state(&mut self, write: fuse::CheckpointWrite) {
+        let pid = write.pid;
+        let cp = &self.checkpoint;
+        if !self.checkpoint_due() || !cp.protocols.contains_key(&pid) || cp.saved.contains_key(&pid)
+        {
+            write.reply.error(libc::EINVAL);
+            return;
+        }
+        // FUSE has checked that the length fits.
+        let written = write.data.len() as u32;
+        let cp = &mut self.checkpoint;
+        let buf = cp.partial.entry(pid).or_default();
+        buf.extend_from_slice(&write.data);
+        let Some(header) = buf.first_chunk::<STATE_HEADER>() else {
+            write.reply.written(written);
+            return;
+        };
+        let len = u64::from_le_bytes(*header);
+        match (buf.len() as u64 - STATE_HEADER as u64).cmp(&len) {
+            CmpOrdering::Less => write.reply.written(written),
+            CmpOrdering::Equal => {
+                let mut state = cp.partial.remove(&pid).unwrap_or_default();
+                state.drain(..STATE_HEADER);
+                debug!("PID {pid} saved {} bytes of state", state.len());
+                cp.saved.insert(pid, (state, write.reply));
+            }
+            CmpOrdering::Greater => {
+                cp.partial.remove(&pid);
+                write.reply.error(libc::EINVAL);
+            }
+        }
+    }
+
+    /// Capture and write the checkpoint once every process on a live node
+    /// has saved its state. `kernel_ts` is the kernel timestep just stepped.
+    pub(super) fn try_checkpoint(&mut self, kernel_ts: u64) -> Result<(), CheckpointError> {
+        if !self.checkpoint_due() || self.checkpoint.waiting_on(&self.channels).next().is_some() {
+            return Ok(());
+        }
+        let checkpoint = self.capture(kernel_ts + 1);
+        checkpoint.write(&self.checkpoint.path)?;
+        info!(
+            "Checkpoint of timestep {} written to {}",
+            self.timestep,
+            self.checkpoint.path.display()
+        );
+        self.checkpoint.written = true;
+        self.checkpoint.done.store(true, Ordering::Release);
+        Ok(())
+    }
+
+    /// Report processes that never saved when the run ends without its
+    /// checkpoint.
+    pub(super) fn warn_missing_checkpoint(&self) {
+        let Some(at) = self.checkpoint.at.filter(|_| !self.checkpoint.written) else {
+            return;
+        };
+        let mut waiting: Vec<String> = self
+            .checkpoint
+            .waiting_on(&self.channels)
+            .map(|pid| self.process_name(pid))
+            .collect();
+        waiting.sort_unstable();
+        warn!(
+            "No checkpoint written: run ended before every protocol saved its state at timestep {at} \
+             (still waiting on {})",
+            waiting.join(", ")
+        );
+    }
+
+    fn node_of(&self, pid: PID) -> Option<NodeHandle> {
+        self.checkpoint.protocols.get(&pid).map(|&(node, _)| node)
+    }
+
+    fn protocol_of(&self, pid: PID) -> String {
+        self.checkpoint
+            .protocols
+            .get(&pid)
+            .map_or_else(|| pid.to_string(), |(_, p)| p.to_string())
+    }
+
+    fn process_name(&self, pid: PID) -> String {
+        let node = self
+            .node_of(pid)
+            .map_or("?", |node| &self.channels.node_names[node.0]);
+        format!("{node}.{}", self.protocol_of(pid))
+    }
+
+    /// Snapshot everything the router would need to carry on from here.
+    pub(super) fn capture(&self, next_timestep: u64) -> Checkpoint {
+        let channels = &self.channels;
+        let mut checkpoint = Checkpoint::new(next_timestep, self.timestep, self.timestep_ns);
+        checkpoint.next_msg_id = self.next_msg_id;
+        checkpoint.node_names = channels.node_names.iter().map(|n| n.to_string()).collect();
+        checkpoint.nodes = channels.nodes.iter().map(NodeSnapshot::from).collect();
+        checkpoint.handles = channels
+            .handles
+            .iter()
+            .enumerate()
+            .map(|(idx, &(pid, node, channel))| HandleSnapshot {
+                node: channels.node_names[node.0].to_string(),
+                protocol: self.protocol_of(pid),
+                channel: channels.channel_names[channel.0].to_string(),
+                mailbox: self.mailboxes[idx]
+                    .iter()
+                    .map(MessageSnapshot::from)
+                    .collect(),
+                unread: self.unread_msg[idx]
+                    .as_ref()
+                    .map(|(read, buf)| (*read, buf.to_vec())),
+                signal: SignalSnapshot::from(&self.signal_info[idx]),
+            })
+            .collect();
+        let mut sleeps = 0;
+        for (due, deadline) in self.deadlines.iter() {
+            match deadline {
+                Deadline::Deliver(frame) => checkpoint.deliveries.push((
+                    *due,
+                    frame.handle_ptr,
+                    MessageSnapshot::from(&frame.msg),
+                )),
+                Deadline::Expire(idx) => checkpoint.expiries.push((*due, *idx)),
+                Deadline::Wake(_) => sleeps += 1,
+            }
+        }
+        if sleeps > 0 {
+            warn!("Checkpoint leaves out {sleeps} sleeps of processes that did not save");
+        }
+        // The wheel keeps insertion order only per slot; message IDs restore
+        // it for deliveries due together.
+        checkpoint
+            .deliveries
+            .sort_by_key(|(due, _, msg)| (*due, msg.msg_id));
+        checkpoint.expiries.sort_unstable();
+        checkpoint.rngs = self
+            .shards
+            .iter()
+            .map(|shard| RngSnapshot {
+                seed: shard.rng.get_seed(),
+                stream: shard.rng.get_stream(),
+                word_pos: shard.rng.get_word_pos(),
+            })
+            .collect();
+        checkpoint.processes = self
+            .checkpoint
+            .saved
+            .iter()
+            .filter_map(|(pid, (state, _))| {
+                let (node, protocol) = self.checkpoint.protocols.get(pid)?;
+                Some(ProcessSnapshot {
+                    node: channels.node_names[node.0].to_string(),
+                    protocol: protocol.to_string(),
+                    state: state.clone(),
+                })
+            })
+            .collect();
+        checkpoint
+            .processes
+            .sort_by(|a, b| (&a.node, &a.protocol).cmp(&(&b.node, &b.protocol)));
+        checkpoint
+    }
+
+    /// Carry on from a checkpoint resolved against this run.
+    pub(super) fn restore(&mut self, restore: Restore) {
+        self.timestep = restore.timestep;
+        self.deadlines = TimingWheel::new(restore.timestep);
+        self.next_msg_id = restore.next_msg_id;
+        for (idx, handle) in restore.handles {
+            self.mailboxes[idx] = handle
+                .mailbox
+                .into_iter()
+                .map(QueuedMessage::from)
+                .collect();
+            self.unread_msg[idx] = handle.unread.map(|(read, buf)| (read, buf.into()));
+            self.signal_info[idx] = SignalInfo::from(handle.signal);
+        }
+        for (due, handle_ptr, msg) in restore.deliveries {
+            let msg = QueuedMessage::from(msg);
+            self.deadlines
+                .insert(due, Deadline::Deliver(AddressedMsg { handle_ptr, msg }));
+        }
+        for (due, idx) in restore.expiries {
+            self.deadlines.insert(due, Deadline::Expire(idx));
+        }
+        for (shard, rng) in self.shards.iter_mut().zip(restore.rngs) {
+            shard.rng = ChaCha12Rng::from_seed(rng.seed);
+            shard.rng.set_stream(rng.stream);
+            shard.rng.set_word_pos(rng.word_pos);
+        }
+        self.checkpoint.restores = restore
+            .states
+            .into_iter()
+            .map(|(pid, state)| (pid, (0, state)))
+            .collect();
+    }
+
+    /// Follow respawned processes. A fresh process on a recovered node
+    /// starts over, so it gets no state back.
+    pub(super) fn remap_checkpoint_pids(&mut self, old_pid: PID, new_pid: PID) {
+        let cp = &mut self.checkpoint;
+        if let Some(protocol) = cp.protocols.remove(&old_pid) {
+            cp.protocols.insert(new_pid, protocol);
+        }
+        cp.partial.remove(&old_pid);
+        cp.restores.remove(&old_pid);
+    }
+}
+
+impl Restore {
+    /// Match `checkpoint` up with this run: check that it was taken of the
+    /// same simulation, apply its node state to `channels`, and index the
+    /// rest by this run's handles and PIDs.
+    pub(crate) fn resolve(
+        checkpoint: Checkpoint,
+        channels: &mut ResolvedChannels,
+        protocols: &HashMap<PID, (NodeHandle, Arc<str>)>,
+        shards: NonZeroUsize,
+        timestep_ns: u64,
+    ) -> Result<Self, CheckpointError> {
+        let mismatch = |what: String| Err(CheckpointError::Mismatch(what));
+        if checkpoint.timestep_ns != timestep_ns {
+            return mismatch(format!(
+                "timesteps are {timestep_ns} ns long, checkpoint has {} ns",
+                checkpoint.timestep_ns
+            ));
+        }
+        if checkpoint.rngs.len() != shards.get() {
+            return mismatch(format!(
+                "router has {shards} shards, checkpoint has {}",
+                checkpoint.rngs.len()
+            ));
+        }
+        let node_names: Vec<&str> = channels.node_names.iter().map(|n| &**n).collect();
+        if checkpoint.node_names != node_names || checkpoint.nodes.len() != node_names.len() {
+            return mismatch(format!(
+                "nodes are {node_names:?}, checkpoint has {:?}",
+                checkpoint.node_names
+            ));
+        }
+
+        let protocol = |pid: &PID| protocols.get(pid).map_or("", |(_, p)| &**p);
+        let handles: HashMap<(&str, &str, &str), usize> = channels
+            .handles
+            .iter()
+            .enumerate()
+            .map(|(idx, (pid, node, channel))| {
+                let key = (
+                    &*channels.node_names[node.0],
+                    protocol(pid),
+                    &*channels.channel_names[channel.0],
+                );
+                (key, idx)
+            })
+            .collect();
+        if checkpoint.handles.len() != handles.len() {
+            return mismatch(format!(
+                "protocols have {} channel files, checkpoint has {}",
+                handles.len(),
+                checkpoint.handles.len()
+            ));
+        }
+        // Index into `checkpoint.handles` -> handle in this run.
+        let mut remap = Vec::with_capacity(handles.len());
+        for saved in &checkpoint.handles {
+            let key = (&*saved.node, &*saved.protocol, &*saved.channel);
+            let Some(&idx) = handles.get(&key) else {
+                return mismatch(format!(
+                    "no channel `{}` for protocol `{}` on node `{}`",
+                    saved.channel, saved.protocol, saved.node
+                ));
+            };
+            remap.push(idx);
+        }
+        let handle = |idx: usize| {
+            remap
+                .get(idx)
+                .copied()
+                .ok_or_else(|| CheckpointError::Mismatch(format!("unknown handle {idx}")))
+        };
+        let deliveries = checkpoint
+            .deliveries
+            .into_iter()
+            .map(|(due, idx, msg)| Ok((due, handle(idx)?, msg)))
+            .collect::<Result<_, CheckpointError>>()?;
+        let expiries = checkpoint
+            .expiries
+            .into_iter()
+            .map(|(due, idx)| Ok((due, handle(idx)?)))
+            .collect::<Result<_, CheckpointError>>()?;
+
+        let pids: HashMap<(&str, &str), PID> = protocols
+            .iter()
+            .map(|(&pid, (node, protocol))| ((&*channels.node_names[node.0], &**protocol), pid))
+            .collect();
+        let mut states = HashMap::new();
+        for process in checkpoint.processes {
+            let Some(&pid) = pids.get(&(&*process.node, &*process.protocol)) else {
+                return mismatch(format!(
+                    "no protocol `{}` on node `{}`",
+                    process.protocol, process.node
+                ));
+            };
+            states.insert(pid, process.state);
+        }
+
+        for (idx, (node, saved)) in channels.nodes.iter_mut().zip(checkpoint.nodes).enumerate() {
+            if !saved.apply(node) {
+                return mismatch(format!(
+                    "node `{}` differs in whether it has a battery",
+                    channels.node_names[idx]
+                ));
+            }
+        }
+        Ok(Self {
+            next_timestep: checkpoint.next_timestep,
+            timestep: checkpoint.timestep,
+            next_msg_id: checkpoint.next_msg_id,
+            handles: remap.into_iter().zip(checkpoint.handles).collect(),
+            deliveries,
+            expiries,
+            rngs: checkpoint.rngs,
+            states,
+        })
+    }
+}
+
+fn to_array(p: &Point) -> [f64; 3] {
+    [p.x, p.y, p.z]
+}
+
+fn to_point([x, y, z]: [f64; 3]) -> Point {
+    Point { x, y, z }
+}
+
+impl From<&Node> for NodeSnapshot {
+    fn from(node: &Node) -> Self {
+        let start = node
+            .start
+            .duration_since(SystemTime::UNIX_EPOCH)
+            .unwrap_or_default();
+        let o = &node.position.orientation;
+        Self {
+            start: (start.as_secs(), start.subsec_nanos()),
+            point: to_array(&node.position.point),
+            orientation: [o.az, o.el, o.roll],
+            motion: MotionSnapshot::from(&node.motion),
+            is_dynamic: node.is_dynamic,
+            energy: node.energy.as_ref().map(EnergySnapshot::from),
+        }
+    }
+}
+
+impl NodeSnapshot {
+    /// Overwrite `node` with the saved state. `false` if only one of them
+    /// has a battery.
+    fn apply(self, node: &mut Node) -> bool {
+        let (secs, nanos) = self.start;
+        node.start = SystemTime::UNIX_EPOCH + Duration::new(secs, nanos);
+        node.position.point = to_point(self.point);
+        let [az, el, roll] = self.orientation;
+        node.position.orientation = Orientation { az, el, roll };
+        node.motion = self.motion.into();
+        node.is_dynamic = self.is_dynamic;
+        match (&mut node.energy, self.energy) {
+            (Some(energy), Some(saved)) => {
+                saved.apply(energy);
+                true
+            }
+            (None, None) => true,
+            _ => false,
+        }
+    }
+}
+
+impl From<&MotionPattern> for MotionSnapshot {
+    fn from(motion: &MotionPattern) -> Self {
+        match *motion {
+            MotionPattern::Static => Self::Static,
+            MotionPattern::Velocity {
+                initial,
+                velocity,
+                start_ts,
+            } => Self::Velocity {
+                initial: to_array(&initial),
+                velocity: to_array(&velocity),
+                start_ts,
+            },
+            MotionPattern::Linear {
+                start,
+                end,
+                start_ts,
+                duration_us,
+            } => Self::Linear {
+                start: to_array(&start),
+                end: to_array(&end),
+                start_ts,
+                duration_us,
+            },
+            MotionPattern::Circle {
+                center,
+                radius,
+                start_angle_deg,
+                angular_vel_deg_per_us,
+                start_ts,
+            } => Self::Circle {
+                center: to_array(&center),
+                radius,
+                start_angle_deg,
+                angular_vel_deg_per_us,
+                start_ts,
+            },
+        }
+    }
+}
+
+impl From<MotionSnapshot> for MotionPattern {
+    fn from(motion: MotionSnapshot) -> Self {
+        match motion {
+            MotionSnapshot::Static => Self::Static,
+            MotionSnapshot::Velocity {
+                initial,
+                velocity,
+                start_ts,
+            } => Self::Velocity {
+                initial: to_point(initial),
+                velocity: to_point(velocity),
+                start_ts,
+            },
+            MotionSnapshot::Linear {
+                start,
+                end,
+                start_ts,
+                duration_us,
+            } => Self::Linear {
+                start: to_point(start),
+                end: to_point(end),
+                start_ts,
+                duration_us,
+            },
+            MotionSnapshot::Circle {
+                center,
+                radius,
+                start_angle_deg,
+                angular_vel_deg_per_us,
+                start_ts,
+            } => Self::Circle {
+                center: to_point(center),
+                radius,
+                start_angle_deg,
+                angular_vel_deg_per_us,
+                start_ts,
+            },
+        }
+    }
+}
+
+impl From<&EnergyState> for EnergySnapshot {
+    fn from(energy: &EnergyState) -> Self {
+        let flows = |flows: &[(String, PowerFlowState)]| {
+            flows
+                .iter()
+                .map(|(name, flow)| (name.clone(), FlowSnapshot::from(flow)))
+                .collect()
+        };
+        Self {
+            charge_nj: energy.charge_nj,
+            current_state: energy.current_state.clone(),
+            is_dead: energy.is_dead,
+            power_sources: flows(&energy.power_sources),
+            power_sinks: flows(&energy.power_sinks),
+        }
+    }
+}
+
+impl EnergySnapshot {
+    fn apply(self, energy: &mut EnergyState) {
+        let flows = |flows: Vec<(String, FlowSnapshot)>| {
+            flows
+                .into_iter()
+                .map(|(name, flow)| (name, PowerFlowState::from(flow)))
+                .collect()
+        };
+        energy.charge_nj = self.charge_nj;
+        energy.current_state = self.current_state;
+        energy.is_dead = self.is_dead;
+        energy.power_sources = flows(self.power_sources);
+        energy.power_sinks = flows(self.power_sinks);
+    }
+}
+
+impl From<&PowerFlowState> for FlowSnapshot {
+    fn from(flow: &PowerFlowState) -> Self {
+        match flow {
+            PowerFlowState::Constant { nj_per_ts } => Self::Constant {
+                nj_per_ts: *nj_per_ts,
+            },
+            PowerFlowState::PiecewiseLinear {
+                breakpoints,
+                repeat_us,
+            } => Self::PiecewiseLinear {
+                breakpoints: breakpoints.clone(),
+                repeat_us: *repeat_us,
+            },
+        }
+    }
+}
+
+impl From<FlowSnapshot> for PowerFlowState {
+    fn from(flow: FlowSnapshot) -> Self {
+        match flow {
+            FlowSnapshot::Constant { nj_per_ts } => Self::Constant { nj_per_ts },
+            FlowSnapshot::PiecewiseLinear {
+                breakpoints,
+                repeat_us,
+            } => Self::PiecewiseLinear {
+                breakpoints,
+                repeat_us,
+            },
+        }
+    }
+}
+
+impl From<&QueuedMessage> for MessageSnapshot {
+    fn from(msg: &QueuedMessage) -> Self {
+        Self {
+            src: msg.src.0,
+            buf: msg.buf.to_vec(),
+            expiration: msg.expiration.map(NonZeroU64::get),
+            bit_errors: msg.bit_errors,
+            msg_id: msg.msg_id,
+            rssi_dbm: msg.rssi_dbm,
+            snr_db: msg.snr_db,
+        }
+    }
+}
+
+impl From<MessageSnapshot> for QueuedMessage {
+    fn from(msg: MessageSnapshot) -> Self {
+        Self {
+            src: NodeIdx(msg.src),
+            buf: msg.buf.into(),
+            expiration: msg.expiration.and_then(NonZeroU64::new),
+            bit_errors: msg.bit_errors,
+            msg_id: msg.msg_id,
+            rssi_dbm: msg.rssi_dbm,
+            snr_db: msg.snr_db,
+        }
+    }
+}
+
+impl From<&SignalInfo> for SignalSnapshot {
+    fn from(info: &SignalInfo) -> Self {
+        Self {
+            rssi_dbm: info.rssi_dbm,
+            snr_db: info.snr_db,
+            src_node: info.src_node,
+            msg_id: info.msg_id,
+            timestep: info.timestep,
+        }
+    }
+}
+
+impl From<SignalSnapshot> for SignalInfo {
+    fn from(info: SignalSnapshot) -> Self {
+        Self {
+            rssi_dbm: info.rssi_dbm,
+            snr_db: info.snr_db,
+            src_node: info.src_node,
+            msg_id: info.msg_id,
+            timestep: info.timestep,
+        }
+    }
+}
@@ -0,0 +1,251 @@
+//! clock.rs
+//! Memory-mapped simulated clock. Reading `ctl.clock` returns the path of a
+//! page laid out as below, which protocols map read-only and poll without a
+//! syscall, much like a vDSO. `nexus::ClockPage` in
+//! `examples/arduino/common/include/ClockPage.h` is the C++ side and must be
+//! kept in sync with these offsets.
+//!
+//! ```text
+//! 0     magic "NXCK" (u32), version (u32)
+//! 8     nanoseconds per timestep (u64), constant for the simulation
+//! 64    sequence (u64), odd while the router is writing
+//! 72    timestep (u64)
+//! 80    elapsed simulated ns since the start of the simulation (u64)
+//! 88    simulated ns since the Unix epoch (u64)
+//! ```
+//!
+//! The fields at 72..96 are guarded by a seqlock: readers load the sequence,
+//! copy the fields, and retry if the sequence was odd or changed meanwhile.
+
+use std::fs;
+use std::io;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{self, AtomicU32, AtomicU64, Ordering};
+
+use config::ast::{TimeUnit, TimestepConfig};
+use tracing::warn;
+
+use crate::router::shm::{map_new_file, shm_dir};
+use crate::router::{RouterError, RoutingServer};
+
+pub(crate) const CLOCK_MAGIC: u32 = u32::from_le_bytes(*b"NXCK");
+pub(crate) const CLOCK_VERSION: u32 = 1;
+const CLOCK_LEN: usize = 4096;
+
+const OFF_MAGIC: usize = 0;
+const OFF_VERSION: usize = 4;
+const OFF_TIMESTEP_NS: usize = 8;
+const OFF_SEQ: usize = 64;
+const OFF_TIMESTEP: usize = 72;
+const OFF_ELAPSED_NS: usize = 80;
+const OFF_EPOCH_NS: usize = 88;
+
+/// One consistent reading of the clock page.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub(crate) struct ClockSnapshot {
+    pub timestep: u64,
+    pub elapsed_ns: u64,
+    pub epoch_ns: u64,
+}
+
+/// Router-side handle on the clock page. The router thread is the only
+/// writer. The backing file is unlinked when this is dropped.
+#[derive(Debug)]
+pub(crate) struct ClockPage {
+    base: *mut u8,
+    path: PathBuf,
+}
+
+impl ClockPage {
+    /// Create and map a fresh clock page at `path`.
+    pub fn create(path: PathBuf, timestep_ns: u64) -> io::Result<Self> {
+        let base = map_new_file(&path, CLOCK_LEN)?;
+        // Magic goes last so a peer that sees it also sees the rest of the
+        // header.
+        unsafe {
+            base.add(OFF_VERSION).cast::<u32>().write(CLOCK_VERSION);
+            base.add(OFF_TIMESTEP_NS).cast::<u64>().write(timestep_ns);
+            (*base.add(OFF_MAGIC).cast::<AtomicU32>()).store(CLOCK_MAGIC, Ordering::Release);
+        }
+        Ok(Self { base, path })
+    }
+
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    fn word(&self, offset: usize) -> &AtomicU64 {
+        unsafe { &*self.base.add(offset).cast::<AtomicU64>() }
+    }
+
+    /// Publish a new reading. The fields are written between two sequence
+    /// bumps so a concurrent reader either sees all of them or retries.
+    pub fn publish(&self, now: ClockSnapshot) {
+        let seq = self.word(OFF_SEQ);
+        let start = seq.load(Ordering::Relaxed);
+        seq.store(start.wrapping_add(1), Ordering::Relaxed);
+        atomic::fence(Ordering::Release);
+        self.word(OFF_TIMESTEP)
+            .store(now.timestep, Ordering::Relaxed);
+        self.word(OFF_ELAPSED_NS)
+            .store(now.elapsed_ns, Ordering::Relaxed);
+        self.word(OFF_EPOCH_NS)
+            .store(now.epoch_ns, Ordering::Relaxed);
+        seq.store(start.wrapping_add(2), Ordering::Release);
+    }
+
+    /// Reader side of the seqlock, the same loop the C++ helper runs.
+    #[cfg(test)]
+    fn read(&self) -> ClockSnapshot {
+        read_page(self.base)
+    }
+}
+
+impl Drop for ClockPage {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.base.cast(), CLOCK_LEN);
+        }
+        let _ = fs::remove_file(&self.path);
+    }
+}
+
+#[cfg(test)]
+fn read_page(base: *const u8) -> ClockSnapshot {
+    let word = |offset: usize| unsafe { &*base.add(offset).cast::<AtomicU64>() };
+    loop {
+        let before = word(OFF_SEQ).load(Ordering::Acquire);
+        if before & 1 == 1 {
+            std::hint::spin_loop();
+            continue;
+        }
+        let now = ClockSnapshot {
+            timestep: word(OFF_TIMESTEP).load(Ordering::Relaxed),
+            elapsed_ns: word(OFF_ELAPSED_NS).load(Ordering::Relaxed),
+            epoch_ns: word(OFF_EPOCH_NS).load(Ordering::Relaxed),
+        };
+        atomic::fence(Ordering::Acquire);
+        if word(OFF_SEQ).load(Ordering::Relaxed) == before {
+            return now;
+        }
+    }
+}
+
+impl ClockSnapshot {
+    /// The reading `ctl.elapsed/ns` and `ctl.time/ns` would give at
+    /// `timestep`, taking the epoch from the simulation start.
+    fn at(ts_config: &TimestepConfig, timestep: u64) -> Self {
+        Self {
+            timestep,
+            elapsed_ns: ts_config.elapsed(timestep, TimeUnit::Nanoseconds),
+            epoch_ns: ts_config.time(timestep, TimeUnit::Nanoseconds),
+        }
+    }
+}
+
+impl RoutingServer {
+    /// Reply to a read of `ctl.clock` with the path of the clock page,
+    /// creating it on first use. Every process shares one page. Failures are
+    /// logged and the read fails with EIO; the ASCII time files keep working.
+    pub fn open_clock_page(&mut self, req: fuse::ReadRequest) -> Result<(), RouterError> {
+        if self.clock_page.is_none() {
+            let name = format!("nexus-clock-{}", std::process::id());
+            match ClockPage::create(shm_dir().join(name), self.timestep_ns) {
+                Ok(page) => {
+                    page.publish(ClockSnapshot::at(&self.ts_config, self.timestep));
+                    self.clock_page = Some(page);
+                }
+                Err(e) => {
+                    warn!("Could not create clock page: {e}");
+                    drop(req.reply);
+                    return Ok(());
+                }
+            }
+        }
+        let path = self
+            .clock_page
+            .as_ref()
+            .expect("created above")
+            .path()
+            .as_os_str()
+            .as_encoded_bytes();
+        Self::reply_capped(req.reply, req.size, path);
+        Ok(())
+    }
+
+    /// Publish the current timestep to the clock page, if anyone mapped it.
+    pub(super) fn publish_clock(&self) {
+        if let Some(page) = &self.clock_page {
+            page.publish(ClockSnapshot::at(&self.ts_config, self.timestep));
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use std::thread;
+
+    use super::*;
+
+    fn make_page(name: &str) -> ClockPage {
+        let path =
+            std::env::temp_dir().join(format!("nexus-clock-test-{}-{name}", std::process::id()));
+        let _ = fs::remove_file(&path);
+        ClockPage::create(path, 1_000_000).unwrap()
+    }
+
+    #[test]
+    fn header_and_fields_are_published() {
+        let page = make_page("header");
+        let now = ClockSnapshot {
+            timestep: 7,
+            elapsed_ns: 7_000_000,
+            epoch_ns: 1_767_268_800_007_000_000,
+        };
+        page.publish(now);
+        assert_eq!(page.read(), now);
+
+        let bytes = fs::read(page.path()).unwrap();
+        assert_eq!(bytes.len(), CLOCK_LEN);
+        assert_eq!(&bytes[OFF_MAGIC..OFF_MAGIC + 4], b"NXCK");
+        assert_eq!(bytes[OFF_VERSION], CLOCK_VERSION as u8);
+        let word = |off: usize| u64::from_le_bytes(bytes[off..off + 8].try_into().unwrap());
+        assert_eq!(word(OFF_TIMESTEP_NS), 1_000_000);
+        assert_eq!(word(OFF_SEQ), 2);
+        assert_eq!(word(OFF_TIMESTEP), 7);
+        assert_eq!(word(OFF_EPOCH_NS), now.epoch_ns);
+    }
+
+    #[test]
+    fn concurrent_reader_never_sees_torn_update() {
+        let page = make_page("torn");
+        let base = page.base as usize;
+        let reader = thread::spawn(move || {
+            let mut last = 0;
+            for _ in 0..100_000 {
+                let now = read_page(base as *const u8);
+                assert_eq!(now.elapsed_ns, now.timestep * 1000);
+                assert_eq!(now.epoch_ns, now.timestep * 3);
+                assert!(now.timestep >= last);
+                last = now.timestep;
+            }
+        });
+        for timestep in 0..200_000 {
+            page.publish(ClockSnapshot {
+                timestep,
+                elapsed_ns: timestep * 1000,
+                epoch_ns: timestep * 3,
+            });
+        }
+        reader.join().unwrap();
+    }
+
+    #[test]
+    fn drop_unlinks_file() {
+        let page = make_page("unlink");
+        let path = page.path().to_path_buf();
+        assert!(path.exists());
+        drop(page);
+        assert!(!path.exists());
+    }
+}
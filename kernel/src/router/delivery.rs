@@ -8,29 +8,6 @@ pub(crate) struct AddressedMsg {
     pub(super) msg: QueuedMessage,
 }
 
-// See MessageQueue in mod.rs for tuple-ordering rationale; the
-// sequence counter guarantees unique ordering, so this comparison is
-// never reached. The trait is only required by BinaryHeap's bound.
-impl PartialEq for AddressedMsg {
-    fn eq(&self, other: &Self) -> bool {
-        self.handle_ptr == other.handle_ptr && self.msg.msg_id == other.msg.msg_id
-    }
-}
-impl Eq for AddressedMsg {}
-impl PartialOrd for AddressedMsg {
-    fn partial_cmp(&self, other: &Self) -> Option<std::cmp::Ordering> {
-        Some(self.cmp(other))
-    }
-}
-impl Ord for AddressedMsg {
-    fn cmp(&self, other: &Self) -> std::cmp::Ordering {
-        self.msg
-            .msg_id
-            .cmp(&other.msg.msg_id)
-            .then(self.handle_ptr.cmp(&other.handle_ptr))
-    }
-}
-
 /// Internal struct used for keeping track of where a queued message is from and
 /// its expiration.
 #[derive(Clone, Debug)]
@@ -48,16 +25,60 @@ pub(crate) struct QueuedMessage {
     pub(super) snr_db: f64,
 }
 
+/// A channel read with a receive timeout that arrived while the handle's
+/// mailbox was empty. The reply is held until a message can be delivered or
+/// the simulation reaches `deadline`.
+#[derive(Debug)]
+pub(crate) struct BlockedRead {
+    pub(super) handle_ptr: usize,
+    pub(super) deadline: Timestep,
+    pub(super) kind: ReadKind,
+    pub(super) req: fuse::ReadRequest,
+}
+
+/// A `poll`/`epoll` waiter on a channel file, notified once when the file
+/// becomes readable.
+pub(crate) trait Poller: std::fmt::Debug {
+    fn notify(self: Box<Self>);
+}
+
+impl Poller for fuser::PollHandle {
+    fn notify(self: Box<Self>) {
+        // Fails only if the FUSE session is gone, i.e. during shutdown.
+        if let Err(e) = (*self).notify() {
+            debug!("Poll notification failed: {e}");
+        }
+    }
+}
+
+/// What a read waiting on a receive timeout should do this timestep.
+#[derive(Debug)]
+pub(crate) enum Wake {
+    /// Reply now, starting with the message taken to find out, if any.
+    Deliver(Option<Rc<[u8]>>),
+    /// The deadline has passed with nothing to deliver.
+    TimedOut,
+    /// Keep waiting.
+    Wait,
+}
+
+/// Which of a channel's receive files a read came through, and so how the
+/// reply is framed.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub(crate) enum ReadKind {
+    /// `<channel>/channel`: one raw message.
+    Channel,
+    /// `<channel>/batch`: as many length-prefixed messages as fit.
+    Batch,
+    /// `<channel>/packet`: one message behind a link metadata header.
+    Packet,
+}
+
 impl RoutingServer {
     /// Take a message along the channel indicated by `channel_handle` from
-    /// `src_node` and post it to the queue along the precomputed route.
-    ///
-    /// For shared channels, the raw message bytes are queued as-is; link
-    /// simulation (packet loss, bit errors) runs later at delivery time so
-    /// that collisions can be modelled.
-    ///
-    /// For exclusive channels, link simulation runs here at queue time and
-    /// only surviving messages enter the queue.
+    /// `src_node` and post it to the queue along the precomputed route. See
+    /// `Shard::route` for where link simulation happens; with more than one
+    /// shard the write is routed at the end of the timestep.
     pub fn queue_message(
         &mut self,
         src_node: NodeHandle,
@@ -65,113 +86,260 @@ impl RoutingServer {
         msg: Vec<u8>,
         msg_id: u64,
     ) -> Result<(), RouterError> {
-        let sz: u64 = msg.len().try_into().expect("usize fits u64");
-        let channel = &self.channels.channels[channel_handle.0];
-        let is_shared = matches!(channel.r#type.kind, ChannelKind::Shared);
-        let timestep = self.timestep;
-        let ts_config = self.ts_config;
+        let shard = self.shard_of(channel_handle);
+        if self.shards.len() > 1 {
+            self.shards[shard].defer(PendingWrite {
+                src: src_node,
+                channel: channel_handle,
+                data: msg,
+                msg_id,
+            });
+            return Ok(());
+        }
+        let ctx = RouteCtx {
+            channels: &self.channels,
+            routes: &self.routes,
+            ts_config: self.ts_config,
+            timestep: self.timestep,
+        };
+        let routed = self.shards[shard].route(&ctx, src_node, channel_handle, &msg);
+        self.enqueue_routed(src_node, msg, msg_id, routed);
+        Ok(())
+    }
 
-        // For shared channels we share one Rc across all recipients.
-        let shared_buf: Rc<[u8]> = if is_shared {
-            Rc::from(msg.as_slice())
-        } else {
-            Rc::from([])
+    /// Deliver any pending message to the FUSE caller via `req.reply`.
+    /// Returns `Ok(true)` if a real message was sent, `Ok(false)` if the
+    /// channel was empty (and an empty reply was already sent).
+    pub fn deliver_msg(
+        &mut self,
+        index: usize,
+        req: fuse::ReadRequest,
+    ) -> Result<bool, RouterError> {
+        let Some(buf) = self.take_msg(index) else {
+            req.reply.data(&[]);
+            return Ok(false);
         };
+        self.reply_msg(index, buf, req);
+        Ok(true)
+    }
 
-        for route in self.routes.entries[channel_handle.0].nodes[&src_node].iter() {
-            let handle_ptr = route.handle_ptr;
-            let dst_node = self.channels.handles[handle_ptr].1;
-            if dst_node == src_node && !channel.r#type.delivers_to_self() {
-                continue;
+    /// Reply to a channel file read with `buf`, a message already taken from
+    /// handle `index`'s mailbox.
+    fn reply_msg(&mut self, index: usize, buf: Rc<[u8]>, req: fuse::ReadRequest) {
+        let (_, _, channel_handle) = self.channels.handles[index];
+        let incremental = matches!(
+            self.channels.channels[channel_handle.0].r#type.kind,
+            ChannelKind::Exclusive { .. }
+        );
+        if incremental {
+            // Exclusive channels allow incremental reads: serve the first
+            // chunk now, stash any remainder for the next read on this handle.
+            let n = std::cmp::min(buf.len(), req.size as usize);
+            req.reply.data(&buf[..n]);
+            if n < buf.len() {
+                self.unread_msg[index] = Some((n, buf));
             }
+        } else {
+            // Shared channels do not allow incremental reads; cap to the
+            // syscall's requested size and reply directly.
+            Self::reply_capped(req.reply, req.size, &buf);
+        }
+    }
 
-            debug!(
-                "Delivering from {} to {}",
-                &self.channels.node_names[src_node.0], &self.channels.node_names[dst_node.0]
-            );
-
-            let link = Self::lookup_or_compute_link(
-                &mut self.link_cache,
-                &self.channels.nodes,
-                &self.channels.channels,
-                src_node.0,
-                dst_node.0,
-                channel_handle.0,
-            );
+    /// Serve the leftover bytes of a previous partial read of handle
+    /// `index`.
+    pub(super) fn reply_unread(&mut self, index: usize, req: fuse::ReadRequest) {
+        let Some((read_ptr, buf)) = &mut self.unread_msg[index] else {
+            req.reply.data(&[]);
+            return;
+        };
+        if *read_ptr >= buf.len() {
+            self.unread_msg[index] = None;
+            req.reply.data(&[]);
+            return;
+        }
+        let remaining = buf.len() - *read_ptr;
+        let n = std::cmp::min(remaining, req.size as usize);
+        let end = *read_ptr + n;
+        req.reply.data(&buf[*read_ptr..end]);
+        *read_ptr = end;
+    }
 
-            // For exclusive channels, run link simulation now; drop the
-            // message if it doesn't survive.
-            let (buf, msg_bit_errors, rssi_dbm, snr_db): (Rc<[u8]>, bool, f64, f64) = if is_shared {
-                (Rc::clone(&shared_buf), false, 0.0, 0.0)
-            } else {
-                match Self::send_through_channel_cached(
-                    channel,
-                    Cow::from(&msg),
-                    &link,
-                    &mut self.rng,
-                ) {
-                    Some((b, be, rssi, snr)) => (b.into(), be, rssi, snr),
-                    None => continue,
-                }
-            };
-
-            let (becomes_active_at, expiration) = Self::message_timesteps(
-                channel,
-                sz,
-                ts_config,
-                timestep,
-                link.distance,
-                link.distance_unit,
-            );
+    /// Pop the next message for handle `index` out of its mailbox, running
+    /// any delivery-time link simulation and emitting the RX trace event.
+    /// Returns `None` if nothing survived to be received. Intact messages
+    /// share the buffer that was queued rather than being copied out.
+    pub(super) fn take_msg(&mut self, index: usize) -> Option<Rc<[u8]>> {
+        let (_, _, channel_handle) = self.channels.handles[index];
+        match &self.channels.channels[channel_handle.0].r#type.kind {
+            // Fuzzed frames are read one at a time, as written, whatever
+            // the medium.
+            _ if self.is_fuzzed(channel_handle) => self.take_exclusive_msg(index),
+            ChannelKind::Shared => self.take_shared_msg(index),
+            ChannelKind::Exclusive { .. } => self.take_exclusive_msg(index),
+        }
+    }
 
-            let msg = AddressedMsg {
-                handle_ptr,
-                msg: QueuedMessage {
-                    src: src_node,
-                    buf,
-                    expiration,
-                    bit_errors: msg_bit_errors,
-                    msg_id,
-                    rssi_dbm,
-                    snr_db,
-                },
-            };
-
-            let num = self.sequence;
-            self.sequence += 1;
-            self.queued
-                .push((Reverse(becomes_active_at), Reverse(num), msg));
+    /// Take the next message for handle `index` that survives delivery,
+    /// dropping the expired and lost ones in front of it. Stops at a take
+    /// that leaves the mailbox unchanged.
+    pub(super) fn take_deliverable(&mut self, index: usize) -> Option<Rc<[u8]>> {
+        while !self.mailboxes[index].is_empty() {
+            let before = self.mailboxes[index].len();
+            if let Some(buf) = self.take_msg(index) {
+                return Some(buf);
+            }
+            if self.mailboxes[index].len() >= before {
+                break;
+            }
         }
+        None
+    }
 
-        Ok(())
+    /// Whether a read of handle `index` waiting until `deadline` can be
+    /// answered now. A mailbox holding only messages that expire, collide
+    /// away or are lost does not end the wait.
+    pub(super) fn wake(&mut self, index: usize, deadline: Timestep) -> Wake {
+        if self.unread_msg[index].is_some() {
+            return Wake::Deliver(None);
+        }
+        match self.take_deliverable(index) {
+            Some(buf) => Wake::Deliver(Some(buf)),
+            None if deadline <= self.timestep => Wake::TimedOut,
+            None => Wake::Wait,
+        }
     }
 
-    /// Deliver any pending message to the FUSE caller via `req.reply`.
-    /// Returns `Ok(true)` if a real message was sent, `Ok(false)` if the
-    /// channel was empty (and an empty reply was already sent).
-    pub fn deliver_msg(
+    /// Serve a read of handle `index` through `kind`. With a receive timeout
+    /// configured, a read that finds nothing to deliver is parked in the
+    /// router instead of being answered with zero bytes straight away.
+    pub(super) fn read_or_park(
         &mut self,
         index: usize,
+        kind: ReadKind,
         req: fuse::ReadRequest,
-    ) -> Result<bool, RouterError> {
-        let (_, _, channel_handle) = self.channels.handles[index];
-        let channel = &mut self.channels.channels[channel_handle.0];
-        match &channel.r#type.kind {
-            ChannelKind::Shared => self.deliver_shared_msg(index, req),
-            ChannelKind::Exclusive { .. } => self.deliver_exclusive_msg(index, req),
+    ) -> Result<(), RouterError> {
+        let Some(timeout) = self.recv_timeouts[index] else {
+            return self.deliver(index, kind, req, None);
+        };
+        let deadline = self.timestep.saturating_add(timeout.get());
+        match self.wake(index, deadline) {
+            Wake::Deliver(taken) => self.deliver(index, kind, req, taken)?,
+            Wake::TimedOut => req.reply.data(&[]),
+            Wake::Wait => self.blocked_reads.push(BlockedRead {
+                handle_ptr: index,
+                deadline,
+                kind,
+                req,
+            }),
         }
+        Ok(())
     }
 
-    fn deliver_shared_msg(
+    /// Reply to a read of handle `index` through `kind`, starting with
+    /// `taken` if a message was already taken from the mailbox.
+    fn deliver(
         &mut self,
         index: usize,
+        kind: ReadKind,
         req: fuse::ReadRequest,
-    ) -> Result<bool, RouterError> {
+        taken: Option<Rc<[u8]>>,
+    ) -> Result<(), RouterError> {
+        match kind {
+            ReadKind::Channel => match taken {
+                Some(buf) => self.reply_msg(index, buf, req),
+                None if self.unread_msg[index].is_some() => self.reply_unread(index, req),
+                None => {
+                    self.deliver_msg(index, req)?;
+                }
+            },
+            ReadKind::Batch | ReadKind::Packet => {
+                // Both serve a partially read message first.
+                if let Some(buf) = taken {
+                    self.unread_msg[index] = Some((0, buf));
+                }
+                if kind == ReadKind::Batch {
+                    self.deliver_batch(index, req);
+                } else {
+                    self.deliver_packet(index, req);
+                }
+            }
+        }
+        Ok(())
+    }
+
+    /// Answer parked reads that can now be given a message and time out
+    /// (zero-byte reply) those whose deadline has been reached.
+    pub fn service_blocked_reads(&mut self) -> Result<(), RouterError> {
+        if self.blocked_reads.is_empty() {
+            return Ok(());
+        }
+        for read in std::mem::take(&mut self.blocked_reads) {
+            let (pid, issued) = (read.req.id.0, read.req.issued);
+            match self.wake(read.handle_ptr, read.deadline) {
+                Wake::Deliver(taken) => {
+                    self.deliver(read.handle_ptr, read.kind, read.req, taken)?;
+                    self.stats.record(pid, Op::RouterRead, issued);
+                }
+                Wake::TimedOut => {
+                    read.req.reply.data(&[]);
+                    self.stats.record(pid, Op::RouterRead, issued);
+                }
+                Wake::Wait => self.blocked_reads.push(read),
+            }
+        }
+        Ok(())
+    }
+
+    /// Answer a readiness query for a data channel file. `POLLIN` is set when
+    /// a read would return data right now, a partial read remainder included.
+    pub fn request_poll(&mut self, req: fuse::PollRequest) -> Result<(), RouterError> {
+        let path = req.id.1.as_str();
+        let lookup_name: &str = path
+            .strip_suffix("/channel")
+            .or_else(|| path.strip_suffix(BATCH_SUFFIX))
+            .or_else(|| path.strip_suffix(PACKET_SUFFIX))
+            .unwrap_or(path);
+        let Some(index) = self.get_handle_index(req.id.0, lookup_name) else {
+            let path = req.id.1.clone();
+            drop(req.reply);
+            return Err(RouterError::UnknownFile(path));
+        };
+        if self.poll_readable(index) {
+            req.reply.poll(req.ready | fuse::POLL_READABLE);
+        } else {
+            if req.notify {
+                self.pollers[index].push(Box::new(req.handle));
+            }
+            req.reply.poll(req.ready);
+        }
+        Ok(())
+    }
+
+    /// Whether a read of handle `index` would return data right now. Expired
+    /// messages are dropped first, so they do not report `POLLIN` for a read
+    /// that would then block.
+    pub(super) fn poll_readable(&mut self, index: usize) -> bool {
+        self.expire_messages(index);
+        self.unread_msg[index].is_some() || !self.mailboxes[index].is_empty()
+    }
+
+    /// Notify every `poll`/`epoll` waiter registered on `handle_ptr`. The
+    /// kernel re-polls the file afterwards, so handles are single-use.
+    pub(super) fn wake_pollers(&mut self, handle_ptr: usize) {
+        for poller in self.pollers[handle_ptr].drain(..) {
+            poller.notify();
+        }
+    }
+
+    fn take_shared_msg(&mut self, index: usize) -> Option<Rc<[u8]>> {
         let (pid, node_handle, channel_handle) = self.channels.handles[index];
         let channel = &self.channels.channels[channel_handle.0];
         let channel_name = &self.channels.channel_names[channel_handle.0];
         let node_name = &self.channels.node_names[node_handle.0];
         let timestep = self.timestep;
+        let shard = self.shard_of(channel_handle);
+        let shard = &mut self.shards[shard];
 
         let mailbox = &mut self.mailboxes[index];
         // remove all expired messages
@@ -183,14 +351,11 @@ impl RoutingServer {
         }
 
         match mailbox.len().cmp(&1) {
-            std::cmp::Ordering::Less => {
-                req.reply.data(&[]);
-                Ok(false)
-            }
+            std::cmp::Ordering::Less => None,
             std::cmp::Ordering::Equal => {
                 let msg = mailbox.pop_front().unwrap();
                 let link = Self::lookup_or_compute_link(
-                    &mut self.link_cache,
+                    &mut shard.link_cache,
                     &self.channels.nodes,
                     &self.channels.channels,
                     msg.src.0,
@@ -202,10 +367,9 @@ impl RoutingServer {
                     channel,
                     Cow::from(msg.buf.as_ref()),
                     &link,
-                    &mut self.rng,
+                    &mut shard.rng,
                 ) {
-                    self.signal_info[index].rssi_dbm = rssi_dbm;
-                    self.signal_info[index].snr_db = snr_db;
+                    self.signal_info[index].record(rssi_dbm, snr_db, &msg, timestep);
                     if tracing::enabled!(Level::INFO) {
                         info!(
                             "{:<30} [RX]: {} <Now: {}, Expiration: {:?}>",
@@ -220,23 +384,22 @@ impl RoutingServer {
                         target: "rx", Level::INFO, timestep, channel = channel_handle.0,
                         node = node_handle.0, tx = false, bit_errors, msg_id = mid, data = buf.as_ref()
                     );
-                    // Shared channels do not allow incremental reads; cap to
-                    // the syscall's requested size and reply directly.
-                    Self::reply_capped(req.reply, req.size, buf.as_ref());
-                    Ok(true)
+                    Some(match buf {
+                        Cow::Borrowed(_) => Rc::clone(&msg.buf),
+                        Cow::Owned(flipped) => flipped.into(),
+                    })
                 } else {
-                    req.reply.data(&[]);
-                    Ok(false)
+                    None
                 }
             }
             std::cmp::Ordering::Greater => {
                 warn!("Detected collision on shared medium.");
                 let max_size = channel.r#type.max_size;
 
-                let cache = &mut self.link_cache;
+                let cache = &mut shard.link_cache;
                 let nodes = &self.channels.nodes;
                 let channels = &self.channels.channels;
-                let rng = &mut self.rng;
+                let rng = &mut shard.rng;
                 let filtered = mailbox.iter().filter_map(|msg| {
                     let link = Self::lookup_or_compute_link(
                         cache,
@@ -273,8 +436,9 @@ impl RoutingServer {
                         v
                     },
                 );
-                self.signal_info[index].rssi_dbm = last_rssi;
-                self.signal_info[index].snr_db = last_snr;
+                if let Some(first) = mailbox.front() {
+                    self.signal_info[index].record(last_rssi, last_snr, first, timestep);
+                }
                 // Collisions always corrupt the signal.
                 let bit_errors = any_bit_errors || mailbox.len() > 1;
                 let mid = mailbox.front().map(|m| m.msg_id).unwrap_or(0);
@@ -282,23 +446,15 @@ impl RoutingServer {
                     target: "rx", Level::INFO, timestep, channel = channel_handle.0,
                     node = node_handle.0, tx = false, bit_errors, msg_id = mid, data = buf.as_slice()
                 );
-                Self::reply_capped(req.reply, req.size, buf.as_slice());
-                Ok(true)
+                Some(buf.into())
             }
         }
     }
 
-    fn deliver_exclusive_msg(
-        &mut self,
-        index: usize,
-        req: fuse::ReadRequest,
-    ) -> Result<bool, RouterError> {
+    fn take_exclusive_msg(&mut self, index: usize) -> Option<Rc<[u8]>> {
         let (pid, node_handle, channel_handle) = self.channels.handles[index];
         let mailbox = &mut self.mailboxes[index];
         if let Some(msg) = mailbox.pop_front() {
-            // Store signal quality from queue-time link simulation
-            self.signal_info[index].rssi_dbm = msg.rssi_dbm;
-            self.signal_info[index].snr_db = msg.snr_db;
             if msg.expiration.is_some_and(|e| e.get() < self.timestep) {
                 warn!(
                     "Message dropped due to timeout (Now: {}, Expiration: {})",
@@ -313,9 +469,11 @@ impl RoutingServer {
                     msg_id = msg.msg_id,
                     reason = "ttl_expired"
                 );
-                req.reply.data(&[]);
-                return Ok(false);
+                return None;
             }
+            // Store signal quality from queue-time link simulation, for
+            // messages that are actually received
+            self.signal_info[index].record(msg.rssi_dbm, msg.snr_db, &msg, self.timestep);
             let node_name = &self.channels.node_names[node_handle.0];
             let channel_name = &self.channels.channel_names[channel_handle.0];
             if tracing::enabled!(Level::INFO) {
@@ -329,27 +487,18 @@ impl RoutingServer {
             }
             let bit_errors = msg.bit_errors;
             let mid = msg.msg_id;
-            let buf = msg.buf.to_vec();
+            let buf = msg.buf;
             event!(
                 target: "rx", Level::INFO, timestep = self.timestep, channel = channel_handle.0,
-                node = node_handle.0, tx = false, bit_errors, msg_id = mid, data = buf.as_slice()
+                node = node_handle.0, tx = false, bit_errors, msg_id = mid, data = buf.as_ref()
             );
-
-            // Exclusive channels allow incremental reads: serve the first
-            // chunk now, stash any remainder for the next read on this handle.
-            let n = std::cmp::min(buf.len(), req.size as usize);
-            req.reply.data(&buf[..n]);
-            if n < buf.len() {
-                self.unread_msg[index] = Some((n, buf));
-            }
             // Suppress unused-variable warning: pid is bound earlier for
             // the tracing path in `info!`, but if Level::INFO is disabled
             // it would otherwise be flagged.
             let _ = pid;
-            Ok(true)
+            Some(buf)
         } else {
-            req.reply.data(&[]);
-            Ok(false)
+            None
         }
     }
 }
@@ -375,38 +524,35 @@ mod tests {
     }
 
     /// Within a single timestep, multiple writes from one publisher must
-    /// pop in insertion order. Without `Reverse` on the sequence number
-    /// the BinaryHeap (a max-heap on raw usize) would pop in reverse
-    /// insertion order, scrambling multi-write payloads — see the
-    /// MessageQueue type alias for context.
+    /// be delivered in insertion order, or multi-write payloads from one
+    /// publisher would be scrambled.
     #[test]
-    fn message_queue_pops_in_insertion_order_within_timestep() {
-        let mut q: MessageQueue = BinaryHeap::new();
-        let ts = Reverse(7u64);
-        for (seq, mid) in (0..4).zip([100, 101, 102, 103]) {
-            q.push((ts, Reverse(seq), synth(mid)));
+    fn deliveries_fire_in_insertion_order_within_timestep() {
+        let mut wheel = TimingWheel::new(1);
+        for mid in [100, 101, 102, 103] {
+            wheel.insert(7, synth(mid));
         }
 
         let mut got = Vec::new();
-        while let Some((_, _, frame)) = q.pop() {
-            got.push(frame.msg.msg_id);
+        while got.is_empty() {
+            got.extend(wheel.advance().into_iter().map(|(_, f)| f.msg.msg_id));
         }
         assert_eq!(got, vec![100, 101, 102, 103]);
     }
 
-    /// Earlier timesteps must still pop before later ones, regardless of
-    /// insertion order. Guards against accidentally Reversing the
-    /// timestep field too.
+    /// Earlier timesteps must still fire before later ones, regardless of
+    /// insertion order.
     #[test]
-    fn message_queue_orders_timesteps_ascending() {
-        let mut q: MessageQueue = BinaryHeap::new();
-        q.push((Reverse(10u64), Reverse(0usize), synth(200)));
-        q.push((Reverse(5u64), Reverse(1usize), synth(201)));
-        q.push((Reverse(7u64), Reverse(2usize), synth(202)));
+    fn deliveries_fire_in_timestep_order() {
+        let mut wheel = TimingWheel::new(1);
+        wheel.insert(10, synth(200));
+        wheel.insert(5, synth(201));
+        wheel.insert(7, synth(202));
 
         let mut got = Vec::new();
-        while let Some((Reverse(ts), _, frame)) = q.pop() {
-            got.push((ts, frame.msg.msg_id));
+        while !wheel.is_empty() {
+            let ts = wheel.now() + 1;
+            got.extend(wheel.advance().into_iter().map(|(_, f)| (ts, f.msg.msg_id)));
         }
         assert_eq!(got, vec![(5, 201), (7, 202), (10, 200)]);
     }
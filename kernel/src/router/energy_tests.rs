@@ -1,19 +1,24 @@
 #[cfg(test)]
 mod tests {
+    use std::rc::Rc;
     use std::sync::Arc;
 
     use crate::{
         resolver::ResolvedChannels,
-        router::{RoutingServer, SignalInfo, energy::EnergyManager, table::RoutingTable},
+        router::{
+            RoutingServer, SignalInfo, energy::EnergyManager, shard::Shard, table::RoutingTable,
+        },
         types::{self, ChannelIdx, EnergyState, NodeIdx, PowerFlowState},
+        wheel::TimingWheel,
     };
     use config::ast::{
         ChannelEnergy, ChannelType, Energy, EnergyUnit, Link, Position, TimeUnit, TimestepConfig,
     };
-    use rand::{SeedableRng, rngs::StdRng};
+    use rand::SeedableRng;
+    use rand_chacha::ChaCha12Rng;
     use std::{
-        collections::{BinaryHeap, HashMap, HashSet, VecDeque},
-        num::NonZeroU64,
+        collections::{HashMap, HashSet, VecDeque},
+        num::{NonZeroU64, NonZeroUsize},
         path::PathBuf,
         sync::mpsc,
         time::SystemTime,
@@ -96,24 +101,29 @@ mod tests {
             ts_config: test_ts_config(),
             channels: resolved,
             routes,
-            queued: BinaryHeap::new(),
+            deadlines: TimingWheel::new(1),
             fuse_mapping,
             mailboxes: vec![VecDeque::new(); mailbox_count],
-            nonempty_mailboxes: Vec::new(),
-            mailbox_active: vec![false; mailbox_count],
             unread_msg: vec![None; mailbox_count],
-            rng: StdRng::seed_from_u64(42),
+            shards: Shard::split(ChaCha12Rng::seed_from_u64(42), NonZeroUsize::MIN),
             energy_mgr,
             remap_tx: std::sync::mpsc::channel().0,
             timestep_ns: {
                 let tc = test_ts_config();
                 tc.length.get() * tc.unit.to_ns_factor()
             },
-            sequence: 0,
             next_msg_id: 0,
             signal_info: vec![SignalInfo::default(); mailbox_count],
-            sleep_alarms: std::collections::BinaryHeap::new(),
-            link_cache: HashMap::new(),
+            recv_timeouts: vec![None; mailbox_count],
+            blocked_reads: Vec::new(),
+            pollers: (0..mailbox_count).map(|_| Vec::new()).collect(),
+            shm_channels: (0..mailbox_count).map(|_| None).collect(),
+            shm_handles: Vec::new(),
+            clock_page: None,
+            stats: fuse::stats::LocalStats::new(Arc::default()),
+            checkpoint: Default::default(),
+            exchange: None,
+            fuzz: None,
         }
     }
 
@@ -513,24 +523,29 @@ mod tests {
             ts_config: test_ts_config(),
             channels: resolved,
             routes,
-            queued: BinaryHeap::new(),
+            deadlines: TimingWheel::new(1),
             fuse_mapping,
             mailboxes: vec![VecDeque::new(); handles.len()],
-            nonempty_mailboxes: Vec::new(),
-            mailbox_active: vec![false; handles.len()],
             unread_msg: vec![None; handles.len()],
-            rng: StdRng::seed_from_u64(42),
+            shards: Shard::split(ChaCha12Rng::seed_from_u64(42), NonZeroUsize::MIN),
             energy_mgr,
             remap_tx: std::sync::mpsc::channel().0,
             timestep_ns: {
                 let tc = test_ts_config();
                 tc.length.get() * tc.unit.to_ns_factor()
             },
-            sequence: 0,
             next_msg_id: 0,
             signal_info: vec![SignalInfo::default(); handles.len()],
-            sleep_alarms: std::collections::BinaryHeap::new(),
-            link_cache: HashMap::new(),
+            recv_timeouts: vec![None; handles.len()],
+            blocked_reads: Vec::new(),
+            pollers: (0..handles.len()).map(|_| Vec::new()).collect(),
+            shm_channels: (0..handles.len()).map(|_| None).collect(),
+            shm_handles: Vec::new(),
+            clock_page: None,
+            stats: fuse::stats::LocalStats::new(Arc::default()),
+            checkpoint: Default::default(),
+            exchange: None,
+            fuzz: None,
         };
 
         // Write "active" to ctl.energy_state
@@ -587,24 +602,29 @@ mod tests {
             ts_config: test_ts_config(),
             channels: resolved,
             routes,
-            queued: BinaryHeap::new(),
+            deadlines: TimingWheel::new(1),
             fuse_mapping,
             mailboxes: vec![VecDeque::new(); handles.len()],
-            nonempty_mailboxes: Vec::new(),
-            mailbox_active: vec![false; handles.len()],
             unread_msg: vec![None; handles.len()],
-            rng: StdRng::seed_from_u64(42),
+            shards: Shard::split(ChaCha12Rng::seed_from_u64(42), NonZeroUsize::MIN),
             energy_mgr,
             remap_tx: std::sync::mpsc::channel().0,
             timestep_ns: {
                 let tc = test_ts_config();
                 tc.length.get() * tc.unit.to_ns_factor()
             },
-            sequence: 0,
             next_msg_id: 0,
             signal_info: vec![SignalInfo::default(); handles.len()],
-            sleep_alarms: std::collections::BinaryHeap::new(),
-            link_cache: HashMap::new(),
+            recv_timeouts: vec![None; handles.len()],
+            blocked_reads: Vec::new(),
+            pollers: (0..handles.len()).map(|_| Vec::new()).collect(),
+            shm_channels: (0..handles.len()).map(|_| None).collect(),
+            shm_handles: Vec::new(),
+            clock_page: None,
+            stats: fuse::stats::LocalStats::new(Arc::default()),
+            checkpoint: Default::default(),
+            exchange: None,
+            fuzz: None,
         };
 
         // Write unknown state
@@ -1065,6 +1085,190 @@ mod tests {
         assert_eq!(router.mailboxes[1].len(), 1);
     }
 
+    // -----------------------------------------------------------------------
+    // Test: intact exclusive deliveries share one payload buffer
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_exclusive_delivery_shares_payload() {
+        let ch_handle: ChannelIdx = ChannelIdx(0);
+        let pub_node = make_node_with_protocol(
+            None,
+            HashSet::new(),
+            HashSet::from([ch_handle]),
+            HashMap::new(),
+        );
+        let sub = || {
+            make_node_with_protocol(
+                None,
+                HashSet::from([ch_handle]),
+                HashSet::new(),
+                HashMap::new(),
+            )
+        };
+        let channel = types::Channel {
+            link: Link::default(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(1), NodeIdx(2)]),
+            publishers: HashSet::from([NodeIdx(0)]),
+        };
+        let handles = vec![
+            (1u32, NodeIdx(0), ChannelIdx(0)),
+            (2u32, NodeIdx(1), ChannelIdx(0)),
+            (3u32, NodeIdx(2), ChannelIdx(0)),
+        ];
+        let mut router = make_router(vec![pub_node, sub(), sub()], vec![channel], handles);
+        router
+            .queue_message(NodeIdx(0), ChannelIdx(0), vec![0xCD; 8], 0)
+            .unwrap();
+        router.step().unwrap();
+
+        let first = router.take_msg(1).unwrap();
+        let second = router.take_msg(2).unwrap();
+        assert_eq!(&first[..], [0xCD; 8]);
+        assert!(Rc::ptr_eq(&first, &second));
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: sharded routers route writes at the end of the timestep
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_sharded_writes_route_at_step() {
+        let (ch0, ch1) = (ChannelIdx(0), ChannelIdx(1));
+        let pub_node = make_node_with_protocol(
+            None,
+            HashSet::new(),
+            HashSet::from([ch0, ch1]),
+            HashMap::new(),
+        );
+        let sub_node = make_node_with_protocol(
+            None,
+            HashSet::from([ch0, ch1]),
+            HashSet::new(),
+            HashMap::new(),
+        );
+        let channel = || types::Channel {
+            link: Link::default(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(1)]),
+            publishers: HashSet::from([NodeIdx(0)]),
+        };
+        let handles = vec![
+            (1u32, NodeIdx(0), ch0),
+            (1u32, NodeIdx(0), ch1),
+            (2u32, NodeIdx(1), ch0),
+            (2u32, NodeIdx(1), ch1),
+        ];
+        let mut router = make_router(
+            vec![pub_node, sub_node],
+            vec![channel(), channel()],
+            handles,
+        );
+        router.shards = Shard::split(
+            ChaCha12Rng::seed_from_u64(42),
+            NonZeroUsize::new(2).unwrap(),
+        );
+        assert_eq!(router.shard_of(ch0), 0);
+        assert_eq!(router.shard_of(ch1), 1);
+
+        router
+            .queue_message(NodeIdx(0), ch0, vec![0xA0], 0)
+            .unwrap();
+        router
+            .queue_message(NodeIdx(0), ch1, vec![0xA1], 1)
+            .unwrap();
+        assert!(router.deadlines.is_empty());
+        router.step().unwrap();
+
+        assert_eq!(&router.take_msg(2).unwrap()[..], [0xA0]);
+        assert_eq!(&router.take_msg(3).unwrap()[..], [0xA1]);
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: shard threads deliver exactly what inline routing does
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_threaded_shards_match_inline_routing() {
+        use config::ast::RssiProbExpr;
+
+        let prob = |p: &str| RssiProbExpr {
+            expr: p.into(),
+            parsed_expr: Some(p.parse().unwrap()),
+            noise_floor_dbm: f64::MIN,
+        };
+        let channels = [ChannelIdx(0), ChannelIdx(1), ChannelIdx(2)];
+        let subscribers = 16;
+        let build = || {
+            let publisher = make_node_with_protocol(
+                None,
+                HashSet::new(),
+                HashSet::from(channels),
+                HashMap::new(),
+            );
+            let nodes = std::iter::once(publisher)
+                .chain((0..subscribers).map(|_| {
+                    make_node_with_protocol(
+                        None,
+                        HashSet::from(channels),
+                        HashSet::new(),
+                        HashMap::new(),
+                    )
+                }))
+                .collect();
+            let channel = || types::Channel {
+                link: Link {
+                    packet_loss: prob("0.3"),
+                    bit_error: prob("0.02"),
+                    ..Link::default()
+                },
+                r#type: ChannelType::new_internal(),
+                subscribers: (1..=subscribers).map(NodeIdx).collect(),
+                publishers: HashSet::from([NodeIdx(0)]),
+            };
+            let handles = (0..=subscribers)
+                .flat_map(|node| channels.map(|ch| (node as u32 + 1, NodeIdx(node), ch)))
+                .collect();
+            let mut router =
+                make_router(nodes, channels.iter().map(|_| channel()).collect(), handles);
+            router.shards =
+                Shard::split(ChaCha12Rng::seed_from_u64(7), NonZeroUsize::new(2).unwrap());
+            router
+        };
+        let run = |min_routes: usize| {
+            let mut router = build();
+            for (i, &ch) in channels.iter().cycle().take(12).enumerate() {
+                router
+                    .queue_message(NodeIdx(0), ch, vec![i as u8; 16], i as u64)
+                    .unwrap();
+            }
+            router.route_pending_over(min_routes);
+            router.step().unwrap();
+            router
+                .mailboxes
+                .iter()
+                .map(|mailbox| {
+                    mailbox
+                        .iter()
+                        .map(|msg| (msg.msg_id, msg.buf.to_vec(), msg.bit_errors))
+                        .collect::<Vec<_>>()
+                })
+                .collect::<Vec<_>>()
+        };
+
+        // Every shard on a thread, then none.
+        let threaded = run(0);
+        let inline = run(usize::MAX);
+        assert_eq!(threaded, inline);
+        // The link model did drop and corrupt some, so the draws mattered.
+        let delivered: usize = inline.iter().map(Vec::len).sum();
+        assert!(0 < delivered && delivered < 12 * subscribers);
+        assert!(
+            inline
+                .iter()
+                .flatten()
+                .any(|(_, _, bit_errors)| *bit_errors)
+        );
+    }
+
     // -----------------------------------------------------------------------
     // Test: piecewise linear evaluation — interpolation
     // -----------------------------------------------------------------------
@@ -1188,24 +1392,29 @@ mod tests {
             ts_config: test_ts_config(),
             channels: resolved,
             routes,
-            queued: BinaryHeap::new(),
+            deadlines: TimingWheel::new(1),
             fuse_mapping,
             mailboxes: vec![VecDeque::new(); handles.len()],
-            nonempty_mailboxes: Vec::new(),
-            mailbox_active: vec![false; handles.len()],
             unread_msg: vec![None; handles.len()],
-            rng: StdRng::seed_from_u64(42),
+            shards: Shard::split(ChaCha12Rng::seed_from_u64(42), NonZeroUsize::MIN),
             energy_mgr,
             remap_tx: std::sync::mpsc::channel().0,
             timestep_ns: {
                 let tc = test_ts_config();
                 tc.length.get() * tc.unit.to_ns_factor()
             },
-            sequence: 0,
             next_msg_id: 0,
             signal_info: vec![SignalInfo::default(); handles.len()],
-            sleep_alarms: std::collections::BinaryHeap::new(),
-            link_cache: HashMap::new(),
+            recv_timeouts: vec![None; handles.len()],
+            blocked_reads: Vec::new(),
+            pollers: (0..handles.len()).map(|_| Vec::new()).collect(),
+            shm_channels: (0..handles.len()).map(|_| None).collect(),
+            shm_handles: Vec::new(),
+            clock_page: None,
+            stats: fuse::stats::LocalStats::new(Arc::default()),
+            checkpoint: Default::default(),
+            exchange: None,
+            fuzz: None,
         };
 
         // Write a source and a sink via control file (nj/ts passthrough)
@@ -1286,24 +1495,29 @@ mod tests {
             ts_config: test_ts_config(),
             channels: resolved,
             routes,
-            queued: BinaryHeap::new(),
+            deadlines: TimingWheel::new(1),
             fuse_mapping,
             mailboxes: vec![VecDeque::new(); handles.len()],
-            nonempty_mailboxes: Vec::new(),
-            mailbox_active: vec![false; handles.len()],
             unread_msg: vec![None; handles.len()],
-            rng: StdRng::seed_from_u64(42),
+            shards: Shard::split(ChaCha12Rng::seed_from_u64(42), NonZeroUsize::MIN),
             energy_mgr,
             remap_tx: std::sync::mpsc::channel().0,
             timestep_ns: {
                 let tc = test_ts_config();
                 tc.length.get() * tc.unit.to_ns_factor()
             },
-            sequence: 0,
             next_msg_id: 0,
             signal_info: vec![SignalInfo::default(); handles.len()],
-            sleep_alarms: std::collections::BinaryHeap::new(),
-            link_cache: HashMap::new(),
+            recv_timeouts: vec![None; handles.len()],
+            blocked_reads: Vec::new(),
+            pollers: (0..handles.len()).map(|_| Vec::new()).collect(),
+            shm_channels: (0..handles.len()).map(|_| None).collect(),
+            shm_handles: Vec::new(),
+            clock_page: None,
+            stats: fuse::stats::LocalStats::new(Arc::default()),
+            checkpoint: Default::default(),
+            exchange: None,
+            fuzz: None,
         };
 
         // Write "source solar 100 mw/s" — 100 mW per second with 1ms timestep
@@ -1317,4 +1531,734 @@ mod tests {
         let e = router.channels.nodes[0].energy.as_ref().unwrap();
         assert_eq!(e.power_sources[0].1.nj_per_timestep(0), 100_000);
     }
+
+    // -----------------------------------------------------------------------
+    // Test: a checkpoint carries mailboxes, in-flight messages, batteries and
+    // the random stream over to a run whose handles are in another order
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_checkpoint_restores_router_state() {
+        use crate::router::checkpoint::{CheckpointState, Checkpointing, Restore};
+        use rand::Rng;
+
+        let ch = ChannelIdx(0);
+        let nodes = || {
+            vec![
+                make_node_with_protocol(
+                    Some(basic_energy(1_000, 2_000)),
+                    HashSet::new(),
+                    HashSet::from([ch]),
+                    HashMap::new(),
+                ),
+                make_node_with_protocol(None, HashSet::from([ch]), HashSet::new(), HashMap::new()),
+            ]
+        };
+        let channel = || types::Channel {
+            link: Link::default(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(1)]),
+            publishers: HashSet::from([NodeIdx(0)]),
+        };
+        let protocols = |names: [(u32, usize, &str); 2]| {
+            HashMap::from(names.map(|(pid, node, name)| (pid, (NodeIdx(node), Arc::from(name)))))
+        };
+        let with_protocols = |router: &mut RoutingServer, names| {
+            let protocols = protocols(names);
+            let plan = Checkpointing {
+                protocols,
+                ..Default::default()
+            };
+            router.checkpoint = CheckpointState::new(plan).0;
+        };
+
+        let mut before = make_router(
+            nodes(),
+            vec![channel()],
+            vec![(1, NodeIdx(0), ch), (2, NodeIdx(1), ch)],
+        );
+        with_protocols(&mut before, [(1, 0, "tx"), (2, 1, "rx")]);
+        before.queue_message(NodeIdx(0), ch, vec![1], 0).unwrap();
+        for _ in 0..3 {
+            before.step().unwrap();
+        }
+        before.queue_message(NodeIdx(0), ch, vec![2], 1).unwrap();
+        before.channels.nodes[0].energy.as_mut().unwrap().charge_nj = 777;
+        let _: u64 = before.shards[0].rng.random();
+        let checkpoint = before.capture(4);
+
+        // A later run started its processes in another order.
+        let mut after = make_router(
+            nodes(),
+            vec![channel()],
+            vec![(4, NodeIdx(1), ch), (3, NodeIdx(0), ch)],
+        );
+        let after_protocols = [(3, 0, "tx"), (4, 1, "rx")];
+        with_protocols(&mut after, after_protocols);
+        let restore = Restore::resolve(
+            checkpoint,
+            &mut after.channels,
+            &protocols(after_protocols),
+            NonZeroUsize::MIN,
+            after.timestep_ns,
+        )
+        .unwrap();
+        assert_eq!(restore.next_timestep, 4);
+        after.restore(restore);
+
+        assert_eq!(after.timestep, before.timestep);
+        assert_eq!(after.next_msg_id, before.next_msg_id);
+        assert_eq!(
+            after.channels.nodes[0].energy.as_ref().unwrap().charge_nj,
+            777
+        );
+        before.step().unwrap();
+        after.step().unwrap();
+        for _ in 0..2 {
+            let expected = before.take_msg(1).map(|m| m.to_vec());
+            assert!(expected.is_some());
+            assert_eq!(after.take_msg(0).map(|m| m.to_vec()), expected);
+        }
+        let draw = |router: &mut RoutingServer| router.shards[0].rng.random::<u64>();
+        assert_eq!(draw(&mut after), draw(&mut before));
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: a checkpoint of another simulation is refused
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_checkpoint_of_other_simulation_rejected() {
+        use crate::errors::CheckpointError;
+        use crate::router::checkpoint::Restore;
+
+        let before = make_router(vec![make_node(None)], vec![], vec![]);
+        let checkpoint = before.capture(1);
+        let mut after = make_router(vec![make_node(None), make_node(None)], vec![], vec![]);
+        let res = Restore::resolve(
+            checkpoint,
+            &mut after.channels,
+            &HashMap::new(),
+            NonZeroUsize::MIN,
+            after.timestep_ns,
+        );
+        assert!(matches!(res, Err(CheckpointError::Mismatch(_))));
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: a protocol without channel files is waited on and matched up on
+    // resume like any other
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_checkpoint_covers_protocol_without_channels() {
+        use crate::checkpoint::ProcessSnapshot;
+        use crate::errors::CheckpointError;
+        use crate::router::checkpoint::{CheckpointState, Checkpointing, Restore};
+
+        let ch = ChannelIdx(0);
+        let channel = types::Channel {
+            link: Link::default(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(0)]),
+            publishers: HashSet::from([NodeIdx(0)]),
+        };
+        let nodes = vec![
+            make_node_with_protocol(
+                None,
+                HashSet::from([ch]),
+                HashSet::from([ch]),
+                HashMap::new(),
+            ),
+            make_node_with_protocol(None, HashSet::new(), HashSet::new(), HashMap::new()),
+        ];
+        // Only PID 1 has a channel file.
+        let mut router = make_router(nodes, vec![channel], vec![(1, NodeIdx(0), ch)]);
+        let protocols = HashMap::from([
+            (1, (NodeIdx(0), Arc::from("chatty"))),
+            (2, (NodeIdx(1), Arc::from("quiet"))),
+        ]);
+        let plan = Checkpointing {
+            at: Some(1),
+            protocols: protocols.clone(),
+            ..Default::default()
+        };
+        router.checkpoint = CheckpointState::new(plan).0;
+        let mut waiting: Vec<_> = router.checkpoint.waiting_on(&router.channels).collect();
+        waiting.sort_unstable();
+        assert_eq!(waiting, vec![1, 2]);
+
+        let mut checkpoint = router.capture(2);
+        checkpoint.processes.push(ProcessSnapshot {
+            node: "node_1".to_string(),
+            protocol: "quiet".to_string(),
+            state: vec![1, 2, 3],
+        });
+        let resolve = |checkpoint, router: &mut RoutingServer| {
+            let timestep_ns = router.timestep_ns;
+            Restore::resolve(
+                checkpoint,
+                &mut router.channels,
+                &protocols,
+                NonZeroUsize::MIN,
+                timestep_ns,
+            )
+        };
+        assert!(resolve(checkpoint.clone(), &mut router).is_ok());
+        checkpoint.processes[0].protocol = "gone".to_string();
+        assert!(matches!(
+            resolve(checkpoint, &mut router),
+            Err(CheckpointError::Mismatch(_))
+        ));
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: writes cross partitions at the end of each window
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_partitioned_writes_swap_at_window() {
+        use crate::partition::{Hello, Partition, Peers, RemoteWrite};
+        use crate::router::Exchange;
+        use crate::test_utils::helpers::free_addrs;
+        use config::ast::{DataRate, DataUnit};
+
+        // Node 0 runs here and listens on channel 0; node 1 runs on
+        // partition 1 and listens on channel 1.
+        let (ch0, ch1) = (ChannelIdx(0), ChannelIdx(1));
+        let here = make_node_with_protocol(
+            None,
+            HashSet::from([ch0]),
+            HashSet::from([ch1]),
+            HashMap::new(),
+        );
+        let there = make_node_with_protocol(
+            None,
+            HashSet::from([ch1]),
+            HashSet::from([ch0]),
+            HashMap::new(),
+        );
+        // One byte takes one timestep, so windows are one timestep long;
+        // use two to see a write wait for the end of one.
+        let mut link = Link::default();
+        link.delays.ts_config = test_ts_config();
+        link.delays.processing = DataRate {
+            rate: 1,
+            data: DataUnit::Byte,
+            time: TimeUnit::Milliseconds,
+        };
+        let channel = |src: usize, dst: usize| types::Channel {
+            link: link.clone(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(dst)]),
+            publishers: HashSet::from([NodeIdx(src)]),
+        };
+        let handles = vec![(1u32, NodeIdx(0), ch0), (1u32, NodeIdx(0), ch1)];
+        let mut router = make_router(
+            vec![here, there],
+            vec![channel(1, 0), channel(0, 1)],
+            handles,
+        );
+
+        let addrs = free_addrs(2);
+        let hello = |partition| Hello {
+            partition,
+            partitions: 2,
+            seed: 42,
+            node_names: vec!["node_0".into(), "node_1".into()],
+            channel_names: vec!["ch_0".into(), "ch_1".into()],
+            timestep_ns: router.timestep_ns,
+            lookahead: 2,
+        };
+        let sent = RemoteWrite {
+            timestep: 1,
+            src: 1,
+            channel: 0,
+            msg_id: 1,
+            point: [3.0, 4.0, 0.0],
+            orientation: [90.0, 0.0, 0.0],
+            data: vec![0xB1],
+        };
+        let peer = {
+            let partition = Partition::new(1, addrs.clone()).unwrap();
+            let (hello, sent) = (hello(1), sent.clone());
+            std::thread::spawn(move || {
+                let mut peers = Peers::connect(&partition, hello).unwrap();
+                let mut outboxes = vec![vec![sent], vec![]];
+                peers.swap(2, &mut outboxes).unwrap()
+            })
+        };
+        let peers = Peers::connect(&Partition::new(0, addrs).unwrap(), hello(0)).unwrap();
+        router.exchange = Some(Exchange::new(
+            peers,
+            vec![vec![], vec![1]],
+            NonZeroU64::new(2),
+        ));
+
+        assert_eq!(router.alloc_msg_id(), 0);
+        assert_eq!(router.alloc_msg_id(), 2);
+        router.forward_write(NodeIdx(0), ch1, &[0xA0], 4);
+        router.step().unwrap();
+
+        let received = peer.join().unwrap();
+        assert_eq!(received.len(), 1);
+        assert_eq!((received[0].src, received[0].msg_id), (0, 4));
+        assert_eq!(received[0].data, [0xA0]);
+        let msg = router.take_msg(0).unwrap();
+        assert_eq!(&msg[..], [0xB1]);
+        assert_eq!(router.signal_info[0].src_node, 1);
+        let position = &router.channels.nodes[1].position;
+        assert_eq!((position.point.x, position.orientation.az), (3.0, 90.0));
+        assert!(router.channels.nodes[1].is_dynamic);
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: a fuzz iteration resets the process and queues its frames
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_fuzz_iteration_replaces_mailboxes() {
+        use crate::router::{Fuzzing, QueuedMessage};
+        use config::ast::ChannelKind;
+
+        // Fuzzed frames arrive as written even on a shared medium, where
+        // several waiting messages would otherwise collide.
+        let (fuzzed, other) = (ChannelIdx(0), ChannelIdx(1));
+        let node = make_node_with_protocol(
+            None,
+            HashSet::from([fuzzed, other]),
+            HashSet::new(),
+            HashMap::new(),
+        );
+        let channel = |kind| {
+            let mut r#type = ChannelType::new_internal();
+            r#type.kind = kind;
+            r#type.max_size = NonZeroUsize::new(4).unwrap();
+            types::Channel {
+                link: Link::default(),
+                r#type,
+                subscribers: HashSet::from([NodeIdx(0)]),
+                publishers: HashSet::new(),
+            }
+        };
+        let handles = vec![(1u32, NodeIdx(0), fuzzed), (1u32, NodeIdx(0), other)];
+        let mut router = make_router(
+            vec![node],
+            vec![
+                channel(ChannelKind::Shared),
+                channel(ChannelKind::Exclusive { nbuffered: None }),
+            ],
+            handles,
+        );
+        router.fuzz = Some(Fuzzing::new(fuzzed, None));
+        let stale = QueuedMessage {
+            src: NodeIdx(0),
+            buf: Rc::from(&[0xEE][..]),
+            expiration: None,
+            bit_errors: false,
+            msg_id: 99,
+            rssi_dbm: 0.0,
+            snr_db: 0.0,
+        };
+        router.mailboxes[0].push_back(stale.clone());
+        router.mailboxes[1].push_back(stale);
+
+        let iteration = |data: &[u8]| fuse::Message {
+            id: (1, "ctl.fuzz".to_string()),
+            data: data.to_vec(),
+        };
+        // The second frame is cut to the channel's max size; the third
+        // frame's length runs past the end and takes what is left.
+        let input = [1, 0, 0xA1, 6, 0, 1, 2, 3, 4, 5, 6, 9, 0, 0xC1];
+        router.write_fuzz(iteration(&input)).unwrap();
+        assert!(router.mailboxes[1].is_empty());
+        assert_eq!(router.mailboxes[0].len(), 3);
+        assert_eq!(&router.take_msg(0).unwrap()[..], [0xA1]);
+        assert_eq!(&router.take_msg(0).unwrap()[..], [1, 2, 3, 4]);
+
+        // The next iteration drops what the last left unread.
+        router.write_fuzz(iteration(&[0, 0])).unwrap();
+        assert_eq!(router.mailboxes[0].len(), 1);
+        assert!(router.take_msg(0).unwrap().is_empty());
+        assert!(router.take_msg(0).is_none());
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: a parked read keeps waiting past undeliverable messages
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_parked_read_waits_past_expired_messages() {
+        use crate::router::{QueuedMessage, Wake};
+
+        let node = make_node_with_protocol(
+            None,
+            HashSet::from([ChannelIdx(0)]),
+            HashSet::new(),
+            HashMap::new(),
+        );
+        let channel = types::Channel {
+            link: Link::default(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(0)]),
+            publishers: HashSet::new(),
+        };
+        let mut router = make_router(
+            vec![node],
+            vec![channel],
+            vec![(1, NodeIdx(0), ChannelIdx(0))],
+        );
+        router.timestep = 10;
+        let msg = |data: u8, expiration| QueuedMessage {
+            src: NodeIdx(0),
+            buf: Rc::from(&[data][..]),
+            expiration: NonZeroU64::new(expiration),
+            bit_errors: false,
+            msg_id: 0,
+            rssi_dbm: 0.0,
+            snr_db: 0.0,
+        };
+        router.mailboxes[0].push_back(msg(0xE1, 5));
+        router.mailboxes[0].push_back(msg(0xE2, 9));
+
+        // Only expired messages: keep waiting until the deadline.
+        assert!(matches!(router.wake(0, 20), Wake::Wait));
+        assert!(router.mailboxes[0].is_empty());
+
+        router.mailboxes[0].push_back(msg(0xE3, 9));
+        router.mailboxes[0].push_back(msg(0xA1, 0));
+        match router.wake(0, 20) {
+            Wake::Deliver(Some(buf)) => assert_eq!(&buf[..], [0xA1]),
+            other => panic!("expected a delivery, got {other:?}"),
+        }
+
+        router.mailboxes[0].push_back(msg(0xE4, 9));
+        assert!(matches!(router.wake(0, 10), Wake::TimedOut));
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: an expired message leaves the last signal reading alone
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_expired_message_keeps_signal_info() {
+        use crate::router::QueuedMessage;
+
+        let node = make_node_with_protocol(
+            None,
+            HashSet::from([ChannelIdx(0)]),
+            HashSet::new(),
+            HashMap::new(),
+        );
+        let channel = types::Channel {
+            link: Link::default(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(0)]),
+            publishers: HashSet::new(),
+        };
+        let mut router = make_router(
+            vec![node],
+            vec![channel],
+            vec![(1, NodeIdx(0), ChannelIdx(0))],
+        );
+        router.timestep = 10;
+        let msg = |rssi_dbm, expiration| QueuedMessage {
+            src: NodeIdx(0),
+            buf: Rc::from(&[0xA1][..]),
+            expiration: NonZeroU64::new(expiration),
+            bit_errors: false,
+            msg_id: 0,
+            rssi_dbm,
+            snr_db: 0.0,
+        };
+        router.mailboxes[0].push_back(msg(-40.0, 0));
+        router.mailboxes[0].push_back(msg(-90.0, 5));
+        assert!(router.take_msg(0).is_some());
+        assert!(router.take_msg(0).is_none());
+        assert_eq!(router.signal_info[0].rssi_dbm, -40.0);
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: poll waiters are notified by deliveries, and only by them
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_pollers_wake_on_delivery() {
+        use crate::router::{AddressedMsg, Deadline, Poller, QueuedMessage};
+        use std::cell::Cell;
+
+        #[derive(Debug)]
+        struct Counter(Rc<Cell<u32>>);
+        impl Poller for Counter {
+            fn notify(self: Box<Self>) {
+                self.0.set(self.0.get() + 1);
+            }
+        }
+
+        let node = make_node_with_protocol(
+            None,
+            HashSet::from([ChannelIdx(0)]),
+            HashSet::new(),
+            HashMap::new(),
+        );
+        let channel = types::Channel {
+            link: Link::default(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(0)]),
+            publishers: HashSet::new(),
+        };
+        let mut router = make_router(
+            vec![node],
+            vec![channel],
+            vec![(1, NodeIdx(0), ChannelIdx(0))],
+        );
+        let msg = |data: u8, expiration| QueuedMessage {
+            src: NodeIdx(0),
+            buf: Rc::from(&[data][..]),
+            expiration: NonZeroU64::new(expiration),
+            bit_errors: false,
+            msg_id: 0,
+            rssi_dbm: 0.0,
+            snr_db: 0.0,
+        };
+        let woken = Rc::new(Cell::new(0));
+        let register = |router: &mut RoutingServer| {
+            router.pollers[0].push(Box::new(Counter(Rc::clone(&woken))));
+        };
+
+        // Nothing pending: the waiter stays registered through idle steps.
+        register(&mut router);
+        router.step().unwrap();
+        router.step().unwrap();
+        assert!(!router.poll_readable(0));
+        assert_eq!(woken.get(), 0);
+        assert_eq!(router.pollers[0].len(), 1);
+
+        // A message due in two timesteps wakes it when the simulation gets
+        // there, not before.
+        let due = router.timestep + 2;
+        router.deadlines.insert(
+            due,
+            Deadline::Deliver(AddressedMsg {
+                handle_ptr: 0,
+                msg: msg(0xA1, 0),
+            }),
+        );
+        router.step().unwrap();
+        assert_eq!(woken.get(), 0);
+        router.step().unwrap();
+        assert_eq!(router.timestep, due);
+        assert_eq!(woken.get(), 1);
+        assert!(router.pollers[0].is_empty());
+        assert!(router.poll_readable(0));
+
+        // Handles are single-use: a second delivery with no one registered
+        // notifies nobody.
+        router.deliver_queued_message(AddressedMsg {
+            handle_ptr: 0,
+            msg: msg(0xA2, 0),
+        });
+        assert_eq!(woken.get(), 1);
+
+        // Once everything queued has expired the file is no longer readable,
+        // and a new waiter is only woken by the next delivery.
+        router.mailboxes[0].clear();
+        router.mailboxes[0].push_back(msg(0xE1, router.timestep - 1));
+        assert!(!router.poll_readable(0));
+        register(&mut router);
+        router.deliver_queued_message(AddressedMsg {
+            handle_ptr: 0,
+            msg: msg(0xA3, 0),
+        });
+        assert_eq!(woken.get(), 2);
+        assert!(router.poll_readable(0));
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: the clock page is republished before anything is woken
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_clock_page_is_current_when_waiters_wake() {
+        use crate::router::{AddressedMsg, Deadline, Poller, QueuedMessage, clock::ClockPage};
+        use std::cell::Cell;
+
+        /// Reads the page's timestep field through the file, as a woken
+        /// protocol would through its own mapping.
+        #[derive(Debug)]
+        struct ReadsClock(PathBuf, Rc<Cell<u64>>);
+        impl Poller for ReadsClock {
+            fn notify(self: Box<Self>) {
+                let page = std::fs::read(&self.0).unwrap();
+                let timestep = u64::from_le_bytes(page[72..80].try_into().unwrap());
+                self.1.set(timestep);
+            }
+        }
+
+        let node = make_node_with_protocol(
+            None,
+            HashSet::from([ChannelIdx(0)]),
+            HashSet::new(),
+            HashMap::new(),
+        );
+        let channel = types::Channel {
+            link: Link::default(),
+            r#type: ChannelType::new_internal(),
+            subscribers: HashSet::from([NodeIdx(0)]),
+            publishers: HashSet::new(),
+        };
+        let mut router = make_router(
+            vec![node],
+            vec![channel],
+            vec![(1, NodeIdx(0), ChannelIdx(0))],
+        );
+        let path = std::env::temp_dir().join(format!("nexus-clock-order-{}", std::process::id()));
+        let _ = std::fs::remove_file(&path);
+        router.clock_page = Some(ClockPage::create(path.clone(), 1_000_000).unwrap());
+        router.publish_clock();
+
+        let seen = Rc::new(Cell::new(u64::MAX));
+        router.pollers[0].push(Box::new(ReadsClock(path, Rc::clone(&seen))));
+        let due = router.timestep + 1;
+        router.deadlines.insert(
+            due,
+            Deadline::Deliver(AddressedMsg {
+                handle_ptr: 0,
+                msg: QueuedMessage {
+                    src: NodeIdx(0),
+                    buf: Rc::from(&[0xA1][..]),
+                    expiration: None,
+                    bit_errors: false,
+                    msg_id: 0,
+                    rssi_dbm: 0.0,
+                    snr_db: 0.0,
+                },
+            }),
+        );
+        router.step().unwrap();
+        assert_eq!(router.timestep, due);
+        assert_eq!(seen.get(), due, "woken waiter saw the previous timestep");
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: a bad batch is dropped whole and the router keeps going
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_bad_batch_is_dropped() {
+        use crate::router::batch::push_frame;
+
+        let node = make_node_with_protocol(
+            None,
+            HashSet::from([ChannelIdx(0)]),
+            HashSet::from([ChannelIdx(0)]),
+            HashMap::new(),
+        );
+        let channel = types::Channel {
+            link: Link::default(),
+            r#type: ChannelType {
+                max_size: NonZeroUsize::new(4).unwrap(),
+                read_own_writes: true,
+                ..ChannelType::new_internal()
+            },
+            subscribers: HashSet::from([NodeIdx(0)]),
+            publishers: HashSet::from([NodeIdx(0)]),
+        };
+        let mut router = make_router(
+            vec![node],
+            vec![channel],
+            vec![(1, NodeIdx(0), ChannelIdx(0))],
+        );
+        let write = |data: Vec<u8>| fuse::Message {
+            id: (1, "ch/batch".into()),
+            data,
+        };
+
+        let mut oversized = Vec::new();
+        push_frame(&mut oversized, b"ok");
+        push_frame(&mut oversized, b"too long");
+        let mut truncated = Vec::new();
+        push_frame(&mut truncated, b"ok");
+        truncated.extend_from_slice(&[9, 0, 0, 0, 1]);
+        for data in [oversized, truncated] {
+            router.write_batch(0, write(data)).unwrap();
+            router.step().unwrap();
+            assert!(router.mailboxes[0].is_empty());
+        }
+
+        let mut good = Vec::new();
+        push_frame(&mut good, b"ok");
+        router.write_batch(0, write(good)).unwrap();
+        router.step().unwrap();
+        assert_eq!(router.mailboxes[0].len(), 1);
+    }
+
+    // -----------------------------------------------------------------------
+    // Test: out-of-range endpoints are culled with or without the grid
+    // -----------------------------------------------------------------------
+    #[test]
+    fn test_range_cut_does_not_depend_on_spatial_index() {
+        use crate::router::spatial::SPATIAL_INDEX_MIN_HANDLES;
+        use config::ast::{ChannelKind, DistanceUnit, Medium, Point, SignalShape};
+
+        let medium = Medium::Wireless {
+            shape: SignalShape::Omnidirectional,
+            wavelength_meters: 0.125,
+            gain_dbi: 2.0,
+            rx_min_dbm: -100.0,
+            tx_min_dbm: -10.0,
+            tx_max_dbm: 14.0,
+        };
+        let range = medium.max_range_meters();
+        // A sender that reads its own writes, a node in range, one in the
+        // grid's neighbouring cell but out of range, and `padding` nodes far
+        // away.
+        let build = |padding: usize| {
+            let xs = [0.0, range / 2.0, range * 1.5]
+                .into_iter()
+                .chain((0..padding).map(|i| range * (10.0 + i as f64)));
+            let nodes: Vec<_> = xs
+                .map(|x| {
+                    let mut node = make_node_with_protocol(
+                        None,
+                        HashSet::from([ChannelIdx(0)]),
+                        HashSet::from([ChannelIdx(0)]),
+                        HashMap::new(),
+                    );
+                    node.position = Position {
+                        point: Point { x, y: 0.0, z: 0.0 },
+                        unit: DistanceUnit::Meters,
+                        ..Position::default()
+                    };
+                    node
+                })
+                .collect();
+            let mut r#type = ChannelType::new_internal();
+            r#type.kind = ChannelKind::Shared;
+            let channel = types::Channel {
+                link: Link {
+                    medium,
+                    ..Link::default()
+                },
+                r#type,
+                subscribers: (0..nodes.len()).map(NodeIdx).collect(),
+                publishers: (0..nodes.len()).map(NodeIdx).collect(),
+            };
+            let handles = (0..nodes.len())
+                .map(|i| (i as u32 + 1, NodeIdx(i), ChannelIdx(0)))
+                .collect();
+            make_router(nodes, vec![channel], handles)
+        };
+
+        for padding in [0, SPATIAL_INDEX_MIN_HANDLES] {
+            let mut router = build(padding);
+            let candidates = router.routes.entries[0]
+                .candidates(&router.channels, ChannelIdx(0), NodeIdx(0))
+                .iter()
+                .map(|route| route.handle_ptr)
+                .collect::<Vec<_>>();
+            assert_eq!(candidates, [0, 1], "with {padding} padding nodes");
+
+            let msg = fuse::Message {
+                id: (1, String::new()),
+                data: vec![0xA1],
+            };
+            router.write_channel_file(0, msg).unwrap();
+            router.step().unwrap();
+            assert!(
+                router.mailboxes[2].is_empty(),
+                "out-of-range node got a message with {padding} padding nodes"
+            );
+        }
+    }
 }
@@ -15,6 +15,8 @@ pub enum RouterError {
     InvalidFloat(Vec<u8>),
     #[error("Invalid motion pattern: {0}")]
     InvalidMotionPattern(String),
+    #[error("Malformed message batch: frame at byte {0} runs past the end of the write")]
+    InvalidBatch(usize),
     #[error("Error sending kernel message: {0:#?}")]
     KernelSendError(CrossbeamSendError<crate::router::RouterInput>),
     #[error("Error receiving message: {0:#?}")]
@@ -29,4 +31,6 @@ pub enum RouterError {
     ReplayCreation,
     #[error("Error creating thread: {0}")]
     ThreadCreation(io::Error),
+    #[error("Error exchanging writes with another partition: {0}")]
+    Partition(crate::errors::PartitionError),
 }
@@ -0,0 +1,245 @@
+//! exchange.rs
+//! The router's side of a simulation split across hosts; see
+//! `crate::partition` for how partitions are assigned and connected.
+//!
+//! Writes from this partition's nodes on a channel with subscribers elsewhere
+//! are kept in an outbox per partition they can reach. Every `lookahead`
+//! router timesteps, right after time advances, the outboxes go out and
+//! every peer's writes for the window that just ended come in. Each one is
+//! routed to this partition's receivers as if it had been written here at its
+//! own timestep, so it is delivered exactly when it would have been on one
+//! host: with every crossing channel taking at least `lookahead` timesteps
+//! for a one byte message, that is never before the window it arrives in.
+//! Only an empty message can be faster, and it is delivered as the window
+//! opens.
+//!
+//! Incoming writes are routed in partition order, each peer's in the order it
+//! made them, on the random stream of their channel's shard. A seed, shard
+//! count and partition layout therefore give the same run on any hosts.
+
+use std::num::NonZeroU64;
+
+use super::*;
+use crate::errors::PartitionError;
+use crate::partition::{Hello, Partition, Peers, RemoteWrite};
+use crate::types::NodeIdx;
+
+#[derive(Debug)]
+pub(crate) struct Exchange {
+    peers: Peers,
+    /// Other partitions with subscribers on each channel.
+    targets: Vec<Vec<usize>>,
+    /// Smallest delay of any channel that crosses partitions, in timesteps;
+    /// the length of a window. `None` if no channel crosses partitions.
+    lookahead: Option<NonZeroU64>,
+    /// Writes waiting for the end of the window, per partition.
+    outboxes: Vec<Vec<RemoteWrite>>,
+}
+
+impl Exchange {
+    /// Work out which channels cross partitions and how far ahead each
+    /// partition can run, then connect to the other partitions.
+    ///
+    /// Other partitions' nodes keep their place in `channels`, but their
+    /// batteries and movement are simulated on their own hosts: here they
+    /// have neither, and sit wherever they last transmitted from.
+    pub(crate) fn connect(
+        partition: &Partition,
+        channels: &mut ResolvedChannels,
+        ts_config: TimestepConfig,
+        seed: u64,
+    ) -> Result<Self, PartitionError> {
+        let nodes = channels.nodes.len();
+        let owners: Vec<usize> = (0..nodes).map(|n| partition.owner(n, nodes)).collect();
+        for (node, _) in channels
+            .nodes
+            .iter_mut()
+            .zip(&owners)
+            .filter(|&(_, &owner)| owner != partition.index())
+        {
+            node.energy = None;
+            node.motion = crate::types::MotionPattern::Static;
+        }
+
+        let mut targets = Vec::with_capacity(channels.channels.len());
+        let mut lookahead: Option<u64> = None;
+        for (index, channel) in channels.channels.iter().enumerate() {
+            let mut reaches: Vec<usize> = channel
+                .subscribers
+                .iter()
+                .map(|node| owners[node.0])
+                .filter(|&owner| owner != partition.index())
+                .collect();
+            reaches.sort_unstable();
+            reaches.dedup();
+            let crosses = channel.publishers.iter().any(|src| {
+                channel
+                    .subscribers
+                    .iter()
+                    .any(|dst| owners[src.0] != owners[dst.0])
+            });
+            if crosses {
+                // Delays only grow with size and distance, so a one byte
+                // message between nodes in the same place is the fastest
+                // anything but an empty write crosses this channel.
+                let (delay, _) = RoutingServer::message_timesteps(
+                    channel,
+                    1,
+                    ts_config,
+                    0,
+                    0.0,
+                    DistanceUnit::Meters,
+                );
+                if delay == 0 {
+                    return Err(PartitionError::NoLookahead(
+                        channels.channel_names[index].to_string(),
+                    ));
+                }
+                lookahead = Some(lookahead.map_or(delay, |l| l.min(delay)));
+            }
+            targets.push(reaches);
+        }
+        let lookahead = lookahead.and_then(NonZeroU64::new);
+
+        let hello = Hello {
+            partition: partition.index(),
+            partitions: partition.count(),
+            seed,
+            node_names: channels.node_names.iter().map(|n| n.to_string()).collect(),
+            channel_names: channels
+                .channel_names
+                .iter()
+                .map(|n| n.to_string())
+                .collect(),
+            timestep_ns: ts_config.length.get() * ts_config.unit.to_ns_factor(),
+            lookahead: lookahead.map_or(0, NonZeroU64::get),
+        };
+        let peers = Peers::connect(partition, hello)?;
+        Ok(Self::new(peers, targets, lookahead))
+    }
+
+    pub(super) fn new(
+        peers: Peers,
+        targets: Vec<Vec<usize>>,
+        lookahead: Option<NonZeroU64>,
+    ) -> Self {
+        Self {
+            outboxes: vec![Vec::new(); peers.count()],
+            peers,
+            targets,
+            lookahead,
+        }
+    }
+
+    /// Message IDs this partition hands out are `index + k * count`, so they
+    /// stay unique across the whole simulation.
+    pub(super) fn first_msg_id(&self) -> u64 {
+        self.peers.index() as u64
+    }
+
+    pub(super) fn msg_id_stride(&self) -> u64 {
+        self.peers.count() as u64
+    }
+
+    /// First router timestep after `timestep` at which a window ends.
+    pub(super) fn next_window(&self, timestep: Timestep) -> Option<Timestep> {
+        self.lookahead
+            .map(|l| (timestep / l.get() + 1).saturating_mul(l.get()))
+    }
+}
+
+impl RoutingServer {
+    /// Keep a copy of a write from one of this partition's nodes for every
+    /// other partition its channel reaches.
+    pub(super) fn forward_write(
+        &mut self,
+        src: NodeHandle,
+        channel: ChannelHandle,
+        data: &[u8],
+        msg_id: u64,
+    ) {
+        let Some(exchange) = &mut self.exchange else {
+            return;
+        };
+        let Some(targets) = exchange.targets.get(channel.0) else {
+            return;
+        };
+        if targets.is_empty() {
+            return;
+        }
+        let position = &self.channels.nodes[src.0].position;
+        let orientation = position.orientation;
+        let write = RemoteWrite {
+            timestep: self.timestep,
+            src: src.0,
+            channel: channel.0,
+            msg_id,
+            point: [position.point.x, position.point.y, position.point.z],
+            orientation: [orientation.az, orientation.el, orientation.roll],
+            data: data.to_vec(),
+        };
+        for &peer in targets {
+            exchange.outboxes[peer].push(write.clone());
+        }
+    }
+
+    /// At the end of a window, swap writes with every other partition and
+    /// route the ones that came in. Called once time has advanced, before
+    /// anything due at the new timestep fires.
+    pub(super) fn exchange_window(&mut self) -> Result<(), RouterError> {
+        let Some(exchange) = &mut self.exchange else {
+            return Ok(());
+        };
+        let Some(lookahead) = exchange.lookahead else {
+            return Ok(());
+        };
+        if self.timestep % lookahead.get() != 0 {
+            return Ok(());
+        }
+        let writes = exchange
+            .peers
+            .swap(self.timestep, &mut exchange.outboxes)
+            .map_err(RouterError::Partition)?;
+        for write in writes {
+            self.route_remote(write);
+        }
+        Ok(())
+    }
+
+    /// Route a write another partition forwarded to this partition's
+    /// receivers, from where and when it was made. The handshake checked
+    /// that its node and channel mean the same here.
+    fn route_remote(&mut self, write: RemoteWrite) {
+        let src = NodeIdx(write.src);
+        let channel = ChannelIdx(write.channel);
+        let position = &mut self.channels.nodes[src.0].position;
+        let [x, y, z] = write.point;
+        let [az, el, roll] = write.orientation;
+        let (point, orientation) = (position.point, position.orientation);
+        if [point.x, point.y, point.z] != write.point
+            || [orientation.az, orientation.el, orientation.roll] != write.orientation
+        {
+            position.point = config::ast::Point { x, y, z };
+            position.orientation = config::ast::Orientation { az, el, roll };
+            let position = position.clone();
+            self.routes.update_position(src.0, &position);
+            self.mark_dynamic(src.0);
+        }
+        let ctx = RouteCtx {
+            channels: &self.channels,
+            routes: &self.routes,
+            ts_config: self.ts_config,
+            timestep: write.timestep,
+        };
+        let shard = self.shard_of(channel);
+        let mut routed = self.shards[shard].route(&ctx, src, channel, &write.data);
+        for dest in &mut routed {
+            debug_assert!(
+                dest.becomes_active_at >= self.timestep || write.data.is_empty(),
+                "a forwarded write arrived after it was due"
+            );
+            dest.becomes_active_at = dest.becomes_active_at.max(self.timestep);
+        }
+        self.enqueue_routed(src, write.data, write.msg_id, routed);
+    }
+}
@@ -0,0 +1,161 @@
+//! fuzz.rs
+//! Handlers for `ctl.fuzz`, the iteration boundary of `nexus fuzz`.
+//!
+//! **Write** starts an iteration. Everything the writing process holds in its
+//! mailboxes is dropped, and the input becomes the frames it receives next on
+//! the fuzzed channel, in order, straight away and exactly as written: no
+//! link simulation, no loss and no collisions. An input is any number of
+//! frames, each a little-endian u16 length followed by that many bytes. A
+//! length that runs past the end takes what is left, so every input a fuzzer
+//! comes up with is a valid one. Frames longer than the channel's
+//! `max_size` are cut to it, as no write could have sent them.
+//!
+//! **Read** returns how many frames of the iteration are still waiting.
+//!
+//! Outside of `nexus fuzz` writes are ignored and reads return 0, so a
+//! protocol built for fuzzing still runs in an ordinary simulation.
+
+use std::rc::Rc;
+
+use tracing::warn;
+
+use crate::router::{QueuedMessage, RouterError, RoutingServer};
+use crate::types::ChannelIdx;
+
+/// Bytes in each frame's length prefix.
+const FRAME_PREFIX: usize = size_of::<u16>();
+
+/// The channel `nexus fuzz` feeds, and what to feed it first.
+#[derive(Debug)]
+pub(crate) struct Fuzzing {
+    pub(crate) channel: ChannelIdx,
+    /// Input delivered to every process on the channel before the first
+    /// step, when reproducing one rather than fuzzing.
+    pub(crate) input: Option<Vec<u8>>,
+}
+
+impl Fuzzing {
+    pub(crate) fn new(channel: ChannelIdx, input: Option<Vec<u8>>) -> Self {
+        Self { channel, input }
+    }
+}
+
+/// Split a fuzz input into its frames.
+pub(crate) fn split_input(data: &[u8]) -> Vec<&[u8]> {
+    let mut frames = Vec::new();
+    let mut rest = data;
+    while rest.len() >= FRAME_PREFIX {
+        let (prefix, tail) = rest.split_at(FRAME_PREFIX);
+        let len = u16::from_le_bytes(prefix.try_into().expect("prefix length")) as usize;
+        let (frame, tail) = tail.split_at(len.min(tail.len()));
+        frames.push(frame);
+        rest = tail;
+    }
+    frames
+}
+
+impl RoutingServer {
+    /// Whether reads of `channel` are served fuzzed frames.
+    pub(super) fn is_fuzzed(&self, channel: ChannelIdx) -> bool {
+        self.fuzz
+            .as_ref()
+            .is_some_and(|fuzz| fuzz.channel == channel)
+    }
+
+    /// Deliver the input being reproduced, if any, to every process on the
+    /// fuzzed channel.
+    pub(super) fn start_fuzz(&mut self) {
+        let Some((channel, input)) = self
+            .fuzz
+            .as_mut()
+            .and_then(|fuzz| Some((fuzz.channel, fuzz.input.take()?)))
+        else {
+            return;
+        };
+        let handles: Vec<usize> = (0..self.channels.handles.len())
+            .filter(|&index| self.channels.handles[index].2 == channel)
+            .collect();
+        for index in handles {
+            self.push_frames(index, &input);
+        }
+    }
+
+    /// Write handler: reset the writing process and queue the frames of its
+    /// next iteration.
+    pub fn write_fuzz(&mut self, msg: fuse::Message) -> Result<(), RouterError> {
+        let Some(fuzz) = &self.fuzz else {
+            return Ok(());
+        };
+        let pid = msg.id.0;
+        let channel_name = self.channels.channel_names[fuzz.channel.0].clone();
+        let Some(index) = self.get_handle_index(pid, &channel_name) else {
+            warn!("Process {pid} started a fuzz iteration but does not receive on {channel_name}");
+            return Ok(());
+        };
+        // Deliveries already in flight to other channels still arrive; in
+        // `nexus fuzz` the only ones are the process's own writes.
+        if let Some(handles) = self.fuse_mapping.get(&pid) {
+            for &handle in handles.values() {
+                self.mailboxes[handle].clear();
+                self.unread_msg[handle] = None;
+            }
+        }
+        self.push_frames(index, &msg.data);
+        Ok(())
+    }
+
+    /// Read handler: frames of the current iteration not read yet.
+    pub fn read_fuzz(&mut self, req: fuse::ReadRequest) -> Result<(), RouterError> {
+        let pending = self
+            .fuzz
+            .as_ref()
+            .and_then(|fuzz| {
+                let channel_name = &self.channels.channel_names[fuzz.channel.0];
+                self.get_handle_index(req.id.0, channel_name)
+            })
+            .map_or(0, |index| {
+                self.mailboxes[index].len() + usize::from(self.unread_msg[index].is_some())
+            });
+        Self::reply_capped(req.reply, req.size, pending.to_string().as_bytes());
+        Ok(())
+    }
+
+    /// Put the frames of `input` in handle `index`'s mailbox, ready to read.
+    fn push_frames(&mut self, index: usize, input: &[u8]) {
+        let (_, node, channel) = self.channels.handles[index];
+        let max_size = self.channels.channels[channel.0].r#type.max_size.get();
+        for frame in split_input(input) {
+            let msg_id = self.alloc_msg_id();
+            self.mailboxes[index].push_back(QueuedMessage {
+                src: node,
+                buf: Rc::from(&frame[..frame.len().min(max_size)]),
+                expiration: None,
+                bit_errors: false,
+                msg_id,
+                rssi_dbm: 0.0,
+                snr_db: 0.0,
+            });
+        }
+        self.wake_pollers(index);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn inputs_split_into_frames() {
+        let input = [2, 0, b'h', b'i', 0, 0, 1, 0, b'!'];
+        assert_eq!(split_input(&input), vec![&b"hi"[..], b"", b"!"]);
+    }
+
+    #[test]
+    fn any_input_is_valid() {
+        // The last length runs past the end and takes what is left; a lone
+        // byte is too short to be a frame.
+        assert_eq!(split_input(&[9, 0, b'a', b'b']), vec![&b"ab"[..]]);
+        assert_eq!(split_input(&[1, 0, b'a', 7]), vec![&b"a"[..]]);
+        assert!(split_input(&[]).is_empty());
+    }
+}
@@ -1,6 +1,7 @@
 use config::units::DecimalScaled;
 
 use super::*;
+use crate::corrupt::flip_random_bits;
 use crate::types::Node;
 use std::collections::HashMap;
 
@@ -95,12 +96,13 @@ impl RoutingServer {
 
     /// Cached counterpart to `send_through_channel`: skips the RSSI
     /// recompute and the `meval` probability evaluation, keeping only the
-    /// random sampling.
+    /// random sampling. Bit errors are drawn as gaps between flipped bits;
+    /// see [`crate::corrupt`] for the random stream this consumes.
     pub(super) fn send_through_channel_cached<'a>(
         channel: &Channel,
         mut buf: Cow<'a, [u8]>,
         link: &CachedLink,
-        rng: &mut StdRng,
+        rng: &mut ChaCha12Rng,
     ) -> Option<(Cow<'a, [u8]>, bool, f64, f64)> {
         if link.below_noise_floor {
             warn!("Packet dropped (rssi = {})", link.pl_rssi);
@@ -110,13 +112,7 @@ impl RoutingServer {
             warn!("Packet dropped (packet_loss, rssi = {})", link.pl_rssi);
             return None;
         }
-        let mut had_bit_errors = false;
-        if link.be_prob != 0.0 {
-            let flips = (0..buf.len() * usize::try_from(u8::BITS).unwrap())
-                .map(|_| channel.link.bit_error.sample_unchecked(link.be_prob, rng));
-            let (_, flipped) = flip_bits(buf.to_mut(), flips);
-            had_bit_errors = flipped > 0;
-        }
+        let had_bit_errors = flip_random_bits(&mut buf, link.be_prob, rng) > 0;
         Some((buf, had_bit_errors, link.be_rssi, link.be_snr))
     }
 }
@@ -10,57 +10,83 @@
 use crate::{
     KernelServer, ResolvedChannels,
     errors::KernelError,
-    helpers::{flip_bits, format_u8_buf},
+    helpers::format_u8_buf,
     router::{self, timectl::SleepAlarm},
     sources::Source,
     types::{Channel, NodeHandle},
+    wheel::TimingWheel,
 };
-#[allow(unused_imports)] // Position is used by delivery.rs via `use super::*`
+#[allow(unused_imports)] // Position is used by delivery.rs and table.rs via `use super::*`
 use config::ast::Position;
 use config::{
     ast::{ChannelKind, DataUnit, DistanceUnit, TimeUnit, TimestepConfig},
     units::DecimalScaled,
 };
+use fuse::stats::{LocalStats, Op, Stats};
 use fuse::{SleepEvent, ctrl_files::ControlFile};
-use rand::rngs::StdRng;
+use rand_chacha::ChaCha12Rng;
+use std::collections::VecDeque;
+use std::num::{NonZeroU64, NonZeroUsize};
 use std::rc::Rc;
 use std::sync::Arc;
 use std::sync::atomic::{AtomicU64, Ordering};
 use std::thread;
 use std::{borrow::Cow, sync::mpsc};
-use std::{cmp::Reverse, collections::BinaryHeap};
 use std::{collections::HashMap, thread::JoinHandle};
-use std::{collections::VecDeque, num::NonZeroU64};
 use tracing::{Level, debug, event, info, instrument, warn};
 
+mod batch;
+mod checkpoint;
+mod clock;
 mod energy;
 mod energy_tests;
+mod exchange;
+mod fuzz;
+mod packet;
 mod posctl;
 mod powerctl;
+mod shard;
+mod shm;
+mod spatial;
 mod timectl;
 use crate::types::{ChannelHandle, ChannelIdx};
 
 pub type Timestep = u64;
-// Tuple ordering: (Reverse<Timestep>, Reverse<usize>, AddressedMsg).
-// BinaryHeap is a max-heap, so Reverse(Timestep) ensures earlier
-// timesteps pop first. The Reverse around the sequence number is the
-// non-obvious bit: without it, two messages enqueued in the same
-// timestep would pop in reverse insertion order (a max-heap on raw
-// usize), silently scrambling multi-write payloads from one publisher.
-// AddressedMsg is never compared (heap stops at the second tuple field
-// because it's a strict total order on the prefix).
-pub type MessageQueue = BinaryHeap<(Reverse<Timestep>, Reverse<usize>, AddressedMsg)>;
 pub type Mailbox = VecDeque<QueuedMessage>;
 
+/// Work the router has scheduled for a future timestep.
+#[derive(Debug)]
+pub(crate) enum Deadline {
+    /// Answer a parked sleep.
+    Wake(SleepAlarm),
+    /// Move a message into its destination's mailbox.
+    Deliver(AddressedMsg),
+    /// Drop expired messages from the front of a handle's mailbox.
+    Expire(usize),
+}
+
+/// Path component separating a channel name from the unit file of its
+/// receive timeout (e.g. `lora/recv_timeout/ms`).
+const RECV_TIMEOUT_DIR: &str = "/recv_timeout/";
+/// Suffix of the framed batch file next to a channel file (`lora/batch`).
+const BATCH_SUFFIX: &str = "/batch";
+/// Suffix of the file that prefixes each received message with its link
+/// metadata (`lora/packet`).
+const PACKET_SUFFIX: &str = "/packet";
+
 mod delivery;
 mod errors;
 mod link_simulation;
 mod messages;
 mod table;
 
+pub(crate) use checkpoint::{Checkpointing, Restore};
 use delivery::*;
 pub use errors::*;
+pub(crate) use exchange::Exchange;
+pub(crate) use fuzz::Fuzzing;
 pub use messages::*;
+use shard::*;
 use table::*;
 
 type ServerHandle = JoinHandle<Result<(), KernelError>>;
@@ -114,8 +140,9 @@ pub(crate) struct RoutingServer {
     channels: ResolvedChannels,
     /// Routing table with information with computed routes between nodes.
     routes: RoutingTable,
-    /// AddressedMsgs queued to become active at a specific timestep.
-    queued: MessageQueue,
+    /// Sleep wakeups, queued deliveries and mailbox TTL expiries, keyed by
+    /// the timestep they fall due at. Advanced once per `step`.
+    deadlines: TimingWheel<Deadline>,
     /// Mapping from channel keys used by FUSE to those used by the kernel.
     /// Nested by PID so the inner map can be queried with `&str`, avoiding
     /// the String allocation a flat `HashMap<(PID, String), usize>` requires
@@ -126,16 +153,9 @@ pub(crate) struct RoutingServer {
     /// past. Uses the niche optimization that the ttl for a channel cannot be
     /// 0, which means we can use an Option<T> here with no overhead!
     mailboxes: Vec<Mailbox>,
-    /// Indices of mailboxes that currently hold ≥ 1 queued message. Lets the
-    /// per-timestep TTL sweep skip the (potentially tens of thousands of)
-    /// idle mailboxes that dominate cost at high node counts. Entries may be
-    /// stale (mailbox already drained between sweeps); the sweep prunes those
-    /// via `retain`. `mailbox_active` is the dedup bitmap that prevents the
-    /// same mailbox from being pushed twice.
-    nonempty_mailboxes: Vec<usize>,
-    mailbox_active: Vec<bool>,
-    /// Random number generator to use
-    rng: StdRng,
+    /// Random streams and link caches for link simulation, one per shard
+    /// of the channels. See `shard.rs`.
+    shards: Vec<Shard>,
     /// Per-handle leftover bytes from a previous read. When an exclusive
     /// channel's mailbox produces a message larger than the syscall's
     /// requested size, the remainder is stashed here keyed by handle index;
@@ -144,34 +164,67 @@ pub(crate) struct RoutingServer {
     /// non-blocking now: the FUSE worker dispatches an `FsMessage::Read`
     /// carrying its `ReplyData` token and returns immediately, so only the
     /// router has the message buffer to slice.
-    unread_msg: Vec<Option<(usize, Vec<u8>)>>,
+    unread_msg: Vec<Option<(usize, Rc<[u8]>)>>,
     /// Energy subsystem: tracks battery nodes, death/recovery transitions.
     energy_mgr: energy::EnergyManager,
     /// Sender for (old_pid, new_pid) pairs consumed by the FUSE filesystem.
     remap_tx: mpsc::Sender<(u32, u32)>,
     /// Cached nanoseconds per timestep (constant for the simulation).
     timestep_ns: u64,
-    /// Sequence counter for message ordering within a timestep.
-    sequence: usize,
     /// Monotonic counter for unique message IDs across the simulation.
     next_msg_id: u64,
     /// Per-handle signal quality from the last RX on each channel endpoint.
     signal_info: Vec<SignalInfo>,
-    // Min-heap by `(timestep, pid)`: the `Reverse` is what makes
-    // `peek`/`pop` return the *earliest* deadline first.
-    sleep_alarms: BinaryHeap<Reverse<SleepAlarm>>,
-    /// Cached deterministic link parameters keyed by
-    /// `(src_node_idx, dst_node_idx, channel_idx)`. Only holds entries for
-    /// pairs where both endpoints are still Static; on Static->Dynamic
-    /// transition we evict any entry containing the node.
-    link_cache: HashMap<(usize, usize, usize), link_simulation::CachedLink>,
+    /// Per-handle receive timeout in timesteps, set through the channel's
+    /// `recv_timeout/<unit>` files. `None` keeps reads non-blocking.
+    recv_timeouts: Vec<Option<NonZeroU64>>,
+    /// Channel reads parked until a message lands in their mailbox or their
+    /// simulated deadline passes. Serviced at the end of every `step`.
+    blocked_reads: Vec<BlockedRead>,
+    /// Per-handle `poll`/`epoll` waiters, notified when a message lands in
+    /// the handle's mailbox.
+    pollers: Vec<Vec<Box<dyn Poller>>>,
+    /// Per-handle shared-memory rings, created the first time a protocol
+    /// reads its channel's `shm` file.
+    shm_channels: Vec<Option<shm::ShmChannel>>,
+    /// Handles with a live entry in `shm_channels`, so each step only visits
+    /// those.
+    shm_handles: Vec<usize>,
+    /// Memory-mapped clock shared by every process, created the first time
+    /// anyone reads `ctl.clock` and republished as soon as `step` advances
+    /// time.
+    clock_page: Option<clock::ClockPage>,
+    /// Per-process counters shared with the FUSE filesystem. The router adds
+    /// request-to-reply latency for reads and sleeps.
+    stats: LocalStats,
+    /// Protocol states saved for a checkpoint and handed back on resume.
+    checkpoint: checkpoint::CheckpointState,
+    /// Writes to and from the hosts running the other partitions, when the
+    /// simulation is split across several.
+    exchange: Option<Exchange>,
+    /// The channel `nexus fuzz` feeds its frames into.
+    fuzz: Option<Fuzzing>,
 }
 
-/// Last-received signal quality for a (destination_node, channel) pair.
+/// Last-received signal quality for a (destination_node, channel) pair,
+/// plus where the message came from for the `packet` file's header.
 #[derive(Debug, Default, Clone)]
 pub(crate) struct SignalInfo {
     pub(crate) rssi_dbm: f64,
     pub(crate) snr_db: f64,
+    pub(crate) src_node: usize,
+    pub(crate) msg_id: u64,
+    pub(crate) timestep: Timestep,
+}
+
+impl SignalInfo {
+    fn record(&mut self, rssi_dbm: f64, snr_db: f64, msg: &QueuedMessage, timestep: Timestep) {
+        self.rssi_dbm = rssi_dbm;
+        self.snr_db = snr_db;
+        self.src_node = msg.src.0;
+        self.msg_id = msg.msg_id;
+        self.timestep = timestep;
+    }
 }
 
 impl RoutingServer {
@@ -182,20 +235,34 @@ impl RoutingServer {
     /// current simulated timestep without needing the value embedded in the
     /// message. `energy_tx` is the asynchronous push channel for depletion
     /// and recovery events; the kernel main thread drains its receiver once
-    /// per tick.
+    /// per tick. `stats` is the registry the FUSE filesystem counts into.
+    /// With `idle_until`, the router publishes the kernel timestep of the
+    /// next step that has work for a protocol after every Tick during which
+    /// all of them ended up blocked on it, and 0 as soon as one might act.
+    /// `rng` seeds every one of `shards`. `checkpoint` says whether to take a
+    /// checkpoint and what to resume from. `exchange` connects the router to
+    /// the other partitions of a simulation split across hosts. `fuzz` names
+    /// the channel `nexus fuzz` feeds.
     #[instrument(skip(
-        channels, rng, source, remap_tx, current_ts, energy_tx, kernel_tx, kernel_rx
+        channels, rng, source, remap_tx, current_ts, energy_tx, kernel_tx, kernel_rx, stats,
+        idle_until, checkpoint, exchange, fuzz
     ))]
     pub fn serve(
         channels: ResolvedChannels,
         ts_config: TimestepConfig,
-        rng: StdRng,
+        rng: ChaCha12Rng,
         mut source: Source,
         remap_tx: mpsc::Sender<(u32, u32)>,
         current_ts: Arc<AtomicU64>,
         energy_tx: mpsc::Sender<EnergyEvents>,
         kernel_tx: crossbeam_channel::Sender<RouterInput>,
         kernel_rx: crossbeam_channel::Receiver<RouterInput>,
+        stats: Arc<Stats>,
+        idle_until: Option<Arc<AtomicU64>>,
+        shards: NonZeroUsize,
+        checkpoint: Checkpointing,
+        exchange: Option<Exchange>,
+        fuzz: Option<Fuzzing>,
     ) -> Result<RouterServer, KernelError> {
         let (router_tx, router_rx) = mpsc::channel::<RouterMessage>();
         thread::Builder::new()
@@ -206,41 +273,59 @@ impl RoutingServer {
                 let routes = RoutingTable::new(&channels);
                 let timestep_ns = ts_config.length.get() * ts_config.unit.to_ns_factor();
                 let energy_mgr = energy::EnergyManager::new(&channels.nodes);
+                let (checkpoint, resume) = checkpoint::CheckpointState::new(checkpoint);
                 let mut router = Self {
                     // This makes all the `NonZeroU64`s happy
                     timestep: 1,
                     channels,
                     routes,
-                    queued: BinaryHeap::new(),
+                    deadlines: TimingWheel::new(1),
                     mailboxes: vec![VecDeque::new(); handles_count],
-                    nonempty_mailboxes: Vec::new(),
-                    mailbox_active: vec![false; handles_count],
                     unread_msg: vec![None; handles_count],
                     fuse_mapping,
                     ts_config,
-                    rng,
+                    shards: Shard::split(rng, shards),
                     energy_mgr,
                     remap_tx,
                     timestep_ns,
-                    sequence: 0,
-                    next_msg_id: 0,
+                    next_msg_id: exchange.as_ref().map_or(0, Exchange::first_msg_id),
                     signal_info: vec![SignalInfo::default(); handles_count],
-                    sleep_alarms: BinaryHeap::new(),
-                    link_cache: HashMap::new(),
+                    recv_timeouts: vec![None; handles_count],
+                    blocked_reads: Vec::new(),
+                    pollers: (0..handles_count).map(|_| Vec::new()).collect(),
+                    shm_channels: (0..handles_count).map(|_| None).collect(),
+                    shm_handles: Vec::new(),
+                    clock_page: None,
+                    stats: LocalStats::new(stats),
+                    checkpoint,
+                    exchange,
+                    fuzz,
                 };
+                if let Some(resume) = resume {
+                    router.restore(resume);
+                }
+                router.start_fuzz();
                 let mut last_polled_ts: u64 = u64::MAX;
                 loop {
                     match kernel_rx.recv() {
                         Ok(RouterInput::Shutdown) => {
+                            router.warn_missing_checkpoint();
                             return Ok(());
                         }
                         Ok(RouterInput::RemapPids(pairs)) => {
+                            if let Some(idle) = &idle_until {
+                                idle.store(0, Ordering::Release);
+                            }
                             router.apply_pid_remaps(&pairs);
                             if router_tx.send(RouterMessage::PidsRemapped).is_err() {
                                 break Err(KernelError::RouterError(RouterError::RouteError));
                             }
                         }
                         Ok(RouterInput::Fs(fs_msg)) => {
+                            // Whatever this is, its sender was not blocked.
+                            if let Some(idle) = &idle_until {
+                                idle.store(0, Ordering::Release);
+                            }
                             // Direct dispatch of the FUSE event. Replaces the
                             // try_iter drain that used to happen on each Poll;
                             // the router now wakes on every FUSE op so reads
@@ -253,6 +338,11 @@ impl RoutingServer {
                                     router.request_sleep(event);
                                     Ok(())
                                 }
+                                fuse::FsMessage::Poll(req) => router.request_poll(req),
+                                fuse::FsMessage::Checkpoint(write) => {
+                                    router.save_state(write);
+                                    Ok(())
+                                }
                             };
                             if let Err(e) = res {
                                 break Err(KernelError::RouterError(e));
@@ -260,14 +350,37 @@ impl RoutingServer {
                         }
                         Ok(RouterInput::Tick) => {
                             let timestep = current_ts.load(Ordering::Acquire);
-                            let ts_advanced = timestep != last_polled_ts;
+                            // The kernel may publish several timesteps before
+                            // this thread wakes (it does not pace steps
+                            // nobody is waiting on), so poll each one in turn
+                            // rather than collapsing them into a single step.
+                            let first = match last_polled_ts {
+                                u64::MAX => timestep,
+                                last => last.saturating_add(1),
+                            };
+                            let polled = if first > timestep {
+                                // Source::Simulated is now a no-op on poll
+                                // because FUSE messages flow via
+                                // RouterInput::Fs; for replay paths
+                                // source.poll injects log records.
+                                source.poll(&mut router, timestep, false)
+                            } else {
+                                (first..=timestep)
+                                    .try_for_each(|ts| source.poll(&mut router, ts, true))
+                            };
                             last_polled_ts = timestep;
-                            // Source::Simulated is now a no-op on poll
-                            // because FUSE messages flow via RouterInput::Fs;
-                            // for replay paths source.poll injects log records.
-                            if let Err(e) = source.poll(&mut router, timestep, ts_advanced) {
+                            if let Err(e) = polled {
                                 break Err(KernelError::SourceError(e));
                             }
+                            if let Err(e) = router.try_checkpoint(timestep) {
+                                break Err(KernelError::Checkpoint(e));
+                            }
+                            if let Some(idle) = &idle_until {
+                                let until = router.idle_until().map_or(0, |due| {
+                                    timestep.saturating_add(due.saturating_sub(router.timestep))
+                                });
+                                idle.store(until, Ordering::Release);
+                            }
                             let depleted: Vec<String> = router
                                 .energy_mgr
                                 .newly_depleted
@@ -308,8 +421,11 @@ impl RoutingServer {
             return;
         }
         self.channels.nodes[node_idx].is_dynamic = true;
-        self.link_cache
-            .retain(|&(s, d, _), _| s != node_idx && d != node_idx);
+        for shard in &mut self.shards {
+            shard
+                .link_cache
+                .retain(|&(s, d, _), _| s != node_idx && d != node_idx);
+        }
     }
 
     /// Apply PID remaps: update handles and fuse_mapping entries, clear
@@ -321,14 +437,28 @@ impl RoutingServer {
             if let Some(inner) = self.fuse_mapping.remove(&old_pid) {
                 self.fuse_mapping.insert(new_pid, inner);
             }
+            self.stats.shared().remap(old_pid, new_pid);
+            self.remap_checkpoint_pids(old_pid, new_pid);
             for (idx, handle) in self.channels.handles.iter_mut().enumerate() {
                 if handle.0 == old_pid {
                     handle.0 = new_pid;
                     self.mailboxes[idx].clear();
-                    self.mailbox_active[idx] = false;
+                    self.recv_timeouts[idx] = None;
+                    self.pollers[idx].clear();
+                    self.shm_channels[idx] = None;
                 }
             }
         }
+        let shm_channels = &self.shm_channels;
+        self.shm_handles.retain(|&idx| shm_channels[idx].is_some());
+        // Reads parked by the old processes can never be answered; dropping
+        // their `ReplyData` fails the syscall with EIO.
+        let handles = &self.channels.handles;
+        self.blocked_reads.retain(|read| {
+            pairs
+                .iter()
+                .all(|&(_, new_pid)| handles[read.handle_ptr].0 != new_pid)
+        });
         // Send remaps to FUSE filesystem
         for &pair in pairs {
             if let Err(e) = self.remap_tx.send(pair) {
@@ -377,24 +507,28 @@ impl RoutingServer {
             | ControlFile::PosEl
             | ControlFile::PosRoll => self.write_pos(ni, msg),
             ControlFile::PowerFlows => self.write_power_flows(ni, msg),
+            ControlFile::Fuzz => self.write_fuzz(msg),
             // Read-only files cannot be written
-            ControlFile::EnergyLeft | ControlFile::Elapsed(_) => {
-                Err(RouterError::UnknownFile(msg.id.1.clone()))
-            }
+            ControlFile::EnergyLeft
+            | ControlFile::Elapsed(_)
+            | ControlFile::Clock
+            | ControlFile::Stats
+            | ControlFile::Restore => Err(RouterError::UnknownFile(msg.id.1.clone())),
             // Sleep variants are routed through `FsMessage::Sleep` rather
             // than the control-write path because they need to defer the
-            // FUSE reply until the deadline. If we ever land here it means
-            // the FS routed incorrectly; report unknown-file rather than
-            // panicking the routing thread.
-            ControlFile::SleepRelative(_) | ControlFile::SleepAbsolute(_) => {
-                Err(RouterError::UnknownFile(msg.id.1.clone()))
-            }
+            // FUSE reply until the deadline, and checkpoint writes through
+            // `FsMessage::Checkpoint` for the same reason. If we ever land
+            // here it means the FS routed incorrectly; report unknown-file
+            // rather than panicking the routing thread.
+            ControlFile::SleepRelative(_)
+            | ControlFile::SleepAbsolute(_)
+            | ControlFile::Checkpoint => Err(RouterError::UnknownFile(msg.id.1.clone())),
         }
     }
 
     pub fn alloc_msg_id(&mut self) -> u64 {
         let id = self.next_msg_id;
-        self.next_msg_id += 1;
+        self.next_msg_id += self.exchange.as_ref().map_or(1, Exchange::msg_id_stride);
         id
     }
 
@@ -416,9 +550,9 @@ impl RoutingServer {
                 format_u8_buf(&msg.data)
             );
         }
-        let msg_id = self.next_msg_id;
-        self.next_msg_id += 1;
+        let msg_id = self.alloc_msg_id();
         event!(target: "tx", Level::INFO, timestep, channel = channel_handle.0, node = src_node.0, tx = true, msg_id, data = msg.data.as_slice());
+        self.forward_write(src_node, channel_handle, &msg.data, msg_id);
 
         // Queue the message first; only drain TX energy on success so that
         // a failed queue does not silently consume charge (BUG-9).
@@ -433,6 +567,18 @@ impl RoutingServer {
     /// nodes listening on the channel.
     pub fn receive_write(&mut self, msg: fuse::Message) -> Result<(), RouterError> {
         let path = msg.id.1.as_str();
+        if let Some((channel_name, _)) = path.rsplit_once(RECV_TIMEOUT_DIR) {
+            let Some(index) = self.get_handle_index(msg.id.0, channel_name) else {
+                return Err(RouterError::UnknownFile(msg.id.1.clone()));
+            };
+            return self.write_recv_timeout(index, msg);
+        }
+        if let Some(channel_name) = path.strip_suffix(BATCH_SUFFIX) {
+            let Some(index) = self.get_handle_index(msg.id.0, channel_name) else {
+                return Err(RouterError::UnknownFile(msg.id.1.clone()));
+            };
+            return self.write_batch(index, msg);
+        }
         // Strip "/channel" suffix for data channel writes; the lookup is
         // borrowed against the path slice with no allocation.
         let lookup_name: &str = path.strip_suffix("/channel").unwrap_or(path);
@@ -462,6 +608,17 @@ impl RoutingServer {
         match ctl {
             ControlFile::Time(_) => self.send_time(ni, req),
             ControlFile::Elapsed(_) => self.send_elapsed(req),
+            ControlFile::Clock => self.open_clock_page(req),
+            ControlFile::Stats => {
+                let stats = self
+                    .stats
+                    .shared()
+                    .snapshot(req.id.0)
+                    .map(|snapshot| snapshot.to_string())
+                    .unwrap_or_default();
+                Self::reply_capped(req.reply, req.size, stats.as_bytes());
+                Ok(())
+            }
             ControlFile::EnergyLeft => {
                 let charge_nj = energy::EnergyManager::charge_nj(&self.channels.nodes, ni);
                 Self::reply_capped(req.reply, req.size, charge_nj.to_string().as_bytes());
@@ -481,6 +638,15 @@ impl RoutingServer {
             | ControlFile::PosEl
             | ControlFile::PosRoll => self.read_pos(ni, req),
             ControlFile::PowerFlows => self.read_power_flows(ni, req),
+            ControlFile::Checkpoint => {
+                self.read_checkpoint(req);
+                Ok(())
+            }
+            ControlFile::Restore => {
+                self.read_restore(req);
+                Ok(())
+            }
+            ControlFile::Fuzz => self.read_fuzz(req),
             // Write-only files cannot be read
             ControlFile::PosDx
             | ControlFile::PosDy
@@ -500,31 +666,30 @@ impl RoutingServer {
         req: fuse::ReadRequest,
     ) -> Result<(), RouterError> {
         // Serve any leftover bytes from a previous partial read first.
-        if let Some((read_ptr, buf)) = &mut self.unread_msg[index] {
-            if *read_ptr >= buf.len() {
-                self.unread_msg[index] = None;
-                req.reply.data(&[]);
-                return Ok(());
-            }
-            let remaining = buf.len() - *read_ptr;
-            let n = std::cmp::min(remaining, req.size as usize);
-            let end = *read_ptr + n;
-            req.reply.data(&buf.as_slice()[*read_ptr..end]);
-            *read_ptr = end;
+        if self.unread_msg[index].is_some() {
+            self.reply_unread(index, req);
             return Ok(());
         }
-        match self.deliver_msg(index, req) {
-            Ok(true) => Ok(()),
-            Ok(false) => Ok(()), // Empty: deliver_msg already replied with &[]
-            Err(e) => Err(e),
-        }
+        self.read_or_park(index, ReadKind::Channel, req)
     }
 
     /// Top-level read dispatch. Non-blocking: takes ownership of the
     /// `ReplyData` token from FUSE, routes the request to the right
     /// reply path, and either replies inline (control files) or hands
-    /// the token to the delivery code (channel reads).
+    /// the token to the delivery code (channel reads). Reads answered here
+    /// are counted now; parked ones when `service_blocked_reads` answers
+    /// them.
     pub fn request_read(&mut self, req: fuse::ReadRequest) -> Result<(), RouterError> {
+        let (pid, issued) = (req.id.0, req.issued);
+        let parked = self.blocked_reads.len();
+        let res = self.route_read(req);
+        if self.blocked_reads.len() == parked {
+            self.stats.record(pid, Op::RouterRead, issued);
+        }
+        res
+    }
+
+    fn route_read(&mut self, req: fuse::ReadRequest) -> Result<(), RouterError> {
         let path = req.id.1.as_str();
 
         // Handle signal quality reads (e.g., "lora/rssi", "lora/snr")
@@ -536,6 +701,39 @@ impl RoutingServer {
             let name = channel_name.to_string();
             return self.read_signal_file(&name, req, |si| si.snr_db);
         }
+        if let Some((channel_name, _)) = path.rsplit_once(RECV_TIMEOUT_DIR) {
+            let Some(index) = self.get_handle_index(req.id.0, channel_name) else {
+                let path_str = req.id.1.clone();
+                drop(req.reply);
+                return Err(RouterError::UnknownFile(path_str));
+            };
+            return self.read_recv_timeout(index, req);
+        }
+        if let Some(channel_name) = path.strip_suffix("/shm") {
+            let Some(index) = self.get_handle_index(req.id.0, channel_name) else {
+                let path_str = req.id.1.clone();
+                drop(req.reply);
+                return Err(RouterError::UnknownFile(path_str));
+            };
+            self.open_shm_channel(index, req);
+            return Ok(());
+        }
+        if let Some(channel_name) = path.strip_suffix(BATCH_SUFFIX) {
+            let Some(index) = self.get_handle_index(req.id.0, channel_name) else {
+                let path_str = req.id.1.clone();
+                drop(req.reply);
+                return Err(RouterError::UnknownFile(path_str));
+            };
+            return self.read_batch(index, req);
+        }
+        if let Some(channel_name) = path.strip_suffix(PACKET_SUFFIX) {
+            let Some(index) = self.get_handle_index(req.id.0, channel_name) else {
+                let path_str = req.id.1.clone();
+                drop(req.reply);
+                return Err(RouterError::UnknownFile(path_str));
+            };
+            return self.read_packet(index, req);
+        }
 
         // Strip "/channel" suffix for data channel reads
         let lookup_name: &str = path.strip_suffix("/channel").unwrap_or(path);
@@ -579,13 +777,17 @@ impl RoutingServer {
 
         if wakeup_timestep <= self.timestep {
             req.reply.written(req.bytes_consumed);
+            self.stats.record(req.pid, Op::RouterSleep, req.issued);
         } else {
-            self.sleep_alarms.push(Reverse(SleepAlarm {
-                timestep: wakeup_timestep,
-                pid: req.pid,
-                bytes_consumed: req.bytes_consumed,
-                reply: req.reply,
-            }));
+            self.deadlines.insert(
+                wakeup_timestep,
+                Deadline::Wake(SleepAlarm {
+                    pid: req.pid,
+                    bytes_consumed: req.bytes_consumed,
+                    issued: req.issued,
+                    reply: req.reply,
+                }),
+            );
         }
     }
 
@@ -613,93 +815,93 @@ impl RoutingServer {
 
     /// Take a single step in the simulation.
     pub fn step(&mut self) -> Result<(), RouterError> {
+        // Ring writes happened during the timestep that is ending, the same
+        // timestep a FUSE write arriving now would be stamped with.
+        self.drain_shm_tx();
+        self.route_pending();
         self.timestep += 1;
+        // Writes from other partitions may be due now.
+        self.exchange_window()?;
+        // Before anything can wake a protocol, so a woken sleeper or reader
+        // never sees the previous timestep on the page.
+        self.publish_clock();
         self.energy_mgr
             .tick(&mut self.channels.nodes, self.timestep, self.timestep_ns);
         self.apply_all_motions_and_log();
-        self.expire_messages();
-        self.send_wakeups();
-        self.deliver_queued_messages()
+        self.fire_deadlines();
+        self.service_blocked_reads()?;
+        self.fill_shm_rx();
+        Ok(())
     }
 
-    /// Remove expired messages from active mailboxes only. The
-    /// `nonempty_mailboxes` index is rebuilt by `retain` so empty entries
-    /// (drained by reads between sweeps) drop out and the sweep stays O(active)
-    /// rather than O(total mailboxes).
-    fn expire_messages(&mut self) {
-        let timestep = self.timestep;
-        let mailboxes = &mut self.mailboxes;
-        let active = &mut self.mailbox_active;
-        self.nonempty_mailboxes.retain(|&i| {
-            let mailbox = &mut mailboxes[i];
-            while mailbox
-                .front()
-                .is_some_and(|msg| msg.expiration.is_some_and(|exp| exp.get() < timestep))
-            {
-                let _ = mailbox.pop_front();
-            }
-            if mailbox.is_empty() {
-                active[i] = false;
-                false
-            } else {
-                true
+    /// Expire, wake and deliver everything due at the new timestep, in that
+    /// order.
+    fn fire_deadlines(&mut self) {
+        let due = self.deadlines.advance();
+        debug_assert_eq!(self.deadlines.now(), self.timestep);
+        let mut deliveries = Vec::new();
+        for (_, deadline) in due {
+            match deadline {
+                Deadline::Expire(index) => self.expire_messages(index),
+                Deadline::Wake(alarm) => {
+                    alarm.reply.written(alarm.bytes_consumed);
+                    self.stats.record(alarm.pid, Op::RouterSleep, alarm.issued);
+                }
+                Deadline::Deliver(frame) => deliveries.push(frame),
             }
-        });
+        }
+        for frame in deliveries {
+            self.deliver_queued_message(frame);
+        }
     }
 
-    fn send_wakeups(&mut self) {
-        while let Some(Reverse(alarm)) = self.sleep_alarms.peek()
-            && alarm.timestep <= self.timestep
+    /// Remove expired messages from the front of a mailbox. Scheduled for
+    /// the timestep after each delivered message's expiration, so only
+    /// mailboxes with something to expire are visited.
+    fn expire_messages(&mut self, index: usize) {
+        let timestep = self.timestep;
+        let mailbox = &mut self.mailboxes[index];
+        while mailbox
+            .front()
+            .is_some_and(|msg| msg.expiration.is_some_and(|exp| exp.get() < timestep))
         {
-            let Reverse(alarm) = self.sleep_alarms.pop().unwrap();
-            alarm.reply.written(alarm.bytes_consumed);
+            let _ = mailbox.pop_front();
         }
     }
 
-    /// Deliver all messages whose activation timestep has arrived.
-    fn deliver_queued_messages(&mut self) -> Result<(), RouterError> {
-        while self
-            .queued
-            .peek()
-            .is_some_and(|(ts, _, _)| ts.0 <= self.timestep)
+    /// Move a message whose activation timestep has arrived into its
+    /// destination's mailbox.
+    fn deliver_queued_message(&mut self, frame: AddressedMsg) {
+        let (_, dst_node, channel_handle) = self.channels.handles[frame.handle_ptr];
+        let mailbox = &mut self.mailboxes[frame.handle_ptr];
+        let channel = &mut self.channels.channels[channel_handle.0];
+
+        if channel
+            .r#type
+            .max_buffered()
+            .is_none_or(|n| n.get() > mailbox.len())
         {
-            let Some((_, _, frame)) = self.queued.pop() else {
-                return Err(RouterError::StepError);
-            };
-            let (_, dst_node, channel_handle) = self.channels.handles[frame.handle_ptr];
-            let mailbox = &mut self.mailboxes[frame.handle_ptr];
-            let channel = &mut self.channels.channels[channel_handle.0];
-
-            if channel
-                .r#type
-                .max_buffered()
-                .is_none_or(|n| n.get() > mailbox.len())
-            {
-                let was_empty = mailbox.is_empty();
-                mailbox.push_back(frame.msg);
-                if was_empty && !self.mailbox_active[frame.handle_ptr] {
-                    self.mailbox_active[frame.handle_ptr] = true;
-                    self.nonempty_mailboxes.push(frame.handle_ptr);
-                }
-
-                // Deduct RX channel energy cost on delivery
-                energy::EnergyManager::drain_rx(
-                    &mut self.channels.nodes,
-                    dst_node.0,
-                    &channel_handle,
-                );
-            } else {
-                warn!("Message dropped due to full queue!");
-                event!(
-                    target: "drop", Level::WARN,
-                    timestep = self.timestep,
-                    channel = channel_handle.0,
-                    node = frame.msg.src.0,
-                    msg_id = frame.msg.msg_id,
-                    reason = "buffer_full"
+            if let Some(expiration) = frame.msg.expiration {
+                self.deadlines.insert(
+                    expiration.get().saturating_add(1),
+                    Deadline::Expire(frame.handle_ptr),
                 );
             }
+            mailbox.push_back(frame.msg);
+            self.wake_pollers(frame.handle_ptr);
+
+            // Deduct RX channel energy cost on delivery
+            energy::EnergyManager::drain_rx(&mut self.channels.nodes, dst_node.0, &channel_handle);
+        } else {
+            warn!("Message dropped due to full queue!");
+            event!(
+                target: "drop", Level::WARN,
+                timestep = self.timestep,
+                channel = channel_handle.0,
+                node = frame.msg.src.0,
+                msg_id = frame.msg.msg_id,
+                reason = "buffer_full"
+            );
         }
-        Ok(())
     }
 }
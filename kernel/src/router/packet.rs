@@ -0,0 +1,106 @@
+//! packet.rs
+//! Received messages with their link metadata. A read of a channel's `packet`
+//! file returns one message behind a fixed header, so the payload and the
+//! signal quality it arrived with come from the same delivery:
+//!
+//! ```text
+//! 0   rssi in dBm (f32)
+//! 4   snr in dB (f32)
+//! 8   timestep the message was received in (u64)
+//! 16  message id, as in the trace (u64)
+//! 24  source node index, as in the trace (u32)
+//! 28  payload length before any truncation (u32)
+//! 32  payload
+//! ```
+//!
+//! All fields are little-endian.
+
+use config::ast::ChannelKind;
+
+use crate::router::{ReadKind, RouterError, RoutingServer, SignalInfo};
+
+/// Bytes before the payload in a `packet` file read.
+pub(crate) const PACKET_HEADER: usize = 32;
+
+/// Encode the header for a `len`-byte payload received as described by
+/// `info`.
+pub(crate) fn packet_header(info: &SignalInfo, len: usize) -> [u8; PACKET_HEADER] {
+    let mut header = [0; PACKET_HEADER];
+    header[0..4].copy_from_slice(&(info.rssi_dbm as f32).to_le_bytes());
+    header[4..8].copy_from_slice(&(info.snr_db as f32).to_le_bytes());
+    header[8..16].copy_from_slice(&info.timestep.to_le_bytes());
+    header[16..24].copy_from_slice(&info.msg_id.to_le_bytes());
+    let src = u32::try_from(info.src_node).unwrap_or(u32::MAX);
+    header[24..28].copy_from_slice(&src.to_le_bytes());
+    let len = u32::try_from(len).unwrap_or(u32::MAX);
+    header[28..32].copy_from_slice(&len.to_le_bytes());
+    header
+}
+
+impl RoutingServer {
+    /// Read from handle `index`'s `packet` file. Blocks under a receive
+    /// timeout exactly like a read of the channel file.
+    pub fn read_packet(&mut self, index: usize, req: fuse::ReadRequest) -> Result<(), RouterError> {
+        self.read_or_park(index, ReadKind::Packet, req)
+    }
+
+    /// Reply to `req` with the next message and its header, or zero bytes if
+    /// nothing was waiting. On exclusive channels a payload longer than the
+    /// read leaves its remainder for the next read of the channel file, as a
+    /// plain channel read would; the header's length field still gives the
+    /// full size.
+    pub(super) fn deliver_packet(&mut self, index: usize, req: fuse::ReadRequest) {
+        // A partially read message carries the metadata it was taken with.
+        let (offset, buf) = match self.unread_msg[index].take() {
+            Some(partial) => partial,
+            None => match self.take_msg(index) {
+                Some(buf) => (0, buf),
+                None => {
+                    req.reply.data(&[]);
+                    return;
+                }
+            },
+        };
+        let payload = &buf[offset..];
+        let room = (req.size as usize).saturating_sub(PACKET_HEADER);
+        let n = payload.len().min(room);
+        let mut out = Vec::with_capacity(PACKET_HEADER + n);
+        out.extend_from_slice(&packet_header(&self.signal_info[index], payload.len()));
+        out.extend_from_slice(&payload[..n]);
+        let (_, _, channel_handle) = self.channels.handles[index];
+        let incremental = matches!(
+            self.channels.channels[channel_handle.0].r#type.kind,
+            ChannelKind::Exclusive { .. }
+        );
+        Self::reply_capped(req.reply, req.size, &out);
+        if incremental && n < payload.len() {
+            self.unread_msg[index] = Some((offset + n, buf));
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn header_layout() {
+        let info = SignalInfo {
+            rssi_dbm: -97.5,
+            snr_db: 7.25,
+            src_node: 3,
+            msg_id: 0x0102_0304_0506_0708,
+            timestep: 42,
+        };
+        let header = packet_header(&info, 200);
+        let f32_at = |i: usize| f32::from_le_bytes(header[i..i + 4].try_into().unwrap());
+        let u64_at = |i: usize| u64::from_le_bytes(header[i..i + 8].try_into().unwrap());
+        let u32_at = |i: usize| u32::from_le_bytes(header[i..i + 4].try_into().unwrap());
+        assert_eq!(f32_at(0), -97.5);
+        assert_eq!(f32_at(4), 7.25);
+        assert_eq!(u64_at(8), 42);
+        assert_eq!(u64_at(16), info.msg_id);
+        assert_eq!(u32_at(24), 3);
+        assert_eq!(u32_at(28), 200);
+    }
+}
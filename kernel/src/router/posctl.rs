@@ -67,6 +67,7 @@ impl RoutingServer {
         let node = &mut self.channels.nodes[node_index];
         if let Some(new_point) = node.motion.current_point(timestep, us_per_step) {
             node.position.point = new_point;
+            self.routes.update_position(node_index, &node.position);
         }
     }
 
@@ -81,6 +82,7 @@ impl RoutingServer {
                 continue;
             };
             node.position.point = new_point;
+            self.routes.update_position(node_idx, &node.position);
             Self::emit_movement_event(node_idx, node, timestep);
         }
     }
@@ -129,6 +131,9 @@ impl RoutingServer {
     /// Write handler for `ctl.pos/x/y/z/az/el/roll` (absolute set).
     /// Resets the motion pattern to `Static`.
     pub fn write_pos(&mut self, node_index: usize, msg: fuse::Message) -> Result<(), RouterError> {
+        // Writes deferred to the end of the timestep were made from where
+        // the node was before this move.
+        self.route_pending();
         // Snapshot any in-progress motion before overriding.
         self.apply_motion(node_index);
         let s = String::from_utf8_lossy(&msg.data);
@@ -152,6 +157,7 @@ impl RoutingServer {
             _ => return Err(RouterError::InvalidString(msg.data)),
         }
         node.motion = MotionPattern::Static;
+        self.routes.update_position(node_index, &node.position);
         self.mark_dynamic(node_index);
         let timestep = self.timestep;
         let node = &self.channels.nodes[node_index];
@@ -167,6 +173,7 @@ impl RoutingServer {
         node_index: usize,
         msg: fuse::Message,
     ) -> Result<(), RouterError> {
+        self.route_pending();
         self.apply_motion(node_index);
         let s = String::from_utf8_lossy(&msg.data);
         let val: f64 = s
@@ -187,6 +194,7 @@ impl RoutingServer {
             _ => return Err(RouterError::InvalidString(msg.data)),
         }
         node.motion = MotionPattern::Static;
+        self.routes.update_position(node_index, &node.position);
         self.mark_dynamic(node_index);
         let timestep = self.timestep;
         let node = &self.channels.nodes[node_index];
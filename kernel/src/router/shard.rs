@@ -0,0 +1,315 @@
+//! shard.rs
+//! Partitioning of the router's link simulation across worker threads.
+//!
+//! Channel `i` belongs to shard `i % shards`. A shard owns everything link
+//! simulation on its channels mutates: the random stream and the link cache.
+//! Mailboxes and queued messages are per handle, and every handle is on a
+//! single channel, so they are partitioned already and stay with the router.
+//!
+//! With one shard, writes are routed as they arrive, exactly as an unsharded
+//! router did. With more, writes wait until the end of the timestep and are
+//! routed shard by shard, each one alone on its random stream. Shards with
+//! enough work are routed on threads of their own. Their results are merged
+//! in shard order, so a seed and shard count give the same run whether or
+//! not any thread was spawned.
+//!
+//! Only routing is sharded. Shared channels run their link simulation when a
+//! receiver reads, to model collisions among whatever is in its mailbox at
+//! that moment; that work draws from the channel's shard but runs on the
+//! router thread, in the order reads arrive.
+
+use std::num::NonZeroUsize;
+use std::thread;
+
+use rand::{Rng, SeedableRng};
+
+use super::*;
+use crate::router::link_simulation::CachedLink;
+
+/// Candidate destinations a shard must have queued up before it is routed
+/// on a thread of its own; spawning one costs about as much as simulating
+/// this many links.
+const PARALLEL_MIN_ROUTES: usize = 4096;
+
+#[derive(Debug)]
+pub(crate) struct Shard {
+    /// Random stream for link simulation on this shard's channels.
+    pub(super) rng: ChaCha12Rng,
+    /// Cached deterministic link parameters keyed by
+    /// `(src_node_idx, dst_node_idx, channel_idx)`. Only holds entries for
+    /// pairs where both endpoints are still Static; on Static->Dynamic
+    /// transition we evict any entry containing the node.
+    pub(super) link_cache: HashMap<(usize, usize, usize), CachedLink>,
+    /// Writes waiting to be routed at the end of the timestep, in arrival
+    /// order.
+    pending: Vec<PendingWrite>,
+}
+
+#[derive(Debug)]
+pub(super) struct PendingWrite {
+    pub(super) src: NodeHandle,
+    pub(super) channel: ChannelHandle,
+    pub(super) data: Vec<u8>,
+    pub(super) msg_id: u64,
+}
+
+/// One destination a write reached, as link simulation left it. Holds no
+/// payload unless bit errors changed it, so routing stays free of the
+/// router's `Rc`s and can run on any thread.
+#[derive(Debug)]
+pub(super) struct Routed {
+    pub(super) handle_ptr: usize,
+    pub(super) flipped: Option<Vec<u8>>,
+    pub(super) bit_errors: bool,
+    pub(super) rssi_dbm: f64,
+    pub(super) snr_db: f64,
+    pub(super) becomes_active_at: Timestep,
+    pub(super) expiration: Option<NonZeroU64>,
+}
+
+/// Router state link simulation reads but never changes.
+pub(super) struct RouteCtx<'a> {
+    pub(super) channels: &'a ResolvedChannels,
+    pub(super) routes: &'a RoutingTable,
+    pub(super) ts_config: TimestepConfig,
+    pub(super) timestep: Timestep,
+}
+
+impl Shard {
+    /// Split `rng` into `count` shards. A single shard keeps `rng` as is, so
+    /// it draws exactly what an unsharded router would; otherwise every
+    /// shard is seeded from `rng` in turn.
+    pub(super) fn split(mut rng: ChaCha12Rng, count: NonZeroUsize) -> Vec<Self> {
+        if count.get() == 1 {
+            return vec![Self::new(rng)];
+        }
+        (0..count.get())
+            .map(|_| Self::new(ChaCha12Rng::seed_from_u64(rng.random())))
+            .collect()
+    }
+
+    fn new(rng: ChaCha12Rng) -> Self {
+        Self {
+            rng,
+            link_cache: HashMap::new(),
+            pending: Vec::new(),
+        }
+    }
+
+    /// Run link simulation for a write of `msg` from `src` to every
+    /// destination on `channel` it could reach.
+    ///
+    /// For shared channels, the raw message bytes are queued as-is; link
+    /// simulation (packet loss, bit errors) runs later at delivery time so
+    /// that collisions can be modelled.
+    ///
+    /// For exclusive channels, link simulation runs here at queue time and
+    /// only surviving messages enter the queue.
+    pub(super) fn route(
+        &mut self,
+        ctx: &RouteCtx,
+        src: NodeHandle,
+        channel_handle: ChannelHandle,
+        msg: &[u8],
+    ) -> Vec<Routed> {
+        let sz: u64 = msg.len().try_into().expect("usize fits u64");
+        let channels = ctx.channels;
+        let channel = &channels.channels[channel_handle.0];
+        let is_shared = matches!(channel.r#type.kind, ChannelKind::Shared);
+
+        let routes = ctx.routes.entries[channel_handle.0].candidates(channels, channel_handle, src);
+        let mut routed = Vec::with_capacity(routes.len());
+        for route in routes.iter() {
+            let handle_ptr = route.handle_ptr;
+            let dst_node = channels.handles[handle_ptr].1;
+            if dst_node == src && !channel.r#type.delivers_to_self() {
+                continue;
+            }
+
+            debug!(
+                "Delivering from {} to {}",
+                &channels.node_names[src.0], &channels.node_names[dst_node.0]
+            );
+
+            let link = RoutingServer::lookup_or_compute_link(
+                &mut self.link_cache,
+                &channels.nodes,
+                &channels.channels,
+                src.0,
+                dst_node.0,
+                channel_handle.0,
+            );
+
+            // For exclusive channels, run link simulation now; drop the
+            // message if it doesn't survive.
+            let (flipped, bit_errors, rssi_dbm, snr_db) = if is_shared {
+                (None, false, 0.0, 0.0)
+            } else {
+                match RoutingServer::send_through_channel_cached(
+                    channel,
+                    Cow::from(msg),
+                    &link,
+                    &mut self.rng,
+                ) {
+                    Some((buf, be, rssi, snr)) => {
+                        let flipped = match buf {
+                            Cow::Borrowed(_) => None,
+                            Cow::Owned(b) => Some(b),
+                        };
+                        (flipped, be, rssi, snr)
+                    }
+                    None => continue,
+                }
+            };
+
+            let (becomes_active_at, expiration) = RoutingServer::message_timesteps(
+                channel,
+                sz,
+                ctx.ts_config,
+                ctx.timestep,
+                link.distance,
+                link.distance_unit,
+            );
+            routed.push(Routed {
+                handle_ptr,
+                flipped,
+                bit_errors,
+                rssi_dbm,
+                snr_db,
+                becomes_active_at,
+                expiration,
+            });
+        }
+        routed
+    }
+
+    pub(super) fn defer(&mut self, write: PendingWrite) {
+        self.pending.push(write);
+    }
+
+    /// Route every deferred write, in arrival order.
+    fn route_pending(&mut self, ctx: &RouteCtx) -> Vec<(PendingWrite, Vec<Routed>)> {
+        let pending = std::mem::take(&mut self.pending);
+        pending
+            .into_iter()
+            .map(|write| {
+                let routed = self.route(ctx, write.src, write.channel, &write.data);
+                (write, routed)
+            })
+            .collect()
+    }
+
+    /// Upper bound on the destinations the deferred writes fan out to.
+    fn pending_routes(&self, routes: &RoutingTable) -> usize {
+        self.pending
+            .iter()
+            .map(|w| routes.entries[w.channel.0].route_count(w.src))
+            .sum()
+    }
+}
+
+impl RoutingServer {
+    pub(super) fn shard_of(&self, channel: ChannelHandle) -> usize {
+        channel.0 % self.shards.len()
+    }
+
+    /// Route the writes deferred during the timestep that is ending. Shards
+    /// with enough candidate destinations run on threads of their own.
+    pub(super) fn route_pending(&mut self) {
+        self.route_pending_over(PARALLEL_MIN_ROUTES);
+    }
+
+    /// `route_pending`, spawning a thread for every shard with at least
+    /// `min_routes` candidate destinations.
+    pub(super) fn route_pending_over(&mut self, min_routes: usize) {
+        if self.shards.iter().all(|shard| shard.pending.is_empty()) {
+            return;
+        }
+        let ctx = RouteCtx {
+            channels: &self.channels,
+            routes: &self.routes,
+            ts_config: self.ts_config,
+            timestep: self.timestep,
+        };
+        let routed: Vec<_> = thread::scope(|scope| {
+            let mut workers = Vec::new();
+            let mut routed: Vec<_> = self
+                .shards
+                .iter_mut()
+                .map(|shard| {
+                    if shard.pending_routes(ctx.routes) >= min_routes {
+                        let ctx = &ctx;
+                        workers.push(scope.spawn(move || shard.route_pending(ctx)));
+                        None
+                    } else {
+                        Some(shard.route_pending(&ctx))
+                    }
+                })
+                .collect();
+            let mut workers = workers.into_iter();
+            for slot in routed.iter_mut().filter(|slot| slot.is_none()) {
+                let worker = workers.next().expect("one worker per spawned shard");
+                *slot = Some(worker.join().expect("router shard panicked"));
+            }
+            routed
+        });
+        for (write, dests) in routed.into_iter().flatten().flatten() {
+            self.enqueue_routed(write.src, write.data, write.msg_id, dests);
+        }
+    }
+
+    /// Queue `msg` for every destination it was routed to. Every recipient
+    /// shares one payload; exclusive destinations only get their own copy
+    /// when link simulation flipped bits in it.
+    pub(super) fn enqueue_routed(
+        &mut self,
+        src: NodeHandle,
+        msg: Vec<u8>,
+        msg_id: u64,
+        routed: Vec<Routed>,
+    ) {
+        let payload: Rc<[u8]> = Rc::from(msg);
+        for dest in routed {
+            let buf = dest.flipped.map_or_else(|| Rc::clone(&payload), Rc::from);
+            let msg = AddressedMsg {
+                handle_ptr: dest.handle_ptr,
+                msg: QueuedMessage {
+                    src,
+                    buf,
+                    expiration: dest.expiration,
+                    bit_errors: dest.bit_errors,
+                    msg_id,
+                    rssi_dbm: dest.rssi_dbm,
+                    snr_db: dest.snr_db,
+                },
+            };
+            self.deadlines
+                .insert(dest.becomes_active_at, Deadline::Deliver(msg));
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn draws(shard: &mut Shard) -> [u64; 4] {
+        std::array::from_fn(|_| shard.rng.random())
+    }
+
+    #[test]
+    fn single_shard_keeps_the_stream_and_splits_are_reproducible() {
+        let mut unsharded = Shard::new(ChaCha12Rng::seed_from_u64(7));
+        let mut single = Shard::split(ChaCha12Rng::seed_from_u64(7), NonZeroUsize::MIN);
+        assert_eq!(single.len(), 1);
+        assert_eq!(draws(&mut single[0]), draws(&mut unsharded));
+
+        let three = NonZeroUsize::new(3).unwrap();
+        let mut a = Shard::split(ChaCha12Rng::seed_from_u64(7), three);
+        let mut b = Shard::split(ChaCha12Rng::seed_from_u64(7), three);
+        let streams: Vec<_> = a.iter_mut().map(draws).collect();
+        assert_eq!(streams, b.iter_mut().map(draws).collect::<Vec<_>>());
+        assert_ne!(streams[0], streams[1]);
+        assert_ne!(streams[1], streams[2]);
+    }
+}
@@ -0,0 +1,521 @@
+//! shm.rs
+//! Shared-memory ring transport for channel files. A protocol that reads its
+//! channel's `shm` file gets the path of a file laid out as below, which it
+//! maps with `MAP_SHARED` to exchange messages with the router without a
+//! FUSE round-trip per message. `nexus::ShmChannel` in
+//! `examples/arduino/common/include/ShmChannel.h` is the C++ side and must be
+//! kept in sync with these offsets.
+//!
+//! ```text
+//! 0     magic "NXSH" (u32), version (u32), ring bytes (u32), max message (u32)
+//! 64    rx head (u64)    written by the router
+//! 128   rx tail (u64)    written by the protocol
+//! 192   tx head (u64)    written by the protocol
+//! 256   tx tail (u64)    written by the router
+//! 320   rx doorbell (u32 futex word), bumped after the router pushes
+//! 4096  rx ring data
+//! 4096 + RING_BYTES     tx ring data
+//! ```
+//!
+//! Each ring is single-producer/single-consumer. Records are a little-endian
+//! u32 length followed by the payload and may wrap around the end of the data
+//! region. Head and tail are free-running byte counters.
+
+use std::fs::{self, OpenOptions};
+use std::io;
+use std::os::fd::AsRawFd;
+use std::os::unix::fs::OpenOptionsExt;
+use std::path::{Path, PathBuf};
+use std::ptr;
+use std::sync::atomic::{AtomicU32, AtomicU64, Ordering};
+
+use tracing::warn;
+
+use crate::router::RoutingServer;
+
+pub(crate) const SHM_MAGIC: u32 = u32::from_le_bytes(*b"NXSH");
+pub(crate) const SHM_VERSION: u32 = 1;
+/// Size of each ring's data region. A power of two so positions wrap with a
+/// mask.
+pub(crate) const RING_BYTES: usize = 1 << 16;
+const HEADER_BYTES: usize = 4096;
+const SHM_LEN: usize = HEADER_BYTES + 2 * RING_BYTES;
+const LEN_PREFIX: usize = size_of::<u32>();
+
+// Each control word sits on its own cache line so the producer and consumer
+// of a ring never write to the same line.
+const OFF_MAGIC: usize = 0;
+const OFF_VERSION: usize = 4;
+const OFF_RING_BYTES: usize = 8;
+const OFF_MAX_MSG: usize = 12;
+const OFF_RX_HEAD: usize = 64;
+const OFF_RX_TAIL: usize = 128;
+const OFF_TX_HEAD: usize = 192;
+const OFF_TX_TAIL: usize = 256;
+const OFF_RX_DOORBELL: usize = 320;
+
+/// One direction of the mapping. Only valid while the owning `ShmChannel`
+/// keeps the region mapped.
+#[derive(Debug)]
+struct Ring {
+    head: *const AtomicU64,
+    tail: *const AtomicU64,
+    data: *mut u8,
+}
+
+impl Ring {
+    /// # Safety
+    /// `base` must point to a live mapping of at least `SHM_LEN` bytes.
+    unsafe fn new(base: *mut u8, head: usize, tail: usize, data: usize) -> Self {
+        unsafe {
+            Self {
+                head: base.add(head).cast(),
+                tail: base.add(tail).cast(),
+                data: base.add(data),
+            }
+        }
+    }
+
+    fn head(&self) -> &AtomicU64 {
+        unsafe { &*self.head }
+    }
+
+    fn tail(&self) -> &AtomicU64 {
+        unsafe { &*self.tail }
+    }
+
+    /// Bytes a producer can still write.
+    fn free(&self) -> usize {
+        let used = self
+            .head()
+            .load(Ordering::Relaxed)
+            .wrapping_sub(self.tail().load(Ordering::Acquire));
+        RING_BYTES.saturating_sub(used as usize)
+    }
+
+    /// Producer side. Returns `false` without writing if `msg` does not fit.
+    fn push(&self, msg: &[u8]) -> bool {
+        let need = LEN_PREFIX + msg.len();
+        if need > self.free() {
+            return false;
+        }
+        let head = self.head().load(Ordering::Relaxed);
+        let len = u32::try_from(msg.len()).expect("ring records fit u32");
+        self.copy_in(head, &len.to_le_bytes());
+        self.copy_in(head.wrapping_add(LEN_PREFIX as u64), msg);
+        self.head()
+            .store(head.wrapping_add(need as u64), Ordering::Release);
+        true
+    }
+
+    /// Consumer side, for records of at most `max_len` payload bytes. A head
+    /// more than a ring ahead of the tail, or a record longer than `max_len`
+    /// or running past the head, can only come from a misbehaving peer: the
+    /// record is dropped and the consumer resynchronises by emptying the
+    /// ring.
+    fn pop(&self, max_len: usize) -> Option<Vec<u8>> {
+        let tail = self.tail().load(Ordering::Relaxed);
+        let head = self.head().load(Ordering::Acquire);
+        let available = head.wrapping_sub(tail);
+        if available > RING_BYTES as u64 {
+            warn!("Shared-memory ring head is {available} bytes past its tail; resetting");
+            self.tail().store(head, Ordering::Release);
+            return None;
+        }
+        let available = available as usize;
+        if available < LEN_PREFIX {
+            return None;
+        }
+        let mut len = [0; LEN_PREFIX];
+        self.copy_out(tail, &mut len);
+        let len = u32::from_le_bytes(len) as usize;
+        if len > max_len || LEN_PREFIX + len > available {
+            warn!("Dropping malformed {len}-byte shared-memory record");
+            self.tail().store(head, Ordering::Release);
+            return None;
+        }
+        let mut msg = vec![0; len];
+        self.copy_out(tail.wrapping_add(LEN_PREFIX as u64), &mut msg);
+        self.tail().store(
+            tail.wrapping_add((LEN_PREFIX + len) as u64),
+            Ordering::Release,
+        );
+        Some(msg)
+    }
+
+    fn copy_in(&self, pos: u64, bytes: &[u8]) {
+        debug_assert!(bytes.len() <= RING_BYTES);
+        let start = pos as usize & (RING_BYTES - 1);
+        let first = bytes.len().min(RING_BYTES - start);
+        unsafe {
+            ptr::copy_nonoverlapping(bytes.as_ptr(), self.data.add(start), first);
+            ptr::copy_nonoverlapping(bytes[first..].as_ptr(), self.data, bytes.len() - first);
+        }
+    }
+
+    fn copy_out(&self, pos: u64, bytes: &mut [u8]) {
+        debug_assert!(bytes.len() <= RING_BYTES);
+        let start = pos as usize & (RING_BYTES - 1);
+        let first = bytes.len().min(RING_BYTES - start);
+        let rest = bytes.len() - first;
+        unsafe {
+            ptr::copy_nonoverlapping(self.data.add(start), bytes.as_mut_ptr(), first);
+            ptr::copy_nonoverlapping(self.data, bytes[first..].as_mut_ptr(), rest);
+        }
+    }
+}
+
+/// Router-side handle on one protocol's shared-memory channel. The backing
+/// file is unlinked when this is dropped.
+#[derive(Debug)]
+pub(crate) struct ShmChannel {
+    base: *mut u8,
+    path: PathBuf,
+    /// Largest payload the channel carries; longer transmit records are
+    /// dropped.
+    max_msg: usize,
+    rx: Ring,
+    tx: Ring,
+}
+
+impl ShmChannel {
+    /// Create and map a fresh ring file at `path`, advertising `max_msg` as
+    /// the largest payload the channel carries.
+    pub fn create(path: PathBuf, max_msg: usize) -> io::Result<Self> {
+        let base = map_new_file(&path, SHM_LEN)?;
+        // The file is zero-filled, so both rings start empty. Magic goes last
+        // so a peer that sees it also sees the rest of the header.
+        let advertised = u32::try_from(max_msg).unwrap_or(u32::MAX);
+        unsafe {
+            base.add(OFF_VERSION).cast::<u32>().write(SHM_VERSION);
+            base.add(OFF_RING_BYTES)
+                .cast::<u32>()
+                .write(RING_BYTES as u32);
+            base.add(OFF_MAX_MSG).cast::<u32>().write(advertised);
+            (*base.add(OFF_MAGIC).cast::<AtomicU32>()).store(SHM_MAGIC, Ordering::Release);
+        }
+        let (rx, tx) = unsafe {
+            (
+                Ring::new(base, OFF_RX_HEAD, OFF_RX_TAIL, HEADER_BYTES),
+                Ring::new(base, OFF_TX_HEAD, OFF_TX_TAIL, HEADER_BYTES + RING_BYTES),
+            )
+        };
+        Ok(Self {
+            base,
+            path,
+            max_msg,
+            rx,
+            tx,
+        })
+    }
+
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// Space left in the receive ring, in payload bytes.
+    pub fn rx_free(&self) -> usize {
+        self.rx.free().saturating_sub(LEN_PREFIX)
+    }
+
+    /// Queue a message for the protocol. Returns `false` if the ring is full.
+    pub fn push_rx(&mut self, msg: &[u8]) -> bool {
+        self.rx.push(msg)
+    }
+
+    /// Take the next message the protocol transmitted, if any.
+    pub fn pop_tx(&mut self) -> Option<Vec<u8>> {
+        self.tx.pop(self.max_msg)
+    }
+
+    /// Wake a protocol blocked on the receive doorbell.
+    pub fn ring_doorbell(&self) {
+        let bell = unsafe { &*self.base.add(OFF_RX_DOORBELL).cast::<AtomicU32>() };
+        bell.fetch_add(1, Ordering::Release);
+        // Shared (non-private) futex so waiters in other processes wake too.
+        unsafe {
+            libc::syscall(
+                libc::SYS_futex,
+                bell.as_ptr(),
+                libc::FUTEX_WAKE,
+                i32::MAX,
+                ptr::null::<libc::timespec>(),
+            );
+        }
+    }
+}
+
+impl Drop for ShmChannel {
+    fn drop(&mut self) {
+        unsafe {
+            libc::munmap(self.base.cast(), SHM_LEN);
+        }
+        let _ = fs::remove_file(&self.path);
+    }
+}
+
+/// Create a zero-filled file of `len` bytes at `path` and map it shared and
+/// writable. The caller owns the mapping and the file; on failure neither is
+/// left behind.
+pub(crate) fn map_new_file(path: &Path, len: usize) -> io::Result<*mut u8> {
+    let file = OpenOptions::new()
+        .read(true)
+        .write(true)
+        .create_new(true)
+        .mode(0o600)
+        .open(path)?;
+    file.set_len(len as u64)?;
+    let base = unsafe {
+        libc::mmap(
+            ptr::null_mut(),
+            len,
+            libc::PROT_READ | libc::PROT_WRITE,
+            libc::MAP_SHARED,
+            file.as_raw_fd(),
+            0,
+        )
+    };
+    if base == libc::MAP_FAILED {
+        let err = io::Error::last_os_error();
+        let _ = fs::remove_file(path);
+        return Err(err);
+    }
+    Ok(base.cast())
+}
+
+/// Directory shared-memory files are created in: tmpfs when available.
+pub(crate) fn shm_dir() -> PathBuf {
+    let dev_shm = Path::new("/dev/shm");
+    if dev_shm.is_dir() {
+        dev_shm.to_path_buf()
+    } else {
+        std::env::temp_dir()
+    }
+}
+
+impl RoutingServer {
+    /// Reply to a read of a channel's `shm` file with the path of its ring
+    /// file, creating the rings on first use. Failures are logged and the
+    /// read fails with EIO; the plain channel file keeps working.
+    pub fn open_shm_channel(&mut self, index: usize, req: fuse::ReadRequest) {
+        if self.shm_channels[index].is_none() {
+            let (pid, _, channel_handle) = self.channels.handles[index];
+            let max_msg = self.channels.channels[channel_handle.0]
+                .r#type
+                .max_size
+                .get();
+            let name = format!("nexus-{}-{pid}-{index}", std::process::id());
+            match ShmChannel::create(shm_dir().join(name), max_msg) {
+                Ok(chan) => {
+                    self.shm_channels[index] = Some(chan);
+                    self.shm_handles.push(index);
+                }
+                Err(e) => {
+                    warn!("Could not create shared-memory channel: {e}");
+                    drop(req.reply);
+                    return;
+                }
+            }
+        }
+        let path = self.shm_channels[index]
+            .as_ref()
+            .expect("created above")
+            .path()
+            .as_os_str()
+            .as_encoded_bytes();
+        Self::reply_capped(req.reply, req.size, path);
+    }
+
+    /// Publish everything protocols pushed to their transmit rings, exactly as
+    /// if each message had been written to the channel file. Records the
+    /// channel cannot carry are dropped, never fatal.
+    pub(super) fn drain_shm_tx(&mut self) {
+        for i in 0..self.shm_handles.len() {
+            let index = self.shm_handles[i];
+            let (pid, node, channel_handle) = self.channels.handles[index];
+            let can_publish = self.channels.channels[channel_handle.0]
+                .publishers
+                .contains(&node);
+            while let Some(data) = self.shm_channels[index]
+                .as_mut()
+                .and_then(ShmChannel::pop_tx)
+            {
+                if !can_publish {
+                    warn!("Dropping shared-memory write to a channel the node cannot publish to");
+                    continue;
+                }
+                let msg = fuse::Message {
+                    id: (pid, String::new()),
+                    data,
+                };
+                // Whatever the peer wrote, one bad record must not end the
+                // simulation.
+                if let Err(e) = self.write_channel_file(index, msg) {
+                    warn!("Dropping shared-memory write: {e}");
+                }
+            }
+        }
+    }
+
+    /// Move deliverable messages from mailboxes into receive rings and ring
+    /// the doorbell of every ring that got something.
+    pub(super) fn fill_shm_rx(&mut self) {
+        for i in 0..self.shm_handles.len() {
+            let index = self.shm_handles[i];
+            let (_, _, channel_handle) = self.channels.handles[index];
+            let max_size = self.channels.channels[channel_handle.0]
+                .r#type
+                .max_size
+                .get();
+            let mut pushed = false;
+            // Finish a message partially read through the channel file first.
+            if let Some((offset, buf)) = self.unread_msg[index].take() {
+                let chan = self.shm_channels[index].as_mut().expect("live handle");
+                if chan.push_rx(&buf[offset..]) {
+                    pushed = true;
+                } else {
+                    self.unread_msg[index] = Some((offset, buf));
+                }
+            }
+            // Only take a message once the ring is sure to have room for it.
+            // Stop when a take leaves the mailbox unchanged (collisions on a
+            // shared medium are re-read until they expire).
+            while self.unread_msg[index].is_none()
+                && !self.mailboxes[index].is_empty()
+                && self.shm_channels[index]
+                    .as_ref()
+                    .is_some_and(|chan| chan.rx_free() >= max_size)
+            {
+                let before = self.mailboxes[index].len();
+                if let Some(buf) = self.take_msg(index) {
+                    let chan = self.shm_channels[index].as_mut().expect("live handle");
+                    pushed |= chan.push_rx(&buf);
+                }
+                if self.mailboxes[index].len() >= before {
+                    break;
+                }
+            }
+            if pushed {
+                self.shm_channels[index]
+                    .as_ref()
+                    .expect("live handle")
+                    .ring_doorbell();
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn make_channel(name: &str) -> ShmChannel {
+        let path =
+            std::env::temp_dir().join(format!("nexus-shm-test-{}-{name}", std::process::id()));
+        let _ = fs::remove_file(&path);
+        ShmChannel::create(path, 255).unwrap()
+    }
+
+    #[test]
+    fn header_is_published() {
+        let chan = make_channel("header");
+        let bytes = fs::read(chan.path()).unwrap();
+        assert_eq!(bytes.len(), SHM_LEN);
+        assert_eq!(&bytes[OFF_MAGIC..OFF_MAGIC + 4], b"NXSH");
+        assert_eq!(bytes[OFF_VERSION], SHM_VERSION as u8);
+        assert_eq!(bytes[OFF_MAX_MSG], 255);
+    }
+
+    #[test]
+    fn rings_roundtrip_in_order() {
+        let mut chan = make_channel("order");
+        // Protocol side of the tx ring is the producer.
+        assert!(chan.tx.push(b"one"));
+        assert!(chan.tx.push(b""));
+        assert!(chan.tx.push(b"three"));
+        assert_eq!(chan.pop_tx().as_deref(), Some(&b"one"[..]));
+        assert_eq!(chan.pop_tx().as_deref(), Some(&b""[..]));
+        assert_eq!(chan.pop_tx().as_deref(), Some(&b"three"[..]));
+        assert_eq!(chan.pop_tx(), None);
+
+        assert!(chan.push_rx(b"hello"));
+        assert_eq!(chan.rx.pop(RING_BYTES).as_deref(), Some(&b"hello"[..]));
+        assert_eq!(chan.rx.pop(RING_BYTES), None);
+    }
+
+    #[test]
+    fn full_ring_rejects_then_wraps() {
+        let mut chan = make_channel("wrap");
+        let msg = vec![0xAB; 1000];
+        let mut pushed = 0;
+        while chan.push_rx(&msg) {
+            pushed += 1;
+        }
+        assert_eq!(pushed, RING_BYTES / (LEN_PREFIX + msg.len()));
+        assert!(chan.rx_free() < msg.len());
+
+        // Draining a few frees room; the next records straddle the end of
+        // the data region.
+        for _ in 0..3 {
+            assert_eq!(chan.rx.pop(RING_BYTES).unwrap(), msg);
+        }
+        let marker: Vec<u8> = (0..=255).collect();
+        assert!(chan.push_rx(&marker));
+        while let Some(got) = chan.rx.pop(RING_BYTES) {
+            if got.len() != msg.len() {
+                assert_eq!(got, marker);
+            }
+        }
+    }
+
+    #[test]
+    fn corrupt_length_empties_ring() {
+        let mut chan = make_channel("corrupt");
+        assert!(chan.tx.push(b"abc"));
+        // Forge a length far past the head.
+        chan.tx.copy_in(0, &u32::MAX.to_le_bytes());
+        assert_eq!(chan.pop_tx(), None);
+        assert_eq!(chan.pop_tx(), None);
+        assert!(chan.tx.push(b"ok"));
+        assert_eq!(chan.pop_tx().as_deref(), Some(&b"ok"[..]));
+    }
+
+    #[test]
+    fn oversized_record_is_dropped() {
+        let mut chan = make_channel("oversized");
+        // Consistent with the head, but longer than the channel's max_size.
+        assert!(chan.tx.push(&[0xAB; 256]));
+        assert!(chan.tx.push(b"lost"));
+        assert_eq!(chan.pop_tx(), None);
+        assert_eq!(chan.pop_tx(), None);
+        assert!(chan.tx.push(&[0xCD; 255]));
+        assert_eq!(chan.pop_tx().unwrap(), [0xCD; 255]);
+    }
+
+    #[test]
+    fn runaway_head_empties_ring() {
+        let mut chan = make_channel("runaway");
+        assert!(chan.tx.push(b"abc"));
+        // A head more than a ring ahead would have `copy_out` read past the
+        // data region.
+        chan.tx
+            .head()
+            .store(2 * RING_BYTES as u64, Ordering::Release);
+        assert_eq!(chan.pop_tx(), None);
+        assert_eq!(
+            chan.tx.tail().load(Ordering::Acquire),
+            2 * RING_BYTES as u64
+        );
+        assert!(chan.tx.push(b"ok"));
+        assert_eq!(chan.pop_tx().as_deref(), Some(&b"ok"[..]));
+    }
+
+    #[test]
+    fn drop_unlinks_file() {
+        let chan = make_channel("unlink");
+        let path = chan.path().to_path_buf();
+        assert!(path.exists());
+        drop(chan);
+        assert!(!path.exists());
+    }
+}
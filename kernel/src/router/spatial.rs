@@ -0,0 +1,199 @@
+//! spatial.rs
+//! Uniform grid over node positions, used to cull broadcast destinations
+//! that are out of a channel's reach.
+//!
+//! Cells are as wide as the channel medium's maximum range, so every
+//! destination a transmission could reach lies in the 27 cells around the
+//! sender's. The grid holds handle indices rather than nodes so a query
+//! yields the same entries `Route::outgoing` would, minus those too far
+//! away to ever receive.
+
+use std::collections::HashMap;
+
+use config::ast::Position;
+use config::units::DecimalScaled;
+
+type Cell = [i64; 3];
+
+/// Channels with fewer endpoints than this keep the flat route list; below
+/// it the per-query bookkeeping costs more than the link math it saves.
+pub(crate) const SPATIAL_INDEX_MIN_HANDLES: usize = 32;
+
+#[derive(Debug)]
+pub(crate) struct SpatialGrid {
+    /// Cell edge length in meters.
+    cell_m: f64,
+    /// Handle indices of the endpoints inside each occupied cell.
+    cells: HashMap<Cell, Vec<usize>>,
+    /// Cell each indexed node is filed under, and its handles on the channel.
+    nodes: HashMap<usize, (Cell, Vec<usize>)>,
+}
+
+impl SpatialGrid {
+    /// Index `handles`, given as `(handle_ptr, node_idx, position)`, into
+    /// cells `range_m` wide.
+    pub(crate) fn new<'a>(
+        range_m: f64,
+        handles: impl IntoIterator<Item = (usize, usize, &'a Position)>,
+    ) -> Self {
+        // Pad the cells so a destination exactly at range can't round into
+        // a cell two away; a zero range would make every position its own.
+        let mut grid = Self {
+            cell_m: (range_m * (1.0 + 1e-9)).max(f64::EPSILON),
+            cells: HashMap::new(),
+            nodes: HashMap::new(),
+        };
+        for (handle_ptr, node, position) in handles {
+            let cell = grid.cell(position);
+            grid.cells.entry(cell).or_default().push(handle_ptr);
+            let entry = grid.nodes.entry(node).or_insert_with(|| (cell, vec![]));
+            entry.1.push(handle_ptr);
+        }
+        grid
+    }
+
+    /// Re-file `node` after it moved. Cheap when it stayed in its cell.
+    pub(crate) fn update(&mut self, node: usize, position: &Position) {
+        let cell = self.cell(position);
+        let Some((old, handles)) = self.nodes.get_mut(&node) else {
+            return;
+        };
+        if *old == cell {
+            return;
+        }
+        if let Some(members) = self.cells.get_mut(old) {
+            members.retain(|h| !handles.contains(h));
+            if members.is_empty() {
+                self.cells.remove(old);
+            }
+        }
+        self.cells
+            .entry(cell)
+            .or_default()
+            .extend(handles.iter().copied());
+        *old = cell;
+    }
+
+    /// Every handle that could be in range of a sender at `position`, in
+    /// ascending handle order so callers visit them in route order.
+    pub(crate) fn near(&self, position: &Position) -> Vec<usize> {
+        let [x, y, z] = self.cell(position);
+        let mut found = vec![];
+        for dx in -1..=1 {
+            for dy in -1..=1 {
+                for dz in -1..=1 {
+                    let cell = [
+                        x.saturating_add(dx),
+                        y.saturating_add(dy),
+                        z.saturating_add(dz),
+                    ];
+                    if let Some(members) = self.cells.get(&cell) {
+                        found.extend_from_slice(members);
+                    }
+                }
+            }
+        }
+        found.sort_unstable();
+        found
+    }
+
+    fn cell(&self, position: &Position) -> Cell {
+        // Float to int casts saturate, so far-flung or non-finite
+        // coordinates land in the outermost cells instead of wrapping.
+        meters(position).map(|v| (v / self.cell_m).floor() as i64)
+    }
+}
+
+/// Whether `to` lies within `range_m` meters of `from`. The one cut applied
+/// to every channel with a finite reach, indexed or not, so the grid only
+/// ever saves work.
+pub(crate) fn within_range(range_m: f64, from: &Position, to: &Position) -> bool {
+    let (a, b) = (meters(from), meters(to));
+    let squared: f64 = (0..3).map(|i| (a[i] - b[i]).powi(2)).sum();
+    squared <= range_m * range_m
+}
+
+/// Position in meters, whatever unit the node was configured in.
+fn meters(position: &Position) -> [f64; 3] {
+    let scale = 10f64.powi(position.unit.power() as i32 - 3);
+    let p = position.point;
+    [p.x * scale, p.y * scale, p.z * scale]
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use config::ast::{DistanceUnit, Point};
+
+    fn at(x: f64, unit: DistanceUnit) -> Position {
+        Position {
+            point: Point { x, y: 0.0, z: 0.0 },
+            unit,
+            ..Position::default()
+        }
+    }
+
+    #[test]
+    fn near_returns_neighbouring_cells_in_handle_order() {
+        let positions = [
+            at(0.0, DistanceUnit::Meters),
+            at(90.0, DistanceUnit::Meters),
+            at(150.0, DistanceUnit::Meters),
+            at(1.0, DistanceUnit::Kilometers),
+        ];
+        // Node 1 has two endpoints on the channel.
+        let handles = [(0, 0), (3, 1), (1, 1), (2, 2), (4, 3)];
+        let grid = SpatialGrid::new(100.0, handles.iter().map(|&(h, n)| (h, n, &positions[n])));
+        assert_eq!(grid.near(&positions[0]), [0, 1, 2, 3]);
+        assert_eq!(grid.near(&at(1000.0, DistanceUnit::Meters)), [4]);
+        assert!(grid.near(&at(-500.0, DistanceUnit::Meters)).is_empty());
+    }
+
+    #[test]
+    fn within_range_is_inclusive_and_unit_aware() {
+        let origin = at(0.0, DistanceUnit::Meters);
+        assert!(within_range(
+            100.0,
+            &origin,
+            &at(100.0, DistanceUnit::Meters)
+        ));
+        assert!(!within_range(
+            100.0,
+            &origin,
+            &at(100.5, DistanceUnit::Meters)
+        ));
+        assert!(within_range(
+            1000.0,
+            &origin,
+            &at(1.0, DistanceUnit::Kilometers)
+        ));
+        assert!(within_range(
+            f64::INFINITY,
+            &origin,
+            &at(1e9, DistanceUnit::Kilometers)
+        ));
+    }
+
+    #[test]
+    fn update_moves_every_handle_of_a_node() {
+        let positions = [
+            at(0.0, DistanceUnit::Meters),
+            at(50.0, DistanceUnit::Meters),
+        ];
+        let mut grid = SpatialGrid::new(
+            100.0,
+            [
+                (0, 0, &positions[0]),
+                (1, 1, &positions[1]),
+                (2, 1, &positions[1]),
+            ],
+        );
+        let far = at(5.0, DistanceUnit::Kilometers);
+        grid.update(1, &far);
+        assert_eq!(grid.near(&positions[0]), [0]);
+        assert_eq!(grid.near(&far), [1, 2]);
+        // Unindexed nodes are ignored
+        grid.update(7, &far);
+        assert_eq!(grid.near(&far), [1, 2]);
+    }
+}
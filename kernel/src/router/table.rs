@@ -1,3 +1,4 @@
+use super::spatial::{SPATIAL_INDEX_MIN_HANDLES, SpatialGrid, within_range};
 use super::*;
 
 /// Struct containing routes for every channel.
@@ -17,6 +18,11 @@ pub struct ChannelRoutes {
     /// routes, where each route is route information to a specific instance of
     /// a node from that class.
     pub nodes: HashMap<NodeHandle, Vec<Route>>,
+    /// Farthest a transmission on the channel can be received, in meters.
+    range_m: f64,
+    /// Endpoints filed by position, for channels big enough and with a short
+    /// enough reach that culling far destinations pays off.
+    grid: Option<SpatialGrid>,
 }
 
 /// Single route from a source node to one destination handle on a channel.
@@ -35,9 +41,22 @@ impl RoutingTable {
             .collect::<Vec<_>>();
         Self { entries }
     }
+
+    /// Re-file `node` in every spatial index after its position changed.
+    pub(super) fn update_position(&mut self, node: usize, position: &Position) {
+        for grid in self.entries.iter_mut().filter_map(|e| e.grid.as_mut()) {
+            grid.update(node, position);
+        }
+    }
 }
 
 impl ChannelRoutes {
+    /// Destinations a write from `src` is checked against before any
+    /// spatial culling.
+    pub(super) fn route_count(&self, src: NodeHandle) -> usize {
+        self.nodes.get(&src).map_or(0, Vec::len)
+    }
+
     fn new(channels: &ResolvedChannels, index: ChannelHandle) -> Self {
         // For every channel, map every publishing node to the set of
         // precomputed routes it has with every receiving node
@@ -46,7 +65,64 @@ impl ChannelRoutes {
             .iter()
             .map(|src_node| (*src_node, Route::outgoing(channels, index, *src_node)))
             .collect::<HashMap<_, _>>();
-        Self { nodes }
+        let range_m = channels.channels[index.0].link.medium.max_range_meters();
+        let endpoints: Vec<(usize, usize, &Position)> = channels
+            .handles
+            .iter()
+            .enumerate()
+            .filter(|(_, (_, _, ch))| *ch == index)
+            .map(|(handle_ptr, (_, node, _))| {
+                (handle_ptr, node.0, &channels.nodes[node.0].position)
+            })
+            .collect();
+        let grid = (range_m.is_finite() && endpoints.len() >= SPATIAL_INDEX_MIN_HANDLES)
+            .then(|| SpatialGrid::new(range_m, endpoints));
+        Self {
+            nodes,
+            range_m,
+            grid,
+        }
+    }
+
+    /// Routes from `src_node` worth running link simulation for: those to
+    /// endpoints within the channel's range, in route order. Anything farther
+    /// would fall below the noise floor and be dropped without drawing
+    /// randomness, and on a shared channel must not collide or cost RX
+    /// energy either. The spatial index only narrows down which endpoints
+    /// get the distance check; it never changes the answer.
+    pub(super) fn candidates(
+        &self,
+        channels: &ResolvedChannels,
+        ch: ChannelHandle,
+        src_node: NodeHandle,
+    ) -> Cow<'_, [Route]> {
+        let position = &channels.nodes[src_node.0].position;
+        let in_range = |handle_ptr: usize| {
+            let (_, dst_node, _) = channels.handles[handle_ptr];
+            within_range(self.range_m, position, &channels.nodes[dst_node.0].position)
+        };
+        let Some(grid) = &self.grid else {
+            let routes = &self.nodes[&src_node];
+            if !self.range_m.is_finite() || routes.iter().all(|r| in_range(r.handle_ptr)) {
+                return Cow::Borrowed(routes);
+            }
+            return Cow::Owned(
+                routes
+                    .iter()
+                    .filter(|r| in_range(r.handle_ptr))
+                    .cloned()
+                    .collect(),
+            );
+        };
+        Cow::Owned(
+            grid.near(position)
+                .into_iter()
+                .filter(|&handle_ptr| {
+                    Route::reaches(channels, ch, src_node, handle_ptr) && in_range(handle_ptr)
+                })
+                .map(|handle_ptr| Route { handle_ptr })
+                .collect(),
+        )
     }
 }
 
@@ -59,21 +135,24 @@ impl Route {
         src_ch: ChannelHandle,
         src_node: NodeHandle,
     ) -> Vec<Self> {
-        let ch = &channels.channels[src_ch.0];
-        channels
-            .handles
-            .iter()
-            .enumerate()
-            .filter_map(|(handle_ptr, (_, dst_node, dst_ch))| {
-                if src_ch == *dst_ch
-                    && (ch.subscribers.contains(dst_node)
-                        || src_node == *dst_node && ch.r#type.delivers_to_self())
-                {
-                    Some(Route { handle_ptr })
-                } else {
-                    None
-                }
-            })
+        (0..channels.handles.len())
+            .filter(|&handle_ptr| Self::reaches(channels, src_ch, src_node, handle_ptr))
+            .map(|handle_ptr| Self { handle_ptr })
             .collect::<Vec<_>>()
     }
+
+    /// Whether a message `src_node` publishes on `src_ch` is routed to the
+    /// endpoint at `handle_ptr`.
+    fn reaches(
+        channels: &ResolvedChannels,
+        src_ch: ChannelHandle,
+        src_node: NodeHandle,
+        handle_ptr: usize,
+    ) -> bool {
+        let ch = &channels.channels[src_ch.0];
+        let (_, dst_node, dst_ch) = &channels.handles[handle_ptr];
+        src_ch == *dst_ch
+            && (ch.subscribers.contains(dst_node)
+                || src_node == *dst_node && ch.r#type.delivers_to_self())
+    }
 }
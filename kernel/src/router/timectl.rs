@@ -1,43 +1,26 @@
 //! timectl.rs
 //! Functionality for time-based control files.
 
-use std::cmp::Ordering;
-use std::time::{Duration, SystemTime};
+use std::collections::{HashMap, HashSet};
+use std::num::NonZeroU64;
+use std::time::{Duration, Instant, SystemTime};
 
 use config::ast::TimeUnit;
 use fuser::ReplyWrite;
 
-use crate::router::{RouterError, RoutingServer};
+use crate::router::{Deadline, RouterError, RoutingServer, Timestep};
 
+/// A sleep parked until its wakeup timestep, which it is filed under in
+/// the router's deadlines.
 #[derive(Debug)]
 pub(crate) struct SleepAlarm {
-    pub timestep: u64,
     pub pid: fuse::PID,
     pub bytes_consumed: u32,
+    /// When FUSE forwarded the sleep, for the request-to-reply latency.
+    pub issued: Instant,
     pub reply: ReplyWrite,
 }
 
-impl PartialEq for SleepAlarm {
-    fn eq(&self, other: &Self) -> bool {
-        self.timestep == other.timestep && self.pid == other.pid
-    }
-}
-impl Eq for SleepAlarm {}
-
-impl Ord for SleepAlarm {
-    fn cmp(&self, other: &Self) -> Ordering {
-        self.timestep
-            .cmp(&other.timestep)
-            .then_with(|| self.pid.cmp(&other.pid))
-    }
-}
-
-impl PartialOrd for SleepAlarm {
-    fn partial_cmp(&self, other: &Self) -> Option<Ordering> {
-        Some(self.cmp(other))
-    }
-}
-
 impl RoutingServer {
     pub fn update_time(
         &mut self,
@@ -93,6 +76,98 @@ impl RoutingServer {
         Ok(())
     }
 
+    /// Set the receive timeout for channel handle `index` from a write to one
+    /// of its `recv_timeout/<unit>` files. Zero restores non-blocking reads.
+    pub fn write_recv_timeout(
+        &mut self,
+        index: usize,
+        msg: fuse::Message,
+    ) -> Result<(), RouterError> {
+        let (val, unit) = Self::msg_to_time_units(&msg)?;
+        let timesteps = Self::duration_to_timesteps(val, unit, self.timestep_ns);
+        self.recv_timeouts[index] = NonZeroU64::new(timesteps);
+        Ok(())
+    }
+
+    /// Report the receive timeout for channel handle `index` in the unit named
+    /// by the file being read.
+    pub fn read_recv_timeout(
+        &mut self,
+        index: usize,
+        req: fuse::ReadRequest,
+    ) -> Result<(), RouterError> {
+        let Some(unit) = Self::suffix_to_time(req.id.1.as_str()) else {
+            let path = req.id.1.clone();
+            drop(req.reply);
+            return Err(RouterError::UnknownFile(path));
+        };
+        let timesteps = self.recv_timeouts[index].map_or(0, NonZeroU64::get);
+        let ns = u128::from(timesteps) * u128::from(self.timestep_ns);
+        let val = ns / u128::from(unit.to_ns_factor());
+        Self::reply_capped(req.reply, req.size, val.to_string().as_bytes());
+        Ok(())
+    }
+
+    /// Earliest timestep at which the router will answer a parked sleep or
+    /// read, or deliver a queued message, provided every process is blocked
+    /// waiting on it. `None` while any process could still act on its own.
+    pub(super) fn idle_until(&self) -> Option<Timestep> {
+        let parked = self
+            .deadlines
+            .iter()
+            .filter_map(|(timestep, deadline)| match deadline {
+                Deadline::Wake(alarm) => Some((alarm.pid, *timestep)),
+                _ => None,
+            })
+            .chain(
+                self.blocked_reads
+                    .iter()
+                    .map(|read| (read.req.id.0, read.deadline)),
+            );
+        // Expiries don't wake anyone, but bounding by them too is harmless
+        // and keeps this to the wheel's earliest slot.
+        let queued = self.deadlines.next_due();
+        // Other partitions' writes for the next window are not in yet.
+        let queued = match self
+            .exchange
+            .as_ref()
+            .and_then(|e| e.next_window(self.timestep))
+        {
+            Some(window) => Some(queued.map_or(window, |due| due.min(window))),
+            None => queued,
+        };
+        Self::quiescent_until(&self.fuse_mapping, parked, queued)
+    }
+
+    /// `idle_until` over plain data: `live` holds every process, `parked`
+    /// each request held for one with the timestep it is answered by.
+    /// Entries for processes no longer live (replaced by a respawn) still
+    /// bound the result but don't count towards everyone being parked.
+    fn quiescent_until<V>(
+        live: &HashMap<fuse::PID, V>,
+        parked: impl Iterator<Item = (fuse::PID, Timestep)>,
+        queued: Option<Timestep>,
+    ) -> Option<Timestep> {
+        let mut due = queued.unwrap_or(Timestep::MAX);
+        let mut blocked = HashSet::with_capacity(live.len());
+        for (pid, timestep) in parked {
+            due = due.min(timestep);
+            if live.contains_key(&pid) {
+                blocked.insert(pid);
+            }
+        }
+        (blocked.len() == live.len()).then_some(due)
+    }
+
+    /// Convert a duration to a whole number of timesteps, rounding up so a
+    /// non-zero timeout never collapses into a non-blocking read.
+    fn duration_to_timesteps(val: u64, unit: TimeUnit, timestep_ns: u64) -> u64 {
+        let ns = u128::from(val) * u128::from(unit.to_ns_factor());
+        ns.div_ceil(u128::from(timestep_ns))
+            .try_into()
+            .unwrap_or(u64::MAX)
+    }
+
     fn msg_to_time_units(msg: &fuse::Message) -> Result<(u64, TimeUnit), RouterError> {
         let unit = Self::suffix_to_time(msg.id.1.as_str())
             .ok_or_else(|| RouterError::UnknownFile(msg.id.1.clone()))?;
@@ -114,3 +189,59 @@ impl RoutingServer {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn duration_to_timesteps_exact() {
+        // 250 ms with a 1 ms timestep
+        let ts = RoutingServer::duration_to_timesteps(250, TimeUnit::Milliseconds, 1_000_000);
+        assert_eq!(ts, 250);
+    }
+
+    #[test]
+    fn duration_to_timesteps_rounds_up() {
+        // 1500 us with a 1 ms timestep must wait for the second step
+        let ts = RoutingServer::duration_to_timesteps(1500, TimeUnit::Microseconds, 1_000_000);
+        assert_eq!(ts, 2);
+        // Anything non-zero is at least one step
+        let ts = RoutingServer::duration_to_timesteps(1, TimeUnit::Nanoseconds, 1_000_000_000);
+        assert_eq!(ts, 1);
+    }
+
+    #[test]
+    fn duration_to_timesteps_zero_is_non_blocking() {
+        let ts = RoutingServer::duration_to_timesteps(0, TimeUnit::Seconds, 1_000_000);
+        assert_eq!(ts, 0);
+    }
+
+    #[test]
+    fn quiescent_until_needs_every_live_process_parked() {
+        let live: HashMap<fuse::PID, ()> = [(1, ()), (2, ())].into();
+        let until = |parked: &[(fuse::PID, Timestep)], queued| {
+            RoutingServer::quiescent_until(&live, parked.iter().copied(), queued)
+        };
+        assert_eq!(until(&[(1, 40)], None), None);
+        assert_eq!(until(&[(1, 40), (2, 25)], None), Some(25));
+        assert_eq!(until(&[(1, 40), (2, 25)], Some(10)), Some(10));
+        // A respawned process's leftover sleep bounds the wait but doesn't
+        // stand in for the live process.
+        assert_eq!(until(&[(1, 40), (9, 5)], None), None);
+        assert_eq!(until(&[(1, 40), (2, 60), (9, 5)], None), Some(5));
+        // Parked forever with nothing queued
+        let nobody: HashMap<fuse::PID, ()> = HashMap::new();
+        assert_eq!(
+            RoutingServer::quiescent_until(&nobody, std::iter::empty(), None),
+            Some(Timestep::MAX)
+        );
+    }
+
+    #[test]
+    fn duration_to_timesteps_no_overflow() {
+        // u64::MAX seconds in nanoseconds overflows u64 without u128 intermediates
+        let ts = RoutingServer::duration_to_timesteps(u64::MAX, TimeUnit::Seconds, 1);
+        assert_eq!(ts, u64::MAX);
+    }
+}
@@ -10,6 +10,8 @@ pub enum KernelMessage {
     UnfreezeNode(String),
     /// Kill a frozen node's processes and respawn them (realistic restart).
     RespawnNode(String),
+    /// Ask whether any protocol has used CPU time since the last query.
+    CpuIdle,
     Shutdown,
 }
 
@@ -22,4 +24,7 @@ pub enum StatusMessage {
         node: String,
         pid_changes: Vec<(u32, u32)>,
     },
+    /// Response to CpuIdle: `true` if no protocol cgroup's `cpu.stat` usage
+    /// changed since the previous query.
+    CpuIdle(bool),
 }
@@ -16,6 +16,7 @@ use std::{
 
 use cpuutils::cpufreq::{self, CpuInfo};
 use runner::{ProtocolHandle, RunController};
+use tracing::warn;
 
 use crate::{KernelServer, errors::KernelError, status::errors::StatusError};
 
@@ -73,6 +74,23 @@ impl StatusKernelServer {
             .map_err(|e| KernelError::StatusError(StatusError::RecvError(e)))
     }
 
+    /// Whether every protocol stayed off the CPU since the previous call.
+    /// Synchronous; the first call after a busy period always says no,
+    /// since there is nothing to compare against.
+    pub fn cpu_idle(&mut self) -> Result<bool, KernelError> {
+        self.tx
+            .send(KernelMessage::CpuIdle)
+            .map_err(|e| KernelError::StatusError(StatusError::KernelSendError(e)))?;
+        match self
+            .rx
+            .recv()
+            .map_err(|e| KernelError::StatusError(StatusError::RecvError(e)))?
+        {
+            StatusMessage::CpuIdle(idle) => Ok(idle),
+            _ => Ok(false),
+        }
+    }
+
     pub fn shutdown(self) -> HandleInner {
         self.tx
             .send(KernelMessage::Shutdown)
@@ -92,6 +110,8 @@ pub struct StatusServer {
     kernel_rx: mpsc::Receiver<KernelMessage>,
     /// Outgoing channel to deliver responses to the kernel.
     status_tx: mpsc::Sender<StatusMessage>,
+    /// Each protocol's `cpu.stat` usage at the last `CpuIdle` query.
+    cpu_usage: Vec<Option<u64>>,
 }
 
 impl StatusServer {
@@ -109,6 +129,20 @@ impl StatusServer {
             .assign_cpu_bandwidths(&self.runc.bandwidth);
     }
 
+    /// Sample every protocol's CPU usage and compare it to the last sample.
+    /// A protocol whose usage can't be read never counts as idle.
+    fn cpu_idle(&mut self) -> bool {
+        let usage: Vec<Option<u64>> = self
+            .runc
+            .handles
+            .iter()
+            .map(|handle| self.runc.cgroups.cpu_usage(handle))
+            .collect();
+        let idle = usage.iter().all(Option::is_some) && usage == self.cpu_usage;
+        self.cpu_usage = usage;
+        idle
+    }
+
     fn check_health(&mut self) -> Result<(), StatusError> {
         let premature_exits = health::check(&mut self.runc.handles);
         if premature_exits.is_empty() {
@@ -150,11 +184,23 @@ impl StatusServer {
                 Ok(KernelMessage::UnfreezeNode(name)) => {
                     self.runc.cgroups.unfreeze_node(&name);
                 }
+                Ok(KernelMessage::CpuIdle) => {
+                    let idle = self.cpu_idle();
+                    self.status_tx
+                        .send(StatusMessage::CpuIdle(idle))
+                        .map_err(|e| KernelError::StatusError(StatusError::StatusSendError(e)))?;
+                }
                 Ok(KernelMessage::RespawnNode(name)) => {
                     let pid_changes = self
                         .runc
                         .cgroups
                         .respawn_node(&name, &mut self.runc.handles);
+                    // Respawns start with the runner's affinity.
+                    for &(_, pid) in &pid_changes {
+                        if let Err(e) = self.runc.affinity.pin(&name, pid) {
+                            warn!("Unable to pin respawned {name} process {pid}: {e}");
+                        }
+                    }
                     let _ = self.status_tx.send(StatusMessage::Respawned {
                         node: name,
                         pid_changes,
@@ -185,6 +231,7 @@ impl StatusServer {
                     cpuinfo,
                     kernel_rx,
                     status_tx,
+                    cpu_usage: vec![],
                 };
                 server.run()
             })
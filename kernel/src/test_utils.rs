@@ -1,7 +1,21 @@
 #[cfg(test)]
 pub(crate) mod helpers {
+    use std::net::{SocketAddr, TcpListener};
+
     use config::ast::Point;
 
+    /// Loopback addresses with ports that were free a moment ago.
+    pub fn free_addrs(count: usize) -> Vec<SocketAddr> {
+        (0..count)
+            .map(|_| {
+                TcpListener::bind("127.0.0.1:0")
+                    .unwrap()
+                    .local_addr()
+                    .unwrap()
+            })
+            .collect()
+    }
+
     pub fn pt(x: f64, y: f64, z: f64) -> Point {
         Point { x, y, z }
     }
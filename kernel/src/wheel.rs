@@ -0,0 +1,168 @@
+//! wheel.rs
+//! Hierarchical timing wheel keyed by timestep.
+//!
+//! Level `L` has 64 slots, each covering `64^L` timesteps. An entry is filed
+//! at the level of the highest 6-bit digit in which its deadline differs from
+//! the current timestep, so level 0 only ever holds the current 64-timestep
+//! block and every level's occupied slots lie ahead of the current one.
+//! Whenever the current timestep crosses into a new block at some level, that
+//! level's slot for the block is cascaded down. Eleven levels cover the whole
+//! `u64` range, so no deadline needs an overflow list.
+//!
+//! Inserting is O(1); advancing one timestep is O(1) amortized plus the
+//! entries that fall due or cascade. Entries due at the same timestep come out
+//! in insertion order.
+
+use std::mem;
+
+type Timestep = u64;
+
+const SLOT_BITS: u32 = 6;
+const SLOTS: usize = 1 << SLOT_BITS;
+const LEVELS: usize = (u64::BITS as usize).div_ceil(SLOT_BITS as usize);
+
+#[derive(Debug)]
+pub struct TimingWheel<T> {
+    /// Last timestep advanced to. Entries are due strictly after it.
+    now: Timestep,
+    /// `LEVELS * SLOTS` buckets, level-major.
+    slots: Vec<Vec<(Timestep, T)>>,
+    /// Per-level bitmap of non-empty slots.
+    occupied: [u64; LEVELS],
+    len: usize,
+}
+
+impl<T> TimingWheel<T> {
+    pub fn new(now: Timestep) -> Self {
+        Self {
+            now,
+            slots: (0..LEVELS * SLOTS).map(|_| Vec::new()).collect(),
+            occupied: [0; LEVELS],
+            len: 0,
+        }
+    }
+
+    pub fn now(&self) -> Timestep {
+        self.now
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// File `item` to come out of the first `advance` at or after `due`.
+    /// Deadlines already reached fire on the next one.
+    pub fn insert(&mut self, due: Timestep, item: T) {
+        let due = due.max(self.now.saturating_add(1));
+        self.file(due, item);
+        self.len += 1;
+    }
+
+    /// Step to the next timestep and return everything due at it, in
+    /// insertion order.
+    pub fn advance(&mut self) -> Vec<(Timestep, T)> {
+        self.now += 1;
+        let now = self.now;
+        // Cascade the highest level whose block just changed first, so what
+        // it files into lower levels is cascaded along with them.
+        let changed = (now.trailing_zeros() / SLOT_BITS) as usize;
+        for level in (1..=changed.min(LEVELS - 1)).rev() {
+            let index = Self::index(level, now);
+            let entries = self.take(index, level);
+            for (due, item) in entries {
+                self.file(due, item);
+            }
+        }
+        let index = Self::index(0, now);
+        let due = self.take(index, 0);
+        self.len -= due.len();
+        due
+    }
+
+    /// Earliest deadline held, if any.
+    pub fn next_due(&self) -> Option<Timestep> {
+        let level = self.occupied.iter().position(|&bits| bits != 0)?;
+        let slot = self.occupied[level].trailing_zeros() as usize;
+        // Level 0 slots hold a single timestep; higher ones a range.
+        self.slots[level * SLOTS + slot]
+            .iter()
+            .map(|(due, _)| *due)
+            .min()
+    }
+
+    /// Every pending entry with its deadline, in no particular order.
+    pub fn iter(&self) -> impl Iterator<Item = &(Timestep, T)> {
+        self.slots.iter().flatten()
+    }
+
+    fn file(&mut self, due: Timestep, item: T) {
+        let level = ((due ^ self.now).max(1).ilog2() / SLOT_BITS) as usize;
+        let index = Self::index(level, due);
+        self.slots[level * SLOTS + index].push((due, item));
+        self.occupied[level] |= 1 << index;
+    }
+
+    fn take(&mut self, index: usize, level: usize) -> Vec<(Timestep, T)> {
+        self.occupied[level] &= !(1 << index);
+        mem::take(&mut self.slots[level * SLOTS + index])
+    }
+
+    fn index(level: usize, timestep: Timestep) -> usize {
+        ((timestep >> (level as u32 * SLOT_BITS)) as usize) & (SLOTS - 1)
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn drain(wheel: &mut TimingWheel<u32>, until: Timestep) -> Vec<(Timestep, u32)> {
+        let mut fired = vec![];
+        while wheel.now() < until {
+            let now = wheel.now() + 1;
+            for (due, item) in wheel.advance() {
+                assert_eq!(due, now);
+                fired.push((now, item));
+            }
+        }
+        fired
+    }
+
+    #[test]
+    fn fires_in_deadline_then_insertion_order_across_levels() {
+        let mut wheel = TimingWheel::new(0);
+        // Within level 0, across one and two cascades, and a tie filed
+        // before and after the cascade that brings the first one down.
+        for (due, item) in [(4_100, 0), (3, 1), (70, 2), (3, 3), (4_100, 4)] {
+            wheel.insert(due, item);
+        }
+        assert_eq!(wheel.next_due(), Some(3));
+        assert_eq!(drain(&mut wheel, 4_000), [(3, 1), (3, 3), (70, 2)]);
+        wheel.insert(4_100, 5);
+        assert_eq!(wheel.next_due(), Some(4_100));
+        assert_eq!(wheel.len(), 3);
+        assert_eq!(
+            drain(&mut wheel, 5_000),
+            [(4_100, 0), (4_100, 4), (4_100, 5)]
+        );
+        assert!(wheel.is_empty());
+        assert_eq!(wheel.next_due(), None);
+    }
+
+    #[test]
+    fn past_deadlines_fire_next_and_far_ones_are_kept() {
+        let mut wheel = TimingWheel::new(100);
+        wheel.insert(7, 0);
+        wheel.insert(100, 1);
+        wheel.insert(u64::MAX, 2);
+        assert_eq!(wheel.next_due(), Some(101));
+        let fired: Vec<_> = wheel.advance().into_iter().map(|(_, i)| i).collect();
+        assert_eq!(fired, [0, 1]);
+        assert_eq!(wheel.next_due(), Some(u64::MAX));
+        assert_eq!(wheel.iter().count(), 1);
+    }
+}
@@ -4,9 +4,11 @@ use config::ast::{self, Resources};
 use cpuutils::{
     cpufreq::{CoreInfo, CpuInfo},
     cpuset::CpuSet,
+    errors::CpusetError,
 };
 
-use crate::{CPU_BANDWIDTH_MIN, CPU_MAX_SCALAR_DIFFERENCE, CPU_PERIOD_MIN};
+use crate::calibration::Calibration;
+use crate::{CPU_BANDWIDTH_MIN, CPU_MAX_SCALAR_DIFFERENCE, CPU_PERIOD_MAX};
 
 /// Builder struct which tracks the requested resources for each
 /// node and the PIDs of protocols running on that node.
@@ -112,6 +114,24 @@ impl Affinity {
             None
         }
     }
+
+    /// CPUs `name`'s protocols run on: the one it was assigned, or every
+    /// CPU the runner may use when it has no CPU limit.
+    pub fn cpus(&self, name: &str) -> Vec<usize> {
+        match self.assignments.get(name) {
+            Some(&(cpu, _)) => vec![cpu],
+            None => self.cpuset.enabled_ids(),
+        }
+    }
+
+    /// Pin `pid`, a process started for `name` after the first ones, to
+    /// the CPU they were given. Nodes without a CPU limit are left alone.
+    pub fn pin(&self, name: &str, pid: u32) -> Result<(), CpusetError> {
+        if let Some(&(cpu, _)) = self.assignments.get(name) {
+            CpuSet::default().enable_cpu(cpu)?.set_affinity(pid)?;
+        }
+        Ok(())
+    }
 }
 
 /// Assigning relative weights to groups for CPU usage.
@@ -176,17 +196,43 @@ pub struct Bandwidth {
     ///     - bandwidth (numerator)
     ///     - period (denominator)
     assignments: HashMap<ast::NodeHandle, (u64, u64)>,
+    /// Host correction applied to every requested rate.
+    calibration: Calibration,
 }
 
 impl Bandwidth {
-    pub fn new(affinity: &Affinity, cpuinfo: &CpuInfo, time_dilation: f64) -> Self {
+    pub fn new(
+        affinity: &Affinity,
+        cpuinfo: &CpuInfo,
+        time_dilation: f64,
+        calibration: Calibration,
+    ) -> Self {
         let mut assignments = HashMap::new();
-        Self::refresh_inner(&mut assignments, affinity, cpuinfo, time_dilation);
-        Self { assignments }
+        Self::refresh_inner(
+            &mut assignments,
+            affinity,
+            cpuinfo,
+            time_dilation,
+            &calibration,
+        );
+        Self {
+            assignments,
+            calibration,
+        }
     }
 
     pub fn refresh(&mut self, affinity: &Affinity, cpuinfo: &CpuInfo, time_dilation: f64) {
-        Self::refresh_inner(&mut self.assignments, affinity, cpuinfo, time_dilation);
+        Self::refresh_inner(
+            &mut self.assignments,
+            affinity,
+            cpuinfo,
+            time_dilation,
+            &self.calibration,
+        );
+    }
+
+    pub fn calibration(&self) -> &Calibration {
+        &self.calibration
     }
 
     pub fn assignments(&self) -> &HashMap<ast::NodeHandle, (u64, u64)> {
@@ -198,8 +244,10 @@ impl Bandwidth {
         affinity: &Affinity,
         cpuinfo: &CpuInfo,
         time_dilation: f64,
+        calibration: &Calibration,
     ) {
         const MIN_DILATION: f64 = 0.01;
+        let base = calibration.period();
 
         for (node, (core, required_cycles)) in affinity.assignments.iter() {
             // NOTE: using `max_frequency` here seems to give a more consistent
@@ -209,23 +257,23 @@ impl Bandwidth {
             if let Some(current_frequency) = cpuinfo.cores.get(core).map(CoreInfo::max_frequency) {
                 // Speed multiplier compresses wall-clock time per timestep, so
                 // nodes need proportionally more CPU bandwidth at higher speeds.
-                let ratio = *required_cycles as f64 * time_dilation.max(MIN_DILATION)
-                    / current_frequency as f64;
+                let required = *required_cycles as f64 * time_dilation.max(MIN_DILATION);
+                let ratio = calibration.correct(required) / current_frequency as f64;
                 // try to minimize the period as much as possible to ensure
-                // scheduling requests are honored on tighter timeframes
+                // scheduling requests are honored on tighter timeframes; the
+                // calibrated base is the shortest one measured to be accurate
                 let (bandwidth, period) = if ratio >= 1.0 {
-                    let period = CPU_PERIOD_MIN;
+                    let period = base;
                     let bandwidth = std::cmp::min(
-                        (CPU_PERIOD_MIN as f64 * ratio) as u64,
-                        CPU_PERIOD_MIN * CPU_MAX_SCALAR_DIFFERENCE,
+                        (base as f64 * ratio) as u64,
+                        base * CPU_MAX_SCALAR_DIFFERENCE,
                     );
                     (bandwidth, period)
                 } else {
-                    let period = std::cmp::min(
-                        (CPU_PERIOD_MIN as f64 / ratio) as u64,
-                        CPU_BANDWIDTH_MIN * CPU_MAX_SCALAR_DIFFERENCE,
-                    );
-                    let bandwidth = CPU_BANDWIDTH_MIN;
+                    let period = std::cmp::min((base as f64 / ratio) as u64, CPU_PERIOD_MAX);
+                    // keep the ratio if the period had to be capped
+                    let bandwidth =
+                        std::cmp::max((period as f64 * ratio).round() as u64, CPU_BANDWIDTH_MIN);
                     (bandwidth, period)
                 };
                 let _ = assignments.insert(node.clone(), (bandwidth, period));
@@ -235,3 +283,31 @@ impl Bandwidth {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::num::NonZeroU64;
+
+    #[test]
+    fn only_limited_nodes_are_held_to_one_cpu() {
+        let mut cpuset = CpuSet::default();
+        for cpu in [2, 3, 5] {
+            cpuset.enable_cpu(cpu).unwrap();
+        }
+        let mut affinity = Affinity::new(cpuset);
+        let limited = Resources {
+            cpu: ast::Cpu {
+                hertz: NonZeroU64::new(1_000),
+                ..Default::default()
+            },
+            ..Default::default()
+        };
+        let cpu = affinity
+            .assign_node(&"limited".to_string(), &limited)
+            .unwrap();
+        assert!([2, 3, 5].contains(&cpu));
+        assert_eq!(affinity.cpus("limited"), [cpu]);
+        assert_eq!(affinity.cpus("free"), [2, 3, 5]);
+    }
+}
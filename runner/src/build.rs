@@ -0,0 +1,362 @@
+//! build.rs
+//! Protocol builds: deduplicated, cached, and run in parallel.
+//!
+//! Protocols sharing a root, build command and build inputs are built once,
+//! however many nodes deploy them. Distinct builds run in parallel, at most
+//! `params.build_jobs` at a time, except that builds sharing a root run one
+//! after another.
+//!
+//! A build is skipped when nothing it reads has changed since it last
+//! succeeded. Its cache key hashes the root, command, arguments, build
+//! inputs and the environment variables builds commonly read. Under that
+//! key the cache records a hash of the contents of the root and inputs as
+//! the build left them, outputs included. While they still hash the same,
+//! the build is up to date. Anything a build reads outside its root must be
+//! listed in `build_inputs` for changes to it to trigger a rebuild.
+
+use std::collections::HashSet;
+use std::fs::{self, File};
+use std::io;
+use std::num::NonZeroUsize;
+use std::os::unix::ffi::OsStrExt;
+use std::os::unix::fs::PermissionsExt;
+use std::path::{Path, PathBuf};
+use std::process::{Command, ExitStatus, Stdio};
+use std::sync::Mutex;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::thread;
+
+use config::ast::{self, NodeProtocol};
+use sha2::{Digest, Sha256};
+
+use crate::errors::{ProtocolError, RunnerDetail};
+
+/// Environment variables that commonly change what a build produces.
+const BUILD_ENV: &[&str] = &[
+    "PATH",
+    "CC",
+    "CXX",
+    "CFLAGS",
+    "CXXFLAGS",
+    "CPPFLAGS",
+    "LDFLAGS",
+    "MAKEFLAGS",
+];
+
+/// One distinct build and the first protocol that asked for it.
+struct BuildJob<'a> {
+    node: &'a str,
+    protocol: &'a str,
+    spec: &'a NodeProtocol,
+}
+
+enum Outcome {
+    UpToDate,
+    Built,
+    Failed(ExitStatus),
+}
+
+/// Where build states are recorded: `$XDG_CACHE_HOME/nexus/builds`, or
+/// `~/.cache/nexus/builds`.
+pub fn cache_dir() -> Option<PathBuf> {
+    std::env::var_os("XDG_CACHE_HOME")
+        .map(PathBuf::from)
+        .or_else(|| home::home_dir().map(|home| home.join(".cache")))
+        .map(|cache| cache.join("nexus").join("builds"))
+}
+
+/// Build every protocol in `sim` that has a build command.
+pub fn build_all(sim: &ast::Simulation, cache: Option<&Path>) -> Result<(), ProtocolError> {
+    let mut nodes: Vec<_> = sim.nodes.iter().collect();
+    nodes.sort_by_key(|(name, _)| *name);
+    let protocols = nodes.into_iter().flat_map(|(node, n)| {
+        let mut protocols: Vec<_> = n.protocols.iter().collect();
+        protocols.sort_by_key(|(name, _)| *name);
+        protocols
+            .into_iter()
+            .map(move |(protocol, spec)| (node.as_str(), protocol.as_str(), spec))
+    });
+    let jobs = sim
+        .params
+        .build_jobs
+        .unwrap_or_else(|| thread::available_parallelism().unwrap_or(NonZeroUsize::MIN));
+    build_protocols(protocols, jobs, cache)
+}
+
+/// Build `protocols`, each distinct build once, `jobs` at a time.
+pub(crate) fn build_protocols<'a>(
+    protocols: impl IntoIterator<Item = (&'a str, &'a str, &'a NodeProtocol)>,
+    jobs: NonZeroUsize,
+    cache: Option<&Path>,
+) -> Result<(), ProtocolError> {
+    let mut distinct = HashSet::new();
+    // Distinct builds grouped by root, so builds in one directory never
+    // race each other.
+    let mut by_root: Vec<Vec<BuildJob>> = Vec::new();
+    let mut total = 0;
+    for (node, protocol, spec) in protocols {
+        if spec.build.cmd.is_empty() {
+            continue;
+        }
+        let same = (
+            &spec.root,
+            &spec.build.cmd,
+            &spec.build.args,
+            &spec.build_inputs,
+        );
+        if !distinct.insert(same) {
+            continue;
+        }
+        let job = BuildJob {
+            node,
+            protocol,
+            spec,
+        };
+        match by_root
+            .iter_mut()
+            .find(|group| group[0].spec.root == spec.root)
+        {
+            Some(group) => group.push(job),
+            None => by_root.push(vec![job]),
+        }
+        total += 1;
+    }
+
+    let next = AtomicUsize::new(0);
+    let outcomes = Mutex::new(Vec::with_capacity(total));
+    thread::scope(|scope| {
+        for _ in 0..jobs.get().min(by_root.len()) {
+            scope.spawn(|| {
+                while let Some(group) = by_root.get(next.fetch_add(1, Ordering::Relaxed)) {
+                    for job in group {
+                        let outcome = run_build(job.spec, cache);
+                        outcomes.lock().unwrap().push((job, outcome));
+                    }
+                }
+            });
+        }
+    });
+
+    let mut outcomes = outcomes.into_inner().unwrap();
+    outcomes.sort_by_key(|(job, _)| (job.node, job.protocol));
+    let mut errors = vec![];
+    let mut up_to_date = 0;
+    for (job, outcome) in outcomes {
+        match outcome.map_err(ProtocolError::UnableToRun)? {
+            Outcome::UpToDate => up_to_date += 1,
+            Outcome::Built => {}
+            Outcome::Failed(exit_code) => {
+                // First failure
+                if errors.is_empty() {
+                    eprintln!("\nError building programs:\n");
+                }
+                errors.push(RunnerDetail::new(
+                    job.node.to_string(),
+                    job.protocol.to_string(),
+                    job.spec.root.clone(),
+                    format!("Command: {} ({exit_code})", job.spec.build),
+                ));
+            }
+        }
+    }
+    if up_to_date > 0 {
+        println!("{up_to_date} of {total} builds were up to date");
+    }
+    if errors.is_empty() {
+        Ok(())
+    } else {
+        Err(ProtocolError::BuildErrors(errors))
+    }
+}
+
+fn run_build(spec: &NodeProtocol, cache: Option<&Path>) -> io::Result<Outcome> {
+    let record = cache.map(|dir| dir.join(build_key(spec)));
+    if let Some(record) = &record
+        && let Ok(recorded) = fs::read_to_string(record)
+        && recorded == tree_hash(spec)?
+    {
+        return Ok(Outcome::UpToDate);
+    }
+    let status = Command::new(&spec.build.cmd)
+        .current_dir(&spec.root)
+        .args(&spec.build.args)
+        .stdout(Stdio::null())
+        .status()?;
+    if !status.success() {
+        return Ok(Outcome::Failed(status));
+    }
+    if let Some(record) = &record {
+        // A cache that cannot be written only costs a rebuild next time.
+        let _ = save_record(record, &tree_hash(spec)?);
+    }
+    Ok(Outcome::Built)
+}
+
+/// Write through a temporary file, so concurrent runs never read half a
+/// record.
+fn save_record(record: &Path, hash: &str) -> io::Result<()> {
+    let dir = record
+        .parent()
+        .expect("records live in the cache directory");
+    fs::create_dir_all(dir)?;
+    let tmp = tempfile::NamedTempFile::new_in(dir)?;
+    fs::write(tmp.path(), hash)?;
+    tmp.persist(record).map_err(|e| e.error)?;
+    Ok(())
+}
+
+/// What identifies a build apart from the files it reads.
+fn build_key(spec: &NodeProtocol) -> String {
+    let mut hasher = Sha256::new();
+    let mut field = |bytes: &[u8]| {
+        hasher.update((bytes.len() as u64).to_le_bytes());
+        hasher.update(bytes);
+    };
+    field(spec.root.as_os_str().as_bytes());
+    field(spec.build.cmd.as_bytes());
+    for arg in &spec.build.args {
+        field(arg.as_bytes());
+    }
+    for input in &spec.build_inputs {
+        field(input.as_os_str().as_bytes());
+    }
+    for var in BUILD_ENV {
+        field(var.as_bytes());
+        field(std::env::var_os(var).unwrap_or_default().as_bytes());
+    }
+    format!("{:x}", hasher.finalize())
+}
+
+/// Hash of everything under the root and build inputs.
+fn tree_hash(spec: &NodeProtocol) -> io::Result<String> {
+    let mut hasher = Sha256::new();
+    for path in std::iter::once(&spec.root).chain(&spec.build_inputs) {
+        hash_path(&mut hasher, path)?;
+    }
+    Ok(format!("{:x}", hasher.finalize()))
+}
+
+fn hash_path(hasher: &mut Sha256, path: &Path) -> io::Result<()> {
+    let meta = fs::symlink_metadata(path)?;
+    if meta.is_dir() {
+        let mut names = fs::read_dir(path)?
+            .map(|entry| entry.map(|e| e.file_name()))
+            .collect::<io::Result<Vec<_>>>()?;
+        names.sort();
+        for name in names.iter().filter(|name| *name != ".git") {
+            hasher.update(b"d");
+            hasher.update((name.len() as u64).to_le_bytes());
+            hasher.update(name.as_bytes());
+            hash_path(hasher, &path.join(name))?;
+        }
+        hasher.update(b"e");
+    } else if meta.is_symlink() {
+        let target = fs::read_link(path)?;
+        hasher.update(b"l");
+        hasher.update((target.as_os_str().len() as u64).to_le_bytes());
+        hasher.update(target.as_os_str().as_bytes());
+    } else {
+        hasher.update(b"f");
+        hasher.update(meta.permissions().mode().to_le_bytes());
+        hasher.update(meta.len().to_le_bytes());
+        io::copy(&mut File::open(path)?, hasher)?;
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use config::ast::Cmd;
+
+    /// A protocol whose build appends a line to `builds.log` in `root`.
+    fn protocol(root: &Path) -> NodeProtocol {
+        NodeProtocol {
+            root: root.to_path_buf(),
+            build: Cmd {
+                cmd: "sh".to_string(),
+                args: vec!["-c".to_string(), "echo built >> builds.log".to_string()],
+            },
+            build_inputs: vec![],
+            runner: Cmd {
+                cmd: String::new(),
+                args: vec![],
+            },
+            zygote: false,
+            publishers: HashSet::new(),
+            subscribers: HashSet::new(),
+        }
+    }
+
+    fn builds(root: &Path) -> usize {
+        fs::read_to_string(root.join("builds.log"))
+            .map(|log| log.lines().count())
+            .unwrap_or(0)
+    }
+
+    #[test]
+    fn identical_builds_run_once_and_are_cached() {
+        let root = tempfile::tempdir().unwrap();
+        let cache = tempfile::tempdir().unwrap();
+        let spec = protocol(root.path());
+        let deployments = [
+            ("a", "main", &spec),
+            ("b", "main", &spec),
+            ("c", "main", &spec),
+        ];
+        let jobs = NonZeroUsize::new(4).unwrap();
+
+        build_protocols(deployments, jobs, Some(cache.path())).unwrap();
+        assert_eq!(builds(root.path()), 1);
+        build_protocols(deployments, jobs, Some(cache.path())).unwrap();
+        assert_eq!(builds(root.path()), 1);
+
+        // Any change under the root, or to the command, rebuilds.
+        fs::write(root.path().join("main.c"), "int main() {}").unwrap();
+        build_protocols(deployments, jobs, Some(cache.path())).unwrap();
+        assert_eq!(builds(root.path()), 2);
+        let mut other = spec.clone();
+        other.build.args[1].push_str(" # again");
+        build_protocols([("a", "main", &other)], jobs, Some(cache.path())).unwrap();
+        assert_eq!(builds(root.path()), 3);
+
+        // Without a cache every distinct build runs.
+        build_protocols(deployments, jobs, None).unwrap();
+        assert_eq!(builds(root.path()), 4);
+    }
+
+    #[test]
+    fn build_inputs_outside_the_root_invalidate() {
+        let root = tempfile::tempdir().unwrap();
+        let common = tempfile::tempdir().unwrap();
+        let cache = tempfile::tempdir().unwrap();
+        let mut spec = protocol(root.path());
+        spec.build_inputs = vec![common.path().to_path_buf()];
+        let jobs = NonZeroUsize::MIN;
+
+        build_protocols([("a", "main", &spec)], jobs, Some(cache.path())).unwrap();
+        build_protocols([("a", "main", &spec)], jobs, Some(cache.path())).unwrap();
+        assert_eq!(builds(root.path()), 1);
+        fs::write(common.path().join("radio.cpp"), "").unwrap();
+        build_protocols([("a", "main", &spec)], jobs, Some(cache.path())).unwrap();
+        assert_eq!(builds(root.path()), 2);
+    }
+
+    #[test]
+    fn failures_are_reported_and_not_cached() {
+        let root = tempfile::tempdir().unwrap();
+        let cache = tempfile::tempdir().unwrap();
+        let mut spec = protocol(root.path());
+        spec.build.args[1] = "echo built >> builds.log; exit 3".to_string();
+        for _ in 0..2 {
+            let err = build_protocols(
+                [("a", "main", &spec)],
+                NonZeroUsize::MIN,
+                Some(cache.path()),
+            )
+            .unwrap_err();
+            assert!(matches!(err, ProtocolError::BuildErrors(ref e) if e.len() == 1));
+        }
+        assert_eq!(builds(root.path()), 2);
+    }
+}
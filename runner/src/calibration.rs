@@ -0,0 +1,329 @@
+//! calibration.rs
+//! Per-host correction for CPU bandwidth throttling. `cpu.max` does not give
+//! a node exactly the share of a core it asks for: quota granularity,
+//! scheduler latency and frequency scaling all skew it, and by how much
+//! depends on the host. `nexus calibrate` runs `examples/count` throttled to
+//! a range of clock rates, periods and node counts, fits
+//! `achieved = scale * requested^exponent` through the results, and saves a
+//! profile. `Bandwidth` loads it to correct the rates it asks for and to use
+//! the shortest period that stayed accurate.
+
+use std::path::{Path, PathBuf};
+
+use serde::{Deserialize, Serialize};
+
+use crate::errors::CalibrationError;
+use crate::{CPU_PERIOD_MAX, CPU_PERIOD_MIN};
+
+/// Overrides where the host's calibration profile is read from and written to.
+pub const CALIBRATION_ENV: &str = "NEXUS_CALIBRATION";
+const HOSTNAME: &str = "/proc/sys/kernel/hostname";
+
+/// `achieved = scale * requested^exponent`, both in hertz.
+#[derive(Clone, Copy, Debug, PartialEq, Serialize, Deserialize)]
+pub struct Fit {
+    pub scale: f64,
+    pub exponent: f64,
+}
+
+impl Default for Fit {
+    fn default() -> Self {
+        Self {
+            scale: 1.0,
+            exponent: 1.0,
+        }
+    }
+}
+
+impl Fit {
+    /// Least-squares fit in log-log space. Needs at least one usable point;
+    /// with a single requested rate only the scale can be fitted.
+    pub fn new(points: &[Point]) -> Option<Self> {
+        let logs: Vec<(f64, f64)> = points
+            .iter()
+            .filter(|p| p.requested_hz > 0 && p.achieved_hz > 0.0)
+            .map(|p| ((p.requested_hz as f64).ln(), p.achieved_hz.ln()))
+            .collect();
+        if logs.is_empty() {
+            return None;
+        }
+        let n = logs.len() as f64;
+        let mean_x = logs.iter().map(|(x, _)| x).sum::<f64>() / n;
+        let mean_y = logs.iter().map(|(_, y)| y).sum::<f64>() / n;
+        let sxx: f64 = logs.iter().map(|(x, _)| (x - mean_x).powi(2)).sum();
+        let sxy: f64 = logs.iter().map(|(x, y)| (x - mean_x) * (y - mean_y)).sum();
+        let exponent = if sxx > f64::EPSILON { sxy / sxx } else { 1.0 };
+        if !exponent.is_finite() || exponent <= 0.0 {
+            return None;
+        }
+        Some(Self {
+            scale: (mean_y - exponent * mean_x).exp(),
+            exponent,
+        })
+    }
+
+    /// Rate a node is expected to achieve when `requested_hz` is asked for.
+    pub fn achieved(&self, requested_hz: f64) -> f64 {
+        self.scale * requested_hz.powf(self.exponent)
+    }
+
+    /// Rate to ask for so a node achieves `target_hz`.
+    pub fn requested(&self, target_hz: f64) -> f64 {
+        (target_hz / self.scale).powf(self.exponent.recip())
+    }
+}
+
+/// One probe's result.
+#[derive(Clone, Debug, PartialEq, Serialize, Deserialize)]
+pub struct Point {
+    /// Number of throttled probes running at once.
+    pub nodes: usize,
+    pub requested_hz: u64,
+    pub achieved_hz: f64,
+}
+
+impl Point {
+    /// `(achieved - requested) / requested`.
+    pub fn error(&self) -> f64 {
+        (self.achieved_hz - self.requested_hz as f64) / self.requested_hz as f64
+    }
+}
+
+/// Every probe run with one base period, and how well a fit explains them.
+#[derive(Clone, Debug, PartialEq, Serialize, Deserialize)]
+pub struct Sweep {
+    pub period_us: u64,
+    pub fit: Fit,
+    /// Mean absolute relative error with no correction applied.
+    pub raw_error: f64,
+    /// Largest relative error left once the fit is applied.
+    pub residual: f64,
+    pub points: Vec<Point>,
+}
+
+impl Sweep {
+    pub fn new(period_us: u64, points: Vec<Point>) -> Self {
+        let fit = Fit::new(&points).unwrap_or_default();
+        let raw_error = if points.is_empty() {
+            f64::INFINITY
+        } else {
+            points.iter().map(|p| p.error().abs()).sum::<f64>() / points.len() as f64
+        };
+        let residual = points
+            .iter()
+            .map(|p| ((fit.achieved(p.requested_hz as f64) - p.achieved_hz) / p.achieved_hz).abs())
+            .fold(
+                if points.is_empty() {
+                    f64::INFINITY
+                } else {
+                    0.0
+                },
+                f64::max,
+            );
+        Self {
+            period_us,
+            fit,
+            raw_error,
+            residual,
+            points,
+        }
+    }
+
+    pub fn accurate(&self, tolerance: f64) -> bool {
+        self.residual <= tolerance
+    }
+}
+
+/// A host's calibration profile.
+#[derive(Clone, Debug, PartialEq, Serialize, Deserialize)]
+pub struct Calibration {
+    /// Host the profile was measured on.
+    pub host: String,
+    /// Base `cpu.max` period in microseconds. Nodes slower than their core
+    /// get this as their quota and a proportionally longer period.
+    pub period_us: u64,
+    pub fit: Fit,
+    /// Largest fitted error accepted when choosing `period_us`.
+    pub tolerance: f64,
+    /// Every sweep the profile was chosen from, shortest period first.
+    pub sweeps: Vec<Sweep>,
+}
+
+impl Default for Calibration {
+    fn default() -> Self {
+        Self::uncorrected(CPU_PERIOD_MIN)
+    }
+}
+
+impl Calibration {
+    /// No correction, with `period_us` as the base period. What the runner
+    /// uses without a profile, and what `nexus calibrate` measures with.
+    pub fn uncorrected(period_us: u64) -> Self {
+        Self {
+            host: String::new(),
+            period_us,
+            fit: Fit::default(),
+            tolerance: 0.0,
+            sweeps: vec![],
+        }
+    }
+
+    /// Choose the shortest period whose fit stays within `tolerance`, or
+    /// the most accurate one if none do.
+    pub fn from_sweeps(host: String, mut sweeps: Vec<Sweep>, tolerance: f64) -> Option<Self> {
+        sweeps.sort_by_key(|s| s.period_us);
+        let chosen = sweeps.iter().find(|s| s.accurate(tolerance)).or_else(|| {
+            sweeps
+                .iter()
+                .min_by(|a, b| a.residual.total_cmp(&b.residual))
+        })?;
+        Some(Self {
+            host,
+            period_us: chosen.period_us,
+            fit: chosen.fit,
+            tolerance,
+            sweeps,
+        })
+    }
+
+    /// Base period clamped to what `cpu.max` accepts.
+    pub fn period(&self) -> u64 {
+        self.period_us.clamp(CPU_PERIOD_MIN, CPU_PERIOD_MAX)
+    }
+
+    /// Cycles per second to ask cgroups for so a node gets `required_hz`.
+    pub fn correct(&self, required_hz: f64) -> f64 {
+        self.fit.requested(required_hz)
+    }
+
+    /// Where this host's profile lives: `$NEXUS_CALIBRATION` if set,
+    /// otherwise `~/.config/nexus/calibration/<hostname>.toml`.
+    pub fn host_path() -> Option<PathBuf> {
+        if let Some(path) = std::env::var_os(CALIBRATION_ENV) {
+            return Some(PathBuf::from(path));
+        }
+        let config = std::env::var_os("XDG_CONFIG_HOME")
+            .map(PathBuf::from)
+            .or_else(|| home::home_dir().map(|home| home.join(".config")))?;
+        Some(
+            config
+                .join("nexus")
+                .join("calibration")
+                .join(format!("{}.toml", hostname())),
+        )
+    }
+
+    pub fn load(path: &Path) -> Result<Self, CalibrationError> {
+        Ok(toml::from_str(&std::fs::read_to_string(path)?)?)
+    }
+
+    pub fn save(&self, path: &Path) -> Result<(), CalibrationError> {
+        if let Some(parent) = path.parent() {
+            std::fs::create_dir_all(parent)?;
+        }
+        std::fs::write(path, toml::to_string(self)?)?;
+        Ok(())
+    }
+
+    /// This host's saved profile, or no correction if it was never
+    /// calibrated. A profile that fails to load is reported and ignored.
+    pub fn for_host() -> Self {
+        let Some(path) = Self::host_path().filter(|p| p.exists()) else {
+            return Self::default();
+        };
+        Self::load(&path).unwrap_or_else(|e| {
+            eprintln!("Ignoring calibration profile at {}: {e}", path.display());
+            Self::default()
+        })
+    }
+}
+
+pub fn hostname() -> String {
+    std::fs::read_to_string(HOSTNAME)
+        .map(|s| s.trim().to_string())
+        .ok()
+        .filter(|s| !s.is_empty())
+        .unwrap_or_else(|| "localhost".to_string())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn points(fit: Fit, rates: &[u64]) -> Vec<Point> {
+        rates
+            .iter()
+            .map(|&requested_hz| Point {
+                nodes: 1,
+                requested_hz,
+                achieved_hz: fit.achieved(requested_hz as f64),
+            })
+            .collect()
+    }
+
+    #[test]
+    fn fit_recovers_power_law_and_inverts() {
+        let truth = Fit {
+            scale: 0.5,
+            exponent: 1.1,
+        };
+        let fit = Fit::new(&points(truth, &[1_000_000, 4_000_000, 16_000_000])).unwrap();
+        assert!((fit.scale - truth.scale).abs() < 1e-6);
+        assert!((fit.exponent - truth.exponent).abs() < 1e-9);
+        let requested = fit.requested(8_000_000.0);
+        assert!((fit.achieved(requested) - 8_000_000.0).abs() < 1e-3);
+
+        let single = Fit::new(&points(truth, &[2_000_000])).unwrap();
+        assert_eq!(single.exponent, 1.0);
+        assert!((single.achieved(2_000_000.0) - truth.achieved(2_000_000.0)).abs() < 1e-3);
+        assert!(Fit::new(&[]).is_none());
+    }
+
+    #[test]
+    fn shortest_accurate_period_is_chosen() {
+        let rates = [1_000_000, 4_000_000, 16_000_000];
+        let mut noisy = points(Fit::default(), &rates);
+        noisy[1].achieved_hz *= 0.7;
+        let exact = points(
+            Fit {
+                scale: 0.9,
+                exponent: 1.0,
+            },
+            &rates,
+        );
+        let sweeps = vec![
+            Sweep::new(20_000, exact.clone()),
+            Sweep::new(1_000, noisy),
+            Sweep::new(5_000, exact),
+        ];
+        assert!((sweeps[0].raw_error - 0.1).abs() < 1e-9);
+        assert!(sweeps[0].accurate(0.01));
+        let cal = Calibration::from_sweeps("host".to_string(), sweeps, 0.01).unwrap();
+        assert_eq!(cal.period_us, 5_000);
+        assert_eq!(cal.sweeps[0].period_us, 1_000);
+        assert!((cal.correct(0.9e6) - 1e6).abs() < 1e-3);
+
+        let none = Calibration::from_sweeps("host".to_string(), cal.sweeps.clone(), 0.0).unwrap();
+        assert_ne!(none.period_us, 1_000);
+        assert!(Calibration::from_sweeps("host".to_string(), vec![], 0.05).is_none());
+    }
+
+    #[test]
+    fn profiles_round_trip_and_default_is_identity() {
+        let cal = Calibration::from_sweeps(
+            "host".to_string(),
+            vec![Sweep::new(2_000, points(Fit::default(), &[1_000_000]))],
+            0.05,
+        )
+        .unwrap();
+        let dir = tempfile::tempdir().unwrap();
+        let path = dir.path().join("nested").join("host.toml");
+        cal.save(&path).unwrap();
+        assert_eq!(Calibration::load(&path).unwrap(), cal);
+
+        let default = Calibration::default();
+        assert_eq!(default.period(), CPU_PERIOD_MIN);
+        assert_eq!(default.correct(16e6), 16e6);
+        assert_eq!(Calibration::uncorrected(10).period(), CPU_PERIOD_MIN);
+    }
+}
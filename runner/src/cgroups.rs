@@ -2,7 +2,8 @@ use std::{
     collections::HashMap,
     io,
     path::{Path, PathBuf},
-    process::Child,
+    process::{Child, ExitStatus, Output},
+    sync::Arc,
 };
 
 use config::ast::{self, NodeProtocol, Resources};
@@ -14,6 +15,7 @@ use crate::{
     cgroupfs::{CgroupFs, RealCgroupFs},
     errors::ProtocolError,
     run_protocol,
+    zygote::{Forked, Zygote},
 };
 
 pub const NODES_LIMITED: &str = "nodes_limited";
@@ -25,6 +27,7 @@ pub const SUBTREE: &str = "cgroup.subtree_control";
 pub const UCLAMP_MIN: &str = "cpu.uclamp.min";
 pub const UCLAMP_MAX: &str = "cpu.uclamp.max";
 pub const CPU_MAX: &str = "cpu.max";
+pub const CPU_STAT: &str = "cpu.stat";
 pub const CPU_MAX_SCALAR_DIFFERENCE: u64 = 1000;
 pub const CPU_BANDWIDTH_MIN: u64 = 1_000;
 // True max is much larger but that's not a case we would ever
@@ -53,6 +56,8 @@ pub struct CgroupController {
     lockdir: TempDir,
     /// Lockfile to drain bash script time quantum before starting
     lockfile: PathBuf,
+    /// Fork servers for `zygote` protocols, one per root and program.
+    zygotes: HashMap<(PathBuf, String), Arc<Zygote>>,
 }
 
 #[derive(Clone, Debug)]
@@ -76,9 +81,56 @@ pub struct ProtocolHandle {
     /// Name of the protocol. Unique identifier for a process within a node.
     pub protocol: ast::ProtocolHandle,
     /// Handle for the executing process.
-    pub process: Option<Child>,
+    pub process: Option<Process>,
     /// Path to the cgroup directory for this protocol.
     pub cgroup_path: Option<PathBuf>,
+    /// Fork server to start the process from, for `zygote` protocols.
+    zygote: Option<Arc<Zygote>>,
+}
+
+/// A protocol's process, started through the shell wrapper or forked by a
+/// zygote.
+#[derive(Debug)]
+pub enum Process {
+    Spawned(Child),
+    Forked(Forked),
+}
+
+impl Process {
+    pub fn id(&self) -> u32 {
+        match self {
+            Process::Spawned(child) => child.id(),
+            Process::Forked(forked) => forked.id(),
+        }
+    }
+
+    pub fn kill(&mut self) -> io::Result<()> {
+        match self {
+            Process::Spawned(child) => child.kill(),
+            Process::Forked(forked) => forked.kill(),
+        }
+    }
+
+    pub fn try_wait(&mut self) -> io::Result<Option<ExitStatus>> {
+        match self {
+            Process::Spawned(child) => child.try_wait(),
+            Process::Forked(forked) => forked.try_wait(),
+        }
+    }
+
+    pub fn wait(&mut self) -> io::Result<ExitStatus> {
+        match self {
+            Process::Spawned(child) => child.wait(),
+            Process::Forked(forked) => forked.wait(),
+        }
+    }
+
+    pub fn wait_with_output(self) -> io::Result<Output> {
+        match self {
+            Process::Spawned(child) => child.wait_with_output(),
+            Process::Forked(forked) => forked.wait_with_output(),
+        }
+    }
 }
 
 impl ProtocolHandle {
@@ -97,12 +149,13 @@ impl ProtocolHandle {
             protocol,
             process: None,
             cgroup_path: None,
+            zygote: None,
         }
     }
 
     /// Return the PID of the running process, if any.
     pub fn pid(&self) -> Option<u32> {
-        self.process.as_ref().map(Child::id)
+        self.process.as_ref().map(Process::id)
     }
 
     /// Kill the current process and respawn it in its cgroup.
@@ -141,12 +194,15 @@ impl ProtocolHandle {
     pub fn finish(mut self) -> Result<Option<ProtocolSummary>, io::Error> {
         match self.process.take() {
             Some(mut p) => {
+                let pid = p.id();
                 p.kill()?;
                 let output = p.wait_with_output()?;
                 Ok(Some(ProtocolSummary {
                     node: self.node,
                     protocol: self.protocol,
+                    pid,
                     output,
+                    stats: None,
                 }))
             }
             None => Ok(None),
@@ -154,15 +210,29 @@ impl ProtocolHandle {
     }
 
     pub fn run(&mut self, cgroup: &Path, lockfile: &Path) -> Result<bool, ProtocolError> {
-        if self.process.is_none() {
-            let process =
-                run_protocol(&self.ast, cgroup, lockfile).map_err(ProtocolError::UnableToRun)?;
-            move_process(&RealCgroupFs, cgroup, process.id());
-            self.process = Some(process);
-            Ok(true)
-        } else {
-            Ok(false)
+        if self.process.is_some() {
+            return Ok(false);
         }
+        let process = match &self.zygote {
+            Some(zygote) => {
+                let runner = &self.ast.runner;
+                let argv: Vec<&str> = std::iter::once(runner.cmd.as_str())
+                    .chain(runner.args.iter().map(String::as_str))
+                    .collect();
+                let forked = zygote
+                    .fork(&argv, &cgroup.join(PROCS), lockfile)
+                    .map_err(ProtocolError::UnableToRun)?;
+                Process::Forked(forked)
+            }
+            None => {
+                let child = run_protocol(&self.ast, cgroup, lockfile)
+                    .map_err(ProtocolError::UnableToRun)?;
+                move_process(&RealCgroupFs, cgroup, child.id());
+                Process::Spawned(child)
+            }
+        };
+        self.process = Some(process);
+        Ok(true)
     }
 }
 
@@ -235,6 +305,7 @@ impl CgroupController {
             fs,
             lockdir,
             lockfile,
+            zygotes: HashMap::new(),
         };
         obj.freeze_nodes();
         Ok(obj)
@@ -341,6 +412,9 @@ impl CgroupController {
             name.to_string(),
         );
         proto_handle.cgroup_path = Some(cgroup.clone());
+        if protocol.zygote {
+            proto_handle.zygote = Some(self.zygote(protocol)?);
+        }
         proto_handle.run(&cgroup, lockfile)?;
         // Re-borrow to add the protocol cgroup
         let node = self.get_node(handle).expect("node was just looked up");
@@ -397,6 +471,23 @@ impl CgroupController {
         }
     }
 
+    /// Microseconds of CPU time the protocol's cgroup has used so far, or
+    /// `None` if its `cpu.stat` can't be read.
+    pub fn cpu_usage(&self, handle: &ProtocolHandle) -> Option<u64> {
+        cpu_usage(&*self.fs, handle.cgroup_path.as_ref()?)
+    }
+
+    /// The fork server for `protocol`'s program, started on first use.
+    fn zygote(&mut self, protocol: &NodeProtocol) -> Result<Arc<Zygote>, ProtocolError> {
+        let key = (protocol.root.clone(), protocol.runner.cmd.clone());
+        if let Some(zygote) = self.zygotes.get(&key) {
+            return Ok(zygote.clone());
+        }
+        let zygote = Arc::new(Zygote::start(protocol).map_err(ProtocolError::UnableToRun)?);
+        self.zygotes.insert(key, zygote.clone());
+        Ok(zygote)
+    }
+
     fn get_node(&mut self, handle: &NodeHandle) -> Option<&mut NodeCgroup> {
         if handle.has_limited_resources {
             self.nodes_limited.nodes.get_mut(&handle.key)
@@ -412,6 +503,13 @@ fn uclamp_min(fs: &dyn CgroupFs, cgroup: &Path, bytes: &[u8]) {
     }
 }
 
+fn cpu_usage(fs: &dyn CgroupFs, cgroup: &Path) -> Option<u64> {
+    let stat = fs.read_to_string(&cgroup.join(CPU_STAT)).ok()?;
+    stat.lines()
+        .find_map(|line| line.strip_prefix("usage_usec "))
+        .and_then(|usage| usage.trim().parse().ok())
+}
+
 fn make_root(fs: &dyn CgroupFs, pid: u32) -> io::Result<PathBuf> {
     let parent_cgroup = PathBuf::from(format!("/proc/{pid}/cgroup"));
     let buf = fs.read_to_string(&parent_cgroup)?;
@@ -535,6 +633,18 @@ mod tests {
         assert_eq!(root, PathBuf::from("/sys/fs/cgroup"));
     }
 
+    #[test]
+    fn cpu_usage_reads_usage_usec() {
+        let mock = MockCgroupFs::new();
+        let cgroup = PathBuf::from("/sys/fs/cgroup/test_cgroup/n1/main");
+        mock.seed_file(
+            cgroup.join(CPU_STAT),
+            "usage_usec 1234\nuser_usec 1000\nsystem_usec 234\n",
+        );
+        assert_eq!(cpu_usage(&mock, &cgroup), Some(1234));
+        assert_eq!(cpu_usage(&mock, Path::new("/missing")), None);
+    }
+
     #[test]
     fn drop_cleans_up() {
         let mock = MockCgroupFs::new();
@@ -1,4 +1,9 @@
-use std::{fmt::Display, path::PathBuf};
+use std::{
+    fmt::Display,
+    net::SocketAddr,
+    num::{NonZeroU32, NonZeroU64},
+    path::PathBuf,
+};
 
 use clap::{Parser, Subcommand, ValueEnum};
 
@@ -24,6 +29,28 @@ pub struct Cli {
     /// Location where the NexusFS should be mounted during simulation
     #[arg(short, long)]
     pub root: Option<PathBuf>,
+
+    /// What to do with trace records when the trace writer falls behind
+    #[arg(long, default_value_t)]
+    pub trace_overflow: TraceOverflow,
+}
+
+#[derive(ValueEnum, Debug, Default, Clone, Copy, PartialEq)]
+pub enum TraceOverflow {
+    /// Wait for the writer, so the trace is complete
+    #[default]
+    Block,
+    /// Drop the record and count it, so the simulation never waits
+    Drop,
+}
+
+impl Display for TraceOverflow {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        match self {
+            TraceOverflow::Block => f.write_str("block"),
+            TraceOverflow::Drop => f.write_str("drop"),
+        }
+    }
 }
 
 #[derive(ValueEnum, Debug, Default, Clone)]
@@ -67,6 +94,33 @@ pub enum RunCmd {
     Simulate {
         /// Configuration toml file for the simulation
         config: PathBuf,
+
+        /// Once simulated time reaches this timestep, have every protocol
+        /// save its state, write a checkpoint to the simulation directory
+        /// and stop
+        #[arg(long)]
+        checkpoint_at: Option<u64>,
+
+        /// Continue from a checkpoint an earlier run of the same
+        /// configuration wrote
+        #[arg(long)]
+        resume_from: Option<PathBuf>,
+
+        /// Sample every protocol's call stack this many times per second of
+        /// CPU time it uses and record the samples in the trace, for
+        /// `nexus profile`
+        #[arg(long, value_name = "HZ")]
+        profile: Option<NonZeroU32>,
+
+        /// Simulate only this partition of the nodes, exchanging messages
+        /// with the hosts running the others
+        #[arg(long, requires = "peers")]
+        partition: Option<usize>,
+
+        /// Address every partition's host listens on, in partition order,
+        /// this host's included
+        #[arg(long, value_delimiter = ',', requires = "partition")]
+        peers: Vec<SocketAddr>,
     },
     Replay {
         logs: PathBuf,
@@ -74,7 +128,119 @@ pub enum RunCmd {
     Logs {
         logs: PathBuf,
     },
-    Fuzz,
+    /// Fuzz a node's protocol in persistent mode: a coverage-guided fuzzer
+    /// linked into it hands each input to the simulator through `ctl.fuzz`,
+    /// and the frames in it take the place of everything the node receives
+    /// on one channel
+    Fuzz {
+        /// Configuration toml file for the simulation
+        config: PathBuf,
+
+        /// Deployment of the node to fuzz (e.g. `rx.0`); no other node runs
+        #[arg(long)]
+        node: String,
+
+        /// Channel the fuzzed frames arrive on
+        #[arg(long)]
+        channel: String,
+
+        /// Deliver the frames of this saved input (e.g. a crash the fuzzer
+        /// found) once at the start of an ordinary run and record its trace,
+        /// instead of fuzzing
+        #[arg(long)]
+        input: Option<PathBuf>,
+    },
+    /// Run a simulation across every combination of the given seeds,
+    /// timestep lengths and clock scales, several runs at a time on
+    /// disjoint CPU sets
+    Sweep {
+        /// Configuration toml file for the simulation
+        config: PathBuf,
+
+        /// Seeds to run with (comma-separated); defaults to the config's
+        #[arg(long, value_delimiter = ',')]
+        seeds: Option<Vec<u64>>,
+
+        /// Timestep lengths to run with, in the config's timestep unit
+        /// (comma-separated); defaults to the config's
+        #[arg(long, value_delimiter = ',')]
+        timestep_lengths: Option<Vec<NonZeroU64>>,
+
+        /// Factors to scale every node's clock rate by (comma-separated)
+        #[arg(long, value_delimiter = ',')]
+        clock_scales: Option<Vec<f64>>,
+
+        /// CPUs each run gets to itself; defaults to one per node
+        #[arg(long)]
+        cpus_per_run: Option<usize>,
+
+        /// Write the aggregated results to this file instead of stdout
+        #[arg(long)]
+        output: Option<PathBuf>,
+    },
+    /// Run one point of a sweep from the snapshot `nexus sweep` wrote
+    #[command(hide = true)]
+    SweepRun {
+        snapshot: PathBuf,
+    },
+    /// Run the benchmark scenarios across node counts and message sizes
+    Bench {
+        /// Directory holding the scenario files and the Makefile that
+        /// builds their protocols
+        #[arg(long, default_value = "examples/bench")]
+        suite: PathBuf,
+
+        /// Scenarios to run by file stem (comma-separated); defaults to
+        /// every `.toml` file in the suite
+        #[arg(long, value_delimiter = ',')]
+        scenarios: Option<Vec<String>>,
+
+        /// Number of `peer` nodes to run each scenario with (comma-separated)
+        #[arg(long, value_delimiter = ',', default_value = "1,4,16")]
+        nodes: Vec<usize>,
+
+        /// Message sizes in bytes to sweep scenarios that take `{size}`
+        /// (comma-separated)
+        #[arg(long, value_delimiter = ',', default_value = "16,256,1024")]
+        sizes: Vec<usize>,
+
+        /// Write results to this file instead of stdout
+        #[arg(long)]
+        output: Option<PathBuf>,
+    },
+    /// Measure how closely cgroup throttling achieves requested clock rates
+    /// on this host, and save a profile that corrects for it
+    Calibrate {
+        /// Directory holding the probe's `nexus.toml`; its first node is run
+        /// throttled and prints how many iterations it managed in a second
+        #[arg(long, default_value = "examples/count")]
+        probe: PathBuf,
+
+        /// Clock rates to request in MHz (comma-separated)
+        #[arg(long, value_delimiter = ',', default_value = "1,4,16,64")]
+        rates: Vec<u64>,
+
+        /// Base `cpu.max` periods to try in microseconds (comma-separated)
+        #[arg(
+            long,
+            value_delimiter = ',',
+            default_value = "1000,2000,5000,10000,20000"
+        )]
+        periods: Vec<u64>,
+
+        /// Numbers of probes to run at once (comma-separated)
+        #[arg(long, value_delimiter = ',', default_value = "1,4")]
+        nodes: Vec<usize>,
+
+        /// Largest relative error, once corrected, for a period to count as
+        /// accurate
+        #[arg(long, default_value_t = 0.05)]
+        tolerance: f64,
+
+        /// Where to save the profile; defaults to this host's profile path
+        #[arg(long)]
+        output: Option<PathBuf>,
+    },
     /// Manage and inspect reusable module files
     Modules {
         #[command(subcommand)]
@@ -85,7 +251,7 @@ pub enum RunCmd {
         /// Path to the .nxs trace file
         trace: PathBuf,
 
-        /// Filter by event types (comma-separated: tx,rx,drop,position,energy,motion)
+        /// Filter by event types (comma-separated: tx,rx,drop,position,energy,motion,cpu)
         #[arg(long, value_delimiter = ',')]
         events: Option<Vec<EventFilter>>,
 
@@ -117,6 +283,32 @@ pub enum RunCmd {
         #[arg(long)]
         header_only: bool,
     },
+    /// Export the CPU samples a `--profile` simulation recorded as folded
+    /// stacks, for flame graph tools
+    Profile {
+        /// Path to the .nxs trace file
+        trace: PathBuf,
+
+        /// Only these nodes (comma-separated)
+        #[arg(long, value_delimiter = ',')]
+        nodes: Option<Vec<String>>,
+
+        /// Only these protocols (comma-separated)
+        #[arg(long, value_delimiter = ',')]
+        protocols: Option<Vec<String>>,
+
+        /// Start timestep (inclusive)
+        #[arg(long)]
+        from: Option<u64>,
+
+        /// End timestep (inclusive)
+        #[arg(long)]
+        to: Option<u64>,
+
+        /// Write the stacks to this file instead of stdout
+        #[arg(long)]
+        output: Option<PathBuf>,
+    },
 }
 
 #[derive(Subcommand, Debug, Clone, PartialEq)]
@@ -145,9 +337,14 @@ impl Display for RunCmd {
             RunCmd::Simulate { .. } => write!(f, "simulate"),
             RunCmd::Replay { .. } => write!(f, "replay"),
             RunCmd::Logs { .. } => write!(f, "logs"),
-            RunCmd::Fuzz => write!(f, "fuzz"),
+            RunCmd::Fuzz { .. } => write!(f, "fuzz"),
+            RunCmd::Sweep { .. } => write!(f, "sweep"),
+            RunCmd::SweepRun { .. } => write!(f, "sweep-run"),
+            RunCmd::Bench { .. } => write!(f, "bench"),
+            RunCmd::Calibrate { .. } => write!(f, "calibrate"),
             RunCmd::Modules { .. } => write!(f, "modules"),
             RunCmd::Parse { .. } => write!(f, "parse"),
+            RunCmd::Profile { .. } => write!(f, "profile"),
         }
     }
 }
@@ -160,6 +357,7 @@ pub enum EventFilter {
     Position,
     Energy,
     Motion,
+    Cpu,
 }
 
 #[derive(ValueEnum, Debug, Clone, Default, PartialEq)]
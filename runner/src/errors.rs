@@ -49,3 +49,13 @@ pub enum ProtocolError {
     #[error("Node not found for handle: {0}")]
     NodeNotFound(String),
 }
+
+#[derive(Error, Debug)]
+pub enum CalibrationError {
+    #[error("Unable to access calibration profile: {0}")]
+    Io(#[from] std::io::Error),
+    #[error("Invalid calibration profile: {0}")]
+    Parse(#[from] toml::de::Error),
+    #[error("Unable to serialize calibration profile: {0}")]
+    Serialize(#[from] toml::ser::Error),
+}
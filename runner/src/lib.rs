@@ -1,4 +1,4 @@
-use config::ast::{self, Cmd, NodeProtocol};
+use config::ast::{self, NodeProtocol};
 use cpuutils::cpufreq::get_cpu_info;
 use std::{
     io,
@@ -7,14 +7,18 @@ use std::{
 };
 use tempfile::TempDir;
 pub mod assignment;
+pub mod build;
+pub mod calibration;
 pub mod cgroupfs;
 pub mod cgroups;
 pub mod cli;
 pub mod errors;
 pub mod output;
+pub mod zygote;
 use errors::*;
 
 use crate::assignment::{Affinity, AffinityBuilder, Bandwidth, Relative, RelativeBuilder};
+use crate::calibration::Calibration;
 pub use crate::cgroups::*;
 
 #[derive(Debug)]
@@ -30,15 +34,12 @@ pub struct RunController {
 pub struct ProtocolSummary {
     pub node: ast::NodeHandle,
     pub protocol: ast::ProtocolHandle,
+    /// PID the protocol was running under when it was stopped.
+    pub pid: fuse::PID,
     pub output: Output,
-}
-
-struct BuildCtx<'a> {
-    node: &'a str,
-    protocol: &'a str,
-    cmd: &'a Cmd,
-    root: &'a Path,
-    handle: Child,
+    /// FUSE and router operation counters, filled in by
+    /// `output::collect_stats`.
+    pub stats: Option<fuse::stats::StatsSnapshot>,
 }
 
 fn run_protocol(p: &NodeProtocol, cgroup: &Path, lockfile: &Path) -> io::Result<Child> {
@@ -70,73 +71,25 @@ exec stdbuf -i0 -o0 -e0 {cmd} {args}
         .spawn()
 }
 
-fn build_protocol<'a>(
-    node_name: &'a ast::NodeHandle,
-    protocol_name: &'a ast::ProtocolHandle,
-    p: &'a NodeProtocol,
-) -> io::Result<BuildCtx<'a>> {
-    let cmd = p.build.cmd.as_str();
-    let args = p.build.args.as_slice();
-    let root = p.root.as_path();
-    Command::new(cmd)
-        .current_dir(root)
-        .args(args)
-        .stdout(Stdio::null())
-        .spawn()
-        .map(|handle| BuildCtx {
-            node: node_name,
-            protocol: protocol_name,
-            cmd: &p.build,
-            root,
-            handle,
-        })
-}
-
-fn check_builds<'a>(contexts: Vec<BuildCtx<'a>>) -> Vec<errors::RunnerDetail> {
-    let mut errors = vec![];
-    for mut ctx in contexts {
-        let exit_code = ctx.handle.wait().expect("cannot wait for process");
-        if !exit_code.success() {
-            // First fialure
-            if errors.is_empty() {
-                eprintln!("\nError building programs:\n");
-            }
-            errors.push(errors::RunnerDetail::new(
-                ctx.node.to_string(),
-                ctx.protocol.to_string(),
-                ctx.root.to_path_buf(),
-                format!("Command: {} ({exit_code})", ctx.cmd),
-            ));
-        }
-    }
-    errors
-}
-
-/// Walk the simulation AST and build each program.
+/// Walk the simulation AST and build each program, skipping builds that are
+/// already up to date. See [`build`](mod@build) for how builds are cached.
 pub fn build(sim: &ast::Simulation) -> Result<(), errors::ProtocolError> {
     println!("Building programs");
-    let contexts = sim
-        .nodes
-        .iter()
-        .flat_map(|(node_name, node)| {
-            node.protocols
-                .iter()
-                .filter(|(_, p)| !p.build.cmd.is_empty())
-                .map(|(protocol_name, p)| build_protocol(node_name, protocol_name, p))
-        })
-        .collect::<io::Result<Vec<_>>>()
-        .map_err(errors::ProtocolError::UnableToRun)?;
-    let errors = check_builds(contexts);
-    if errors.is_empty() {
-        Ok(())
-    } else {
-        Err(errors::ProtocolError::BuildErrors(errors))
-    }
+    build::build_all(sim, build::cache_dir().as_deref())
 }
 
 /// Execute all the protocols on every node in their own process.
 /// Returns a result with a vector of handles to refer to running processes.
+/// CPU bandwidth is corrected with this host's calibration profile, if any.
 pub fn run(sim: &ast::Simulation) -> Result<RunController, ProtocolError> {
+    run_calibrated(sim, Calibration::for_host())
+}
+
+/// `run`, with bandwidth assigned according to `calibration`.
+pub fn run_calibrated(
+    sim: &ast::Simulation,
+    calibration: Calibration,
+) -> Result<RunController, ProtocolError> {
     let mut cgroup_controller = CgroupController::new()?;
     let mut handles = Vec::new();
     let mut affinity_builder = AffinityBuilder::new();
@@ -174,8 +127,12 @@ pub fn run(sim: &ast::Simulation) -> Result<RunController, ProtocolError> {
     let relative_assignments = relative_builder.build(CPU_WEIGHT_MIN, CPU_WEIGHT_MAX);
     cgroup_controller.assign_cpu_weights(&relative_assignments);
     let cpuinfo = get_cpu_info(&affinity_assignments.cpuset);
-    let bandwidth_assignments =
-        Bandwidth::new(&affinity_assignments, &cpuinfo, sim.params.time_dilation);
+    let bandwidth_assignments = Bandwidth::new(
+        &affinity_assignments,
+        &cpuinfo,
+        sim.params.time_dilation,
+        calibration,
+    );
     cgroup_controller.assign_cpu_bandwidths(&bandwidth_assignments);
 
     Ok(RunController {
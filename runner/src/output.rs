@@ -19,20 +19,24 @@
 //! is serialised across all nodes and streams. Callers that fan-out
 //! to a channel (the GUI) get this for free; callers doing heavier
 //! work should keep the closure cheap.
+//!
+//! The per-protocol FUSE and router operation statistics printed at the
+//! end of a run are collected and formatted here too.
 
 use std::collections::HashMap;
 use std::fs::File;
-use std::io::{self, Read, Write as _};
+use std::io::{self, Read, Write};
 use std::os::fd::{AsRawFd, RawFd};
 use std::path::{Path, PathBuf};
 use std::process::{ChildStderr, ChildStdout};
 use std::thread::{self, JoinHandle};
 
+use fuse::stats::{Op, Stats};
 use mio::unix::SourceFd;
 use mio::{Events, Interest, Poll, Token};
 
 use crate::ProtocolSummary;
-use crate::cgroups::ProtocolHandle;
+use crate::cgroups::{Process, ProtocolHandle};
 
 /// Which output stream a captured line came from.
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
@@ -82,17 +86,27 @@ where
         };
         let node = handle.node.clone();
         let protocol = handle.protocol.clone();
-        if let Some(stdout) = process.stdout.take() {
+        let (stdout, stderr) = match process {
+            Process::Spawned(child) => (
+                child.stdout.take().map(PipeReader::Stdout),
+                child.stderr.take().map(PipeReader::Stderr),
+            ),
+            Process::Forked(forked) => (
+                forked.stdout.take().map(PipeReader::Pipe),
+                forked.stderr.take().map(PipeReader::Pipe),
+            ),
+        };
+        if let Some(pipe) = stdout {
             specs.push(StreamSpec {
-                pipe: PipeReader::Stdout(stdout),
+                pipe,
                 node: node.clone(),
                 protocol: protocol.clone(),
                 stream: OutputStream::Stdout,
             });
         }
-        if let Some(stderr) = process.stderr.take() {
+        if let Some(pipe) = stderr {
             specs.push(StreamSpec {
-                pipe: PipeReader::Stderr(stderr),
+                pipe,
                 node,
                 protocol,
                 stream: OutputStream::Stderr,
@@ -162,6 +176,49 @@ pub fn collect_captured_output(sim_dir: &Path, summaries: &mut [ProtocolSummary]
     }
 }
 
+/// Copy each summary's operation counters out of `stats`, the registry the
+/// FUSE filesystem and router recorded into during the run.
+pub fn collect_stats(stats: &Stats, summaries: &mut [ProtocolSummary]) {
+    for summary in summaries {
+        summary.stats = stats.snapshot(summary.pid);
+    }
+}
+
+/// Write one row per operation each protocol performed at least once.
+/// Latencies are in microseconds; the percentiles are the upper bounds of
+/// power-of-two buckets, so read them as "at most".
+pub fn write_stats_summary(mut w: impl Write, summaries: &[ProtocolSummary]) -> io::Result<()> {
+    writeln!(
+        w,
+        "{:<16} {:<16} {:<13} {:>10} {:>12} {:>10} {:>10} {:>10}",
+        "node", "protocol", "op", "count", "total_ms", "mean_us", "p50_us", "p99_us"
+    )?;
+    for summary in summaries {
+        let Some(stats) = &summary.stats else {
+            continue;
+        };
+        for op in Op::ALL {
+            let s = stats.get(op);
+            if s.count == 0 {
+                continue;
+            }
+            writeln!(
+                w,
+                "{:<16} {:<16} {:<13} {:>10} {:>12.3} {:>10.3} {:>10.3} {:>10.3}",
+                summary.node,
+                summary.protocol,
+                op.name(),
+                s.count,
+                s.total_ns as f64 / 1e6,
+                s.mean_ns() as f64 / 1e3,
+                s.quantile_ns(0.5) as f64 / 1e3,
+                s.quantile_ns(0.99) as f64 / 1e3,
+            )?;
+        }
+    }
+    Ok(())
+}
+
 /// One epoll registration's worth of state. Owns the pipe (so the fd
 /// closes when this is dropped), the capture file, and the rolling
 /// line buffer holding bytes received since the last newline.
@@ -174,11 +231,13 @@ struct Capture {
     stream: OutputStream,
 }
 
-/// Type-erased stdout/stderr handle. Both impl `Read + AsRawFd` but
-/// they're distinct types; this enum lets us store either.
+/// Type-erased stdout/stderr handle. All impl `Read + AsRawFd` but
+/// they're distinct types; this enum lets us store any of them.
 enum PipeReader {
     Stdout(ChildStdout),
     Stderr(ChildStderr),
+    /// Read end of a pipe handed to a zygote-forked process.
+    Pipe(File),
 }
 
 impl Read for PipeReader {
@@ -186,6 +245,7 @@ impl Read for PipeReader {
         match self {
             PipeReader::Stdout(p) => p.read(buf),
             PipeReader::Stderr(p) => p.read(buf),
+            PipeReader::Pipe(p) => p.read(buf),
         }
     }
 }
@@ -195,6 +255,7 @@ impl AsRawFd for PipeReader {
         match self {
             PipeReader::Stdout(p) => p.as_raw_fd(),
             PipeReader::Stderr(p) => p.as_raw_fd(),
+            PipeReader::Pipe(p) => p.as_raw_fd(),
         }
     }
 }
@@ -457,6 +518,48 @@ mod tests {
         );
     }
 
+    /// Only operations a protocol actually performed get a row, and
+    /// protocols without counters are skipped.
+    #[test]
+    fn stats_summary_lists_performed_ops() {
+        use std::os::unix::process::ExitStatusExt;
+        use std::process::{ExitStatus, Output};
+        use std::time::Instant;
+
+        let stats = Stats::default();
+        stats.register(42);
+        let counters = stats.get(42).unwrap();
+        counters.record(Op::Read, Instant::now());
+        counters.record(Op::Read, Instant::now());
+        counters.record(Op::RouterSleep, Instant::now());
+        let summary = |node: &str, pid| ProtocolSummary {
+            node: node.to_string(),
+            protocol: "p".to_string(),
+            pid,
+            output: Output {
+                status: ExitStatus::from_raw(0),
+                stdout: Vec::new(),
+                stderr: Vec::new(),
+            },
+            stats: None,
+        };
+        let mut summaries = vec![summary("a", 42), summary("b", 7)];
+        collect_stats(&stats, &mut summaries);
+        assert!(summaries[1].stats.is_none());
+
+        let mut out = Vec::new();
+        write_stats_summary(&mut out, &summaries).unwrap();
+        let out = String::from_utf8(out).unwrap();
+        let rows: Vec<Vec<&str>> = out
+            .lines()
+            .skip(1)
+            .map(|l| l.split_whitespace().collect())
+            .collect();
+        assert_eq!(rows.len(), 2);
+        assert_eq!(rows[0][..4], ["a", "p", "read", "2"]);
+        assert_eq!(rows[1][..4], ["a", "p", "router_sleep", "1"]);
+    }
+
     /// A child that writes bytes without a terminating newline, then
     /// exits, must still have those bytes flushed to the capture file
     /// and surfaced to the callback.
@@ -0,0 +1,524 @@
+//! zygote.rs
+//! Fork servers for protocols with `zygote = true`.
+//!
+//! Instead of starting every deployment through its own shell and `exec`,
+//! the runner starts the program once per root and command with
+//! `NEXUS_ZYGOTE_FD` naming one end of a `SOCK_SEQPACKET` socket. The SDK's
+//! `nexus::zygote` hook (`examples/arduino/common/include/Zygote.h`) then
+//! serves requests on it, forking one deployment per request.
+//!
+//! Request: NUL-terminated fields, the lockfile to wait on, the
+//! `cgroup.procs` file to join, then the deployment's `argv`, with its
+//! stdout and stderr pipes attached as `SCM_RIGHTS`. Reply: the
+//! deployment's PID as a native-endian `i32`, or a negated errno.
+//!
+//! The zygote forks twice, so each deployment is re-parented to the runner
+//! and can be waited on and killed like a protocol the runner started
+//! itself. Being a child subreaper is a property of the whole runner
+//! process, so it is one only while a request is served: the zygote reaps
+//! the middle fork, re-parenting the deployment, before it replies. Anything
+//! else orphaned under the runner in that window is re-parented too, and
+//! stays a zombie until the runner exits. The deployment moves itself
+//! into its cgroup and waits for the lockfile as the shell wrapper does, so
+//! the runner writes no `cgroup.procs` for it.
+
+use std::fs::File;
+use std::io;
+use std::os::fd::{AsRawFd, FromRawFd, OwnedFd, RawFd};
+use std::os::unix::ffi::OsStrExt;
+use std::os::unix::process::{CommandExt, ExitStatusExt};
+use std::path::{Path, PathBuf};
+use std::process::{Child, Command, ExitStatus, Output, Stdio};
+use std::sync::Mutex;
+
+use config::ast::NodeProtocol;
+
+/// Environment variable telling a program which descriptor to serve
+/// requests on.
+pub const ZYGOTE_ENV: &str = "NEXUS_ZYGOTE_FD";
+
+/// A running fork server. Closing its socket on drop makes it exit.
+#[derive(Debug)]
+pub struct Zygote {
+    process: Child,
+    /// Requests and replies alternate, so one caller at a time.
+    socket: Mutex<OwnedFd>,
+}
+
+impl Zygote {
+    /// Start `protocol`'s program as a fork server in its root.
+    pub fn start(protocol: &NodeProtocol) -> io::Result<Self> {
+        let (ours, theirs) = seqpacket_pair()?;
+        let fd = theirs.as_raw_fd();
+        let mut command = Command::new(program(protocol));
+        command
+            .args(&protocol.runner.args)
+            .current_dir(&protocol.root)
+            .env(ZYGOTE_ENV, fd.to_string())
+            .stdin(Stdio::null())
+            .stdout(Stdio::null());
+        // SAFETY: fcntl is async-signal-safe.
+        unsafe {
+            command.pre_exec(move || {
+                if libc::fcntl(fd, libc::F_SETFD, 0) < 0 {
+                    return Err(io::Error::last_os_error());
+                }
+                Ok(())
+            });
+        }
+        let process = command.spawn()?;
+        Ok(Self {
+            process,
+            socket: Mutex::new(ours),
+        })
+    }
+
+    /// Fork a deployment running with `args` as its `argv`. It joins the
+    /// cgroup owning `procs`, then waits for `lockfile` to be removed.
+    pub fn fork(&self, args: &[&str], procs: &Path, lockfile: &Path) -> io::Result<Forked> {
+        let mut request = Vec::new();
+        for field in [
+            lockfile.as_os_str().as_bytes(),
+            procs.as_os_str().as_bytes(),
+        ]
+        .into_iter()
+        .chain(args.iter().map(|arg| arg.as_bytes()))
+        {
+            if field.contains(&0) {
+                return Err(io::Error::new(
+                    io::ErrorKind::InvalidInput,
+                    "zygote request field contains a NUL byte",
+                ));
+            }
+            request.extend_from_slice(field);
+            request.push(0);
+        }
+        let (stdout, stdout_w) = pipe()?;
+        let (stderr, stderr_w) = pipe()?;
+
+        let socket = self.socket.lock().unwrap();
+        let _subreaper = Subreaper::acquire()?;
+        send_with_fds(
+            socket.as_raw_fd(),
+            &request,
+            &[stdout_w.as_raw_fd(), stderr_w.as_raw_fd()],
+        )?;
+        drop((stdout_w, stderr_w));
+        let mut reply = [0u8; size_of::<i32>()];
+        // SAFETY: `reply` is valid for writes of its length.
+        let n = unsafe {
+            libc::recv(
+                socket.as_raw_fd(),
+                reply.as_mut_ptr().cast(),
+                reply.len(),
+                0,
+            )
+        };
+        if n < 0 {
+            return Err(io::Error::last_os_error());
+        }
+        if n as usize != reply.len() {
+            return Err(io::Error::new(
+                io::ErrorKind::UnexpectedEof,
+                "zygote exited without replying",
+            ));
+        }
+        match i32::from_ne_bytes(reply) {
+            pid if pid > 0 => Ok(Forked {
+                pid: pid as u32,
+                stdout: Some(stdout),
+                stderr: Some(stderr),
+                status: None,
+            }),
+            err => Err(io::Error::from_raw_os_error(-err)),
+        }
+    }
+}
+
+impl Drop for Zygote {
+    fn drop(&mut self) {
+        let _ = self.process.kill();
+        let _ = self.process.wait();
+    }
+}
+
+/// A deployment forked by a zygote. The runner is its parent, so it is
+/// waited on directly.
+#[derive(Debug)]
+pub struct Forked {
+    pid: u32,
+    pub stdout: Option<File>,
+    pub stderr: Option<File>,
+    status: Option<ExitStatus>,
+}
+
+impl Forked {
+    pub fn id(&self) -> u32 {
+        self.pid
+    }
+
+    pub fn kill(&mut self) -> io::Result<()> {
+        // Once reaped, the PID may belong to someone else.
+        if self.status.is_some() {
+            return Ok(());
+        }
+        // SAFETY: plain syscall.
+        if unsafe { libc::kill(self.pid as libc::pid_t, libc::SIGKILL) } < 0 {
+            let err = io::Error::last_os_error();
+            if err.raw_os_error() != Some(libc::ESRCH) {
+                return Err(err);
+            }
+        }
+        Ok(())
+    }
+
+    pub fn try_wait(&mut self) -> io::Result<Option<ExitStatus>> {
+        self.wait_pid(libc::WNOHANG)
+    }
+
+    pub fn wait(&mut self) -> io::Result<ExitStatus> {
+        self.wait_pid(0)
+            .map(|status| status.expect("blocking wait returns a status"))
+    }
+
+    /// Wait for the process, collecting whatever is left on its pipes.
+    pub fn wait_with_output(mut self) -> io::Result<Output> {
+        let read = |pipe: Option<File>| -> io::Result<Vec<u8>> {
+            let mut buf = Vec::new();
+            if let Some(mut pipe) = pipe {
+                io::Read::read_to_end(&mut pipe, &mut buf)?;
+            }
+            Ok(buf)
+        };
+        let stdout = read(self.stdout.take())?;
+        let stderr = read(self.stderr.take())?;
+        Ok(Output {
+            status: self.wait()?,
+            stdout,
+            stderr,
+        })
+    }
+
+    fn wait_pid(&mut self, flags: libc::c_int) -> io::Result<Option<ExitStatus>> {
+        if let Some(status) = self.status {
+            return Ok(Some(status));
+        }
+        let mut status = 0;
+        loop {
+            // SAFETY: `status` is valid for writes.
+            let pid = unsafe { libc::waitpid(self.pid as libc::pid_t, &mut status, flags) };
+            match pid {
+                0 => return Ok(None),
+                pid if pid > 0 => break,
+                _ => {
+                    let err = io::Error::last_os_error();
+                    if err.kind() != io::ErrorKind::Interrupted {
+                        return Err(err);
+                    }
+                }
+            }
+        }
+        self.status = Some(ExitStatus::from_raw(status));
+        Ok(self.status)
+    }
+}
+
+/// The program to start, resolved against the protocol root when it is a
+/// relative path, as the shell wrapper's `exec` would.
+fn program(protocol: &NodeProtocol) -> PathBuf {
+    let cmd = Path::new(&protocol.runner.cmd);
+    if cmd.is_relative() && cmd.components().count() > 1 {
+        protocol.root.join(cmd)
+    } else {
+        cmd.to_path_buf()
+    }
+}
+
+/// Requests being served, across every zygote.
+static SUBREAPING: Mutex<usize> = Mutex::new(0);
+
+/// Keeps orphaned descendants, and so the deployment a zygote is forking,
+/// children of this process while any request is being served.
+struct Subreaper;
+
+impl Subreaper {
+    fn acquire() -> io::Result<Self> {
+        let mut serving = SUBREAPING.lock().unwrap();
+        if *serving == 0 {
+            set_subreaper(true)?;
+        }
+        *serving += 1;
+        Ok(Self)
+    }
+}
+
+impl Drop for Subreaper {
+    fn drop(&mut self) {
+        let mut serving = SUBREAPING.lock().unwrap();
+        *serving -= 1;
+        if *serving == 0 {
+            // Deployments already re-parented stay children.
+            let _ = set_subreaper(false);
+        }
+    }
+}
+
+fn set_subreaper(on: bool) -> io::Result<()> {
+    // SAFETY: plain syscall.
+    if unsafe { libc::prctl(libc::PR_SET_CHILD_SUBREAPER, libc::c_ulong::from(on)) } < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    Ok(())
+}
+
+fn seqpacket_pair() -> io::Result<(OwnedFd, OwnedFd)> {
+    let mut fds = [0; 2];
+    // SAFETY: `fds` is valid for two descriptors.
+    let ret = unsafe {
+        libc::socketpair(
+            libc::AF_UNIX,
+            libc::SOCK_SEQPACKET | libc::SOCK_CLOEXEC,
+            0,
+            fds.as_mut_ptr(),
+        )
+    };
+    if ret < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    // SAFETY: both descriptors were just created and are owned here.
+    Ok(unsafe { (OwnedFd::from_raw_fd(fds[0]), OwnedFd::from_raw_fd(fds[1])) })
+}
+
+/// Returns `(read, write)` ends of a new pipe.
+fn pipe() -> io::Result<(File, OwnedFd)> {
+    let mut fds = [0; 2];
+    // SAFETY: `fds` is valid for two descriptors.
+    if unsafe { libc::pipe2(fds.as_mut_ptr(), libc::O_CLOEXEC) } < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    // SAFETY: both descriptors were just created and are owned here.
+    Ok(unsafe { (File::from_raw_fd(fds[0]), OwnedFd::from_raw_fd(fds[1])) })
+}
+
+fn send_with_fds(socket: RawFd, payload: &[u8], fds: &[RawFd]) -> io::Result<()> {
+    let fds_len = size_of_val(fds) as u32;
+    // SAFETY: CMSG_SPACE only computes a size.
+    let space = unsafe { libc::CMSG_SPACE(fds_len) } as usize;
+    // u64s keep the header aligned.
+    let mut control = vec![0u64; space.div_ceil(size_of::<u64>())];
+    let mut iov = libc::iovec {
+        iov_base: payload.as_ptr().cast_mut().cast(),
+        iov_len: payload.len(),
+    };
+    // SAFETY: all-zero is a valid msghdr.
+    let mut msg: libc::msghdr = unsafe { std::mem::zeroed() };
+    msg.msg_iov = &mut iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.as_mut_ptr().cast();
+    msg.msg_controllen = space as _;
+    // SAFETY: the control buffer holds one header with room for `fds`.
+    let sent = unsafe {
+        let cmsg = libc::CMSG_FIRSTHDR(&msg);
+        (*cmsg).cmsg_level = libc::SOL_SOCKET;
+        (*cmsg).cmsg_type = libc::SCM_RIGHTS;
+        (*cmsg).cmsg_len = libc::CMSG_LEN(fds_len) as _;
+        std::ptr::copy_nonoverlapping(fds.as_ptr(), libc::CMSG_DATA(cmsg).cast(), fds.len());
+        libc::sendmsg(socket, &msg, libc::MSG_NOSIGNAL)
+    };
+    if sent < 0 {
+        return Err(io::Error::last_os_error());
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use config::ast::Cmd;
+    use std::collections::HashSet;
+
+    /// Serves requests the way `Zygote.h` does, but execs the deployment's
+    /// `argv` instead of returning into it.
+    const FAKE_ZYGOTE: &str = r#"
+import os, socket, struct
+sock = socket.socket(fileno=int(os.environ["NEXUS_ZYGOTE_FD"]))
+while True:
+    msg, fds, _, _ = socket.recv_fds(sock, 65536, 2)
+    if not msg:
+        os._exit(0)
+    lockfile, procs, *argv = msg.split(b"\0")[:-1]
+    r, w = os.pipe()
+    middle = os.fork()
+    if middle == 0:
+        child = os.fork()
+        if child == 0:
+            os.dup2(fds[0], 1)
+            os.dup2(fds[1], 2)
+            with open(procs, "w") as f:
+                f.write(str(os.getpid()))
+            os.execvp(argv[0], argv)
+        os.write(w, struct.pack("i", child))
+        os._exit(0)
+    for fd in fds:
+        os.close(fd)
+    child = os.read(r, 4)
+    os.waitpid(middle, 0)
+    sock.send(child)
+"#;
+
+    /// Prints its arguments after the hook, one per line, and exits with
+    /// their count.
+    const HOOKED: &str = r#"
+#include <cstdio>
+
+#include "Zygote.h"
+
+int main(int argc, char** argv) {
+    nexus::zygote(argc, argv);
+    for (int i = 1; i < argc; ++i) {
+        printf("%s\n", argv[i]);
+    }
+    fprintf(stderr, "%d\n", static_cast<int>(getpid()));
+    return argc - 1;
+}
+"#;
+
+    fn zygote(dir: &Path, cmd: &str, args: &[&str]) -> Zygote {
+        Zygote::start(&NodeProtocol {
+            root: dir.to_path_buf(),
+            build: Cmd {
+                cmd: String::new(),
+                args: vec![],
+            },
+            build_inputs: vec![],
+            runner: Cmd {
+                cmd: cmd.to_string(),
+                args: args.iter().map(|arg| arg.to_string()).collect(),
+            },
+            zygote: true,
+            publishers: HashSet::new(),
+            subscribers: HashSet::new(),
+        })
+        .unwrap()
+    }
+
+    fn fake_zygote(dir: &Path) -> Zygote {
+        zygote(dir, "python3", &["-c", FAKE_ZYGOTE])
+    }
+
+    /// `HOOKED`, compiled as the examples are against the SDK's `Zygote.h`.
+    fn hooked_zygote(dir: &Path) -> Zygote {
+        let include =
+            Path::new(env!("CARGO_MANIFEST_DIR")).join("../examples/arduino/common/include");
+        std::fs::write(dir.join("main.cpp"), HOOKED).unwrap();
+        let status = Command::new("g++")
+            .current_dir(dir)
+            .args(["-std=c++23", "-Wall", "-Wextra", "-I"])
+            .arg(&include)
+            .args(["main.cpp", "-o", "main"])
+            .status()
+            .unwrap();
+        assert!(status.success());
+        zygote(dir, "./main", &[])
+    }
+
+    #[test]
+    fn the_sdk_hook_serves_deployments() {
+        let dir = tempfile::tempdir().unwrap();
+        let zygote = hooked_zygote(dir.path());
+        let procs = dir.path().join("cgroup.procs");
+        let lockfile = dir.path().join("lock");
+        // Both exist before anyone writes to them, as in a simulation.
+        File::create(&procs).unwrap();
+        File::create(&lockfile).unwrap();
+
+        let mut children: Vec<_> = [["main", "a", "b"], ["main", "c", "d"]]
+            .iter()
+            .map(|args| zygote.fork(args, &procs, &lockfile).unwrap())
+            .collect();
+        // Held until the simulation starts.
+        std::thread::sleep(std::time::Duration::from_millis(50));
+        for child in &mut children {
+            assert!(child.try_wait().unwrap().is_none());
+        }
+        std::fs::remove_file(&lockfile).unwrap();
+
+        let pids = [children[0].id(), children[1].id()];
+        let outputs: Vec<_> = children
+            .into_iter()
+            .map(|child| child.wait_with_output().unwrap())
+            .collect();
+        for (output, (stdout, pid)) in outputs
+            .iter()
+            .zip([("a\nb\n", pids[0]), ("c\nd\n", pids[1])])
+        {
+            assert_eq!(output.status.code(), Some(2));
+            assert_eq!(output.stdout, stdout.as_bytes());
+            assert_eq!(output.stderr, format!("{pid}\n").into_bytes());
+        }
+        // Each deployment joined the cgroup itself; the last write wins.
+        let joined: u32 = std::fs::read_to_string(&procs).unwrap().parse().unwrap();
+        assert!(pids.contains(&joined));
+    }
+
+    #[test]
+    fn the_sdk_hook_refuses_malformed_requests() {
+        let dir = tempfile::tempdir().unwrap();
+        let zygote = hooked_zygote(dir.path());
+        let procs = dir.path().join("cgroup.procs");
+        // No argv after the lockfile and cgroup.
+        let err = zygote
+            .fork(&[], &procs, Path::new("/nonexistent"))
+            .unwrap_err();
+        assert_eq!(err.raw_os_error(), Some(libc::EINVAL));
+        // The zygote keeps serving.
+        let child = zygote
+            .fork(&["main"], &procs, Path::new("/nonexistent"))
+            .unwrap();
+        assert_eq!(child.wait_with_output().unwrap().status.code(), Some(0));
+    }
+
+    #[test]
+    fn forked_deployments_are_waited_on_by_the_runner() {
+        let dir = tempfile::tempdir().unwrap();
+        let zygote = fake_zygote(dir.path());
+        let procs = dir.path().join("cgroup.procs");
+        let lockfile = dir.path().join("lock");
+
+        let child = zygote
+            .fork(
+                &["sh", "-c", "echo out; echo err >&2; exit 3"],
+                &procs,
+                &lockfile,
+            )
+            .unwrap();
+        let pid = child.id();
+        let output = child.wait_with_output().unwrap();
+        assert_eq!(output.status.code(), Some(3));
+        assert_eq!(output.stdout, b"out\n");
+        assert_eq!(output.stderr, b"err\n");
+        assert_eq!(std::fs::read_to_string(&procs).unwrap(), pid.to_string());
+    }
+
+    #[test]
+    fn forked_deployments_can_be_killed() {
+        let dir = tempfile::tempdir().unwrap();
+        let zygote = fake_zygote(dir.path());
+        let procs = dir.path().join("cgroup.procs");
+
+        let mut children: Vec<_> = (0..4)
+            .map(|_| {
+                zygote
+                    .fork(&["sleep", "60"], &procs, Path::new("/nonexistent"))
+                    .unwrap()
+            })
+            .collect();
+        for child in &mut children {
+            assert!(child.try_wait().unwrap().is_none());
+            child.kill().unwrap();
+            assert_eq!(child.wait().unwrap().signal(), Some(libc::SIGKILL));
+            // Killing a reaped process is a no-op.
+            child.kill().unwrap();
+        }
+    }
+}
@@ -93,6 +93,15 @@ pub fn format_record(header: &TraceHeader, record: &TraceRecord) -> String {
             let name = node_name(header, *node);
             format!("[t={ts:0>w$}] MOT  {name}  {spec}")
         }
+        TraceEvent::CpuSample {
+            node,
+            protocol,
+            stack,
+            count,
+        } => {
+            let name = node_name(header, *node);
+            format!("[t={ts:0>w$}] CPU  {name}/{protocol}  x{count} {stack}")
+        }
     }
 }
 
@@ -163,6 +172,19 @@ pub fn record_to_json(header: &TraceHeader, record: &TraceRecord) -> Value {
             "node": node_name(header, *node),
             "spec": spec,
         }),
+        TraceEvent::CpuSample {
+            node,
+            protocol,
+            stack,
+            count,
+        } => json!({
+            "timestep": ts,
+            "event": "CpuSample",
+            "node": node_name(header, *node),
+            "protocol": protocol,
+            "stack": stack,
+            "count": count,
+        }),
     }
 }
 
@@ -344,6 +366,28 @@ mod tests {
         assert!(out.contains("velocity 1.0 0.0 0.0"));
     }
 
+    #[test]
+    fn test_format_record_cpu_sample() {
+        let h = test_header();
+        let rec = TraceRecord {
+            timestep: 7,
+            event: TraceEvent::CpuSample {
+                node: 2,
+                protocol: "mesh".into(),
+                stack: "main;loop;route".into(),
+                count: 3,
+            },
+        };
+        let out = format_record(&h, &rec);
+        assert!(out.contains("CPU"));
+        assert!(out.contains("carol/mesh"));
+        assert!(out.contains("x3 main;loop;route"));
+        let val = record_to_json(&h, &rec);
+        assert_eq!("CpuSample", val["event"]);
+        assert_eq!("main;loop;route", val["stack"]);
+        assert_eq!(3, val["count"]);
+    }
+
     #[test]
     fn test_record_to_json_tx() {
         let h = test_header();
@@ -2,7 +2,13 @@ use bincode::{Decode, Encode};
 use serde::{Deserialize, Serialize};
 
 pub const MAGIC: [u8; 4] = *b"NXTR";
-pub const VERSION: u16 = 4;
+pub const VERSION: u16 = 5;
+/// Last version whose records follow the header unblocked.
+pub const UNBLOCKED_VERSION: u16 = 4;
+/// Magic opening the `.nxs.idx` block index.
+pub const INDEX_MAGIC: [u8; 4] = *b"NXTI";
+/// Magic opening the `.nxs.sum` trace summary.
+pub const SUMMARY_MAGIC: [u8; 4] = *b"NXTS";
 
 #[derive(Encode, Decode, Serialize, Deserialize, Debug, Clone)]
 pub struct TraceHeader {
@@ -57,6 +63,16 @@ pub enum TraceEvent {
         node: u32,
         spec: String,
     },
+    /// `count` CPU samples of one protocol with the same call stack, taken
+    /// while simulated time stood at the record's timestep. `stack` lists
+    /// the frames outermost first, separated by `;`, as flame graph tools
+    /// read them.
+    CpuSample {
+        node: u32,
+        protocol: String,
+        stack: String,
+        count: u32,
+    },
 }
 
 #[derive(Encode, Decode, Serialize, Deserialize, Debug, Clone, PartialEq)]
@@ -64,3 +80,113 @@ pub struct TraceRecord {
     pub timestep: u64,
     pub event: TraceEvent,
 }
+
+impl TraceEvent {
+    /// Node the event happened at.
+    pub fn node(&self) -> u32 {
+        match self {
+            TraceEvent::MessageSent { src_node, .. } => *src_node,
+            TraceEvent::MessageRecv { dst_node, .. } => *dst_node,
+            TraceEvent::MessageDropped { src_node, .. } => *src_node,
+            TraceEvent::PositionUpdate { node, .. } => *node,
+            TraceEvent::EnergyUpdate { node, .. } => *node,
+            TraceEvent::MotionUpdate { node, .. } => *node,
+            TraceEvent::CpuSample { node, .. } => *node,
+        }
+    }
+
+    /// Channel the event happened on, for message events.
+    pub fn channel(&self) -> Option<u32> {
+        match self {
+            TraceEvent::MessageSent { channel, .. } => Some(*channel),
+            TraceEvent::MessageRecv { channel, .. } => Some(*channel),
+            TraceEvent::MessageDropped { channel, .. } => Some(*channel),
+            TraceEvent::PositionUpdate { .. } => None,
+            TraceEvent::EnergyUpdate { .. } => None,
+            TraceEvent::MotionUpdate { .. } => None,
+            TraceEvent::CpuSample { .. } => None,
+        }
+    }
+}
+
+/// Set when a block's payload is deflate-compressed rather than stored raw.
+pub const BLOCK_COMPRESSED: u32 = 1 << 0;
+/// Set when a block holds events without a channel.
+pub const BLOCK_UNCHANNELED: u32 = 1 << 1;
+
+/// Summary of one block of records. Written in front of the block in the
+/// trace and again, after the block's offset, in the index, so either one
+/// is enough to find and skip blocks without decoding them.
+///
+/// Node and channel membership are kept as 64-bit masks of `index % 64`: a
+/// clear bit means the block certainly has no event there, a set bit only
+/// that it may.
+#[derive(Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct BlockInfo {
+    pub first_ts: u64,
+    pub last_ts: u64,
+    pub node_mask: u64,
+    pub channel_mask: u64,
+    pub records: u32,
+    /// Length of the encoded records once decompressed.
+    pub raw_len: u32,
+    /// Length of the payload as stored.
+    pub stored_len: u32,
+    pub flags: u32,
+}
+
+impl BlockInfo {
+    pub const SIZE: usize = 4 * size_of::<u64>() + 4 * size_of::<u32>();
+
+    /// Account for `record` being appended to the block.
+    pub fn add(&mut self, record: &TraceRecord) {
+        if self.records == 0 {
+            self.first_ts = record.timestep;
+        }
+        self.last_ts = record.timestep;
+        self.records += 1;
+        self.node_mask |= 1 << (record.event.node() % 64);
+        match record.event.channel() {
+            Some(channel) => self.channel_mask |= 1 << (channel % 64),
+            None => self.flags |= BLOCK_UNCHANNELED,
+        }
+    }
+
+    pub fn to_bytes(&self) -> [u8; Self::SIZE] {
+        let mut out = [0u8; Self::SIZE];
+        let words = [
+            self.first_ts,
+            self.last_ts,
+            self.node_mask,
+            self.channel_mask,
+        ];
+        for (chunk, word) in out.chunks_exact_mut(8).zip(words) {
+            chunk.copy_from_slice(&word.to_le_bytes());
+        }
+        let halves = [self.records, self.raw_len, self.stored_len, self.flags];
+        for (chunk, half) in out[32..].chunks_exact_mut(4).zip(halves) {
+            chunk.copy_from_slice(&half.to_le_bytes());
+        }
+        out
+    }
+
+    /// Decode a summary from the first `SIZE` bytes of `bytes`.
+    pub fn from_bytes(bytes: &[u8]) -> Option<Self> {
+        let bytes = bytes.get(..Self::SIZE)?;
+        let word = |i: usize| u64::from_le_bytes(bytes[i * 8..i * 8 + 8].try_into().unwrap());
+        let half = |i: usize| {
+            let at = 32 + i * 4;
+            u32::from_le_bytes(bytes[at..at + 4].try_into().unwrap())
+        };
+        Some(Self {
+            first_ts: word(0),
+            last_ts: word(1),
+            node_mask: word(2),
+            channel_mask: word(3),
+            records: half(0),
+            raw_len: half(1),
+            stored_len: half(2),
+            flags: half(3),
+        })
+    }
+}
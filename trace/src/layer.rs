@@ -1,33 +1,71 @@
 use std::path::Path;
-use std::sync::{Arc, Mutex};
+use std::sync::Arc;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::thread::{self, JoinHandle};
 
+use crossbeam_channel::{Receiver, RecvTimeoutError, Sender};
+use runner::cli::TraceOverflow;
 use tracing::field::Visit;
 use tracing::{Event, Subscriber};
 use tracing_subscriber::layer::{Context, Layer};
 
 use crate::format::{TraceEvent, TraceHeader, TraceRecord};
-use crate::writer::TraceWriter;
+use crate::writer::{FLUSH_INTERVAL, TraceWriter};
 
-/// A handle to the trace writer that flushes on drop.
+/// Records the layer can queue before the writer thread is considered to
+/// have fallen behind.
+pub const QUEUE_RECORDS: usize = 64 * 1024;
+
+enum Queued {
+    Record(TraceRecord),
+    /// Write out everything queued ahead of this and stop.
+    Finish,
+}
+
+/// A handle to the trace writer thread that finishes the trace on drop.
 ///
 /// The global tracing subscriber set by `.init()` is never dropped, so the
-/// `TraceWriter`'s `BufWriter` would never be flushed. This handle keeps a
-/// clone of the shared writer and flushes it when dropped, ensuring all
-/// buffered trace records reach disk.
-pub struct TraceHandle(Arc<Mutex<TraceWriter>>);
+/// layer's end of the queue is never closed. Dropping this handle tells the
+/// writer thread to write out every record queued so far and waits for it.
+pub struct TraceHandle {
+    queue: Sender<Queued>,
+    dropped: Arc<AtomicU64>,
+    thread: Option<JoinHandle<()>>,
+}
+
+impl TraceHandle {
+    /// Records left out of the trace because the queue was full, or the
+    /// writer thread had already finished.
+    pub fn dropped(&self) -> u64 {
+        self.dropped.load(Ordering::Relaxed)
+    }
+}
 
 impl Drop for TraceHandle {
     fn drop(&mut self) {
-        if let Ok(mut w) = self.0.lock() {
-            let _ = w.flush();
+        let _ = self.queue.send(Queued::Finish);
+        if let Some(thread) = self.thread.take() {
+            let _ = thread.join();
+        }
+        let dropped = self.dropped();
+        if dropped > 0 {
+            tracing::warn!("{dropped} trace records were dropped");
         }
     }
 }
 
 /// A `tracing_subscriber::Layer` that captures `tx` and `rx` target events
 /// and writes them as `TraceRecord`s to a unified trace file.
+///
+/// Events are turned into records on the thread emitting them and queued on
+/// a bounded lock-free channel. Encoding, compression and disk I/O all
+/// happen on a writer thread of the layer's own, so the simulation only
+/// waits when the queue is full, and not at all under
+/// [`TraceOverflow::Drop`].
 pub struct TraceLayer {
-    writer: Arc<Mutex<TraceWriter>>,
+    queue: Sender<Queued>,
+    overflow: TraceOverflow,
+    dropped: Arc<AtomicU64>,
 }
 
 impl TraceLayer {
@@ -37,15 +75,70 @@ impl TraceLayer {
     pub fn new(
         path: impl AsRef<Path>,
         header: &TraceHeader,
+        overflow: TraceOverflow,
+    ) -> std::io::Result<(Self, TraceHandle)> {
+        Self::with_capacity(path, header, overflow, QUEUE_RECORDS)
+    }
+
+    /// As [`TraceLayer::new`], queueing at most `capacity` records.
+    pub fn with_capacity(
+        path: impl AsRef<Path>,
+        header: &TraceHeader,
+        overflow: TraceOverflow,
+        capacity: usize,
     ) -> std::io::Result<(Self, TraceHandle)> {
-        let writer = Arc::new(Mutex::new(TraceWriter::create(path, header)?));
+        let writer = TraceWriter::create(path, header)?;
+        let (tx, rx) = crossbeam_channel::bounded(capacity);
+        let thread = thread::Builder::new()
+            .name("nexus-trace".to_string())
+            .spawn(move || write_queued(writer, rx))?;
+        let dropped = Arc::new(AtomicU64::new(0));
         Ok((
             Self {
-                writer: Arc::clone(&writer),
+                queue: tx.clone(),
+                overflow,
+                dropped: Arc::clone(&dropped),
+            },
+            TraceHandle {
+                queue: tx,
+                dropped,
+                thread: Some(thread),
             },
-            TraceHandle(writer),
         ))
     }
+
+    fn enqueue(&self, record: TraceRecord) {
+        let queued = match self.overflow {
+            TraceOverflow::Block => self.queue.send(Queued::Record(record)).is_ok(),
+            TraceOverflow::Drop => self.queue.try_send(Queued::Record(record)).is_ok(),
+        };
+        if !queued {
+            self.dropped.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+}
+
+/// Writer thread body: write records as they are queued, and flush once the
+/// queue has been idle for a flush interval so a stalled simulation's trace
+/// still reaches disk.
+fn write_queued(mut writer: TraceWriter, queue: Receiver<Queued>) {
+    let mut failed = false;
+    loop {
+        let result = match queue.recv_timeout(FLUSH_INTERVAL) {
+            Ok(Queued::Record(record)) => writer.write_record(&record),
+            Ok(Queued::Finish) | Err(RecvTimeoutError::Disconnected) => break,
+            Err(RecvTimeoutError::Timeout) => writer.flush(),
+        };
+        if let Err(e) = result
+            && !failed
+        {
+            tracing::warn!("Failed to write trace: {e}");
+            failed = true;
+        }
+    }
+    if let Err(e) = writer.flush() {
+        tracing::warn!("Failed to flush trace: {e}");
+    }
 }
 
 #[derive(Debug, Default)]
@@ -148,6 +241,19 @@ impl<S: Subscriber> Layer<S> for TraceLayer {
                     },
                 }
             }
+            "profile" => {
+                let mut visitor = ProfileVisitor::default();
+                event.record(&mut visitor);
+                TraceRecord {
+                    timestep: visitor.timestep,
+                    event: TraceEvent::CpuSample {
+                        node: visitor.node,
+                        protocol: visitor.protocol,
+                        stack: visitor.stack,
+                        count: visitor.count,
+                    },
+                }
+            }
             "motion" => {
                 let mut visitor = MotionVisitor::default();
                 event.record(&mut visitor);
@@ -162,8 +268,7 @@ impl<S: Subscriber> Layer<S> for TraceLayer {
             _ => return,
         };
 
-        let mut writer = self.writer.lock().unwrap();
-        let _ = writer.write_record(&record);
+        self.enqueue(record);
     }
 }
 
@@ -288,3 +393,33 @@ impl Visit for MotionVisitor {
         }
     }
 }
+
+#[derive(Debug, Default)]
+struct ProfileVisitor {
+    timestep: u64,
+    node: u32,
+    protocol: String,
+    stack: String,
+    count: u32,
+}
+
+impl Visit for ProfileVisitor {
+    fn record_debug(&mut self, _: &tracing::field::Field, _: &dyn std::fmt::Debug) {}
+
+    fn record_u64(&mut self, field: &tracing::field::Field, value: u64) {
+        match field.name() {
+            "timestep" => self.timestep = value,
+            "node" => self.node = value as u32,
+            "count" => self.count = value as u32,
+            _ => {}
+        }
+    }
+
+    fn record_str(&mut self, field: &tracing::field::Field, value: &str) {
+        match field.name() {
+            "protocol" => self.protocol = value.to_string(),
+            "stack" => self.stack = value.to_string(),
+            _ => {}
+        }
+    }
+}
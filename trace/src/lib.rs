@@ -2,5 +2,7 @@ pub mod display;
 pub mod format;
 pub mod layer;
 pub mod parse;
+pub mod profile;
 pub mod reader;
+pub mod summary;
 pub mod writer;
@@ -4,7 +4,7 @@ use std::process::{Command, Stdio};
 
 use super::display;
 use super::format::{TraceEvent, TraceHeader, TraceRecord};
-use super::reader::TraceReader;
+use super::reader::{TraceFilter, TraceReader};
 use anyhow::{Result, bail};
 use runner::cli::{EventFilter, ParseOutput};
 
@@ -82,6 +82,15 @@ impl ResolvedFilter {
         })
     }
 
+    /// The node and channel part of the filter, for the reader to skip
+    /// blocks by.
+    pub fn trace_filter(&self) -> TraceFilter {
+        TraceFilter {
+            nodes: self.node_indices.clone(),
+            channels: self.channel_indices.clone(),
+        }
+    }
+
     /// Returns true if the record passes all active filters.
     pub fn matches(&self, record: &TraceRecord) -> bool {
         // Timestep range
@@ -105,6 +114,7 @@ impl ResolvedFilter {
                 TraceEvent::PositionUpdate { .. } => filters.contains(&EventFilter::Position),
                 TraceEvent::EnergyUpdate { .. } => filters.contains(&EventFilter::Energy),
                 TraceEvent::MotionUpdate { .. } => filters.contains(&EventFilter::Motion),
+                TraceEvent::CpuSample { .. } => filters.contains(&EventFilter::Cpu),
             };
             if !matched {
                 return false;
@@ -113,7 +123,7 @@ impl ResolvedFilter {
 
         // Node filter
         if let Some(ref indices) = self.node_indices {
-            let node_id = event_node_id(&record.event);
+            let node_id = record.event.node();
             if !indices.contains(&node_id) {
                 return false;
             }
@@ -121,8 +131,9 @@ impl ResolvedFilter {
 
         // Channel filter
         if let Some(ref indices) = self.channel_indices {
-            let ch = event_channel_id(&record.event);
-            // Events without a channel (position, energy, motion) pass channel filter
+            let ch = record.event.channel();
+            // Events without a channel (position, energy, motion, CPU samples)
+            // pass channel filter
             if let Some(id) = ch
                 && !indices.contains(&id)
             {
@@ -134,28 +145,6 @@ impl ResolvedFilter {
     }
 }
 
-fn event_node_id(event: &TraceEvent) -> u32 {
-    match event {
-        TraceEvent::MessageSent { src_node, .. } => *src_node,
-        TraceEvent::MessageRecv { dst_node, .. } => *dst_node,
-        TraceEvent::MessageDropped { src_node, .. } => *src_node,
-        TraceEvent::PositionUpdate { node, .. } => *node,
-        TraceEvent::EnergyUpdate { node, .. } => *node,
-        TraceEvent::MotionUpdate { node, .. } => *node,
-    }
-}
-
-fn event_channel_id(event: &TraceEvent) -> Option<u32> {
-    match event {
-        TraceEvent::MessageSent { channel, .. } => Some(*channel),
-        TraceEvent::MessageRecv { channel, .. } => Some(*channel),
-        TraceEvent::MessageDropped { channel, .. } => Some(*channel),
-        TraceEvent::PositionUpdate { .. } => None,
-        TraceEvent::EnergyUpdate { .. } => None,
-        TraceEvent::MotionUpdate { .. } => None,
-    }
-}
-
 /// Main entry point for the `nexus parse` subcommand.
 #[allow(clippy::too_many_arguments)]
 pub fn run_parse(
@@ -185,6 +174,7 @@ pub fn run_parse(
 
     let filter = ResolvedFilter::new(header, events, nodes, channels, from, to)?;
 
+    reader.set_filter(filter.trace_filter());
     // Seek to start timestep if possible
     if let Some(from_ts) = filter.from_ts {
         let _ = reader.seek_to_timestep(from_ts);
@@ -0,0 +1,167 @@
+//! profile.rs
+//! Folded call stacks from the CPU samples in a trace, as read by flame graph
+//! tools (`flamegraph.pl`, `inferno-flamegraph`, speedscope): one line per
+//! distinct stack, frames outermost first and separated by `;`, followed by
+//! its sample count.
+
+use std::collections::BTreeMap;
+use std::fs::File;
+use std::io::{self, BufWriter, Write};
+use std::path::Path;
+
+use anyhow::Result;
+use runner::cli::EventFilter;
+
+use super::display::node_name;
+use super::format::{TraceEvent, TraceHeader, TraceRecord};
+use super::parse::ResolvedFilter;
+use super::reader::TraceReader;
+
+/// Sample counts per call stack. Stacks are rooted at the node and protocol
+/// they were sampled in, so one graph holds every node side by side.
+#[derive(Debug, Default, Clone, PartialEq)]
+pub struct FoldedStacks {
+    stacks: BTreeMap<String, u64>,
+}
+
+impl FoldedStacks {
+    /// Count `record` if it holds CPU samples. Returns whether it did.
+    pub fn add(&mut self, header: &TraceHeader, record: &TraceRecord) -> bool {
+        let TraceEvent::CpuSample {
+            node,
+            protocol,
+            stack,
+            count,
+        } = &record.event
+        else {
+            return false;
+        };
+        let mut key = format!("{};{protocol}", node_name(header, *node));
+        if !stack.is_empty() {
+            key.push(';');
+            key.push_str(stack);
+        }
+        *self.stacks.entry(key).or_default() += u64::from(*count);
+        true
+    }
+
+    /// Total number of samples.
+    pub fn total(&self) -> u64 {
+        self.stacks.values().sum()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.stacks.is_empty()
+    }
+
+    /// Stacks in lexicographic order with their sample counts.
+    pub fn iter(&self) -> impl Iterator<Item = (&str, u64)> {
+        self.stacks
+            .iter()
+            .map(|(stack, count)| (stack.as_str(), *count))
+    }
+
+    /// Write the stacks in the folded format.
+    pub fn write_to(&self, mut w: impl Write) -> io::Result<()> {
+        for (stack, count) in self.iter() {
+            writeln!(w, "{stack} {count}")?;
+        }
+        w.flush()
+    }
+}
+
+/// Main entry point for the `nexus profile` subcommand.
+pub fn run_profile(
+    trace_path: &Path,
+    nodes: Option<Vec<String>>,
+    protocols: Option<Vec<String>>,
+    from: Option<u64>,
+    to: Option<u64>,
+    output: Option<&Path>,
+) -> Result<()> {
+    let mut reader = TraceReader::open(trace_path)?;
+    let header = reader.header.clone();
+    let filter = ResolvedFilter::new(&header, Some(vec![EventFilter::Cpu]), nodes, None, from, to)?;
+    reader.set_filter(filter.trace_filter());
+    if let Some(from_ts) = from {
+        let _ = reader.seek_to_timestep(from_ts);
+    }
+
+    let mut folded = FoldedStacks::default();
+    while let Some(record) = reader.next_record()? {
+        if let Some(to_ts) = to
+            && record.timestep > to_ts
+        {
+            break;
+        }
+        if !filter.matches(&record) {
+            continue;
+        }
+        if let (Some(wanted), TraceEvent::CpuSample { protocol, .. }) = (&protocols, &record.event)
+            && !wanted.contains(protocol)
+        {
+            continue;
+        }
+        folded.add(&header, &record);
+    }
+
+    if folded.is_empty() {
+        eprintln!(
+            "No CPU samples in {} for this selection; was it simulated with --profile?",
+            trace_path.display()
+        );
+    }
+    match output {
+        Some(path) => folded.write_to(BufWriter::new(File::create(path)?))?,
+        None => folded.write_to(io::stdout().lock())?,
+    }
+    Ok(())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn sample(timestep: u64, node: u32, stack: &str, count: u32) -> TraceRecord {
+        TraceRecord {
+            timestep,
+            event: TraceEvent::CpuSample {
+                node,
+                protocol: "p".into(),
+                stack: stack.into(),
+                count,
+            },
+        }
+    }
+
+    #[test]
+    fn folds_samples_by_node_and_stack() {
+        let header = TraceHeader {
+            node_names: vec!["rx".into(), "tx".into()],
+            channel_names: vec![],
+            timestep_count: 10,
+            node_max_nj: vec![None; 2],
+        };
+        let mut folded = FoldedStacks::default();
+        assert!(folded.add(&header, &sample(1, 0, "main;loop", 2)));
+        assert!(folded.add(&header, &sample(2, 0, "main;loop", 3)));
+        assert!(folded.add(&header, &sample(2, 1, "main", 1)));
+        assert!(folded.add(&header, &sample(3, 1, "", 1)));
+        let other = TraceRecord {
+            timestep: 2,
+            event: TraceEvent::EnergyUpdate {
+                node: 0,
+                energy_nj: 1,
+            },
+        };
+        assert!(!folded.add(&header, &other));
+
+        assert_eq!(folded.total(), 7);
+        let mut out = Vec::new();
+        folded.write_to(&mut out).unwrap();
+        assert_eq!(
+            String::from_utf8(out).unwrap(),
+            "rx;p;main;loop 5\ntx;p 1\ntx;p;main 1\n"
+        );
+    }
+}
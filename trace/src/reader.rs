@@ -1,24 +1,82 @@
+use std::collections::VecDeque;
 use std::fs::File;
-use std::io::{BufReader, Read, Seek, SeekFrom};
+use std::io::Read;
 use std::path::Path;
 
 use bincode::config;
+use bincode::error::DecodeError;
+use flate2::read::DeflateDecoder;
+use memmap2::Mmap;
 
-use crate::format::{MAGIC, TraceHeader, TraceRecord, VERSION};
+use crate::format::{
+    BLOCK_COMPRESSED, BLOCK_UNCHANNELED, BlockInfo, INDEX_MAGIC, MAGIC, TraceEvent, TraceHeader,
+    TraceRecord, UNBLOCKED_VERSION, VERSION,
+};
 
-/// Index entry mapping timestep → byte offset in the trace file.
+/// Index entry locating one block of records in the trace file.
 #[derive(Debug, Clone, Copy)]
 struct IndexEntry {
-    pub timestep: u64,
-    pub offset: u64,
+    /// Byte offset of the block's payload.
+    payload: u64,
+    /// Length of the payload. Only differs from `info.stored_len` for the
+    /// single block standing in for an unblocked trace.
+    len: u64,
+    info: BlockInfo,
 }
 
-/// Reads a `.nxs` trace file with optional `.nxs.idx` for O(1) seeking.
+/// Nodes and channels to read events for. `None` means all of them; events
+/// without a channel pass any channel filter.
+#[derive(Debug, Clone, Default)]
+pub struct TraceFilter {
+    pub nodes: Option<Vec<u32>>,
+    pub channels: Option<Vec<u32>>,
+}
+
+impl TraceFilter {
+    pub fn matches(&self, event: &TraceEvent) -> bool {
+        let node_ok = self
+            .nodes
+            .as_ref()
+            .is_none_or(|nodes| nodes.contains(&event.node()));
+        let channel_ok = match (&self.channels, event.channel()) {
+            (Some(channels), Some(channel)) => channels.contains(&channel),
+            _ => true,
+        };
+        node_ok && channel_ok
+    }
+
+    /// Whether a block with this summary can hold a matching event.
+    fn may_match(&self, info: &BlockInfo) -> bool {
+        let mask = |ids: &[u32]| ids.iter().fold(0u64, |m, id| m | 1 << (id % 64));
+        let node_ok = self
+            .nodes
+            .as_ref()
+            .is_none_or(|nodes| info.node_mask & mask(nodes) != 0);
+        let channel_ok = self.channels.as_ref().is_none_or(|channels| {
+            info.flags & BLOCK_UNCHANNELED != 0 || info.channel_mask & mask(channels) != 0
+        });
+        node_ok && channel_ok
+    }
+}
+
+/// Reads a `.nxs` trace file through a memory map. Blocks are only
+/// decompressed once a read reaches them, so opening is independent of the
+/// trace's length, and seeking or filtering skips the blocks it rules out
+/// without decoding them. The `.nxs.idx` index is used when present; blocks
+/// it is missing (e.g. after a crash) are found by walking the trace's own
+/// block summaries.
 pub struct TraceReader {
-    reader: BufReader<File>,
+    map: Mmap,
     pub header: TraceHeader,
     index: Vec<IndexEntry>,
     data_start: u64,
+    filter: TraceFilter,
+    /// Next block to decode.
+    next_block: usize,
+    /// Records decoded from the current block and not yet returned.
+    pending: VecDeque<TraceRecord>,
+    /// Records before this timestep are skipped; set by seeking.
+    from_ts: u64,
 }
 
 impl std::fmt::Debug for TraceReader {
@@ -34,100 +92,219 @@ impl std::fmt::Debug for TraceReader {
 impl TraceReader {
     pub fn open(path: impl AsRef<Path>) -> Result<Self, TraceReadError> {
         let path = path.as_ref();
-        let mut file = File::open(path)?;
+        let file = File::open(path)?;
+        // SAFETY: the map is only read. Traces are not modified once
+        // written; one truncated by another process while mapped would
+        // fault the reader, as with any mapped file.
+        let map = unsafe { Mmap::map(&file)? };
 
         // Read and verify magic
-        let mut magic = [0u8; 4];
-        file.read_exact(&mut magic)?;
-        if magic != MAGIC {
+        if map.get(..MAGIC.len()) != Some(&MAGIC[..]) {
             return Err(TraceReadError::InvalidMagic);
         }
 
         // Read and verify version
-        let mut ver_bytes = [0u8; 2];
-        file.read_exact(&mut ver_bytes)?;
-        let version = u16::from_le_bytes(ver_bytes);
-        if version != VERSION {
+        let version = u16::from_le_bytes(read_array(&map, MAGIC.len())?);
+        if version != VERSION && version != UNBLOCKED_VERSION {
             return Err(TraceReadError::UnsupportedVersion(version));
         }
 
-        // Read header length
-        let mut len_bytes = [0u8; 4];
-        file.read_exact(&mut len_bytes)?;
-        let header_len = u32::from_le_bytes(len_bytes) as usize;
-
-        // Read header
-        let mut header_bytes = vec![0u8; header_len];
-        file.read_exact(&mut header_bytes)?;
+        // Read header length, then the header itself
+        let len_at = MAGIC.len() + size_of::<u16>();
+        let header_len = u32::from_le_bytes(read_array(&map, len_at)?) as usize;
+        let header_at = len_at + size_of::<u32>();
+        let header_bytes = map
+            .get(header_at..header_at + header_len)
+            .ok_or(TraceReadError::Truncated)?;
         let cfg = config::standard();
-        let (header, _): (TraceHeader, _) = bincode::decode_from_slice(&header_bytes, cfg)?;
+        let (header, _): (TraceHeader, _) = bincode::decode_from_slice(header_bytes, cfg)?;
 
-        let data_start = (MAGIC.len() + size_of::<u16>() + size_of::<u32>() + header_len) as u64;
+        let data_start = (header_at + header_len) as u64;
 
-        // Load index if available
-        let idx_path = path.with_extension("nxs.idx");
-        let index = if idx_path.exists() {
-            Self::load_index(&idx_path)?
+        let index = if version == UNBLOCKED_VERSION {
+            // Records follow the header directly: stand them in as one raw
+            // block that may hold anything.
+            vec![IndexEntry {
+                payload: data_start,
+                len: map.len() as u64 - data_start,
+                info: BlockInfo {
+                    last_ts: u64::MAX,
+                    node_mask: u64::MAX,
+                    channel_mask: u64::MAX,
+                    flags: BLOCK_UNCHANNELED,
+                    ..BlockInfo::default()
+                },
+            }]
         } else {
-            Vec::new()
+            let idx_path = path.with_extension("nxs.idx");
+            let mut index = if idx_path.exists() {
+                Self::load_index(&idx_path, map.len() as u64)?
+            } else {
+                Vec::new()
+            };
+            let indexed_end = index.last().map_or(data_start, |e| e.payload + e.len);
+            index.extend(Self::walk_blocks(&map, indexed_end));
+            index
         };
 
         Ok(Self {
-            reader: BufReader::new(file),
+            map,
             header,
             index,
             data_start,
+            filter: TraceFilter::default(),
+            next_block: 0,
+            pending: VecDeque::new(),
+            from_ts: 0,
         })
     }
 
-    fn load_index(path: &Path) -> Result<Vec<IndexEntry>, TraceReadError> {
+    /// Load the blocks listed in the index file, up to the first one the
+    /// trace does not fully hold. An index from another format is ignored.
+    fn load_index(path: &Path, trace_len: u64) -> Result<Vec<IndexEntry>, TraceReadError> {
         let data = std::fs::read(path)?;
-        let entry_size = size_of::<u64>() * 2;
-        let mut entries = Vec::with_capacity(data.len() / entry_size);
-        let mut i = 0;
-        let sz = size_of::<u64>();
-        while i + entry_size <= data.len() {
-            let end = i + sz;
-            let timestep = u64::from_le_bytes(data[i..end].try_into().unwrap());
-            let offset = u64::from_le_bytes(data[end..end + sz].try_into().unwrap());
-            entries.push(IndexEntry { timestep, offset });
-            i += entry_size;
+        let preamble = INDEX_MAGIC.len() + size_of::<u16>();
+        if data.get(..INDEX_MAGIC.len()) != Some(&INDEX_MAGIC[..])
+            || read_array(&data, INDEX_MAGIC.len())
+                .ok()
+                .map(u16::from_le_bytes)
+                != Some(VERSION)
+        {
+            return Ok(Vec::new());
+        }
+        let entry_size = size_of::<u64>() + BlockInfo::SIZE;
+        let mut entries = Vec::with_capacity((data.len() - preamble) / entry_size);
+        for entry in data[preamble..].chunks_exact(entry_size) {
+            let offset = u64::from_le_bytes(entry[..8].try_into().unwrap());
+            let info = BlockInfo::from_bytes(&entry[8..]).expect("entry holds a summary");
+            let payload = offset + BlockInfo::SIZE as u64;
+            let len = u64::from(info.stored_len);
+            if payload + len > trace_len {
+                break;
+            }
+            entries.push(IndexEntry { payload, len, info });
         }
         Ok(entries)
     }
 
-    /// Seek to the start of a given timestep using the index. Returns false
-    /// if the timestep is not in the index (falls back to sequential read).
-    pub fn seek_to_timestep(&mut self, ts: u64) -> Result<bool, TraceReadError> {
-        // Binary search for the largest timestep <= ts
-        let pos = self.index.partition_point(|e| e.timestep <= ts);
-        if pos == 0 {
-            // Before all indexed entries, seek to data start
-            self.reader.seek(SeekFrom::Start(self.data_start))?;
-            return Ok(!self.index.is_empty());
+    /// Find the blocks from `offset` on by their summaries, stopping at the
+    /// first one cut short.
+    fn walk_blocks(map: &[u8], mut offset: u64) -> Vec<IndexEntry> {
+        let mut entries = Vec::new();
+        while let Some(info) = map.get(offset as usize..).and_then(BlockInfo::from_bytes) {
+            let payload = offset + BlockInfo::SIZE as u64;
+            let len = u64::from(info.stored_len);
+            if payload + len > map.len() as u64 {
+                break;
+            }
+            entries.push(IndexEntry { payload, len, info });
+            offset = payload + len;
         }
-        let entry = &self.index[pos - 1];
-        self.reader.seek(SeekFrom::Start(entry.offset))?;
-        Ok(true)
+        entries
+    }
+
+    /// Only return records for events passing `filter`. Blocks that cannot
+    /// hold one are skipped without being decompressed.
+    pub fn set_filter(&mut self, filter: TraceFilter) {
+        self.filter = filter;
+    }
+
+    /// Seek to the start of a given timestep using the index, so the next
+    /// record read is the first at or after `ts`. Returns false if no block
+    /// reaches `ts`.
+    pub fn seek_to_timestep(&mut self, ts: u64) -> Result<bool, TraceReadError> {
+        self.next_block = self.block_at_timestep(ts);
+        self.pending.clear();
+        self.from_ts = ts;
+        Ok(self.next_block < self.index.len())
     }
 
     /// Seek back to the beginning of trace data.
     pub fn rewind(&mut self) -> Result<(), TraceReadError> {
-        self.reader.seek(SeekFrom::Start(self.data_start))?;
+        self.next_block = 0;
+        self.pending.clear();
+        self.from_ts = 0;
         Ok(())
     }
 
     /// Read the next record, or None at EOF.
     pub fn next_record(&mut self) -> Result<Option<TraceRecord>, TraceReadError> {
+        loop {
+            while let Some(record) = self.pending.pop_front() {
+                if record.timestep >= self.from_ts && self.filter.matches(&record.event) {
+                    return Ok(Some(record));
+                }
+            }
+            let Some(entry) = self.index.get(self.next_block).copied() else {
+                return Ok(None);
+            };
+            self.next_block += 1;
+            if entry.info.last_ts >= self.from_ts && self.filter.may_match(&entry.info) {
+                self.pending = self.decode_block(&entry)?;
+            }
+        }
+    }
+
+    fn decode_block(&self, entry: &IndexEntry) -> Result<VecDeque<TraceRecord>, TraceReadError> {
+        let stored = &self.map[entry.payload as usize..(entry.payload + entry.len) as usize];
+        let inflated;
+        let raw = if entry.info.flags & BLOCK_COMPRESSED != 0 {
+            let mut buf = Vec::with_capacity(entry.info.raw_len as usize);
+            DeflateDecoder::new(stored).read_to_end(&mut buf)?;
+            inflated = buf;
+            &inflated[..]
+        } else {
+            stored
+        };
+        let unblocked = entry.info.records == 0;
         let cfg = config::standard();
-        match bincode::decode_from_reader::<TraceRecord, _, _>(&mut self.reader, cfg) {
-            Ok(record) => Ok(Some(record)),
-            Err(bincode::error::DecodeError::Io { inner, .. })
-                if inner.kind() == std::io::ErrorKind::UnexpectedEof =>
-            {
-                Ok(None)
+        let mut records = VecDeque::with_capacity(entry.info.records as usize);
+        let mut at = 0;
+        while at < raw.len() {
+            match bincode::decode_from_slice::<TraceRecord, _>(&raw[at..], cfg) {
+                Ok((record, used)) => {
+                    records.push_back(record);
+                    at += used;
+                }
+                // An unblocked trace cut short ends in a partial record.
+                Err(DecodeError::UnexpectedEnd { .. }) if unblocked => break,
+                Err(e) => return Err(e.into()),
             }
-            Err(e) => Err(e.into()),
+        }
+        Ok(records)
+    }
+
+    /// Number of records in the trace, from the block summaries; `None` for
+    /// an unblocked trace, whose count is only known once read.
+    pub fn record_count(&self) -> Option<u64> {
+        self.index
+            .iter()
+            .map(|e| (e.info.records > 0).then_some(u64::from(e.info.records)))
+            .sum()
+    }
+
+    /// Number of blocks, in timestep order. An unblocked trace is one block.
+    pub fn block_count(&self) -> usize {
+        self.index.len()
+    }
+
+    /// Summary of block `i`.
+    pub fn block_info(&self, i: usize) -> Option<&BlockInfo> {
+        self.index.get(i).map(|e| &e.info)
+    }
+
+    /// First block still holding timestep `ts`, or `block_count()` if none
+    /// reaches it.
+    pub fn block_at_timestep(&self, ts: u64) -> usize {
+        self.index.partition_point(|e| e.info.last_ts < ts)
+    }
+
+    /// Decode every record of block `i`, whatever the filter and position.
+    /// Leaves the sequential read position alone.
+    pub fn read_block(&self, i: usize) -> Result<Vec<TraceRecord>, TraceReadError> {
+        match self.index.get(i) {
+            Some(entry) => Ok(self.decode_block(entry)?.into()),
+            None => Ok(Vec::new()),
         }
     }
 
@@ -163,6 +340,13 @@ impl TraceReader {
     }
 }
 
+fn read_array<const N: usize>(bytes: &[u8], at: usize) -> Result<[u8; N], TraceReadError> {
+    bytes
+        .get(at..at + N)
+        .and_then(|b| b.try_into().ok())
+        .ok_or(TraceReadError::Truncated)
+}
+
 #[derive(Debug, thiserror::Error)]
 pub enum TraceReadError {
     #[error("IO error: {0}")]
@@ -171,6 +355,8 @@ pub enum TraceReadError {
     InvalidMagic,
     #[error("Unsupported trace version: {0}")]
     UnsupportedVersion(u16),
+    #[error("Trace file ends inside its header")]
+    Truncated,
     #[error("Decode error: {0}")]
-    Decode(#[from] bincode::error::DecodeError),
+    Decode(#[from] DecodeError),
 }
@@ -0,0 +1,465 @@
+use std::io::{BufWriter, Write};
+use std::path::{Path, PathBuf};
+
+use bincode::{Decode, Encode, config};
+
+use crate::format::{SUMMARY_MAGIC, TraceEvent, TraceHeader, TraceRecord, VERSION};
+use crate::reader::{TraceReadError, TraceReader};
+
+/// Most buckets, counted across every node and channel series, the finest
+/// level holds. Caps the summary at a few megabytes however long the trace.
+const MAX_CELLS: u64 = 1 << 18;
+
+/// Message events in one bucket.
+#[derive(Encode, Decode, Debug, Clone, Copy, Default, PartialEq, Eq)]
+pub struct Counts {
+    pub sent: u32,
+    pub received: u32,
+    pub dropped: u32,
+}
+
+impl Counts {
+    pub fn total(&self) -> u64 {
+        u64::from(self.sent) + u64::from(self.received) + u64::from(self.dropped)
+    }
+
+    /// Share of deliveries that were dropped, if any were attempted.
+    pub fn drop_rate(&self) -> Option<f32> {
+        let attempts = u64::from(self.received) + u64::from(self.dropped);
+        (attempts > 0).then(|| self.dropped as f32 / attempts as f32)
+    }
+
+    fn record(&mut self, event: &TraceEvent) {
+        let field = match event {
+            TraceEvent::MessageSent { .. } => &mut self.sent,
+            TraceEvent::MessageRecv { .. } => &mut self.received,
+            TraceEvent::MessageDropped { .. } => &mut self.dropped,
+            _ => return,
+        };
+        *field = field.saturating_add(1);
+    }
+
+    fn merge(&mut self, other: &Counts) {
+        self.sent = self.sent.saturating_add(other.sent);
+        self.received = self.received.saturating_add(other.received);
+        self.dropped = self.dropped.saturating_add(other.dropped);
+    }
+}
+
+/// One resolution of the summary: the trace cut into buckets of `width`
+/// timesteps, with every series holding one entry per bucket.
+#[derive(Encode, Decode, Debug, Clone, PartialEq)]
+pub struct Level {
+    /// Timesteps per bucket, a power of two.
+    pub width: u64,
+    /// Messages of all nodes.
+    pub total: Vec<Counts>,
+    /// `nodes[node][bucket]`, by the node at which each event happened.
+    pub nodes: Vec<Vec<Counts>>,
+    /// `channels[channel][bucket]`.
+    pub channels: Vec<Vec<Counts>>,
+    /// Energy each node had left at the end of each bucket; `None` until its
+    /// first report.
+    pub energy_nj: Vec<Vec<Option<u64>>>,
+}
+
+impl Level {
+    fn new(width: u64, buckets: usize, nodes: usize, channels: usize) -> Self {
+        Self {
+            width,
+            total: vec![Counts::default(); buckets],
+            nodes: vec![vec![Counts::default(); buckets]; nodes],
+            channels: vec![vec![Counts::default(); buckets]; channels],
+            energy_nj: vec![vec![None; buckets]; nodes],
+        }
+    }
+
+    /// Number of buckets.
+    pub fn len(&self) -> usize {
+        self.total.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.total.is_empty()
+    }
+
+    /// Bucket holding timestep `ts`. Timesteps past the end fall in the last
+    /// bucket.
+    pub fn bucket_of(&self, ts: u64) -> usize {
+        ((ts / self.width) as usize).min(self.len().saturating_sub(1))
+    }
+
+    /// First timestep of `bucket`.
+    pub fn start_of(&self, bucket: usize) -> u64 {
+        bucket as u64 * self.width
+    }
+
+    /// The next level up, with buckets twice as wide.
+    fn coarsen(&self) -> Self {
+        fn merged(series: &[Counts]) -> Vec<Counts> {
+            series
+                .chunks(2)
+                .map(|pair| {
+                    let mut counts = pair[0];
+                    if let Some(next) = pair.get(1) {
+                        counts.merge(next);
+                    }
+                    counts
+                })
+                .collect()
+        }
+        Self {
+            width: self.width * 2,
+            total: merged(&self.total),
+            nodes: self.nodes.iter().map(|s| merged(s)).collect(),
+            channels: self.channels.iter().map(|s| merged(s)).collect(),
+            energy_nj: self
+                .energy_nj
+                .iter()
+                .map(|s| s.chunks(2).map(|pair| *pair.last().unwrap()).collect())
+                .collect(),
+        }
+    }
+}
+
+/// Width of the finest buckets: the narrowest power of two that keeps
+/// `timesteps` within `MAX_CELLS` across `series` series.
+fn finest_width(timesteps: u64, series: usize) -> u64 {
+    let buckets = (MAX_CELLS / series.max(1) as u64).max(1);
+    timesteps.div_ceil(buckets).max(1).next_power_of_two()
+}
+
+/// Accumulates a `TraceSummary` one record at a time, as the trace is
+/// written or read.
+#[derive(Debug, Clone)]
+pub struct SummaryBuilder {
+    records: u64,
+    receivers: Vec<Vec<u32>>,
+    cpu_samples: u64,
+    finest: Level,
+}
+
+impl SummaryBuilder {
+    pub fn new(header: &TraceHeader) -> Self {
+        let nodes = header.node_names.len();
+        let channels = header.channel_names.len();
+        let width = finest_width(header.timestep_count, nodes + channels);
+        let buckets = header.timestep_count.div_ceil(width).max(1) as usize;
+        Self {
+            records: 0,
+            receivers: vec![Vec::new(); channels],
+            cpu_samples: 0,
+            finest: Level::new(width, buckets, nodes, channels),
+        }
+    }
+
+    pub fn add(&mut self, record: &TraceRecord) {
+        self.records += 1;
+        let level = &mut self.finest;
+        let bucket = level.bucket_of(record.timestep);
+        let event = &record.event;
+        match event {
+            TraceEvent::MessageSent { .. }
+            | TraceEvent::MessageRecv { .. }
+            | TraceEvent::MessageDropped { .. } => {
+                level.total[bucket].record(event);
+                if let Some(series) = level.nodes.get_mut(event.node() as usize) {
+                    series[bucket].record(event);
+                }
+                if let Some(series) = event
+                    .channel()
+                    .and_then(|channel| level.channels.get_mut(channel as usize))
+                {
+                    series[bucket].record(event);
+                }
+                if let TraceEvent::MessageRecv {
+                    dst_node, channel, ..
+                } = event
+                    && let Some(receivers) = self.receivers.get_mut(*channel as usize)
+                    && !receivers.contains(dst_node)
+                {
+                    receivers.push(*dst_node);
+                }
+            }
+            TraceEvent::EnergyUpdate { node, energy_nj } => {
+                if let Some(series) = level.energy_nj.get_mut(*node as usize) {
+                    series[bucket] = Some(*energy_nj);
+                }
+            }
+            TraceEvent::CpuSample { count, .. } => self.cpu_samples += u64::from(*count),
+            TraceEvent::PositionUpdate { .. } | TraceEvent::MotionUpdate { .. } => {}
+        }
+    }
+
+    pub fn finish(mut self) -> TraceSummary {
+        for series in &mut self.finest.energy_nj {
+            let mut last = None;
+            for energy in series {
+                last = energy.or(last);
+                *energy = last;
+            }
+        }
+        for receivers in &mut self.receivers {
+            receivers.sort_unstable();
+        }
+        TraceSummary::new(Stored {
+            records: self.records,
+            receivers: self.receivers,
+            cpu_samples: self.cpu_samples,
+            finest: self.finest,
+        })
+    }
+}
+
+/// What a `.nxs.sum` file holds; the coarser levels are rebuilt on load.
+#[derive(Encode, Decode)]
+struct Stored {
+    records: u64,
+    receivers: Vec<Vec<u32>>,
+    cpu_samples: u64,
+    finest: Level,
+}
+
+/// Multi-resolution overview of a trace: message counts per node, per
+/// channel and in total, and energy per node, in buckets of power-of-two
+/// widths from the finest level up to a single bucket. Its size depends on
+/// the number of nodes and channels, not on the length of the trace, so
+/// views of a whole trace can be drawn from it without reading records.
+///
+/// The writer builds it alongside the block index and stores it next to
+/// the trace as `.nxs.sum`; `open` rebuilds it for traces without one.
+#[derive(Debug, Clone, PartialEq)]
+pub struct TraceSummary {
+    records: u64,
+    receivers: Vec<Vec<u32>>,
+    cpu_samples: u64,
+    /// Finest first.
+    levels: Vec<Level>,
+}
+
+impl TraceSummary {
+    fn new(stored: Stored) -> Self {
+        let mut levels = vec![stored.finest];
+        while let Some(last) = levels.last()
+            && last.len() > 1
+        {
+            levels.push(last.coarsen());
+        }
+        Self {
+            records: stored.records,
+            receivers: stored.receivers,
+            cpu_samples: stored.cpu_samples,
+            levels,
+        }
+    }
+
+    /// Where the summary of the trace at `trace_path` is stored.
+    pub fn path_for(trace_path: &Path) -> PathBuf {
+        trace_path.with_extension("nxs.sum")
+    }
+
+    /// The stored summary of the trace `reader` has open, or one built by
+    /// reading the whole trace if it has none or it is out of date. A
+    /// rebuilt summary is stored for next time where the trace's directory
+    /// allows.
+    pub fn open(trace_path: &Path, reader: &mut TraceReader) -> Result<Self, TraceReadError> {
+        let path = Self::path_for(trace_path);
+        let records = reader.record_count();
+        if let Some(records) = records
+            && let Ok(Some(summary)) = Self::load(&path)
+            && summary.records == records
+        {
+            return Ok(summary);
+        }
+        let summary = Self::build(reader)?;
+        if records.is_some() {
+            let _ = summary.save(&path);
+        }
+        Ok(summary)
+    }
+
+    /// Summarize every record `reader` returns from the start of the trace.
+    /// Leaves the reader rewound.
+    pub fn build(reader: &mut TraceReader) -> Result<Self, TraceReadError> {
+        let mut builder = SummaryBuilder::new(&reader.header);
+        reader.rewind()?;
+        while let Some(record) = reader.next_record()? {
+            builder.add(&record);
+        }
+        reader.rewind()?;
+        Ok(builder.finish())
+    }
+
+    /// Read a stored summary. Returns `None` for a file of another format.
+    pub fn load(path: &Path) -> Result<Option<Self>, TraceReadError> {
+        let data = std::fs::read(path)?;
+        let preamble = SUMMARY_MAGIC.len() + size_of::<u16>();
+        if data.get(..SUMMARY_MAGIC.len()) != Some(&SUMMARY_MAGIC[..])
+            || data
+                .get(SUMMARY_MAGIC.len()..preamble)
+                .map(|v| u16::from_le_bytes(v.try_into().unwrap()))
+                != Some(VERSION)
+        {
+            return Ok(None);
+        }
+        let (stored, _): (Stored, _) =
+            bincode::decode_from_slice(&data[preamble..], config::standard())?;
+        Ok(Some(Self::new(stored)))
+    }
+
+    pub fn save(&self, path: &Path) -> std::io::Result<()> {
+        let mut out = BufWriter::new(std::fs::File::create(path)?);
+        out.write_all(&SUMMARY_MAGIC)?;
+        out.write_all(&VERSION.to_le_bytes())?;
+        let stored = Stored {
+            records: self.records,
+            receivers: self.receivers.clone(),
+            cpu_samples: self.cpu_samples,
+            finest: self.levels[0].clone(),
+        };
+        bincode::encode_into_std_write(&stored, &mut out, config::standard())
+            .map_err(std::io::Error::other)?;
+        out.flush()
+    }
+
+    /// Number of records summarized.
+    pub fn records(&self) -> u64 {
+        self.records
+    }
+
+    /// Nodes that received on each channel, by channel index.
+    pub fn receivers(&self) -> &[Vec<u32>] {
+        &self.receivers
+    }
+
+    /// CPU samples the trace holds; zero unless simulated with `--profile`.
+    pub fn cpu_samples(&self) -> u64 {
+        self.cpu_samples
+    }
+
+    /// Every level, finest first.
+    pub fn levels(&self) -> &[Level] {
+        &self.levels
+    }
+
+    /// The finest level that splits `span` timesteps into at most
+    /// `max_buckets` buckets, or the coarsest if none does.
+    pub fn level_for(&self, span: u64, max_buckets: usize) -> &Level {
+        self.levels
+            .iter()
+            .find(|level| span.div_ceil(level.width) <= max_buckets as u64)
+            .unwrap_or_else(|| self.levels.last().unwrap())
+    }
+
+    /// Start of the finest bucket from which on, through the bucket holding
+    /// `to`, the trace has at least `messages` message events; 0 if it has
+    /// fewer in all.
+    pub fn window_start(&self, to: u64, messages: u64) -> u64 {
+        let finest = &self.levels[0];
+        let mut seen = 0;
+        for bucket in (0..=finest.bucket_of(to)).rev() {
+            seen += finest.total[bucket].total();
+            if seen >= messages {
+                return finest.start_of(bucket);
+            }
+        }
+        0
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::format::DropReason;
+
+    fn header(timesteps: u64) -> TraceHeader {
+        TraceHeader {
+            node_names: vec!["a".into(), "b".into()],
+            channel_names: vec!["ch".into()],
+            timestep_count: timesteps,
+            node_max_nj: vec![Some(100), None],
+        }
+    }
+
+    fn record(timestep: u64, event: TraceEvent) -> TraceRecord {
+        TraceRecord { timestep, event }
+    }
+
+    fn sent(node: u32) -> TraceEvent {
+        TraceEvent::MessageSent {
+            src_node: node,
+            channel: 0,
+            data: vec![],
+            msg_id: 0,
+        }
+    }
+
+    #[test]
+    fn finest_width_keeps_the_cell_budget() {
+        assert_eq!(finest_width(1000, 3), 1);
+        assert_eq!(finest_width(0, 0), 1);
+        let width = finest_width(10_000_000, 100);
+        assert!(width.is_power_of_two());
+        assert!(10_000_000u64.div_ceil(width) * 100 <= MAX_CELLS);
+        assert!(10_000_000u64.div_ceil(width / 2) * 100 > MAX_CELLS);
+    }
+
+    #[test]
+    fn levels_halve_up_to_one_bucket() {
+        let mut builder = SummaryBuilder::new(&header(5));
+        for ts in 0..5 {
+            builder.add(&record(ts, sent(0)));
+        }
+        builder.add(&record(
+            3,
+            TraceEvent::MessageRecv {
+                dst_node: 1,
+                channel: 0,
+                data: vec![],
+                bit_errors: false,
+                msg_id: 0,
+            },
+        ));
+        builder.add(&record(
+            4,
+            TraceEvent::MessageDropped {
+                src_node: 1,
+                channel: 0,
+                reason: DropReason::PacketLoss,
+                msg_id: 0,
+            },
+        ));
+        builder.add(&record(
+            1,
+            TraceEvent::EnergyUpdate {
+                node: 0,
+                energy_nj: 40,
+            },
+        ));
+        let summary = builder.finish();
+
+        let widths: Vec<_> = summary
+            .levels()
+            .iter()
+            .map(|l| (l.width, l.len()))
+            .collect();
+        assert_eq!(widths, vec![(1, 5), (2, 3), (4, 2), (8, 1)]);
+        let top = summary.levels().last().unwrap();
+        assert_eq!(top.total[0].total(), 7);
+        assert_eq!(top.nodes[1][0].drop_rate(), Some(0.5));
+        assert_eq!(top.channels[0][0].sent, 5);
+        assert_eq!(
+            summary.levels()[0].energy_nj[0],
+            vec![None, Some(40), Some(40), Some(40), Some(40)]
+        );
+        assert_eq!(top.energy_nj[0][0], Some(40));
+        assert_eq!(summary.receivers(), &[vec![1]]);
+        assert_eq!(summary.records(), 8);
+
+        assert_eq!(summary.level_for(5, 2).width, 4);
+        assert_eq!(summary.level_for(5, 100).width, 1);
+        assert_eq!(summary.level_for(5, 0).width, 8);
+        assert_eq!(summary.window_start(4, 3), 3);
+        assert_eq!(summary.window_start(4, 100), 0);
+    }
+}
@@ -1,28 +1,51 @@
 use std::fs::File;
 use std::io::{BufWriter, Write};
-use std::path::Path;
+use std::path::{Path, PathBuf};
 use std::time::Instant;
 
 use bincode::{config, encode_into_std_write};
+use flate2::Compression;
+use flate2::write::DeflateEncoder;
 
-use crate::format::{MAGIC, TraceHeader, TraceRecord, VERSION};
+use crate::format::{
+    BLOCK_COMPRESSED, BlockInfo, INDEX_MAGIC, MAGIC, TraceHeader, TraceRecord, VERSION,
+};
+use crate::summary::{SummaryBuilder, TraceSummary};
 
 /// How often to flush buffered data to disk.
-const FLUSH_INTERVAL: std::time::Duration = std::time::Duration::from_secs(1);
+pub(crate) const FLUSH_INTERVAL: std::time::Duration = std::time::Duration::from_secs(1);
+
+/// Encoded bytes a block collects before it is closed at the next timestep
+/// boundary. Big enough for deflate to pay off, small enough that seeking
+/// decodes little past the timestep it wants.
+const BLOCK_BYTES: usize = 64 * 1024;
 
 /// Writes trace records to a `.nxs` file with an accompanying `.nxs.idx` index.
 ///
 /// File format:
-///   [MAGIC 4B][VERSION 2B][header (bincode)][records...](bincode)
+///   [MAGIC 4B][VERSION 2B][header len 4B][header (bincode)][blocks...]
+///   block: [BlockInfo 48B][records (bincode), deflated unless stored raw]
 ///
 /// Index format (`.nxs.idx`):
-///   Vec of (timestep: u64, byte_offset: u64) pairs, one per timestep boundary.
+///   [INDEX_MAGIC 4B][VERSION 2B] then per block: [byte_offset 8B][BlockInfo 48B]
+///
+/// Blocks close at timestep boundaries once they are big enough or a flush
+/// is due, and on an explicit `flush`, so only the last block of a trace
+/// cut short can be lost.
+///
+/// The `.nxs.sum` summary (see `TraceSummary`) is accumulated as records are
+/// written and stored when the writer is dropped. A trace cut short has
+/// none; readers rebuild it.
 pub struct TraceWriter {
     writer: BufWriter<File>,
     idx_writer: BufWriter<File>,
-    last_indexed_ts: Option<u64>,
+    /// Encoded records of the open block.
+    block: Vec<u8>,
+    info: BlockInfo,
     byte_offset: u64,
     last_flush: Instant,
+    summary: Option<SummaryBuilder>,
+    summary_path: PathBuf,
 }
 
 impl TraceWriter {
@@ -30,11 +53,19 @@ impl TraceWriter {
         let path = path.as_ref();
         let mut writer = BufWriter::new(File::create(path)?);
         let idx_path = path.with_extension("nxs.idx");
-        let idx_writer = BufWriter::new(File::create(idx_path)?);
+        let mut idx_writer = BufWriter::new(File::create(idx_path)?);
+        // A summary left by an earlier run would describe another trace.
+        let summary_path = TraceSummary::path_for(path);
+        match std::fs::remove_file(&summary_path) {
+            Err(e) if e.kind() != std::io::ErrorKind::NotFound => return Err(e),
+            _ => {}
+        }
 
         // Write magic and version
         writer.write_all(&MAGIC)?;
         writer.write_all(&VERSION.to_le_bytes())?;
+        idx_writer.write_all(&INDEX_MAGIC)?;
+        idx_writer.write_all(&VERSION.to_le_bytes())?;
 
         // Write header
         let cfg = config::standard();
@@ -49,42 +80,81 @@ impl TraceWriter {
         Ok(Self {
             writer,
             idx_writer,
-            last_indexed_ts: None,
+            block: Vec::with_capacity(BLOCK_BYTES),
+            info: BlockInfo::default(),
             byte_offset,
             last_flush: Instant::now(),
+            summary: Some(SummaryBuilder::new(header)),
+            summary_path,
         })
     }
 
     pub fn write_record(&mut self, record: &TraceRecord) -> std::io::Result<()> {
-        // Write index entry at timestep boundaries
-        if self.last_indexed_ts.is_none_or(|ts| ts != record.timestep) {
+        // Close the block at timestep boundaries, so a timestep only spans
+        // blocks when flushed explicitly.
+        if self.info.records > 0 && record.timestep != self.info.last_ts {
             // Periodically flush so data survives premature exit.
-            // Only flush at timestep boundaries to keep the trace and index
-            // consistent with each other.
-            if self.last_indexed_ts.is_some() && self.last_flush.elapsed() >= FLUSH_INTERVAL {
+            if self.last_flush.elapsed() >= FLUSH_INTERVAL {
                 self.flush()?;
-                self.last_flush = Instant::now();
+            } else if self.block.len() >= BLOCK_BYTES {
+                self.finish_block()?;
             }
-            self.last_indexed_ts = Some(record.timestep);
-            self.idx_writer.write_all(&record.timestep.to_le_bytes())?;
-            self.idx_writer.write_all(&self.byte_offset.to_le_bytes())?;
         }
 
         let cfg = config::standard();
-        let n =
-            encode_into_std_write(record, &mut self.writer, cfg).map_err(std::io::Error::other)?;
-        self.byte_offset += n as u64;
+        encode_into_std_write(record, &mut self.block, cfg).map_err(std::io::Error::other)?;
+        self.info.add(record);
+        if let Some(summary) = &mut self.summary {
+            summary.add(record);
+        }
         Ok(())
     }
 
+    /// Close the open block and flush both files.
     pub fn flush(&mut self) -> std::io::Result<()> {
+        self.finish_block()?;
+        self.last_flush = Instant::now();
         self.writer.flush()?;
         self.idx_writer.flush()
     }
+
+    /// Write out the open block, compressed unless that would not save
+    /// anything, and index it.
+    fn finish_block(&mut self) -> std::io::Result<()> {
+        if self.info.records == 0 {
+            return Ok(());
+        }
+        let mut encoder = DeflateEncoder::new(Vec::new(), Compression::fast());
+        encoder.write_all(&self.block)?;
+        let compressed = encoder.finish()?;
+        let mut info = std::mem::take(&mut self.info);
+        let payload = if compressed.len() < self.block.len() {
+            info.flags |= BLOCK_COMPRESSED;
+            &compressed
+        } else {
+            &self.block
+        };
+        let too_big = |_| std::io::Error::other("trace block over 4 GiB");
+        info.raw_len = self.block.len().try_into().map_err(too_big)?;
+        info.stored_len = payload.len().try_into().map_err(too_big)?;
+
+        let info_bytes = info.to_bytes();
+        self.writer.write_all(&info_bytes)?;
+        self.writer.write_all(payload)?;
+        self.idx_writer.write_all(&self.byte_offset.to_le_bytes())?;
+        self.idx_writer.write_all(&info_bytes)?;
+        self.byte_offset += (info_bytes.len() + payload.len()) as u64;
+        self.block.clear();
+        Ok(())
+    }
 }
 
 impl Drop for TraceWriter {
     fn drop(&mut self) {
-        let _ = self.flush();
+        if self.flush().is_ok()
+            && let Some(summary) = self.summary.take()
+        {
+            let _ = summary.finish().save(&self.summary_path);
+        }
     }
 }
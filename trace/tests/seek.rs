@@ -0,0 +1,164 @@
+use std::io::Write;
+
+use trace::format::*;
+use trace::reader::{TraceFilter, TraceReader};
+use trace::writer::TraceWriter;
+
+fn header() -> TraceHeader {
+    TraceHeader {
+        node_names: (0..100).map(|i| format!("n{i}")).collect(),
+        channel_names: vec!["lora".into(), "wifi".into()],
+        timestep_count: 2_000,
+        node_max_nj: vec![None; 100],
+    }
+}
+
+/// Every node sends on every timestep, and every tenth timestep also
+/// reports its position, enough records for a few dozen blocks.
+fn records() -> Vec<TraceRecord> {
+    let mut records = Vec::new();
+    for timestep in 0..2_000u64 {
+        for node in 0..4u32 {
+            records.push(TraceRecord {
+                timestep,
+                event: TraceEvent::MessageSent {
+                    src_node: node * 25,
+                    channel: node % 2,
+                    data: vec![node as u8; 32],
+                    msg_id: timestep * 4 + u64::from(node),
+                },
+            });
+        }
+        if timestep % 10 == 0 {
+            records.push(TraceRecord {
+                timestep,
+                event: TraceEvent::PositionUpdate {
+                    node: 50,
+                    x: timestep as f64,
+                    y: 0.0,
+                    z: 0.0,
+                },
+            });
+        }
+    }
+    records
+}
+
+fn write(path: &std::path::Path, records: &[TraceRecord]) {
+    let mut writer = TraceWriter::create(path, &header()).unwrap();
+    for rec in records {
+        writer.write_record(rec).unwrap();
+    }
+}
+
+fn drain(reader: &mut TraceReader) -> Vec<TraceRecord> {
+    std::iter::from_fn(|| reader.next_record().unwrap()).collect()
+}
+
+#[test]
+fn seek_and_filter_match_a_full_scan() {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("run.nxs");
+    let records = records();
+    write(&path, &records);
+    let mut reader = TraceReader::open(&path).unwrap();
+    assert_eq!(drain(&mut reader), records);
+
+    assert!(reader.seek_to_timestep(1_234).unwrap());
+    let tail: Vec<_> = records
+        .iter()
+        .filter(|r| r.timestep >= 1_234)
+        .cloned()
+        .collect();
+    assert_eq!(drain(&mut reader), tail);
+    assert_eq!(reader.records_for_timestep(700).unwrap().len(), 5);
+    assert!(!reader.seek_to_timestep(5_000).unwrap());
+
+    let filter = TraceFilter {
+        nodes: Some(vec![25, 50]),
+        channels: Some(vec![1]),
+    };
+    reader.set_filter(filter.clone());
+    reader.rewind().unwrap();
+    let expected: Vec<_> = records
+        .iter()
+        .filter(|r| filter.matches(&r.event))
+        .cloned()
+        .collect();
+    assert!(!expected.is_empty());
+    assert_eq!(drain(&mut reader), expected);
+}
+
+#[test]
+fn blocks_missing_from_the_index_are_found_in_the_trace() {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("run.nxs");
+    let records = records();
+    write(&path, &records);
+
+    // Keep the index's preamble and first entry only, as if the run died
+    // before the rest reached disk.
+    let idx_path = path.with_extension("nxs.idx");
+    let idx = std::fs::read(&idx_path).unwrap();
+    std::fs::write(&idx_path, &idx[..6 + 8 + BlockInfo::SIZE]).unwrap();
+    assert_eq!(drain(&mut TraceReader::open(&path).unwrap()), records);
+
+    std::fs::remove_file(&idx_path).unwrap();
+    let mut reader = TraceReader::open(&path).unwrap();
+    reader.seek_to_timestep(1_999).unwrap();
+    assert_eq!(drain(&mut reader), records[records.len() - 4..]);
+}
+
+#[test]
+fn unblocked_traces_are_still_read() {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("old.nxs");
+    let records = records();
+    let cfg = bincode::config::standard();
+    let header_bytes = bincode::encode_to_vec(header(), cfg).unwrap();
+    let mut file = std::fs::File::create(&path).unwrap();
+    file.write_all(&MAGIC).unwrap();
+    file.write_all(&UNBLOCKED_VERSION.to_le_bytes()).unwrap();
+    file.write_all(&(header_bytes.len() as u32).to_le_bytes())
+        .unwrap();
+    file.write_all(&header_bytes).unwrap();
+    for rec in &records[..50] {
+        bincode::encode_into_std_write(rec, &mut file, cfg).unwrap();
+    }
+    // A record cut short by a crash ends the trace.
+    file.write_all(&[0, 1]).unwrap();
+    drop(file);
+
+    let mut reader = TraceReader::open(&path).unwrap();
+    assert_eq!(reader.header.node_names.len(), 100);
+    reader.seek_to_timestep(5).unwrap();
+    let expected: Vec<_> = records[..50]
+        .iter()
+        .filter(|r| r.timestep >= 5)
+        .cloned()
+        .collect();
+    assert_eq!(drain(&mut reader), expected);
+}
+
+#[test]
+fn blocks_read_by_index_cover_the_trace() {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("run.nxs");
+    let records = records();
+    write(&path, &records);
+    let reader = TraceReader::open(&path).unwrap();
+    assert!(reader.block_count() > 1);
+    assert_eq!(reader.record_count(), Some(records.len() as u64));
+
+    let blocks: Vec<_> = (0..reader.block_count())
+        .map(|i| reader.read_block(i).unwrap())
+        .collect();
+    assert_eq!(blocks.concat(), records);
+    for (i, block) in blocks.iter().enumerate() {
+        assert_eq!(reader.block_info(i).unwrap().records as usize, block.len());
+    }
+    let at = reader.block_at_timestep(1_234);
+    assert!(blocks[at].iter().any(|r| r.timestep == 1_234));
+    assert!(blocks[at - 1].iter().all(|r| r.timestep < 1_234));
+    assert_eq!(reader.block_at_timestep(5_000), reader.block_count());
+}
@@ -0,0 +1,115 @@
+use trace::format::*;
+use trace::reader::TraceReader;
+use trace::summary::TraceSummary;
+use trace::writer::TraceWriter;
+
+fn header() -> TraceHeader {
+    TraceHeader {
+        node_names: vec!["rx".into(), "tx".into()],
+        channel_names: vec!["lora".into()],
+        timestep_count: 1_000,
+        node_max_nj: vec![Some(1_000), None],
+    }
+}
+
+/// `tx` sends every timestep; `rx` receives all but every fifth message,
+/// and reports its energy every hundred timesteps.
+fn records() -> Vec<TraceRecord> {
+    let mut records = Vec::new();
+    for timestep in 0..1_000u64 {
+        records.push(TraceRecord {
+            timestep,
+            event: TraceEvent::MessageSent {
+                src_node: 1,
+                channel: 0,
+                data: vec![7; 16],
+                msg_id: timestep,
+            },
+        });
+        records.push(TraceRecord {
+            timestep,
+            event: if timestep % 5 == 0 {
+                TraceEvent::MessageDropped {
+                    src_node: 0,
+                    channel: 0,
+                    reason: DropReason::PacketLoss,
+                    msg_id: timestep,
+                }
+            } else {
+                TraceEvent::MessageRecv {
+                    dst_node: 0,
+                    channel: 0,
+                    data: vec![7; 16],
+                    bit_errors: false,
+                    msg_id: timestep,
+                }
+            },
+        });
+        if timestep % 100 == 0 {
+            records.push(TraceRecord {
+                timestep,
+                event: TraceEvent::EnergyUpdate {
+                    node: 0,
+                    energy_nj: 1_000 - timestep,
+                },
+            });
+        }
+    }
+    records
+}
+
+fn write(path: &std::path::Path) {
+    let mut writer = TraceWriter::create(path, &header()).unwrap();
+    for rec in records() {
+        writer.write_record(&rec).unwrap();
+    }
+}
+
+#[test]
+fn writer_stores_the_summary_a_full_read_builds() {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("run.nxs");
+    write(&path);
+    let sum_path = TraceSummary::path_for(&path);
+    let stored = TraceSummary::load(&sum_path).unwrap().unwrap();
+
+    let mut reader = TraceReader::open(&path).unwrap();
+    assert_eq!(TraceSummary::build(&mut reader).unwrap(), stored);
+    assert_eq!(TraceSummary::open(&path, &mut reader).unwrap(), stored);
+
+    let top = stored.levels().last().unwrap();
+    assert_eq!(top.len(), 1);
+    assert_eq!(top.nodes[1][0].sent, 1_000);
+    assert_eq!(top.nodes[0][0].drop_rate(), Some(0.2));
+    assert_eq!(top.energy_nj[0][0], Some(100));
+    assert_eq!(stored.receivers(), &[vec![0]]);
+    assert_eq!(stored.window_start(999, 20), 990);
+}
+
+#[test]
+fn stale_or_missing_summaries_are_rebuilt() {
+    let dir = tempfile::tempdir().unwrap();
+    let path = dir.path().join("run.nxs");
+    write(&path);
+    let sum_path = TraceSummary::path_for(&path);
+    let mut reader = TraceReader::open(&path).unwrap();
+    let fresh = TraceSummary::build(&mut reader).unwrap();
+
+    // A summary of some other trace stored under this name.
+    let mut other = TraceWriter::create(dir.path().join("other.nxs"), &header()).unwrap();
+    other.write_record(&records()[0]).unwrap();
+    drop(other);
+    std::fs::rename(dir.path().join("other.nxs.sum"), &sum_path).unwrap();
+    assert_eq!(TraceSummary::open(&path, &mut reader).unwrap(), fresh);
+    // ... and stored again in its place.
+    assert_eq!(TraceSummary::load(&sum_path).unwrap().unwrap(), fresh);
+
+    std::fs::remove_file(&sum_path).unwrap();
+    assert_eq!(TraceSummary::open(&path, &mut reader).unwrap(), fresh);
+    assert!(sum_path.exists());
+
+    // Rewriting the trace drops the old summary until the writer finishes.
+    let writer = TraceWriter::create(&path, &header()).unwrap();
+    assert!(!sum_path.exists());
+    drop(writer);
+}